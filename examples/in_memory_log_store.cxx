@@ -30,6 +30,7 @@ inmem_log_store::inmem_log_store()
     , disk_emul_thread_(nullptr)
     , disk_emul_thread_stop_signal_(false)
     , disk_emul_last_durable_index_(0)
+    , append_batch_enabled_(true)
 {
     // Dummy entry for index 0.
     ptr<buffer> buf = buffer::alloc(sz_ulong);
@@ -98,6 +99,35 @@ ulong inmem_log_store::append(ptr<log_entry>& entry) {
     return idx;
 }
 
+ulong inmem_log_store::append_batch(std::vector< ptr<log_entry> >& entries) {
+    if (!append_batch_enabled_) {
+        return log_store::append_batch(entries);
+    }
+
+    // Clone outside the lock, and then insert all at once.
+    std::vector< ptr<log_entry> > clones;
+    clones.reserve(entries.size());
+    for (ptr<log_entry>& entry: entries) {
+        clones.push_back( make_clone(entry) );
+    }
+
+    std::lock_guard<std::mutex> l(logs_lock_);
+    size_t first_idx = start_idx_ + logs_.size() - 1;
+    size_t idx = first_idx;
+    for (ptr<log_entry>& clone: clones) {
+        logs_.emplace_hint(logs_.end(), idx++, clone);
+    }
+
+    if (disk_emul_delay && !clones.empty()) {
+        // Logs are durable in order, the last one is enough.
+        uint64_t cur_time = timer_helper::get_timeofday_us();
+        disk_emul_logs_being_written_[cur_time + disk_emul_delay * 1000] = idx - 1;
+        disk_emul_ea_.invoke();
+    }
+
+    return first_idx;
+}
+
 void inmem_log_store::write_at(ulong index, ptr<log_entry>& entry) {
     ptr<log_entry> clone = make_clone(entry);
 
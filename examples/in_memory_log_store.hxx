@@ -46,6 +46,8 @@ public:
 
     ulong append(ptr<log_entry>& entry);
 
+    ulong append_batch(std::vector< ptr<log_entry> >& entries);
+
     void write_at(ulong index, ptr<log_entry>& entry);
 
     ptr<std::vector<ptr<log_entry>>> log_entries(ulong start, ulong end);
@@ -71,6 +73,8 @@ public:
 
     void set_disk_delay(raft_server* raft, size_t delay_ms);
 
+    void set_append_batch_enabled(bool to) { append_batch_enabled_ = to; }
+
 private:
     static ptr<log_entry> make_clone(const ptr<log_entry>& entry);
 
@@ -130,6 +134,12 @@ private:
      */
     std::atomic<uint64_t> disk_emul_last_durable_index_;
 
+    /**
+     * If `false`, `append_batch` will fall back to the default
+     * implementation calling `append` for each entry.
+     */
+    std::atomic<bool> append_batch_enabled_;
+
     // Testing purpose --------------- END
 };
 
@@ -25,6 +25,10 @@ limitations under the License.
 #include "delayed_task_scheduler.hxx"
 #include "delayed_task.hxx"
 #include "rpc_cli_factory.hxx"
+#include "rpc_listener.hxx"
+
+#include <functional>
+#include <string>
 
 namespace nuraft {
 
@@ -34,7 +38,6 @@ namespace nuraft {
  */
 class asio_service_impl;
 class logger;
-class rpc_listener;
 class asio_service
     : public delayed_task_scheduler
     , public rpc_client_factory {
@@ -60,6 +63,70 @@ public:
     ptr<rpc_listener> create_rpc_listener(ushort listening_port,
                                           ptr<logger>& l);
 
+    /**
+     * Create a client factory for the given Raft group, whose clients
+     * share a single connection per endpoint with the clients of
+     * other groups created by this function.
+     *
+     * Each request carries the group ID, so that the receiving
+     * `asio_service` can route it to the local member of the group
+     * registered by `register_mux_group`. Requests of the same group are
+     * delivered in order, and groups take turns to use the connection.
+     *
+     * @param group_id Group ID. Should be the same for all members of
+     *                 the group.
+     * @return Client factory.
+     */
+    ptr<rpc_client_factory> create_mux_client_factory(uint64_t group_id);
+
+    /**
+     * Register the local member of the given group, so that requests
+     * through multiplexed connections can be routed to it. Listeners
+     * created by this service will accept them, regardless of the handler
+     * given to `rpc_listener::listen`, which can be `nullptr` if the
+     * listener is used only for multiplexed connections.
+     *
+     * @param group_id Group ID.
+     * @param handler Raft server instance.
+     */
+    void register_mux_group(uint64_t group_id, ptr<msg_handler>& handler);
+
+    /**
+     * Deregister the given group. Requests to the group will be
+     * rejected afterwards.
+     *
+     * @param group_id Group ID.
+     */
+    void deregister_mux_group(uint64_t group_id);
+
+    /**
+     * Start a plain HTTP endpoint serving `GET /metrics` with the text
+     * returned by the given function (e.g., `stat_exporter::render`),
+     * so that the stats can be scraped by Prometheus. Only one endpoint
+     * can be started. Connections not sending a complete request within
+     * 5 seconds are closed.
+     *
+     * The function is invoked by Asio worker threads, which also handle
+     * Raft messages. `stat_exporter::render` acquires the lock of each
+     * server (through `raft_server::get_peer_info_all`), hence a slow
+     * function or a server holding its lock long delays other work of
+     * that worker.
+     *
+     * @param listening_port Port number.
+     * @param renderer Function returning OpenMetrics text.
+     * @param bind_address Local address to listen on. Loopback by default,
+     *                     use "0.0.0.0" to accept remote scrapers.
+     * @return `true` on success.
+     */
+    bool start_metrics_endpoint(ushort listening_port,
+                                const std::function<std::string()>& renderer,
+                                const std::string& bind_address = "127.0.0.1");
+
+    /**
+     * Stop the endpoint started by `start_metrics_endpoint`.
+     */
+    void stop_metrics_endpoint();
+
     void stop();
 
     uint32_t get_active_workers();
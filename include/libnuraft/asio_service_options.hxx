@@ -136,7 +136,9 @@ struct asio_service_options {
         , crc_on_payload_(false)
         , corrupted_msg_handler_(nullptr)
         , streaming_mode_(false)
+        , streaming_cumulative_ack_(false)
         , custom_io_context_(nullptr)
+        , timer_wheel_tick_ms_(0)
         {}
 
     /**
@@ -296,6 +298,17 @@ struct asio_service_options {
      */
     bool streaming_mode_;
 
+    /**
+     * If `true`, in streaming mode, followers can acknowledge multiple
+     * `append_entries` requests with a single response, when those
+     * requests have already arrived back to back. Only the highest log
+     * index is delivered to Raft, and the leader retires all covered
+     * requests at once.
+     * Followers not supporting it will respond to each request as usual.
+     * Not applicable to SSL or multiplexed connections.
+     */
+    bool streaming_cumulative_ack_;
+
     /**
      * If given, it will disable the internal thread pool but instead
      * rely on the external thread pool. The user is responsible for
@@ -306,6 +319,18 @@ struct asio_service_options {
 #else
     asio::io_context* custom_io_context_;
 #endif
+
+    /**
+     * If non-zero, `schedule` will use a hierarchical timer wheel
+     * (`timer_wheel_scheduler`) driven by a single Asio timer ticking
+     * at this interval in milliseconds, instead of allocating a separate
+     * Asio timer for each task. Expired tasks are posted to the Asio
+     * worker threads.
+     *
+     * It reduces the timer management overhead when many Raft servers
+     * share the same Asio service, at the cost of timer resolution.
+     */
+    size_t timer_wheel_tick_ms_;
 };
 
 }
@@ -0,0 +1,94 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "pp_util.hxx"
+
+#include <cstdint>
+#include <mutex>
+
+namespace nuraft {
+
+/**
+ * Per-peer controller of the batch size of `append_entries` requests,
+ * used when `raft_params::target_append_latency_us_` is set.
+ *
+ * Followers report how long it took to write the logs of each request,
+ * and the controller models the latency as a fixed cost per request
+ * plus a cost per byte, fitted by a linear regression over recent
+ * samples (older ones decay). The next batch is sized so that its
+ * latency meets the target:
+ *
+ *   - If the fixed cost alone exceeds the target (e.g., a slow disk
+ *     with expensive sync), the target cannot be met and the batch
+ *     is not limited, so that the follower receives fewer, larger
+ *     batches amortizing the cost.
+ *
+ *   - Otherwise, the batch is limited to what the follower can write
+ *     within the target, so that a fast follower receives smaller,
+ *     lower-latency batches.
+ *
+ * Thread-safe.
+ */
+class batch_size_controller {
+public:
+    batch_size_controller();
+
+    __nocopy__(batch_size_controller);
+
+public:
+    /**
+     * Add a latency sample reported by the follower.
+     *
+     * @param bytes Size of the logs written.
+     * @param latency_us Time taken to write them, in microseconds.
+     */
+    void on_append_latency(uint64_t bytes, uint64_t latency_us);
+
+    /**
+     * Get the size of the next batch.
+     *
+     * @param target_us Target latency per request, in microseconds.
+     * @return Batch size in bytes, 0 if not limited.
+     */
+    int64_t get_batch_size(uint64_t target_us) const;
+
+    /**
+     * Get the average latency of recent samples.
+     *
+     * @return Microseconds, 0 if no sample.
+     */
+    uint64_t get_avg_latency_us() const;
+
+    static const int64_t MIN_BATCH_SIZE = 4096;
+
+private:
+    /**
+     * Decayed sums of samples for the regression:
+     * count, bytes, latency, bytes^2, and bytes * latency.
+     */
+    double num_;
+    double sum_b_;
+    double sum_l_;
+    double sum_bb_;
+    double sum_bl_;
+
+    mutable std::mutex lock_;
+};
+
+}
+
@@ -0,0 +1,178 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "basic_types.hxx"
+#include "logger.hxx"
+#include "pp_util.hxx"
+#include "ptr.hxx"
+
+#include <atomic>
+#include <string>
+
+namespace nuraft {
+
+/**
+ * Logger that defers formatting of the logs of NuRaft.
+ *
+ * Instead of formatting the message on the calling thread, each log
+ * site records its static location and raw arguments into a lock-free
+ * ring buffer of the calling thread. A background thread, shared by all
+ * `binary_logger` instances, periodically formats the recorded logs,
+ * sorted by timestamp in each round, and passes them to the given sink
+ * logger through `logger::put_deferred_details`, so that debug level
+ * logging costs little on the critical path.
+ *
+ * Logs whose level is more severe than `options::deferred_level_`
+ * are formatted on the calling thread, and the background thread is
+ * woken up to pass them to the sink right after all logs recorded
+ * before them.
+ *
+ * If a ring buffer is full, new logs are dropped and counted,
+ * so that the calling thread never formats or flushes logs by itself.
+ */
+class binary_logger : public logger {
+public:
+    struct options {
+        options()
+            : flush_interval_ms_(100)
+            , deferred_level_(4)
+            {}
+
+        /**
+         * Interval of the background thread formatting the recorded logs.
+         * As the thread is shared, the shortest interval among the live
+         * instances is used. It also wakes up early if a ring buffer
+         * becomes half full, or a log is not deferred.
+         */
+        int32 flush_interval_ms_;
+
+        /**
+         * Logs whose level is equal to or greater than this
+         * (i.e., less severe) are deferred. By default, info,
+         * debug, and trace level logs.
+         */
+        int deferred_level_;
+    };
+
+    /**
+     * @param sink Logger that will receive formatted logs.
+     *             Its log level will be used as the initial level.
+     * @param opt Options.
+     */
+    binary_logger(ptr<logger> sink, const options& opt = options());
+
+    ~binary_logger();
+
+    __nocopy__(binary_logger);
+
+public:
+    /**
+     * Set the log level of both this logger and the sink.
+     *
+     * @param l New log level.
+     */
+    void set_level(int l);
+
+    /**
+     * Get the log level, without calling the sink.
+     *
+     * @return Current log level.
+     */
+    int get_level() { return level_.load(std::memory_order_relaxed); }
+
+    /**
+     * Put an already formatted log. It is passed to the sink by the
+     * background thread, right after all logs recorded before it.
+     * After `shutdown`, it is passed to the sink directly.
+     */
+    void put_details(int level,
+                     const char* source_file,
+                     const char* func_name,
+                     size_t line_number,
+                     const std::string& log_line);
+
+    /**
+     * Format all logs recorded so far, and pass them to their sinks.
+     * Can be called by the application, e.g., before a planned exit.
+     */
+    void flush();
+
+    /**
+     * Flush all recorded logs, and stop deferring logs. Logs put after
+     * this are passed to the sink directly. The background thread stops
+     * once no instance is running.
+     */
+    void shutdown();
+
+    /**
+     * Get the number of logs dropped so far, as ring buffers were full.
+     * It is also reported to the sink as a warning.
+     *
+     * @return Number of dropped logs.
+     */
+    uint64_t get_num_dropped() const { return num_dropped_.load(); }
+
+    /**
+     * Level threshold of deferred logs, see `options::deferred_level_`.
+     */
+    int get_deferred_level() const { return opt_.deferred_level_; }
+
+    /**
+     * (Internal)
+     * Called by log sites when the ring buffer is full. The log is
+     * dropped, and the background thread is woken up.
+     */
+    void on_ring_full();
+
+    /**
+     * (Internal)
+     * Called by log sites when the ring buffer becomes half full,
+     * to wake up the background thread early.
+     */
+    void request_flush();
+
+private:
+    friend class binary_log_mgr;
+
+    void put_recorded(int level,
+                      const char* source_file,
+                      const char* func_name,
+                      size_t line_number,
+                      uint64_t timestamp_us,
+                      uint64_t thread_id,
+                      const std::string& log_line);
+
+    options opt_;
+
+    ptr<logger> sink_;
+
+    std::atomic<int> level_;
+
+    std::atomic<uint64_t> num_dropped_;
+
+    /**
+     * Number of dropped logs reported so far.
+     * Protected by the global flush lock.
+     */
+    uint64_t num_dropped_reported_;
+
+    std::atomic<bool> stopping_;
+};
+
+}
+
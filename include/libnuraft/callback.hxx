@@ -229,6 +229,16 @@ public:
          * ctx: pointer to `ReqResp` instance.
          */
         ReceivedMisbehavingMessage = 29,
+
+        /**
+         * A sampled request has been finished, and its stage timestamps
+         * are reported. See `raft_params::trace_sample_interval_`.
+         * Invoked on both the leader and followers, in the commit thread
+         * or the thread returning the result, so it should return quickly.
+         *
+         * ctx: pointer to `request_trace` instance.
+         */
+        RequestTraced = 30,
     };
 
     struct Param {
@@ -32,6 +32,8 @@ limitations under the License.
 namespace nuraft {
 
 class delayed_task_scheduler;
+class failure_detector;
+class heartbeat_batcher;
 class logger;
 class rpc_client_factory;
 class rpc_listener;
@@ -56,6 +58,9 @@ public:
         , scheduler_(scheduler)
         , params_(cs_new<raft_params>(params))
         , custom_global_mgr_(custom_global_mgr)
+        , hb_batcher_(nullptr)
+        , group_id_(0)
+        , failure_detector_(nullptr)
     {}
 
     /**
@@ -91,6 +96,35 @@ public:
         params_ = to;
     }
 
+    /**
+     * Set the heartbeat batcher shared by Raft groups in this process.
+     * Should be called before creating `raft_server`.
+     *
+     * @param batcher Heartbeat batcher.
+     * @param group_id ID of the Raft group that this server belongs to.
+     *                 Should be the same across all members of the group,
+     *                 and unique in the process.
+     */
+    void set_hb_batcher(ptr<heartbeat_batcher> batcher, uint64_t group_id) {
+        hb_batcher_ = batcher;
+        group_id_ = group_id;
+    }
+
+    /**
+     * Set the failure detector shared by Raft groups in this process.
+     * Should be called before creating `raft_server`.
+     *
+     * @param detector Failure detector.
+     * @param group_id ID of the Raft group that this server belongs to,
+     *                 same as the one given to `set_hb_batcher`.
+     *                 Should be the same across all members of the group,
+     *                 and unique in the process.
+     */
+    void set_failure_detector(ptr<failure_detector> detector, uint64_t group_id) {
+        failure_detector_ = detector;
+        group_id_ = group_id;
+    }
+
     __nocopy__(context);
 
 public:
@@ -141,6 +175,24 @@ public:
      */
     global_mgr* custom_global_mgr_;
 
+    /**
+     * If given, heartbeats of this server will be coalesced with
+     * those of other groups, see `heartbeat_batcher`.
+     */
+    ptr<heartbeat_batcher> hb_batcher_;
+
+    /**
+     * Group ID used for `hb_batcher_` and `failure_detector_`.
+     */
+    uint64_t group_id_;
+
+    /**
+     * If given, followers of a quiescent group will watch the leader
+     * through this detector, instead of running election timers.
+     * See `raft_params::quiesce_after_ms_`.
+     */
+    ptr<failure_detector> failure_detector_;
+
     /**
      * Lock.
      */
@@ -0,0 +1,302 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "basic_types.hxx"
+#include "pp_util.hxx"
+#include "ptr.hxx"
+#include "rpc_cli.hxx"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace nuraft {
+
+class delayed_task;
+class delayed_task_scheduler;
+class raft_server;
+class rpc_client_factory;
+
+/**
+ * Failure detector shared by Raft groups in the same process.
+ *
+ * Quiescent followers do not receive heartbeats, hence they cannot
+ * notice the failure of the leader by themselves. Instead, they watch
+ * the leader through this detector, which periodically sends a single
+ * `liveness_check_request` per node regardless of the number of groups.
+ * The request lists the watched members, and the detector of the other
+ * node answers for each of them, whether it is still running (and still
+ * the leader of the given term). Once a member is gone, or its node does
+ * not respond for the given number of checks in a row, its watchers are
+ * notified.
+ *
+ * Each `raft_server` given this detector through `context` registers
+ * itself, so that the detector can answer the checks from other nodes.
+ */
+class failure_detector
+    : public std::enable_shared_from_this<failure_detector>
+{
+public:
+    /**
+     * Function that returns the key of the node that the given server
+     * is running on. Watchers with the same key share the checks.
+     */
+    using dest_key_func =
+        std::function< std::string(int32 srv_id, const std::string& endpoint) >;
+
+    /**
+     * Callback function invoked when the watched node is declared dead.
+     */
+    using failure_callback = std::function< void() >;
+
+    /**
+     * Status of a watched member, reported by the detector of its node.
+     */
+    enum member_status : uint8_t {
+        /**
+         * The member does not exist on the node, or it is not
+         * the leader of the given term anymore.
+         */
+        GONE = 0x0,
+
+        /**
+         * The member is running (and is the leader of the given term).
+         */
+        ALIVE = 0x1,
+
+        /**
+         * The member could not tell, as it is busy (i.e., its lock is
+         * held by someone else). Counted as a failed check.
+         */
+        BUSY = 0x2,
+    };
+
+    struct options {
+        options()
+            : check_interval_ms_(500)
+            , max_failures_(3)
+            , dest_key_func_(nullptr)
+            {}
+
+        /**
+         * Interval of liveness checks.
+         * If 0, the caller is responsible for calling `check_now()`.
+         */
+        int32 check_interval_ms_;
+
+        /**
+         * Number of consecutive failed checks to declare a member dead.
+         */
+        int32 max_failures_;
+
+        /**
+         * Custom destination key function. If not given, the endpoint
+         * (i.e., `host:port`) will be used, as processes on the same
+         * host are told apart by port.
+         */
+        dest_key_func dest_key_func_;
+    };
+
+    failure_detector(const ptr<rpc_client_factory>& factory,
+                     const ptr<delayed_task_scheduler>& scheduler,
+                     const options& opt = options());
+
+    ~failure_detector();
+
+    __nocopy__(failure_detector);
+
+public:
+    /**
+     * Start watching the given member of a Raft group.
+     *
+     * @param group_id Group ID of the member.
+     * @param srv_id ID of the server to watch.
+     * @param endpoint Endpoint of the server.
+     * @param leader_term If non-zero, the member is considered gone
+     *                    once it is not the leader of this term.
+     * @param on_failure Callback function invoked (only once) when the
+     *                   member is declared dead. It may race with
+     *                   `unwatch`, thus it should tolerate being invoked
+     *                   right after `unwatch`.
+     * @return Watch ID, or 0 if the detector is stopped.
+     */
+    uint64_t watch(uint64_t group_id,
+                   int32 srv_id,
+                   const std::string& endpoint,
+                   ulong leader_term,
+                   const failure_callback& on_failure);
+
+    /**
+     * Stop watching.
+     *
+     * @param watch_id Watch ID returned by `watch`.
+     */
+    void unwatch(uint64_t watch_id);
+
+    /**
+     * Register the local member of the given group, so that the checks
+     * from other nodes can be answered.
+     *
+     * @param group_id Group ID.
+     * @param srv Raft server instance.
+     */
+    void register_group(uint64_t group_id, raft_server* srv);
+
+    /**
+     * Deregister the given member. Its watchers on other nodes will be
+     * notified by their next check. Will wait for the completion of
+     * the ongoing check, if any.
+     *
+     * @param group_id Group ID.
+     * @param srv Raft server instance.
+     */
+    void deregister_group(uint64_t group_id, raft_server* srv);
+
+    /**
+     * Process an incoming `liveness_check_request`.
+     *
+     * @param req Liveness check request.
+     * @return Liveness check response.
+     */
+    ptr<resp_msg> handle_check(req_msg& req);
+
+    /**
+     * Send liveness checks to all watched nodes immediately.
+     */
+    void check_now();
+
+    /**
+     * Stop the detector. No more callback will be invoked.
+     */
+    void shutdown();
+
+    /**
+     * Get the number of nodes being watched.
+     *
+     * @return Number of nodes.
+     */
+    size_t get_num_watched_nodes() const;
+
+    /**
+     * Get the number of liveness checks sent so far.
+     *
+     * @return Number of checks.
+     */
+    uint64_t get_num_checks_sent() const { return num_checks_sent_; }
+
+private:
+    struct watcher {
+        watcher(uint64_t group_id,
+                int32 srv_id,
+                ulong leader_term,
+                const failure_callback& on_failure)
+            : group_id_(group_id)
+            , srv_id_(srv_id)
+            , leader_term_(leader_term)
+            , on_failure_(on_failure)
+            , num_failures_(0)
+            {}
+        uint64_t group_id_;
+        int32 srv_id_;
+        ulong leader_term_;
+        failure_callback on_failure_;
+        int32 num_failures_;
+    };
+
+    struct node {
+        node(int32 srv_id, const std::string& endpoint)
+            : srv_id_(srv_id)
+            , endpoint_(endpoint)
+            , in_flight_(false)
+            {}
+        int32 srv_id_;
+        std::string endpoint_;
+        ptr<rpc_client> client_;
+        std::map<uint64_t, watcher> watchers_;
+        bool in_flight_;
+    };
+
+    std::string get_dest_key(int32 srv_id, const std::string& endpoint) const;
+
+    void schedule_check();
+
+    void send_check(const std::string& key, ptr<node>& nn);
+
+    void handle_check_resp(const std::string& key,
+                           ptr<node> nn,
+                           ptr<rpc_client> client,
+                           std::vector<uint64_t> watch_ids,
+                           ptr<resp_msg>& resp,
+                           ptr<rpc_exception>& err);
+
+    static member_status get_member_status(raft_server* srv, ulong leader_term);
+
+    options opt_;
+
+    ptr<rpc_client_factory> factory_;
+
+    ptr<delayed_task_scheduler> scheduler_;
+
+    /**
+     * Periodic task sending liveness checks, running while
+     * there is any node to watch.
+     */
+    ptr<delayed_task> check_task_;
+
+    std::atomic<bool> check_scheduled_;
+
+    /**
+     * Watched nodes, <destination key, node>.
+     */
+    std::map< std::string, ptr<node> > nodes_;
+
+    /**
+     * <watch ID, destination key>.
+     */
+    std::unordered_map< uint64_t, std::string > watch_keys_;
+
+    /**
+     * Lock for `nodes_` and `watch_keys_`.
+     */
+    mutable std::mutex lock_;
+
+    /**
+     * Local members, <<group ID, server ID>, server>.
+     */
+    std::map< std::pair<uint64_t, int32>, raft_server* > members_;
+
+    /**
+     * Lock for `members_`. Held while answering a check, which never
+     * blocks on the lock of a member.
+     */
+    std::mutex members_lock_;
+
+    uint64_t next_watch_id_;
+
+    std::atomic<bool> stopped_;
+
+    std::atomic<uint64_t> num_checks_sent_;
+};
+
+}
+
@@ -25,10 +25,8 @@ limitations under the License.
 #include "ptr.hxx"
 
 #include <atomic>
-#include <list>
 #include <mutex>
 #include <thread>
-#include <unordered_set>
 #include <vector>
 
 namespace nuraft {
@@ -191,6 +189,22 @@ private:
      */
     void init_thread_pool();
 
+    /**
+     * Push the given server to the queue of a worker in the given pool,
+     * and wake up workers.
+     */
+    void push_to_pool(std::vector< ptr<worker_handle> >& pool,
+                      std::atomic<size_t>& next_worker,
+                      ptr<raft_server>& server);
+
+    /**
+     * Pop a server from the queue of the given worker. If the queue is
+     * empty, steal one from other workers in the same pool.
+     */
+    ptr<raft_server> pop_from_pool(std::vector< ptr<worker_handle> >& pool,
+                                   worker_handle& handle,
+                                   size_t& queue_length_out);
+
     /**
      * Loop for commit worker threads.
      */
@@ -232,38 +246,16 @@ private:
     std::vector< ptr<worker_handle> > append_workers_;
 
     /**
-     * Commit requests.
-     * Duplicate requests from the same `raft_server` will not be allowed.
-     */
-    std::list< ptr<raft_server> > commit_queue_;
-
-    /**
-     * A set for efficient duplicate checking of `raft_server`.
-     * It will contain all `raft_server`s currently in `commit_queue_`.
-     */
-    std::unordered_set< ptr<raft_server> > commit_server_set_;
-
-    /**
-     * Lock for `commit_queue_` and `commit_server_set_`.
-     */
-    std::mutex commit_queue_lock_;
-
-    /**
-     * Append (replication) requests.
-     * Duplicate requests from the same `raft_server` will not be allowed.
-     */
-    std::list< ptr<raft_server> > append_queue_;
-
-    /**
-     * A set for efficient duplicate checking of `raft_server`.
-     * It will contain all `raft_server`s currently in `append_queue_`.
+     * Round-robin counter choosing the commit worker to queue
+     * a request from non-worker threads.
      */
-    std::unordered_set< ptr<raft_server> > append_server_set_;
+    std::atomic<size_t> next_commit_worker_;
 
     /**
-     * Lock for `append_queue_` and `append_server_set_`.
+     * Round-robin counter choosing the append worker to queue
+     * a request from non-worker threads.
      */
-    std::mutex append_queue_lock_;
+    std::atomic<size_t> next_append_worker_;
 };
 
 } // namespace nuraft;
@@ -0,0 +1,275 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "delayed_task.hxx"
+#include "pp_util.hxx"
+#include "ptr.hxx"
+#include "raft_server_handler.hxx"
+#include "rpc_cli.hxx"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nuraft {
+
+class delayed_task_scheduler;
+class rpc_client_factory;
+
+/**
+ * Coalesces heartbeats of multiple Raft groups in the same process.
+ *
+ * Empty `append_entries` requests sent by heartbeat timers are queued
+ * per destination node for a short window, and then sent as a single
+ * `heartbeat_batch_request`. The receiving `raft_server` hands the
+ * batch over to its own batcher, which dispatches each heartbeat to the
+ * local member of the corresponding group, and returns all responses
+ * in a single `heartbeat_batch_response`.
+ *
+ * Each heartbeat is still processed by `handle_append_entries`, thus
+ * the Raft semantics are the same as those of individual heartbeats.
+ * A member busy with another request does not get the heartbeat,
+ * same as when it is lost, so that it does not delay the others.
+ *
+ * All members of the same group should use the same group ID, and
+ * every node sending or receiving batches should enable it.
+ */
+class heartbeat_batcher
+    : public raft_server_handler
+    , public std::enable_shared_from_this<heartbeat_batcher>
+{
+public:
+    /**
+     * Function that returns the key of the node that the given server
+     * is running on. Heartbeats with the same key are coalesced.
+     */
+    using dest_key_func =
+        std::function< std::string(int32 srv_id, const std::string& endpoint) >;
+
+    struct options {
+        options()
+            : flush_interval_ms_(5)
+            , max_batch_size_(1024)
+            , dest_key_func_(nullptr)
+            {}
+
+        /**
+         * Time window to wait for other heartbeats before sending a batch.
+         * If 0, the caller is responsible for calling `flush()`.
+         */
+        int32 flush_interval_ms_;
+
+        /**
+         * Max number of heartbeats in a batch. Once a batch reaches this
+         * size, it will be sent immediately.
+         */
+        size_t max_batch_size_;
+
+        /**
+         * Custom destination key function. If not given, the endpoint
+         * (i.e., `host:port`) will be used, as processes on the same
+         * host are told apart by port.
+         */
+        dest_key_func dest_key_func_;
+    };
+
+    heartbeat_batcher(const ptr<rpc_client_factory>& factory,
+                      const ptr<delayed_task_scheduler>& scheduler,
+                      const options& opt = options());
+
+    ~heartbeat_batcher();
+
+    __nocopy__(heartbeat_batcher);
+
+public:
+    /**
+     * Register the local member of the given group, so that heartbeats
+     * in incoming batches can be dispatched to it.
+     *
+     * @param group_id Group ID.
+     * @param srv Raft server instance.
+     */
+    void register_group(uint64_t group_id, raft_server* srv);
+
+    /**
+     * Deregister the given group.
+     * Will wait for the completion of the ongoing dispatch, if any.
+     *
+     * @param group_id Group ID.
+     * @param srv Raft server instance. Does nothing if the group has
+     *            been registered by another instance.
+     */
+    void deregister_group(uint64_t group_id, raft_server* srv);
+
+    /**
+     * Queue a heartbeat to be sent in the next batch.
+     *
+     * @param group_id Group ID of the sender.
+     * @param endpoint Endpoint of the destination server.
+     * @param req Heartbeat request. Should not contain any log.
+     * @param when_done Handler to be invoked with the individual
+     *                  response of this heartbeat.
+     */
+    void enqueue(uint64_t group_id,
+                 const std::string& endpoint,
+                 ptr<req_msg>& req,
+                 rpc_handler& when_done);
+
+    /**
+     * Send all queued heartbeats immediately.
+     */
+    void flush();
+
+    /**
+     * Process an incoming `heartbeat_batch_request`.
+     *
+     * @param req Batch request.
+     * @return Batch response.
+     */
+    ptr<resp_msg> handle_batch(req_msg& req);
+
+    /**
+     * Stop the batcher. All queued heartbeats will fail.
+     */
+    void shutdown();
+
+    /**
+     * Get the number of batches sent so far.
+     *
+     * @return Number of batches.
+     */
+    uint64_t get_num_batches_sent() const { return num_batches_sent_; }
+
+    /**
+     * Get the number of heartbeats sent so far, in all batches.
+     *
+     * @return Number of heartbeats.
+     */
+    uint64_t get_num_hbs_sent() const { return num_hbs_sent_; }
+
+private:
+    struct hb_elem {
+        hb_elem(uint64_t group_id, ptr<req_msg>& req, rpc_handler& when_done)
+            : group_id_(group_id), req_(req), when_done_(when_done)
+            {}
+        uint64_t group_id_;
+        ptr<req_msg> req_;
+        rpc_handler when_done_;
+    };
+
+    struct batch {
+        std::string endpoint_;
+        std::vector<hb_elem> elems_;
+    };
+
+    struct group_elem {
+        group_elem(raft_server* srv) : srv_(srv), num_dispatching_(0) {}
+        raft_server* srv_;
+
+        /**
+         * Number of heartbeats being dispatched to `srv_`,
+         * protected by `groups_lock_`.
+         */
+        size_t num_dispatching_;
+    };
+
+    std::string get_dest_key(int32 srv_id, const std::string& endpoint) const;
+
+    void send_batch(const std::string& key, ptr<batch>& bb);
+
+    void handle_batch_resp(const std::string& key,
+                           ptr<rpc_client> client,
+                           ptr<batch> bb,
+                           ptr<resp_msg>& resp,
+                           ptr<rpc_exception>& err);
+
+    /**
+     * Parse the response of a batch with `num_elems` heartbeats.
+     *
+     * @param buf Context of the batch response.
+     * @param num_elems Number of heartbeats in the batch.
+     * @param[out] sub_resps Individual responses, `nullptr` if
+     *                       the destination did not respond.
+     * @return `false` if the response is corrupted or of an unknown version.
+     */
+    static bool parse_batch_resp(buffer& buf,
+                                 size_t num_elems,
+                                 std::vector< ptr<resp_msg> >& sub_resps);
+
+    static void fail_batch(batch& bb, const std::string& err_msg);
+
+    options opt_;
+
+    ptr<rpc_client_factory> factory_;
+
+    ptr<delayed_task_scheduler> scheduler_;
+
+    /**
+     * Task to flush queued heartbeats, scheduled on the first `enqueue`.
+     */
+    ptr<delayed_task> flush_task_;
+
+    std::atomic<bool> flush_scheduled_;
+
+    /**
+     * Queued heartbeats, <destination key, batch>.
+     */
+    std::map< std::string, ptr<batch> > pending_;
+
+    /**
+     * Shared RPC clients, <destination key, client>.
+     */
+    std::map< std::string, ptr<rpc_client> > clients_;
+
+    /**
+     * Lock for `pending_` and `clients_`.
+     */
+    std::mutex lock_;
+
+    /**
+     * Local members, <group ID, server>.
+     */
+    std::unordered_map< uint64_t, ptr<group_elem> > groups_;
+
+    /**
+     * Lock for `groups_`. Not held while dispatching heartbeats,
+     * so that a slow member does not block the others.
+     */
+    std::mutex groups_lock_;
+
+    /**
+     * Notified when a dispatch is done, to wake up `deregister_group`.
+     */
+    std::condition_variable dispatch_done_cv_;
+
+    std::atomic<bool> stopped_;
+
+    std::atomic<uint64_t> num_batches_sent_;
+
+    std::atomic<uint64_t> num_hbs_sent_;
+};
+
+}
+
@@ -0,0 +1,294 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "pp_util.hxx"
+#include "ptr.hxx"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace nuraft {
+
+class stat_elem;
+class stat_mgr;
+
+/**
+ * Static location where a lock is acquired.
+ */
+struct lock_site {
+    const char* file_;
+    const char* func_;
+    size_t line_;
+};
+
+/**
+ * Contention of a lock at a call site, see
+ * `raft_server::get_lock_contentions`.
+ */
+struct lock_contention {
+    lock_contention()
+        : line_(0)
+        , num_contentions_(0)
+        , total_wait_us_(0)
+        , max_wait_us_(0)
+        {}
+
+    /**
+     * Name of the lock, e.g., `raft_lock` or `peer_lock`.
+     */
+    std::string lock_name_;
+
+    /**
+     * Call site that waited for the lock.
+     */
+    std::string file_;
+    std::string func_;
+    size_t line_;
+
+    /**
+     * Number of times the lock was already held by others.
+     */
+    uint64_t num_contentions_;
+
+    /**
+     * Total and maximum time spent on waiting, in microseconds.
+     */
+    uint64_t total_wait_us_;
+    uint64_t max_wait_us_;
+};
+
+/**
+ * Wait time and hold time of a lock, recorded by `basic_profiled_mutex`.
+ *
+ * Given the stats of a Raft server, `<name>_acquisitions` and
+ * `<name>_contentions` counters, and `<name>_wait_us` (contended ones
+ * only) and `<name>_hold_us` (sampled) histograms are added to them.
+ * Each contended call site gets its own stat scope, with `lock` and
+ * `site` labels added, having `lock_site_contentions` and
+ * `lock_site_wait_us` counters.
+ */
+class lock_profile {
+public:
+    lock_profile(const std::string& name, ptr<stat_mgr> stats);
+
+    ~lock_profile();
+
+    __nocopy__(lock_profile);
+
+public:
+    /**
+     * Monotonic clock in microseconds.
+     */
+    static uint64_t now_us();
+
+    const std::string& get_name() const { return name_; }
+
+    /**
+     * Called after the lock is acquired.
+     *
+     * @param site Call site, `nullptr` if unknown.
+     * @param contended `true` if the lock was held by others.
+     * @param wait_us Time spent on waiting.
+     */
+    void on_acquired(const lock_site* site, bool contended, uint64_t wait_us);
+
+    /**
+     * Called before the lock is released, if its hold time is sampled.
+     *
+     * @param hold_us Time the lock was held.
+     */
+    void on_released(uint64_t hold_us);
+
+    /**
+     * Append the contended call sites so far to the given list.
+     *
+     * @param[out] contentions_out List of contentions.
+     */
+    void get_contentions(std::vector<lock_contention>& contentions_out) const;
+
+private:
+    struct site_entry {
+        site_entry()
+            : num_contentions_(0)
+            , total_wait_us_(0)
+            , max_wait_us_(0)
+            , num_contentions_stat_(nullptr)
+            , wait_us_stat_(nullptr)
+            {}
+        uint64_t num_contentions_;
+        uint64_t total_wait_us_;
+        uint64_t max_wait_us_;
+        ptr<stat_mgr> stats_;
+        stat_elem* num_contentions_stat_;
+        stat_elem* wait_us_stat_;
+    };
+
+    std::string name_;
+
+    ptr<stat_mgr> stats_;
+
+    stat_elem* num_acquisitions_stat_;
+
+    stat_elem* num_contentions_stat_;
+
+    stat_elem* wait_us_stat_;
+
+    stat_elem* hold_us_stat_;
+
+    /**
+     * Contended call sites. Only accessed on contention,
+     * which is already the slow path.
+     */
+    mutable std::mutex sites_lock_;
+    std::unordered_map<const lock_site*, site_entry> sites_;
+};
+
+/**
+ * Wrapper of `std::mutex` or `std::recursive_mutex`, that records its
+ * wait time, hold time, and contended call sites to a `lock_profile`
+ * once it is given by `set_profile`. Otherwise, it only adds a relaxed
+ * atomic load to each `lock` call.
+ *
+ * To keep the overhead low, the clock is read only on contention, and
+ * for the hold time of every `HOLD_SAMPLE_INTERVAL`-th acquisition.
+ *
+ * Use `profiled_lock` or `profiled_guard` below to record the call site;
+ * `lock` called by standard lock guards records no site.
+ */
+template<typename M>
+class basic_profiled_mutex {
+public:
+    static const uint64_t HOLD_SAMPLE_INTERVAL = 16;
+
+    basic_profiled_mutex()
+        : profile_(nullptr)
+        , cur_profile_(nullptr)
+        , acquired_us_(0)
+        , num_acquired_(0)
+        , depth_(0)
+        {}
+
+    __nocopy__(basic_profiled_mutex);
+
+public:
+    /**
+     * Start or stop profiling. Once given, the profile is kept until
+     * this mutex is destroyed, thus the same profile should be given
+     * when restarting.
+     *
+     * @param profile Profile to record, or `nullptr` to stop.
+     */
+    void set_profile(const ptr<lock_profile>& profile) {
+        if (profile) profile_holder_ = profile;
+        profile_.store(profile.get(), std::memory_order_relaxed);
+    }
+
+    void lock() { lock_at(nullptr); }
+
+    basic_profiled_mutex& lock_at(const lock_site* site) {
+        lock_profile* pp = profile_.load(std::memory_order_relaxed);
+        if (!pp) {
+            mutex_.lock();
+            // Re-entered while held by a profiled `lock_at`.
+            if (depth_) depth_++;
+            return *this;
+        }
+
+        if (mutex_.try_lock()) {
+            on_locked(pp, site, false, 0);
+        } else {
+            uint64_t start_us = lock_profile::now_us();
+            mutex_.lock();
+            on_locked(pp, site, true, start_us);
+        }
+        return *this;
+    }
+
+    bool try_lock() {
+        if (!mutex_.try_lock()) return false;
+        lock_profile* pp = profile_.load(std::memory_order_relaxed);
+        if (pp) {
+            on_locked(pp, nullptr, false, 0);
+        } else if (depth_) {
+            depth_++;
+        }
+        return true;
+    }
+
+    void unlock() {
+        if (depth_ && --depth_ == 0 && acquired_us_) {
+            cur_profile_->on_released(lock_profile::now_us() - acquired_us_);
+        }
+        mutex_.unlock();
+    }
+
+private:
+    void on_locked(lock_profile* pp,
+                   const lock_site* site,
+                   bool contended,
+                   uint64_t start_us)
+    {
+        // Only the outermost lock of a recursive mutex is recorded.
+        if (depth_++) return;
+        cur_profile_ = pp;
+
+        uint64_t now_us = contended ? lock_profile::now_us() : 0;
+        pp->on_acquired(site, contended, contended ? now_us - start_us : 0);
+
+        acquired_us_ = 0;
+        if (++num_acquired_ % HOLD_SAMPLE_INTERVAL == 0) {
+            acquired_us_ = now_us ? now_us : lock_profile::now_us();
+        }
+    }
+
+    M mutex_;
+
+    std::atomic<lock_profile*> profile_;
+
+    ptr<lock_profile> profile_holder_;
+
+    // Below members are protected by `mutex_`.
+    lock_profile* cur_profile_;
+    uint64_t acquired_us_;
+    uint64_t num_acquired_;
+    size_t depth_;
+};
+
+template<typename M>
+const uint64_t basic_profiled_mutex<M>::HOLD_SAMPLE_INTERVAL;
+
+using profiled_mutex = basic_profiled_mutex<std::mutex>;
+using profiled_recursive_mutex = basic_profiled_mutex<std::recursive_mutex>;
+
+}
+
+// Lock guard named `name`, that records its call site.
+#define profiled_guard(name, lock)                                   \
+    static const nuraft::lock_site _lock_site_##name =               \
+        { __FILE__, __func__, __LINE__ };                            \
+    std::unique_lock< std::remove_reference<decltype(lock)>::type >  \
+        name( (lock).lock_at(&_lock_site_##name), std::adopt_lock )
+
+#define profiled_lock(lock)     profiled_guard(guard, lock)
+
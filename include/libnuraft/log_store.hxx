@@ -66,6 +66,27 @@ public:
      */
     virtual ulong append(ptr<log_entry>& entry) = 0;
 
+    /**
+     * Append multiple log entries to store at once.
+     * Raft will call this API instead of `append` when it has
+     * multiple log entries to append in a row, so that the store can
+     * write them all in a single I/O and update its index only once.
+     *
+     * The default implementation calls `append` for each entry.
+     *
+     * @param entries Log entries to append, in order.
+     * @return Log index number of the first entry.
+     *         If `entries` is empty, `next_slot()`.
+     */
+    virtual ulong append_batch(std::vector< ptr<log_entry> >& entries) {
+        if (entries.empty()) return next_slot();
+        ulong first_idx = append(entries[0]);
+        for (size_t ii = 1; ii < entries.size(); ++ii) {
+            append(entries[ii]);
+        }
+        return first_idx;
+    }
+
     /**
      * Overwrite a log entry at the given `index`.
      * This API should make sure that all log entries
@@ -23,10 +23,14 @@ limitations under the License.
 
 #include "pp_util.hxx"
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 
 namespace nuraft {
 
+class binary_logger;
+
 class logger {
     __interface_body__(logger);
 
@@ -102,6 +106,48 @@ public:
                              const char* func_name,
                              size_t line_number,
                              const std::string& log_line) {}
+
+    /**
+     * Put a log recorded earlier and formatted later by `binary_logger`.
+     * By default, the timestamp and thread ID are ignored, and the log
+     * is passed to `put_details`.
+     *
+     * @param level Level of given log.
+     * @param source_file Name of file where the log is located.
+     * @param func_name Name of function where the log is located.
+     * @param line_number Line number of the log.
+     * @param timestamp_us Time when the log was recorded,
+     *                     in microseconds since epoch.
+     * @param thread_id Hash of the ID of the thread recording the log.
+     * @param log_line Contents of the log.
+     */
+    virtual void put_deferred_details(int level,
+                                      const char* source_file,
+                                      const char* func_name,
+                                      size_t line_number,
+                                      uint64_t timestamp_us,
+                                      uint64_t thread_id,
+                                      const std::string& log_line)
+    {
+        put_details(level, source_file, func_name, line_number, log_line);
+    }
+
+    /**
+     * Get the `binary_logger` to record deferred logs into.
+     * Only `binary_logger` returns itself, while it is running.
+     * Not virtual, as it is called at every log site.
+     *
+     * @return `binary_logger` instance, or `nullptr`.
+     */
+    binary_logger* get_binary_logger() const {
+        return binary_logger_.load(std::memory_order_relaxed);
+    }
+
+protected:
+    /**
+     * Set by `binary_logger` to itself, and cleared on its `shutdown`.
+     */
+    std::atomic<binary_logger*> binary_logger_{nullptr};
 };
 
 }
@@ -60,11 +60,15 @@ enum msg_type {
     reconnect_response              = 27,
     custom_notification_request     = 28,
     custom_notification_response    = 29,
+    heartbeat_batch_request         = 30,
+    heartbeat_batch_response        = 31,
+    liveness_check_request          = 32,
+    liveness_check_response         = 33,
 };
 
 inline bool ATTR_UNUSED is_valid_msg(msg_type type) {
     if ( type >= request_vote_request &&
-         type <= custom_notification_response ) {
+         type <= liveness_check_response ) {
         return true;
     }
     return false;
@@ -102,6 +106,10 @@ inline std::string ATTR_UNUSED msg_type_to_string(msg_type type) {
     case reconnect_response:            return "reconnect_response";
     case custom_notification_request:   return "custom_notification_request";
     case custom_notification_response:  return "custom_notification_response";
+    case heartbeat_batch_request:       return "heartbeat_batch_request";
+    case heartbeat_batch_response:      return "heartbeat_batch_response";
+    case liveness_check_request:        return "liveness_check_request";
+    case liveness_check_response:       return "liveness_check_response";
     default:
         return "unknown (" + std::to_string(static_cast<int>(type)) + ")";
     }
@@ -23,6 +23,7 @@ limitations under the License.
 #include "asio_service.hxx"
 #include "async.hxx"
 #include "basic_types.hxx"
+#include "binary_logger.hxx"
 #include "buffer.hxx"
 #include "buffer_serializer.hxx"
 #include "callback.hxx"
@@ -31,22 +32,28 @@ limitations under the License.
 #include "delayed_task_scheduler.hxx"
 #include "delayed_task.hxx"
 #include "error_code.hxx"
+#include "failure_detector.hxx"
 #include "global_mgr.hxx"
+#include "heartbeat_batcher.hxx"
+#include "lock_profiler.hxx"
 #include "log_entry.hxx"
 #include "log_store.hxx"
 #include "logger.hxx"
 #include "ptr.hxx"
 #include "raft_params.hxx"
 #include "raft_server.hxx"
+#include "request_trace.hxx"
 #include "rpc_cli_factory.hxx"
 #include "rpc_cli.hxx"
 #include "rpc_listener.hxx"
 #include "snapshot.hxx"
 #include "srv_config.hxx"
 #include "srv_state.hxx"
+#include "stat_exporter.hxx"
 #include "state_machine.hxx"
 #include "state_mgr.hxx"
 #include "timer_task.hxx"
+#include "timer_wheel_scheduler.hxx"
 
 #include "launcher.hxx"
 
@@ -21,19 +21,23 @@ limitations under the License.
 #ifndef _PEER_HXX_
 #define _PEER_HXX_
 
+#include "batch_size_controller.hxx"
 #include "context.hxx"
 #include "delayed_task_scheduler.hxx"
 #include "internal_timer.hxx"
+#include "lock_profiler.hxx"
 #include "timer_task.hxx"
 #include "rpc_cli_factory.hxx"
 #include "snapshot_sync_ctx.hxx"
 #include "srv_config.hxx"
+#include "stream_window.hxx"
 
 #include <atomic>
 #include <cassert>
 
 namespace nuraft {
 
+class heartbeat_batcher;
 class snapshot;
 class peer {
 public:
@@ -43,6 +47,8 @@ public:
           ptr<logger>& logger )
         : config_(config)
         , scheduler_(ctx.scheduler_)
+        , hb_batcher_(ctx.hb_batcher_)
+        , group_id_(ctx.group_id_)
         , rpc_( ctx.rpc_cli_factory_->create_client(config->get_endpoint()) )
         , current_hb_interval_( ctx.get_params()->heart_beat_interval_ )
         , hb_interval_( ctx.get_params()->heart_beat_interval_ )
@@ -84,6 +90,10 @@ public:
         , bytes_in_flight_(0)
         , snapshot_sync_is_needed_(false)
         , self_mark_down_(false)
+        , quiesced_(false)
+        , fd_watch_id_(0)
+        , replication_scheduled_(false)
+        , replication_requested_(false)
         , l_(logger)
     {
         reset_ls_timer();
@@ -122,7 +132,7 @@ public:
         return hb_task_;
     }
 
-    std::mutex& get_lock() {
+    profiled_mutex& get_lock() {
         return lock_;
     }
 
@@ -237,7 +247,28 @@ public:
     void send_req(ptr<peer> myself,
                   ptr<req_msg>& req,
                   rpc_handler& handler,
-                  bool streaming = false);
+                  bool streaming = false,
+                  bool coalesce = false);
+
+    /**
+     * Send a request through the heartbeat lane, a separate connection
+     * used when `raft_params::use_heartbeat_lane_` is set. The connection
+     * is created on the first request, and re-created after a failure.
+     *
+     * Unlike `send_req`, the busy flag and in-flight bytes of
+     * the main connection are not touched.
+     *
+     * @return `true` if the request has been sent.
+     */
+    bool send_lane_req(ptr<peer> myself,
+                       ptr<req_msg>& req,
+                       rpc_handler& handler,
+                       context& ctx);
+
+    bool has_lane_rpc() {
+        std::lock_guard<std::mutex> l(rpc_protector_);
+        return lane_rpc_ != nullptr;
+    }
 
     void shutdown();
 
@@ -356,6 +387,10 @@ public:
         bytes_in_flight_.store(0);
     }
 
+    stream_window& get_stream_window() { return stream_window_; }
+
+    batch_size_controller& get_batch_size_ctl() { return batch_size_ctl_; }
+
     void try_set_free(msg_type type, bool streaming);
 
     bool is_lost() const { return lost_by_leader_; }
@@ -380,6 +415,46 @@ public:
         return old;
     }
 
+    bool is_quiesced() const {
+        return quiesced_;
+    }
+    bool set_quiesced(bool to) {
+        return quiesced_.exchange(to);
+    }
+
+    uint64_t get_fd_watch_id() const { return fd_watch_id_; }
+    void set_fd_watch_id(uint64_t to) { fd_watch_id_ = to; }
+
+    /**
+     * Request the replicator to run for this peer.
+     *
+     * @return `true` if the caller should queue this peer, as it is
+     *         neither queued nor running.
+     */
+    bool request_replication() {
+        replication_requested_ = true;
+        return !replication_scheduled_.exchange(true);
+    }
+
+    /**
+     * Called by the replicator right before it runs for this peer.
+     */
+    void clear_replication_request() {
+        replication_requested_ = false;
+    }
+
+    /**
+     * Called by the replicator after it runs for this peer.
+     *
+     * @return `true` if the replicator should run again, as there was
+     *         a new request in the meantime.
+     */
+    bool finish_replication() {
+        replication_scheduled_ = false;
+        return replication_requested_ &&
+               !replication_scheduled_.exchange(true);
+    }
+
 private:
     void handle_rpc_result(ptr<peer> myself,
                            ptr<rpc_client> my_rpc_client,
@@ -387,9 +462,24 @@ private:
                            ptr<rpc_result>& pending_result,
                            bool streaming,
                            size_t req_size_bytes,
+                           uint64_t sent_us,
                            ptr<resp_msg>& resp,
                            ptr<rpc_exception>& err);
 
+    void handle_batched_hb_result(ptr<peer> myself,
+                                  ptr<rpc_client> my_rpc_client,
+                                  ptr<req_msg>& req,
+                                  ptr<rpc_result>& pending_result,
+                                  uint64_t sent_us,
+                                  ptr<resp_msg>& resp,
+                                  ptr<rpc_exception>& err);
+
+    void handle_lane_result(ptr<peer> myself,
+                            ptr<rpc_client> my_rpc_client,
+                            rpc_handler& handler,
+                            ptr<resp_msg>& resp,
+                            ptr<rpc_exception>& err);
+
     /**
      * Information (config) of this server.
      */
@@ -400,13 +490,29 @@ private:
      */
     ptr<delayed_task_scheduler> scheduler_;
 
+    /**
+     * Heartbeat batcher, if heartbeat coalescing is enabled.
+     */
+    ptr<heartbeat_batcher> hb_batcher_;
+
+    /**
+     * Group ID used for `hb_batcher_`.
+     */
+    uint64_t group_id_;
+
     /**
      * RPC client to this server.
      */
     ptr<rpc_client> rpc_;
 
     /**
-     * Guard of `rpc_`.
+     * RPC client of the heartbeat lane to this server,
+     * `nullptr` until the first request on the lane.
+     */
+    ptr<rpc_client> lane_rpc_;
+
+    /**
+     * Guard of `rpc_` and `lane_rpc_`.
      */
     std::mutex rpc_protector_;
 
@@ -490,7 +596,7 @@ private:
     /**
      * Lock for this peer.
      */
-    std::mutex lock_;
+    profiled_mutex lock_;
 
     // --- For tracking long pause ---
     /**
@@ -614,6 +720,17 @@ private:
      */
     std::atomic<int64_t> bytes_in_flight_;
 
+    /**
+     * Round trip time, delivery rate, and the in-flight window
+     * estimated from them.
+     */
+    stream_window stream_window_;
+
+    /**
+     * Batch size for the log write latency reported by this peer.
+     */
+    batch_size_controller batch_size_ctl_;
+
     /**
      * Set to `true` if this peer was in the middle of receiving snapshot,
      * but received a normal request. In such a case, even though
@@ -626,6 +743,29 @@ private:
      */
     std::atomic<bool> self_mark_down_;
 
+    /**
+     * If `true`, this peer has suspended its election timer, and
+     * the leader does not send heartbeats to it.
+     */
+    std::atomic<bool> quiesced_;
+
+    /**
+     * ID of the leader's watch on this peer's node through the failure
+     * detector, while this peer is quiesced. 0 if not watching.
+     * Protected by `raft_server::lock_`.
+     */
+    uint64_t fd_watch_id_;
+
+    /**
+     * `true` if this peer is queued or being processed by the replicator.
+     */
+    std::atomic<bool> replication_scheduled_;
+
+    /**
+     * `true` if there is a replication request not processed yet.
+     */
+    std::atomic<bool> replication_requested_;
+
     /**
      * Logger instance.
      */
@@ -102,6 +102,14 @@ struct raft_params {
         , parallel_log_appending_(false)
         , max_log_gap_in_stream_(0)
         , max_bytes_in_flight_in_stream_(0)
+        , stream_window_autotune_(false)
+        , target_append_latency_us_(0)
+        , use_heartbeat_lane_(false)
+        , quiesce_after_ms_(0)
+        , quiesce_backstop_ms_(60000)
+        , num_replicator_threads_(0)
+        , trace_sample_interval_(0)
+        , profile_locks_(false)
         {}
 
     /**
@@ -668,6 +676,101 @@ public:
      * specified byte limit. This limitation is effective only in streaming mode.
      */
     int64_t max_bytes_in_flight_in_stream_;
+
+    /**
+     * If `true`, the in-flight window of each peer in streaming mode is sized
+     * from the measured round trip time and delivery rate of the peer
+     * (see `stream_window`), instead of the static limits.
+     * `max_log_gap_in_stream_` still should be non-zero to enable streaming
+     * mode, and it and `max_bytes_in_flight_in_stream_` (if non-zero) work
+     * as upper bounds of the window.
+     */
+    bool stream_window_autotune_;
+
+    /**
+     * If non-zero, followers report how long it took to write the logs of
+     * each `append_entries` request, and the leader sizes the next batch
+     * to each follower so that the write latency meets this target
+     * (in microseconds), see `batch_size_controller`. The batch size
+     * hint from the follower's state machine, if given, is still
+     * respected as an upper bound.
+     *
+     * Should be set on all members, as followers report the latency
+     * only when it is set.
+     */
+    int32 target_append_latency_us_;
+
+    /**
+     * If `true`, the leader opens a second connection to each peer
+     * (heartbeat lane), used for heartbeats while the main connection is
+     * occupied by `append_entries` requests (e.g., a large batch, or
+     * in-flight requests in streaming mode), and for vote requests.
+     * Then a heartbeat is not queued behind bulk traffic, so that
+     * followers do not start a false election.
+     *
+     * A heartbeat on the lane is an empty `append_entries` request
+     * at the peer's matched index, and its response is used only to
+     * detect liveness and a higher term.
+     *
+     * If the client factory multiplexes connections to the same endpoint
+     * (e.g., `asio_service::create_mux_client_factory`), the lane shares
+     * the connection with the main one.
+     */
+    bool use_heartbeat_lane_;
+
+    /**
+     * If non-zero, the group becomes quiescent if there has been no new log
+     * for this time (in milliseconds) and all followers have the same log
+     * and commit index as the leader. The leader stops sending heartbeats,
+     * and followers suspend their election timers, until a new log is
+     * appended.
+     *
+     * Followers quiesce only when `failure_detector` is given to `context`
+     * of both the leader and followers, so that they can wake up when
+     * the leader is gone.
+     * Not available when `use_full_consensus_among_healthy_members_` is set.
+     */
+    int32 quiesce_after_ms_;
+
+    /**
+     * Election timeout (in milliseconds) of a quiescent follower, as a
+     * backstop of the failure detector. Once it expires, the follower
+     * wakes up and resumes its normal election timer. If zero or
+     * negative, 10 times `election_timeout_upper_bound_` is used.
+     */
+    int32 quiesce_backstop_ms_;
+
+    /**
+     * If non-zero, the leader replicates logs to each peer in a separate
+     * replicator task, running on a thread pool of this size. A replicator
+     * reads logs and builds `append_entries` requests without holding the
+     * main lock of `raft_server`, so that a slow peer or log store read
+     * does not block client requests or replication to the other peers.
+     *
+     * Heartbeats, snapshots, and streaming mode are processed in the
+     * original way. Replicators can be enabled or disabled at runtime,
+     * but the new number of threads is applied only when they are
+     * enabled again.
+     */
+    int32 num_replicator_threads_;
+
+    /**
+     * If non-zero, logs whose index is a multiple of this value are traced,
+     * and their stage timestamps (accepted, appended, sent to and acked by
+     * each peer, committed, applied, and returned) are reported through
+     * `cb_func::RequestTraced`. Followers trace the same logs, so that
+     * the traces of both sides can be matched by log index.
+     */
+    int32 trace_sample_interval_;
+
+    /**
+     * If `true`, wait time and hold time of the main locks of Raft server
+     * (`raft_lock`, `cli_lock`, `commit_lock`, `commit_ret_elems_lock`,
+     * and `peer_lock`) are recorded to the stats of the server, along
+     * with the call sites that waited for them.
+     * See `raft_server::get_lock_contentions`.
+     */
+    bool profile_locks_;
 };
 
 }
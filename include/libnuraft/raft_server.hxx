@@ -24,7 +24,9 @@ limitations under the License.
 #include "async.hxx"
 #include "callback.hxx"
 #include "internal_timer.hxx"
+#include "lock_profiler.hxx"
 #include "log_store.hxx"
+#include "request_trace.hxx"
 #include "snapshot_sync_req.hxx"
 #include "rpc_cli.hxx"
 #include "srv_config.hxx"
@@ -38,6 +40,7 @@ limitations under the License.
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace nuraft {
 
@@ -50,19 +53,26 @@ class global_mgr;
 class EventAwaiter;
 class logger;
 class peer;
+class log_term_index;
+class peer_replicator;
 class rpc_client;
 class raft_server_handler;
 class req_msg;
+class request_tracer;
 class resp_msg;
 class rpc_exception;
 class snapshot_sync_ctx;
+class stat_elem;
+class stat_mgr;
 class state_machine;
 class state_mgr;
 struct context;
 struct raft_params;
 class raft_server : public std::enable_shared_from_this<raft_server> {
+    friend class failure_detector;
     friend class nuraft_global_mgr;
     friend class raft_server_handler;
+    friend class peer_replicator;
     friend class snapshot_io_mgr;
 public:
     struct init_options {
@@ -518,6 +528,23 @@ public:
     ulong get_target_committed_log_idx() const
     { return quick_commit_index_.load(); }
 
+    /**
+     * Get the last pre-committed log index number, that is, the last log
+     * appended by this server as a leader.
+     *
+     * @return Last pre-committed log index number.
+     */
+    ulong get_precommit_log_idx() const
+    { return precommit_index_.load(); }
+
+    /**
+     * Get the number of client requests waiting for their logs
+     * to be committed.
+     *
+     * @return Number of requests.
+     */
+    size_t get_num_pending_commit_elems();
+
     /**
      * Get the leader's last committed log index number.
      *
@@ -614,6 +641,17 @@ public:
         return true;
     }
 
+    /**
+     * Check if this server is quiescent, see `raft_params::quiesce_after_ms_`.
+     * Leader is quiescent when all followers have quiesced, and
+     * follower is quiescent when its election timer is suspended.
+     *
+     * @return `true` if quiescent.
+     */
+    bool is_quiescent() const {
+        return quiescent_;
+    }
+
     /**
      * Get the configuration of given server.
      *
@@ -654,6 +692,15 @@ public:
             : id_(-1)
             , last_log_idx_(0)
             , last_succ_resp_us_(0)
+            , stream_log_window_(0)
+            , stream_byte_window_(0)
+            , min_rtt_us_(0)
+            , smoothed_rtt_us_(0)
+            , ack_bytes_per_sec_(0)
+            , append_latency_us_(0)
+            , batch_size_bytes_(0)
+            , hb_lane_connected_(false)
+            , bytes_in_flight_(0)
             {}
 
         /**
@@ -671,6 +718,51 @@ public:
          * in microsecond.
          */
         ulong last_succ_resp_us_;
+
+        /**
+         * The in-flight window of this peer in streaming mode, in the number
+         * of logs and bytes. Estimated one if `stream_window_autotune_` is set,
+         * otherwise the static limits. 0 means unlimited (bytes only).
+         */
+        int64_t stream_log_window_;
+        int64_t stream_byte_window_;
+
+        /**
+         * The minimum and smoothed round trip time of `append_entries`
+         * requests to this peer, in microsecond.
+         */
+        uint64_t min_rtt_us_;
+        uint64_t smoothed_rtt_us_;
+
+        /**
+         * The recent delivery rate of logs acknowledged by this peer,
+         * in bytes per second.
+         */
+        uint64_t ack_bytes_per_sec_;
+
+        /**
+         * The average time taken by this peer to write the logs of
+         * a request, in microsecond, if reported by the peer.
+         */
+        uint64_t append_latency_us_;
+
+        /**
+         * The size of the next batch to this peer for
+         * `target_append_latency_us_`, in bytes. 0 if not limited.
+         */
+        int64_t batch_size_bytes_;
+
+        /**
+         * `true` if the heartbeat lane to this peer has been connected,
+         * see `use_heartbeat_lane_`.
+         */
+        bool hb_lane_connected_;
+
+        /**
+         * The size of the logs sent to this peer but not acknowledged yet,
+         * in bytes.
+         */
+        int64_t bytes_in_flight_;
     };
 
     /**
@@ -767,6 +859,88 @@ public:
      */
     static void reset_all_stats();
 
+    /**
+     * Snapshot of the stats in a scope, see `get_all_stat_scopes`.
+     */
+    struct stat_scope {
+        /**
+         * Labels identifying the scope, e.g., `server_id` and `group_id`
+         * for a Raft server. Empty for process-wide stats.
+         */
+        std::map<std::string, std::string> labels_;
+
+        /**
+         * Counters and gauges, by name.
+         */
+        std::map<std::string, int64_t> values_;
+
+        /**
+         * Histograms, by name, in the same format as `get_stat_histogram`.
+         */
+        std::map<std::string, std::map<double, uint64_t>> histograms_;
+    };
+
+    /**
+     * Get the stats of all scopes: process-wide stats (e.g., buffer
+     * allocations) first, and then the stats of each Raft server in
+     * this process.
+     *
+     * Static getters above (e.g., `get_stat_counter`) return the sum
+     * over all scopes.
+     *
+     * @param[out] scopes_out Snapshot of each scope.
+     */
+    static void get_all_stat_scopes(std::vector<stat_scope>& scopes_out);
+
+    /**
+     * Get the labels identifying the stats of this server.
+     *
+     * @return Labels.
+     */
+    std::map<std::string, std::string> get_stat_labels() const;
+
+    /**
+     * Get the counter number of given stat name, of this server only.
+     *
+     * @param name Stat name to retrieve.
+     * @return Counter value.
+     */
+    uint64_t get_server_stat_counter(const std::string& name) const;
+
+    /**
+     * Get the gauge number of given stat name, of this server only.
+     *
+     * @param name Stat name to retrieve.
+     * @return Gauge value.
+     */
+    int64_t get_server_stat_gauge(const std::string& name) const;
+
+    /**
+     * Get the histogram of given stat name, of this server only.
+     *
+     * @param name Stat name to retrieve.
+     * @param[out] histogram_out Histogram, same as `get_stat_histogram`.
+     * @return `true` on success.
+     */
+    bool get_server_stat_histogram(const std::string& name,
+                                   std::map<double, uint64_t>& histogram_out) const;
+
+    /**
+     * Reset all stats of this server to zero.
+     */
+    void reset_server_stats();
+
+    /**
+     * Get the call sites that waited for the internal locks of this
+     * server (e.g., `raft_lock` and `peer_lock`), sorted by the total
+     * wait time. Empty if `raft_params::profile_locks_` has never been set.
+     *
+     * @param[out] contentions_out Contended call sites.
+     * @param max_num Maximum number of call sites to return, 0 for all.
+     */
+    void get_lock_contentions(std::vector<lock_contention>& contentions_out,
+                              size_t max_num = 10);
+
     /**
      * Apply a log entry containing configuration change, while Raft
      * server is not running.
@@ -1042,10 +1216,10 @@ protected:
     void drop_all_sm_watcher_elems();
 
     ptr<resp_msg> handle_ext_msg(req_msg& req,
-                                 std::unique_lock<std::recursive_mutex>& guard);
+                                 std::unique_lock<profiled_recursive_mutex>& guard);
     ptr<resp_msg> handle_install_snapshot_req(
         req_msg& req,
-        std::unique_lock<std::recursive_mutex>& guard);
+        std::unique_lock<profiled_recursive_mutex>& guard);
     ptr<resp_msg> handle_rm_srv_req(req_msg& req);
     ptr<resp_msg> handle_add_srv_req(req_msg& req);
     ptr<resp_msg> handle_log_sync_req(req_msg& req);
@@ -1060,20 +1234,32 @@ protected:
     void handle_leave_cluster_resp(resp_msg& resp);
 
     bool handle_snapshot_sync_req(snapshot_sync_req& req,
-                                  std::unique_lock<std::recursive_mutex>& guard);
+                                  std::unique_lock<profiled_recursive_mutex>& guard);
 
     bool check_cond_for_zp_election();
     void request_prevote();
     void initiate_vote(bool force_vote = false);
     void request_vote(bool force_vote);
     void request_append_entries();
-    bool request_append_entries(ptr<peer> p);
+    bool request_append_entries(ptr<peer> p, bool heartbeat = false);
+    bool request_replication(ptr<peer> p);
+    void replicate_to_peer(ptr<peer> p);
+    bool can_replicate_without_lock(peer& p);
+    void update_replicator();
+    void update_lock_profiling();
+    void update_peer_lock_profiling(peer& p);
+    void start_follower_traces(req_msg& req, uint64_t received_us);
+    void report_traces(std::vector<request_trace>& traces);
     bool send_request(ptr<peer>& p,
                       ptr<req_msg>& msg,
                       rpc_handler& m_handler,
-                      bool streaming = false);
+                      bool streaming = false,
+                      bool coalesce = false);
     void handle_peer_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err);
     void handle_append_entries_resp(resp_msg& resp);
+    ulong get_next_log_idx_by_conflict_term(ulong conflict_term,
+                                            ulong conflict_term_first_idx,
+                                            ulong prev_next_log);
     void handle_install_snapshot_resp(resp_msg& resp);
     void handle_install_snapshot_resp_new_member(resp_msg& resp);
     void handle_prevote_resp(resp_msg& resp);
@@ -1089,7 +1275,10 @@ protected:
     void handle_join_leave_rpc_err(msg_type t_msg, ptr<peer> p);
     void reset_srv_to_join();
     void reset_srv_to_leave();
-    ptr<req_msg> create_append_entries_req(ptr<peer>& pp, ulong custom_last_log_idx = 0);
+    ptr<req_msg> create_append_entries_req(ptr<peer>& pp,
+                                           ulong custom_last_log_idx = 0,
+                                           bool entries_only = false);
+    void set_excluded_flag(peer& p, req_msg& req);
     ptr<req_msg> create_sync_snapshot_req(ptr<peer>& pp,
                                           ulong last_log_idx,
                                           ulong term,
@@ -1126,6 +1315,9 @@ protected:
                           ptr<std::exception>& err);
     void on_retryable_req_err(ptr<peer>& p, ptr<req_msg>& req);
     ulong term_for_log(ulong log_idx);
+    ulong log_term_at(ulong log_idx);
+    void rebuild_log_term_index();
+    ulong lower_bound_log_term(ulong term, ulong lo, ulong hi);
 
     void commit_in_bg();
     bool commit_in_bg_exec(size_t timeout_ms = 0);
@@ -1155,10 +1347,18 @@ protected:
 
     void set_config(const ptr<cluster_config>& new_config);
     ptr<snapshot> get_last_snapshot() const;
+    peer_info make_peer_info(peer& pp) const;
     void set_last_snapshot(const ptr<snapshot>& new_snapshot);
 
     ulong store_log_entry(ptr<log_entry>& entry, ulong index = 0);
 
+    ulong store_log_entries(std::vector< ptr<log_entry> >& entries);
+
+    void end_of_append_batch(ulong start, ulong cnt, bool more_in_stream);
+    void wait_for_durable_log(ulong log_idx);
+    void flush_deferred_append_batch();
+    void commit_appended_logs(ulong target_idx);
+
     ptr<resp_msg> handle_out_of_log_msg(req_msg& req,
                                         ptr<custom_notification_msg> msg,
                                         ptr<resp_msg> resp);
@@ -1177,10 +1377,27 @@ protected:
 
     void request_append_entries_for_all();
 
+    bool can_quiesce();
+    void update_quiescence(resp_msg& resp);
+    void handle_quiesce_req(req_msg& req, ptr<resp_msg>& resp);
+    void wake_from_quiescence(const char* reason);
+    void reset_quiescence();
+    void handle_leader_failure(uint64_t watch_id);
+    void watch_quiesced_peer(peer& pp);
+    void unwatch_quiesced_peer(peer& pp);
+    void handle_follower_failure(int32 peer_id, uint64_t watch_id);
+    void restart_quiesce_backstop_timer();
+
+    void send_lane_heartbeat(ptr<peer>& p);
+    void handle_lane_hb_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err);
+    bool send_vote_req(ptr<peer>& pp, ptr<req_msg>& req);
+
     uint64_t get_current_leader_index();
 
     global_mgr* get_global_mgr() const;
 
+    void init_stats();
+
 protected:
     static const int default_snapshot_sync_block_size;
 
@@ -1206,6 +1423,20 @@ protected:
      */
     EventAwaiter* bg_append_ea_;
 
+    /**
+     * Per-peer replicators, used when
+     * `raft_params::num_replicator_threads_` is set.
+     */
+    ptr<peer_replicator> replicator_;
+
+    /**
+     * Run-length index of log terms, to avoid `log_store::term_at`
+     * calls. Updated whenever Raft writes or compacts logs. It should be
+     * in sync with the log store, as a stale run returns a wrong term
+     * instead of falling back to the log store.
+     */
+    ptr<log_term_index> log_term_index_;
+
     /**
      * `true` if this server is ready to serve operation.
      */
@@ -1391,6 +1622,17 @@ protected:
      */
     std::atomic<bool> serving_req_;
 
+    /**
+     * `true` if this server is in the queue of global commit workers,
+     * to avoid duplicate requests. See `nuraft_global_mgr`.
+     */
+    std::atomic<bool> global_commit_scheduled_;
+
+    /**
+     * `true` if this server is in the queue of global append workers.
+     */
+    std::atomic<bool> global_append_scheduled_;
+
     /**
      * Number of steps remaining to turn off this server.
      * Will be triggered once this server is removed from the cluster.
@@ -1585,12 +1827,12 @@ protected:
     /**
      * Lock of entire Raft operation.
      */
-    mutable std::recursive_mutex lock_;
+    mutable profiled_recursive_mutex lock_;
 
     /**
      * Lock of handling client request and role change.
      */
-    std::recursive_mutex cli_lock_;
+    profiled_recursive_mutex cli_lock_;
 
     /**
      * Condition variable to invoke BG commit thread.
@@ -1605,7 +1847,7 @@ protected:
     /**
      * Lock to allow only one thread for commit.
      */
-    std::mutex commit_lock_;
+    profiled_mutex commit_lock_;
 
     /**
      * Lock for auto forwarding.
@@ -1621,7 +1863,7 @@ protected:
     /**
      * Lock for `commit_ret_elems_`.
      */
-    std::mutex commit_ret_elems_lock_;
+    profiled_mutex commit_ret_elems_lock_;
 
     /**
      * Map of state machine watchers.
@@ -1656,6 +1898,12 @@ protected:
      */
     rpc_handler ex_resp_handler_;
 
+    /**
+     * (Read-only)
+     * Response handler of heartbeats on the heartbeat lane.
+     */
+    rpc_handler lane_hb_resp_handler_;
+
     /**
      * Last snapshot instance.
      */
@@ -1725,6 +1973,74 @@ protected:
      * a `AppendEntries` request including invalid one too.
      */
     timer_helper last_rcvd_append_entries_req_;
+
+    /**
+     * If `true`, this server is quiescent, see `is_quiescent()`.
+     */
+    std::atomic<bool> quiescent_;
+
+    /**
+     * Last log index and the time when it was first seen by
+     * the leader, to determine if the group is idle.
+     */
+    ulong quiesce_last_idx_;
+    timer_helper quiesce_timer_;
+
+    /**
+     * Watch ID of the leader in `context::failure_detector_`,
+     * while this follower is quiescent. 0 if not watching.
+     */
+    uint64_t fd_watch_id_;
+
+    /**
+     * Range of logs [start, end) appended by streamed `append_entries`
+     * requests, whose `log_store::end_of_append_batch` call is deferred
+     * until the last request of the stream. `end` is 0 if nothing
+     * is deferred. Protected by `lock_`.
+     */
+    ulong deferred_append_start_;
+    ulong deferred_append_end_;
+
+    /**
+     * If `parallel_log_appending_` is on, the last log index whose
+     * durability wait is deferred in the same way. 0 if none.
+     * Protected by `lock_`.
+     */
+    ulong deferred_durable_idx_;
+
+    /**
+     * Commit index held back as its logs may not be durable yet,
+     * while the end of append batch is deferred. 0 if none.
+     */
+    ulong deferred_commit_idx_;
+
+    /**
+     * (Read-only)
+     * Traces of sampled requests in progress,
+     * see `raft_params::trace_sample_interval_`.
+     */
+    ptr<request_tracer> req_tracer_;
+
+    /**
+     * (Read-only)
+     * Stats of this server, and its hot stats.
+     */
+    ptr<stat_mgr> stats_;
+    stat_elem* num_ae_sent_stat_;
+    stat_elem* num_ae_rcvd_stat_;
+    stat_elem* num_committed_stat_;
+    stat_elem* log_append_latency_stat_;
+
+    /**
+     * Profiles of the locks above, created when
+     * `raft_params::profile_locks_` is set for the first time.
+     * Protected by `lock_`.
+     */
+    ptr<lock_profile> raft_lock_profile_;
+    ptr<lock_profile> cli_lock_profile_;
+    ptr<lock_profile> commit_lock_profile_;
+    ptr<lock_profile> commit_ret_elems_lock_profile_;
+    ptr<lock_profile> peer_lock_profile_;
 };
 
 } // namespace nuraft;
@@ -41,6 +41,33 @@ protected:
                                          raft_server::req_ext_params()) {
         return srv->process_req(req, ext_params);
     }
+
+    /**
+     * Same as `process_req`, but does not wait for the given server
+     * if its lock is held by another thread. Should not be used for
+     * requests that release the lock in the middle, e.g., snapshot install.
+     *
+     * @param srv `raft_server` instance.
+     * @param req Request.
+     * @return ptr<resp_msg> Response, `nullptr` if the server was busy.
+     */
+    static ptr<resp_msg> try_process_req(raft_server* srv, req_msg& req) {
+        // `lock_` is recursive, `process_req` will re-acquire it.
+        std::unique_lock<profiled_recursive_mutex> l(srv->lock_, std::try_to_lock);
+        if (!l.owns_lock()) return nullptr;
+        return srv->process_req(req, raft_server::req_ext_params());
+    }
+
+    /**
+     * Complete the log appends deferred by the requests with
+     * `req_msg::MORE_IN_STREAM` flag. Should be called before sending
+     * the response of any of them.
+     *
+     * @param srv `raft_server` instance.
+     */
+    static void flush_deferred_appends(raft_server* srv) {
+        srv->flush_deferred_append_batch();
+    }
 };
 
 }
@@ -34,6 +34,17 @@ public:
     // This flag is used only when full consensus mode is enabled.
     static constexpr uint64_t EXCLUDED_FROM_THE_QUORUM = 0x1;
 
+    // If set, the leader asks the receiver to suspend its election timer,
+    // as the group is idle. See `raft_params::quiesce_after_ms_`.
+    static constexpr uint64_t QUIESCE = 0x2;
+
+    // Local flag set by the transport (never sent over the wire): the next
+    // request in the same stream has already arrived, and the response of
+    // this request will not be sent before that of the next one. The
+    // receiver may defer `log_store::end_of_append_batch` and the durability
+    // wait until the transport calls `flush_deferred_appends`.
+    static constexpr uint64_t MORE_IN_STREAM = 0x4;
+
     req_msg(ulong term,
             msg_type type,
             int32 src,
@@ -0,0 +1,118 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "basic_types.hxx"
+
+#include <cstdint>
+#include <map>
+
+namespace nuraft {
+
+/**
+ * Stage timestamps of a sampled request, reported through
+ * `cb_func::RequestTraced` when `raft_params::trace_sample_interval_`
+ * is set. All timestamps are microseconds since epoch, and 0 if
+ * the stage has not been reached.
+ *
+ * Both the leader and followers sample the logs whose index is a multiple
+ * of the interval, so that their traces of the same log can be matched.
+ */
+struct request_trace {
+    request_trace()
+        : is_leader_(false)
+        , first_log_idx_(0)
+        , last_log_idx_(0)
+        , term_(0)
+        , accepted_us_(0)
+        , received_us_(0)
+        , leader_timestamp_us_(0)
+        , appended_us_(0)
+        , committed_us_(0)
+        , applied_us_(0)
+        , returned_us_(0)
+        {}
+
+    /**
+     * `true` if traced by the leader, which accepted the request.
+     */
+    bool is_leader_;
+
+    /**
+     * Range of logs of the request. On followers, it is a single log.
+     */
+    ulong first_log_idx_;
+    ulong last_log_idx_;
+
+    /**
+     * Term of the logs.
+     */
+    ulong term_;
+
+    /**
+     * (Leader) The request was accepted from the client.
+     */
+    uint64_t accepted_us_;
+
+    /**
+     * (Follower) The `append_entries` request containing the log
+     * was received.
+     */
+    uint64_t received_us_;
+
+    /**
+     * (Follower) The timestamp of the log given by the leader,
+     * if `asio_service_options::replicate_log_timestamp_` is set.
+     */
+    uint64_t leader_timestamp_us_;
+
+    /**
+     * The logs were appended to the local log store.
+     */
+    uint64_t appended_us_;
+
+    /**
+     * (Leader) The logs were sent to each peer for the first time,
+     * <peer ID, timestamp>.
+     */
+    std::map<int32, uint64_t> sent_us_;
+
+    /**
+     * (Leader) Each peer acknowledged the logs, <peer ID, timestamp>.
+     */
+    std::map<int32, uint64_t> acked_us_;
+
+    /**
+     * The logs were committed: reached the quorum on the leader,
+     * or the leader's commit index was received on followers.
+     */
+    uint64_t committed_us_;
+
+    /**
+     * `state_machine::commit` of the last log returned.
+     */
+    uint64_t applied_us_;
+
+    /**
+     * (Leader) The result was returned to the client. 0 if the request
+     * does not wait for the commit (e.g., asynchronous replication).
+     */
+    uint64_t returned_us_;
+};
+
+}
+
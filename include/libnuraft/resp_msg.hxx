@@ -42,6 +42,15 @@ public:
     // This is the hint for the leader.
     static constexpr uint64_t SELF_MARK_DOWN = 0x1;
 
+    // If set, the follower has suspended its election timer
+    // in response to `req_msg::QUIESCE`.
+    static constexpr uint64_t QUIESCED = 0x2;
+
+    // If set, this response was omitted by the follower, and the
+    // following response acknowledges the request cumulatively.
+    // Only the transport-level bookkeeping is needed.
+    static constexpr uint64_t CUMULATIVELY_ACKED = 0x4;
+
     resp_msg(ulong term,
              msg_type type,
              int32 src,
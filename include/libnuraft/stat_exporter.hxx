@@ -0,0 +1,88 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "pp_util.hxx"
+#include "ptr.hxx"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nuraft {
+
+class raft_server;
+
+/**
+ * Renders the stats of this process in OpenMetrics text format,
+ * so that they can be scraped by Prometheus without knowing
+ * the stat names in advance:
+ *
+ *   - All stats in all scopes (see `raft_server::get_all_stat_scopes`),
+ *     labeled by their scopes. Histograms are rendered as cumulative
+ *     buckets with 1-2-5 upper bounds.
+ *
+ *   - Term, role, log indexes, and queue depths of each added server.
+ *
+ *   - Replication state of each peer (`raft_server::peer_info`),
+ *     if the server is the leader, labeled by `peer_id`.
+ *
+ * See `asio_service::start_metrics_endpoint` to serve it over HTTP.
+ *
+ * Thread-safe.
+ */
+class stat_exporter {
+public:
+    stat_exporter();
+
+    __nocopy__(stat_exporter);
+
+public:
+    /**
+     * Add a server whose state will be rendered.
+     * The exporter does not keep the server alive.
+     *
+     * @param server Raft server instance.
+     */
+    void add_server(ptr<raft_server> server);
+
+    /**
+     * Remove the given server.
+     *
+     * @param server Raft server instance.
+     */
+    void remove_server(ptr<raft_server> server);
+
+    /**
+     * Render the current stats.
+     *
+     * @return OpenMetrics text, ending with `# EOF`.
+     */
+    std::string render();
+
+    /**
+     * HTTP `Content-Type` of the rendered text.
+     */
+    static const char* CONTENT_TYPE;
+
+private:
+    std::mutex lock_;
+    std::vector< wptr<raft_server> > servers_;
+};
+
+}
+
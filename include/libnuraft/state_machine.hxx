@@ -353,6 +353,18 @@ public:
         std::unordered_map<int, uint64_t> peer_index_map_;
     };
 
+    /**
+     * Tell whether this state machine adjusts the commit index.
+     * If `false`, Raft will not build `adjust_commit_index_params`
+     * nor call `adjust_commit_index` on each commit decision.
+     *
+     * State machines not overriding `adjust_commit_index` can
+     * return `false` to save that cost.
+     *
+     * @return `true` (default) if `adjust_commit_index` should be called.
+     */
+    virtual bool adjusts_commit_index() const { return true; }
+
     /**
      * This function will be called when Raft succeeds in replicating logs
      * to an arbitrary follower and attempts to commit logs. Users can manually
@@ -360,6 +372,8 @@ public:
      * or greater than the given `current_commit_index`. Otherwise, no log
      * will be committed.
      *
+     * Not called if `adjusts_commit_index` returns `false`.
+     *
      * @param params Parameters.
      * @return Adjusted commit index.
      */
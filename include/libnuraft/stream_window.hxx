@@ -0,0 +1,166 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "pp_util.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace nuraft {
+
+/**
+ * Per-peer estimator of the in-flight window in streaming mode,
+ * used when `raft_params::stream_window_autotune_` is set.
+ *
+ * It measures the round trip time and the delivery rate of
+ * acknowledged `append_entries` requests, and sizes the window
+ * as a multiple of the bandwidth-delay product (BDP), that is,
+ * the delivery rate times the minimum round trip time:
+ *
+ *   - If the smoothed round trip time is not much larger than
+ *     the minimum one, the window is twice the BDP, so that it keeps
+ *     growing (up to twice per sample) as long as the peer keeps up.
+ *
+ *   - If requests start queueing up (congestion), the window is
+ *     the BDP, to drain the queue.
+ *
+ *   - If the connection fails, the window shrinks to the initial one.
+ *
+ * Samples during which the data in flight never reached the window are
+ * limited by the application rather than the peer, so that they do not
+ * change the window.
+ *
+ * Thread-safe.
+ */
+class stream_window {
+public:
+    stream_window();
+
+    __nocopy__(stream_window);
+
+public:
+    /**
+     * Update the estimates with an acknowledged request.
+     *
+     * @param num_logs Number of logs in the request.
+     * @param num_bytes Size of the logs in the request.
+     * @param rtt_us Round trip time of the request, in microseconds.
+     * @param now_us Current time, in microseconds.
+     */
+    void on_ack(size_t num_logs,
+                size_t num_bytes,
+                uint64_t rtt_us,
+                uint64_t now_us);
+
+    /**
+     * Notify that the data in flight has reached the window, and
+     * the next request is held back.
+     */
+    void on_window_full();
+
+    /**
+     * Shrink the window to the initial one, on connection failure.
+     */
+    void on_failure();
+
+    /**
+     * Get the window in the number of logs.
+     *
+     * @param cap Upper bound, 0 if unlimited.
+     * @return Number of logs.
+     */
+    int64_t get_log_window(int64_t cap) const;
+
+    /**
+     * Get the window in bytes.
+     *
+     * @param cap Upper bound, 0 if unlimited.
+     * @return Number of bytes.
+     */
+    int64_t get_byte_window(int64_t cap) const;
+
+    /**
+     * Get the minimum round trip time in the recent window.
+     *
+     * @return Microseconds, 0 if not measured yet.
+     */
+    uint64_t get_min_rtt_us() const;
+
+    /**
+     * Get the smoothed round trip time.
+     *
+     * @return Microseconds, 0 if not measured yet.
+     */
+    uint64_t get_smoothed_rtt_us() const;
+
+    /**
+     * Get the recent maximum delivery rate of acknowledged logs.
+     *
+     * @return Bytes per second.
+     */
+    uint64_t get_byte_rate() const;
+
+    static const int64_t INIT_LOG_WINDOW = 16;
+    static const int64_t MIN_LOG_WINDOW = 4;
+    static const int64_t MAX_LOG_WINDOW = 1 << 20;
+    static const int64_t INIT_BYTE_WINDOW = 1 << 20;
+    static const int64_t MIN_BYTE_WINDOW = 64 << 10;
+    static const int64_t MAX_BYTE_WINDOW = (int64_t)1 << 32;
+
+private:
+    void close_sample(uint64_t now_us);
+
+    /**
+     * Minimum round trip time, and when it was measured.
+     * Expired after `MIN_RTT_EXPIRY_US`, to follow path changes.
+     */
+    uint64_t min_rtt_us_;
+    uint64_t min_rtt_stamp_us_;
+
+    /**
+     * Exponentially weighted moving average of round trip time.
+     */
+    uint64_t srtt_us_;
+
+    /**
+     * Current delivery rate sample.
+     */
+    uint64_t sample_start_us_;
+    uint64_t sample_logs_;
+    uint64_t sample_bytes_;
+
+    /**
+     * `true` if the window was full during the current sample.
+     */
+    bool sample_window_full_;
+
+    /**
+     * Maximum delivery rates, decaying over samples.
+     */
+    double max_log_rate_;
+    double max_byte_rate_;
+
+    int64_t log_window_;
+    int64_t byte_window_;
+
+    mutable std::mutex lock_;
+};
+
+}
+
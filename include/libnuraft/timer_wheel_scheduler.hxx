@@ -0,0 +1,168 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "delayed_task_scheduler.hxx"
+#include "event_awaiter.hxx"
+#include "pp_util.hxx"
+#include "ptr.hxx"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace nuraft {
+
+/**
+ * Hierarchical hashed timer wheel, implementing `delayed_task_scheduler`.
+ *
+ * Unlike `asio_service`, which arms one `asio::steady_timer` per task,
+ * all tasks share a single tick source. Both `schedule` and `cancel` are
+ * O(1): a task is linked into a slot of the wheel, and moved to a lower
+ * level only when the higher level wheel cascades.
+ *
+ * Tasks never fire earlier than requested, but they may fire up to
+ * one tick later. Tasks beyond the range of the wheel (2^24 ticks) are
+ * kept in an overflow list, and linked into the wheel whenever it wraps
+ * around.
+ */
+class timer_wheel_scheduler : public delayed_task_scheduler {
+public:
+    /**
+     * Function that runs an expired task. If not given, the task will
+     * be executed inline by the thread calling `advance()`.
+     */
+    using dispatcher = std::function< void(ptr<delayed_task>&) >;
+
+    struct options {
+        options()
+            : tick_ms_(10)
+            , use_internal_thread_(true)
+            , dispatcher_(nullptr)
+            {}
+
+        /**
+         * Resolution of the wheel in milliseconds.
+         */
+        uint32_t tick_ms_;
+
+        /**
+         * If `true`, an internal thread will call `advance()` every tick.
+         * Otherwise, the user is responsible for calling it periodically.
+         */
+        bool use_internal_thread_;
+
+        /**
+         * Custom dispatcher for expired tasks.
+         */
+        dispatcher dispatcher_;
+    };
+
+    timer_wheel_scheduler(const options& opt = options());
+
+    ~timer_wheel_scheduler();
+
+    __nocopy__(timer_wheel_scheduler);
+
+public:
+    virtual void schedule(ptr<delayed_task>& task, int32 milliseconds) __override__;
+
+    /**
+     * Process all ticks elapsed so far, and dispatch expired tasks.
+     *
+     * @return Number of dispatched tasks.
+     */
+    size_t advance();
+
+    /**
+     * Stop the internal thread (if running). Tasks scheduled after this
+     * call will not fire unless `advance()` is called manually.
+     */
+    void stop();
+
+    /**
+     * Get the number of tasks currently scheduled.
+     *
+     * @return Number of active timers.
+     */
+    size_t get_num_active_timers() const { return num_active_.load(); }
+
+    /**
+     * Get the tick interval.
+     *
+     * @return Tick interval in milliseconds.
+     */
+    uint32_t get_tick_ms() const { return opt_.tick_ms_; }
+
+private:
+    struct node;
+
+    static const size_t NUM_LEVELS = 4;
+    static const size_t SLOT_BITS = 6;
+    static const size_t NUM_SLOTS = (size_t)1 << SLOT_BITS;
+    static const uint64_t SLOT_MASK = NUM_SLOTS - 1;
+
+    virtual void cancel_impl(ptr<delayed_task>& task) __override__;
+
+    uint64_t now_tick() const;
+
+    void link(node* nn);
+
+    void unlink(node* nn);
+
+    void cascade(node* head);
+
+    void cascade_overflow();
+
+    void tick_thread_loop();
+
+    options opt_;
+
+    std::chrono::steady_clock::time_point start_;
+
+    /**
+     * Next tick to be processed, protected by `lock_`.
+     */
+    uint64_t cur_tick_;
+
+    /**
+     * Sentinel nodes of each slot, protected by `lock_`.
+     */
+    node* slots_[NUM_LEVELS][NUM_SLOTS];
+
+    /**
+     * Sentinel node of tasks beyond the range of the wheel,
+     * protected by `lock_`.
+     */
+    node* overflow_;
+
+    std::atomic<size_t> num_active_;
+
+    mutable std::mutex lock_;
+
+    std::atomic<bool> stopping_;
+
+    EventAwaiter tick_ea_;
+
+    std::thread tick_thread_;
+};
+
+}
+
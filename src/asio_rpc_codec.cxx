@@ -0,0 +1,207 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "asio_rpc_codec.hxx"
+
+#include "buffer_serializer.hxx"
+#include "crc32.hxx"
+#include "log_entry.hxx"
+#include "req_msg.hxx"
+#include "strfmt.hxx"
+
+namespace nuraft {
+
+size_t asio_rpc_codec::log_entry_header_size(uint32_t flags) {
+    // Term, value type, and value size.
+    size_t ret = 8 + 1 + 4;
+    if (flags & INCLUDE_LOG_TIMESTAMP) {
+        ret += 8;
+    }
+    if (flags & CRC_ON_PAYLOAD) {
+        ret += 5;
+    }
+    return ret;
+}
+
+ptr<buffer> asio_rpc_codec::encode_req(req_msg& req,
+                                       uint32_t flags,
+                                       uint64_t stream_id,
+                                       const std::string& meta)
+{
+    size_t stream_id_size = (flags & STREAM_ID) ? sizeof(uint64_t) : 0;
+
+    size_t meta_size = 0;
+    if (!meta.empty()) {
+        flags |= INCLUDE_META;
+        meta_size = sizeof(int32) + meta.size();
+    }
+
+    const size_t LOG_ENTRY_SIZE = log_entry_header_size(flags);
+    size_t log_data_size = 0;
+    for (auto& entry: req.log_entries()) {
+        log_data_size += LOG_ENTRY_SIZE + entry->get_buf().size();
+    }
+
+    size_t payload_size = stream_id_size + meta_size + log_data_size;
+    ptr<buffer> req_buf = buffer::alloc(RPC_REQ_HEADER_SIZE + payload_size);
+
+    buffer_serializer req_buf_bs(req_buf);
+    req_buf_bs.put_u8(0x0);
+    req_buf_bs.put_u8((byte)req.get_type());
+    req_buf_bs.put_i32(req.get_src());
+    req_buf_bs.put_i32(req.get_dst());
+    req_buf_bs.put_u64(req.get_term());
+    req_buf_bs.put_u64(req.get_last_log_term());
+    req_buf_bs.put_u64(req.get_last_log_idx());
+    req_buf_bs.put_u64(req.get_commit_idx());
+    req_buf_bs.put_i32((int32)payload_size);
+
+    // Calculate CRC32 on header-only.
+    uint32_t crc_header = crc32_8( req_buf->data_begin(),
+                                   RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
+                                   0 );
+    size_t crc_pos = req_buf_bs.pos();
+    req_buf_bs.put_u64( ((uint64_t)flags << 32) | crc_header );
+
+    // From now on, it will contain the payload (== meta + log entries).
+    size_t payload_pos = req_buf_bs.pos();
+
+    // Stream ID goes first, so that the receiver can find the target.
+    if (flags & STREAM_ID) {
+        req_buf_bs.put_u64(stream_id);
+    }
+
+    if (flags & INCLUDE_META) {
+        req_buf_bs.put_bytes( (const byte*)meta.data(), meta.size() );
+    }
+
+    // Log entries are written in place, without intermediate buffers.
+    for (auto& entry: req.log_entries()) {
+        log_entry* le = entry.get();
+        req_buf_bs.put_u64( le->get_term() );
+        req_buf_bs.put_u8( le->get_val_type() );
+        if (flags & INCLUDE_LOG_TIMESTAMP) {
+            req_buf_bs.put_u64( le->get_timestamp() );
+        }
+        if (flags & CRC_ON_PAYLOAD) {
+            req_buf_bs.put_u8(le->has_crc32() ? 1 : 0);
+            req_buf_bs.put_u32(le->get_crc32());
+        }
+        req_buf_bs.put_i32( le->get_buf().size() );
+        req_buf_bs.put_raw( le->get_buf().data_begin(), le->get_buf().size() );
+    }
+
+    if (flags & CRC_ON_ENTIRE_MESSAGE) {
+        uint32_t crc_payload = crc32_8( req_buf->data_begin() + payload_pos,
+                                        payload_size,
+                                        crc_header );
+        // Overwrite CRC field.
+        req_buf_bs.pos(crc_pos);
+        req_buf_bs.put_u64( ((uint64_t)flags << 32) | crc_payload );
+    }
+
+    return req_buf;
+}
+
+void asio_rpc_codec::decode_req_header(buffer& hdr, req_header& out) {
+    buffer_serializer h_bs(hdr);
+    out.marker_ = h_bs.get_u8();
+    out.type_ = (msg_type)h_bs.get_u8();
+    out.src_ = h_bs.get_i32();
+    out.dst_ = h_bs.get_i32();
+    out.term_ = h_bs.get_u64();
+    out.last_log_term_ = h_bs.get_u64();
+    out.last_log_idx_ = h_bs.get_u64();
+    out.commit_idx_ = h_bs.get_u64();
+    out.data_size_ = h_bs.get_i32();
+
+    uint64_t flags_and_crc = h_bs.get_u64();
+    out.crc_from_msg_ = flags_and_crc & (uint32_t)0xffffffff;
+    out.flags_ = (flags_and_crc >> 32);
+
+    out.crc_header_ = crc32_8( hdr.data_begin(),
+                               RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
+                               0 );
+}
+
+asio_rpc_codec::decode_result
+    asio_rpc_codec::decode_log_entries(buffer& log_ctx,
+                                       size_t pos,
+                                       uint32_t flags,
+                                       std::string& meta_out,
+                                       std::vector<ptr<log_entry>>& entries_out,
+                                       std::string& err_msg)
+{
+    buffer_serializer ss(log_ctx);
+    ss.pos(pos);
+    size_t log_ctx_size = log_ctx.size();
+
+    // If flag is set, read meta first.
+    if (flags & INCLUDE_META) {
+        size_t meta_len = 0;
+        const byte* meta_raw = (const byte*)ss.get_bytes(meta_len);
+        if (meta_len) {
+            meta_out = std::string((const char*)meta_raw, meta_len);
+        }
+    }
+
+    const size_t LOG_ENTRY_SIZE = log_entry_header_size(flags);
+    while (log_ctx_size > ss.pos()) {
+        if (log_ctx_size - ss.pos() < LOG_ENTRY_SIZE) {
+            // Possibly corrupted packet. Stop here.
+            err_msg = sstrfmt("wrong log ctx size %zu pos %zu")
+                      .fmt(log_ctx_size, ss.pos());
+            return LOG_ENTRY_TRUNCATED;
+        }
+        ulong term = ss.get_u64();
+        log_val_type val_type = (log_val_type)ss.get_u8();
+        uint64_t timestamp = (flags & INCLUDE_LOG_TIMESTAMP) ? ss.get_u64() : 0;
+        bool has_crc32 = (flags & CRC_ON_PAYLOAD) ? (ss.get_u8() != 0) : false;
+        uint32_t crc32 = (flags & CRC_ON_PAYLOAD) ? ss.get_u32() : 0;
+
+        size_t val_size = ss.get_i32();
+        if (log_ctx_size - ss.pos() < val_size) {
+            // Out-of-bound size.
+            err_msg = sstrfmt("wrong value size %zu log ctx %zu %zu")
+                      .fmt(val_size, log_ctx_size, ss.pos());
+            return VALUE_OUT_OF_BOUND;
+        }
+
+        ptr<buffer> buf( buffer::alloc(val_size) );
+        ss.get_buffer(buf);
+        ptr<log_entry> entry(
+            cs_new<log_entry>(term, buf, val_type, timestamp, has_crc32, crc32, false) );
+
+        if ((flags & CRC_ON_PAYLOAD) && has_crc32) {
+            // Verify CRC.
+            uint32_t crc_payload = crc32_8( buf->data_begin(),
+                                            buf->size(),
+                                            0 );
+            if (crc_payload != crc32) {
+                err_msg = sstrfmt("log entry CRC mismatch: local calculation %x, "
+                                  "from message %x")
+                          .fmt(crc_payload, crc32);
+                return LOG_ENTRY_CRC_MISMATCH;
+            }
+        }
+
+        entries_out.push_back(entry);
+    }
+    return OK;
+}
+
+} // namespace nuraft;
+
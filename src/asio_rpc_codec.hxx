@@ -0,0 +1,232 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "basic_types.hxx"
+#include "buffer.hxx"
+#include "msg_type.hxx"
+#include "ptr.hxx"
+
+#include <string>
+#include <vector>
+
+// Note: both req & resp header structures have been modified by Jung-Sang Ahn.
+//       They MUST NOT be combined with the original code.
+
+// request header:
+//     byte         marker (req = 0x0)  (1),
+//     msg_type     type                (1),
+//     int32        src                 (4),
+//     int32        dst                 (4),
+//     ulong        term                (8),
+//     ulong        last_log_term       (8),
+//     ulong        last_log_idx        (8),
+//     ulong        commit_idx          (8),
+//     int32        log data size       (4),
+//     ulong        flags + CRC32       (8),
+//     -------------------------------------
+//                  total               (54)
+#define RPC_REQ_HEADER_SIZE (4*3 + 8*5 + 1*2)
+
+// response header:
+//     byte         marker (resp = 0x1) (1),
+//     msg_type     type                (1),
+//     int32        src                 (4),
+//     int32        dst                 (4),
+//     ulong        term                (8),
+//     ulong        next_idx            (8),
+//     bool         accepted            (1),
+//     int32        ctx data dize       (4),
+//     ulong        flags + CRC32       (8),
+//     -------------------------------------
+//                  total               (39)
+#define RPC_RESP_HEADER_SIZE (4*3 + 8*3 + 1*3)
+
+#define DATA_SIZE_LEN (4)
+#define CRC_FLAGS_LEN (8)
+
+// === RPC Flags =========
+
+// If set, RPC message includes custom meta given by user.
+#define INCLUDE_META (0x1)
+
+// If set, RPC message (response) includes additional hints.
+#define INCLUDE_HINT (0x2)
+
+// If set, each log entry will contain timestamp.
+#define INCLUDE_LOG_TIMESTAMP (0x4)
+
+// If set, CRC number represents the entire message.
+#define CRC_ON_ENTIRE_MESSAGE (0x8)
+
+// If set, each log entry will contain a CRC on the payload.
+#define CRC_ON_PAYLOAD (0x10)
+
+// If set, RPC message (response) includes result code
+#define INCLUDE_RESULT_CODE (0x20)
+
+// If set, and
+//   - If it is used in a request (leader -> follower),
+//     the follower has been excluded from the quorum,
+//     determined by the leader (i.e., sender).
+//   - If it is used in a response (follower -> leader),
+//     the follower is marked down by itself.
+#define MARK_DOWN (0x40)
+
+// If set, the message is sent through a multiplexed connection, and
+//   - If it is used in a request, the payload starts with 8-byte stream ID
+//     (i.e., group ID) of the request, followed by meta and log entries.
+//   - If it is used in a response, the carried data starts with 8-byte
+//     stream ID of the request, followed by meta, hint, and so on.
+//     Responses of different streams can be out of order.
+#define STREAM_ID (0x80)
+
+// If set, and
+//   - If it is used in a request (leader -> follower),
+//     the leader asks the follower to quiesce.
+//   - If it is used in a response (follower -> leader),
+//     the follower has quiesced.
+#define QUIESCING (0x100)
+
+// If set, and
+//   - If it is used in a request (leader -> follower),
+//     the leader accepts a cumulative acknowledgement for this request.
+//   - If it is used in a response (follower -> leader),
+//     the last 4 bytes of the carried data is the number of preceding
+//     requests whose responses were omitted, as this response
+//     also acknowledges them.
+#define CUMULATIVE_ACK (0x200)
+
+// If set in a response, along with `STREAM_ID`, the stream ID in the request
+// is not registered on the receiver side, hence the request was discarded.
+#define UNKNOWN_STREAM (0x400)
+
+// =======================
+
+namespace nuraft {
+
+class log_entry;
+class req_msg;
+
+/**
+ * Wire format of the requests sent by `asio_service`, separated from
+ * the socket handling so that it can be measured on its own.
+ */
+class asio_rpc_codec {
+public:
+    struct req_header {
+        req_header()
+            : marker_(0x0)
+            , type_(msg_type::append_entries_request)
+            , src_(0)
+            , dst_(0)
+            , term_(0)
+            , last_log_term_(0)
+            , last_log_idx_(0)
+            , commit_idx_(0)
+            , data_size_(0)
+            , flags_(0x0)
+            , crc_from_msg_(0)
+            , crc_header_(0)
+            {}
+
+        byte marker_;
+        msg_type type_;
+        int32 src_;
+        int32 dst_;
+        ulong term_;
+        ulong last_log_term_;
+        ulong last_log_idx_;
+        ulong commit_idx_;
+        int32 data_size_;
+        uint32_t flags_;
+
+        /**
+         * CRC in the message, which covers the entire message
+         * if `CRC_ON_ENTIRE_MESSAGE` is set in `flags_`.
+         */
+        uint32_t crc_from_msg_;
+
+        /**
+         * CRC calculated on the header (except for the last field).
+         */
+        uint32_t crc_header_;
+    };
+
+    enum decode_result {
+        OK = 0,
+        LOG_ENTRY_TRUNCATED = 1,
+        VALUE_OUT_OF_BOUND = 2,
+        LOG_ENTRY_CRC_MISMATCH = 3,
+    };
+
+    /**
+     * Size of each log entry in the payload, except for its value.
+     *
+     * @param flags RPC flags.
+     * @return Size in bytes.
+     */
+    static size_t log_entry_header_size(uint32_t flags);
+
+    /**
+     * Serialize the given request into a single buffer:
+     * the header, followed by the stream ID, meta, and log entries.
+     *
+     * @param req Request to serialize.
+     * @param flags RPC flags. `INCLUDE_META` will be set if `meta` is
+     *              not empty. If `CRC_ON_ENTIRE_MESSAGE` is set, the CRC
+     *              will cover the payload as well.
+     * @param stream_id Stream ID, used only if `STREAM_ID` is set.
+     * @param meta Custom meta given by user.
+     * @return Serialized request.
+     */
+    static ptr<buffer> encode_req(req_msg& req,
+                                  uint32_t flags,
+                                  uint64_t stream_id,
+                                  const std::string& meta);
+
+    /**
+     * Parse the header of a request, whose size is `RPC_REQ_HEADER_SIZE`.
+     * It does not validate any field, but only calculates the CRC.
+     *
+     * @param hdr Header to parse.
+     * @param[out] out Parsed header.
+     */
+    static void decode_req_header(buffer& hdr, req_header& out);
+
+    /**
+     * Parse the meta and log entries in the payload of a request,
+     * and verify the CRC of each log entry if it has one.
+     *
+     * @param log_ctx Payload of the request.
+     * @param pos Position where the meta (or the first log entry) starts.
+     * @param flags RPC flags in the header.
+     * @param[out] meta_out Custom meta, if `INCLUDE_META` is set.
+     * @param[out] entries_out Parsed log entries.
+     * @param[out] err_msg Details of the error, if not `OK`.
+     * @return `OK` on success.
+     */
+    static decode_result decode_log_entries(buffer& log_ctx,
+                                            size_t pos,
+                                            uint32_t flags,
+                                            std::string& meta_out,
+                                            std::vector<ptr<log_entry>>& entries_out,
+                                            std::string& err_msg);
+};
+
+} // namespace nuraft;
+
@@ -27,6 +27,7 @@ limitations under the License.
 
 #include "asio_service.hxx"
 
+#include "asio_rpc_codec.hxx"
 #include "buffer_serializer.hxx"
 #include "callback.hxx"
 #include "crc32.hxx"
@@ -34,8 +35,10 @@ limitations under the License.
 #include "internal_timer.hxx"
 #include "rpc_listener.hxx"
 #include "raft_server.hxx"
+#include "stat_exporter.hxx"
 #include "raft_server_handler.hxx"
 #include "strfmt.hxx"
+#include "timer_wheel_scheduler.hxx"
 #include "tracer.hxx"
 
 #ifdef USE_BOOST_ASIO
@@ -58,7 +61,9 @@ limitations under the License.
 #include <ctime>
 #include <exception>
 #include <list>
+#include <map>
 #include <thread>
+#include <unordered_map>
 
 
 //#define SSL_LIBRARY_NOT_FOUND (1)
@@ -76,76 +81,14 @@ limitations under the License.
     using ssl_context = asio::ssl::context;
 #endif
 
-// Note: both req & resp header structures have been modified by Jung-Sang Ahn.
-//       They MUST NOT be combined with the original code.
-
-// request header:
-//     byte         marker (req = 0x0)  (1),
-//     msg_type     type                (1),
-//     int32        src                 (4),
-//     int32        dst                 (4),
-//     ulong        term                (8),
-//     ulong        last_log_term       (8),
-//     ulong        last_log_idx        (8),
-//     ulong        commit_idx          (8),
-//     int32        log data size       (4),
-//     ulong        flags + CRC32       (8),
-//     -------------------------------------
-//                  total               (54)
-#define RPC_REQ_HEADER_SIZE (4*3 + 8*5 + 1*2)
-
-// response header:
-//     byte         marker (resp = 0x1) (1),
-//     msg_type     type                (1),
-//     int32        src                 (4),
-//     int32        dst                 (4),
-//     ulong        term                (8),
-//     ulong        next_idx            (8),
-//     bool         accepted            (1),
-//     int32        ctx data dize       (4),
-//     ulong        flags + CRC32       (8),
-//     -------------------------------------
-//                  total               (39)
-#define RPC_RESP_HEADER_SIZE (4*3 + 8*3 + 1*3)
-
-#define DATA_SIZE_LEN (4)
-#define CRC_FLAGS_LEN (8)
-
-// === RPC Flags =========
-
-// If set, RPC message includes custom meta given by user.
-#define INCLUDE_META (0x1)
-
-// If set, RPC message (response) includes additional hints.
-#define INCLUDE_HINT (0x2)
-
-// If set, each log entry will contain timestamp.
-#define INCLUDE_LOG_TIMESTAMP (0x4)
-
-// If set, CRC number represents the entire message.
-#define CRC_ON_ENTIRE_MESSAGE (0x8)
-
-// If set, each log entry will contain a CRC on the payload.
-#define CRC_ON_PAYLOAD (0x10)
-
-// If set, RPC message (response) includes result code
-#define INCLUDE_RESULT_CODE (0x20)
-
-// If set, and
-//   - If it is used in a request (leader -> follower),
-//     the follower has been excluded from the quorum,
-//     determined by the leader (i.e., sender).
-//   - If it is used in a response (follower -> leader),
-//     the follower is marked down by itself.
-#define MARK_DOWN (0x40)
-
-// =======================
-
 namespace nuraft {
 
 static const size_t SSL_GRACE_PERIOD_MS = 500;
 static const size_t SEND_RETRY_MS       = 500;
 static const size_t SEND_RETRY_MAX      = 6;
+// Metrics endpoint closes connections not sending
+// a complete request within this time.
+static const size_t METRICS_READ_TIMEOUT_MS = 5000;
 
 asio_service::meta_cb_params req_to_params(req_msg* req, resp_msg* resp) {
     return asio_service::meta_cb_params
@@ -160,19 +103,54 @@ asio_service::meta_cb_params req_to_params(req_msg* req, resp_msg* resp) {
              resp );
 }
 
+// Parse `endpoint` in `[protocol://]host:port` format.
+static bool parse_endpoint(const std::string& endpoint,
+                           std::string& hostname_out,
+                           std::string& port_out)
+{
+    // NOTE:
+    //   Abandoned regular expression due to bug in GCC < 4.9.
+    //   And also support `endpoint` which doesn't start with `tcp://`.
+#if 0
+    // the endpoint is expecting to be protocol://host:port,
+    // and we only support tcp for this factory
+    // which is endpoint must be tcp://hostname:port
+    static std::regex reg("^tcp://(([a-zA-Z0-9\\-]+\\.)*([a-zA-Z0-9]+)):([0-9]+)$");
+    std::smatch mresults;
+    if (!std::regex_match(endpoint, mresults, reg) || mresults.size() != 5) {
+        return false;
+    }
+#endif
+    size_t pos = endpoint.rfind(":");
+    if (pos == std::string::npos) return false;
+    int port_num = std::stoi( endpoint.substr(pos + 1) );
+    if (!port_num) return false;
+    port_out = std::to_string( port_num );
+
+    size_t pos2 = endpoint.rfind("://", pos - 1);
+    hostname_out = (pos2 == std::string::npos)
+                   ? endpoint.substr(0, pos)
+                   : endpoint.substr(pos2 + 3, pos - pos2 - 3);
+
+    return !hostname_out.empty();
+}
+
 // === ASIO Abstraction ===
 //     (to switch SSL <-> unsecure on-the-fly)
 struct pending_req_pkg {
     pending_req_pkg(ptr<req_msg>& req,
                     rpc_handler& when_done,
-                    uint64_t timeout_ms = 0)
+                    uint64_t timeout_ms = 0,
+                    uint64_t stream_id = 0)
         : req_(req)
         , when_done_(when_done)
         , timeout_ms_(timeout_ms)
+        , stream_id_(stream_id)
         {}
     ptr<req_msg> req_;
     rpc_handler when_done_;
     uint64_t timeout_ms_;
+    uint64_t stream_id_;
 };
 
 class aa {
@@ -201,6 +179,8 @@ public:
 };
 
 // asio service implementation
+class asio_rpc_client;
+class asio_metrics_endpoint;
 class asio_service_impl {
 public:
     asio_service_impl(const asio_service::options& _opt = asio_service::options(),
@@ -216,6 +196,14 @@ public:
     }
     uint64_t assign_client_id() { return client_id_counter_.fetch_add(1); }
 
+    ptr<asio_rpc_client> get_mux_transport(const std::string& host,
+                                           const std::string& port,
+                                           ptr<logger>& l);
+
+    ptr<msg_handler> find_mux_group(uint64_t group_id);
+
+    ptr<msg_handler> find_any_mux_group();
+
 private:
 #ifndef SSL_LIBRARY_NOT_FOUND
     std::string get_password(std::size_t size,
@@ -224,6 +212,7 @@ private:
     void stop();
     void worker_entry();
     void timer_handler(ERROR_CODE err);
+    void timer_wheel_handler(ERROR_CODE err);
 
 private:
     std::unique_ptr<asio::io_service> io_svc_;
@@ -238,7 +227,42 @@ private:
     std::list< ptr<std::thread> > worker_handles_;
     asio_service::options my_opt_;
     asio::steady_timer asio_timer_;
+    std::unique_ptr<timer_wheel_scheduler> timer_wheel_;
+    asio::steady_timer timer_wheel_tick_;
+    std::atomic<bool> timer_wheel_running_;
     std::atomic<uint64_t> client_id_counter_;
+
+    /**
+     * Shared connections of multiplexed clients, <host:port, client>.
+     */
+    std::map< std::string, ptr<asio_rpc_client> > mux_transports_;
+
+    /**
+     * Lock for `mux_transports_`.
+     */
+    std::mutex mux_transports_lock_;
+
+    /**
+     * Local servers to which multiplexed requests are routed,
+     * <group ID, server>.
+     */
+    std::unordered_map< uint64_t, ptr<msg_handler> > mux_groups_;
+
+    /**
+     * Lock for `mux_groups_`.
+     */
+    std::mutex mux_groups_lock_;
+
+    /**
+     * HTTP endpoint serving metrics, if started.
+     */
+    ptr<asio_metrics_endpoint> metrics_endpoint_;
+
+    /**
+     * Lock for `metrics_endpoint_`.
+     */
+    std::mutex metrics_endpoint_lock_;
+
     ptr<logger> l_;
     friend asio_service;
 };
@@ -274,8 +298,11 @@ public:
         , src_id_(-1)
         , is_leader_(false)
         , cached_port_(0)
-        , crc_header_(0)
-        , crc_from_msg_(0)
+        , req_hdr_()
+        , num_omitted_resps_(0)
+        , appends_deferred_(false)
+        , multiplexed_(false)
+        , writing_stream_resp_(false)
     {
         p_tr("asio rpc session created: %p", this);
     }
@@ -378,27 +405,14 @@ public:
             //  due to async_read() above, header_ size will be always
             //  equal to or greater than RPC_REQ_HEADER_SIZE.
 
-            // Deprecate `buffer::get` and use `buffer_serializer`.
-
-            // header_->pos(0);
-            buffer_serializer h_bs(header_);
-            byte* header_data = header_->data_begin();
-            crc_header_ = crc32_8( header_data,
-                                   RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
-                                   0 );
-
-            // header_->pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN);
-            h_bs.pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN);
-            // uint64_t flags_and_crc = header_->get_ulong();
-            uint64_t flags_and_crc = h_bs.get_u64();
-            crc_from_msg_ = flags_and_crc & (uint32_t)0xffffffff;
-            flags_ = (flags_and_crc >> 32);
+            asio_rpc_codec::decode_req_header(*header_, req_hdr_);
+            flags_ = req_hdr_.flags_;
 
             // Verify CRC (if entire message validation is disbaled).
             if ( !(flags_ & CRC_ON_ENTIRE_MESSAGE) &&
-                 crc_header_ != crc_from_msg_ ) {
+                 req_hdr_.crc_header_ != req_hdr_.crc_from_msg_ ) {
                 p_er("header CRC mismatch: local calculation %x, from message %x",
-                     crc_header_, crc_from_msg_);
+                     req_hdr_.crc_header_, req_hdr_.crc_from_msg_);
 
                 if (impl_->get_options().corrupted_msg_handler_) {
                     impl_->get_options().corrupted_msg_handler_(header_, nullptr);
@@ -408,13 +422,9 @@ public:
                 return;
             }
 
-            // header_->pos(0);
-            // byte marker = header_->get_byte();
-            h_bs.pos(0);
-            byte marker = h_bs.get_u8();
-            if (marker != 0x0) {
+            if (req_hdr_.marker_ != 0x0) {
                 // Means that this is not RPC_REQ, shouldn't happen.
-                p_er("Wrong packet: expected REQ, got %u", marker);
+                p_er("Wrong packet: expected REQ, got %u", req_hdr_.marker_);
 
                 if (impl_->get_options().corrupted_msg_handler_) {
                     impl_->get_options().corrupted_msg_handler_(header_, nullptr);
@@ -424,9 +434,8 @@ public:
                 return;
             }
 
-            msg_type m_type = (msg_type)h_bs.get_u8();
-            if (!is_valid_msg(m_type)) {
-                p_er("Wrong message type: got %u", (uint8_t)m_type);
+            if (!is_valid_msg(req_hdr_.type_)) {
+                p_er("Wrong message type: got %u", (uint8_t)req_hdr_.type_);
 
                 if (impl_->get_options().corrupted_msg_handler_) {
                     impl_->get_options().corrupted_msg_handler_(header_, nullptr);
@@ -436,10 +445,7 @@ public:
                 return;
             }
 
-            // header_->pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN - DATA_SIZE_LEN);
-            // int32 data_size = header_->get_int();
-            h_bs.pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN - DATA_SIZE_LEN);
-            int32 data_size = h_bs.get_i32();
+            int32 data_size = req_hdr_.data_size_;
             // Up to 1GB.
             if (data_size < 0 || data_size > 0x40000000) {
                 p_er("bad log data size in the header %d, stop "
@@ -474,6 +480,7 @@ public:
     }
 
     void stop() {
+        flush_deferred_appends();
         invoke_connection_callback(false);
         close_socket();
         if (callback_) {
@@ -488,6 +495,11 @@ public:
 
 private:
     void invoke_connection_callback(bool is_open) {
+        if (!handler_) {
+            // Listener only for multiplexed requests.
+            return;
+        }
+
         if (is_leader_ && src_id_ != handler_->get_leader()) {
             // Leader has been changed without closing session.
             is_leader_ = false;
@@ -541,26 +553,14 @@ private:
         ptr<rpc_session> self = this->shared_from_this();
 
        try {
-        // Deprecate `buffer::get` and use `buffer_serializer`.
-        // hdr->pos(1);
-        // msg_type t = (msg_type)hdr->get_byte();
-        // int32 src = hdr->get_int();
-        // int32 dst = hdr->get_int();
-        // ulong term = hdr->get_ulong();
-        // ulong last_term = hdr->get_ulong();
-        // ulong last_idx = hdr->get_ulong();
-        // ulong commit_idx = hdr->get_ulong();
-
-        buffer_serializer h_bs(header_);
-        h_bs.pos(1);
-        msg_type t = (msg_type)h_bs.get_u8();
-        int32 src = h_bs.get_i32();
-        int32 dst = h_bs.get_i32();
-        ulong term = h_bs.get_u64();
-        ulong last_term = h_bs.get_u64();
-        ulong last_idx = h_bs.get_u64();
-        ulong commit_idx = h_bs.get_u64();
-        int32 log_data_size = h_bs.get_i32();
+        msg_type t = req_hdr_.type_;
+        int32 src = req_hdr_.src_;
+        int32 dst = req_hdr_.dst_;
+        ulong term = req_hdr_.term_;
+        ulong last_term = req_hdr_.last_log_term_;
+        ulong last_idx = req_hdr_.last_log_idx_;
+        ulong commit_idx = req_hdr_.commit_idx_;
+        int32 log_data_size = req_hdr_.data_size_;
 
         if (flags_ & CRC_ON_ENTIRE_MESSAGE) {
             // Calculate the CRC of `log_ctx`.
@@ -568,11 +568,11 @@ private:
                 log_ctx
                 ? crc32_8( log_ctx->data_begin(),
                            log_ctx->size(),
-                           crc_header_ )
-                : crc_header_;
-            if (crc_payload != crc_from_msg_) {
+                           req_hdr_.crc_header_ )
+                : req_hdr_.crc_header_;
+            if (crc_payload != req_hdr_.crc_from_msg_) {
                 p_er("request CRC mismatch: local calculation %x, from message %x",
-                     crc_payload, crc_from_msg_);
+                     crc_payload, req_hdr_.crc_from_msg_);
 
                 if (impl_->get_options().corrupted_msg_handler_) {
                     impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
@@ -583,7 +583,99 @@ private:
             }
         }
 
-        if (src_id_ == -1) {
+        // If the request came through a multiplexed connection,
+        // find the target server by its stream ID.
+        ptr<msg_handler> target = handler_;
+        size_t payload_pos = 0;
+        uint64_t stream_id = 0;
+        bool multiplexed = (flags_ & STREAM_ID);
+        if (multiplexed_ && !multiplexed) {
+            // Responses of the streams in progress would be mixed up.
+            p_er( "session %" PRIu64 " got a non-multiplexed request "
+                  "on a multiplexed connection, stop this session",
+                  session_id_ );
+            this->stop();
+            return;
+        }
+        if (multiplexed) {
+            if (!log_ctx || log_ctx->size() < sizeof(uint64_t)) {
+                p_er("stream ID is missing in the request, stop this session");
+
+                if (impl_->get_options().corrupted_msg_handler_) {
+                    impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
+                }
+
+                this->stop();
+                return;
+            }
+            buffer_serializer ss(log_ctx);
+            stream_id = ss.get_u64();
+            payload_pos = ss.pos();
+            multiplexed_ = true;
+
+            target = impl_->find_mux_group(stream_id);
+            if (!target) {
+                // Reject this request only, other streams sharing
+                // this connection should not be affected.
+                p_wn( "session %" PRIu64 " got a request from %d for "
+                      "unknown stream %" PRIu64 "",
+                      session_id_, src, stream_id );
+                ptr<req_msg> req = cs_new<req_msg>
+                                   ( term, t, src, dst,
+                                     last_term, last_idx, commit_idx );
+                ptr<resp_msg> resp = cs_new<resp_msg>(term, t, dst, src);
+                write_stream_resp(stream_id, req, resp, UNKNOWN_STREAM);
+                this->start(self);
+                return;
+            }
+
+        } else if ( !handler_ &&
+                    t == msg_type::liveness_check_request ) {
+            // Listener only for multiplexed requests. Any local member
+            // can answer for all members through their shared failure
+            // detector. Otherwise, this node is alive but cannot tell
+            // about any member.
+            ptr<req_msg> req = cs_new<req_msg>
+                               ( term, t, src, dst,
+                                 last_term, last_idx, commit_idx );
+            ptr<msg_handler> any_member = impl_->find_any_mux_group();
+            ptr<resp_msg> resp;
+            if (any_member && log_data_size > 0 && log_ctx) {
+                std::string meta_str;
+                std::string err_msg;
+                asio_rpc_codec::decode_result rc =
+                    asio_rpc_codec::decode_log_entries( *log_ctx,
+                                                        0,
+                                                        flags_,
+                                                        meta_str,
+                                                        req->log_entries(),
+                                                        err_msg );
+                if (rc == asio_rpc_codec::OK) {
+                    resp = raft_server_handler::process_req
+                           ( any_member.get(), *req );
+                }
+            }
+            if (!resp) {
+                resp = cs_new<resp_msg>
+                       ( term, msg_type::liveness_check_response,
+                         dst, src );
+                resp->accept(0);
+            }
+            on_resp_ready(req, resp);
+            return;
+
+        } else if (!handler_) {
+            p_er( "session %" PRIu64 " got a non-multiplexed request, "
+                  "but no handler is given", session_id_ );
+            this->stop();
+            return;
+        }
+
+        if (multiplexed) {
+            // Connection-level callbacks are not applicable,
+            // as multiple groups share this session.
+
+        } else if (src_id_ == -1) {
             // It means this is the first message on this session.
             // Invoke callback function of new connection.
             src_id_ = src;
@@ -594,7 +686,7 @@ private:
             is_leader_ = false;
         }
 
-        if (!is_leader_) {
+        if (!multiplexed && !is_leader_) {
             // If leader flag is not set, we identify whether the endpoint
             // server is leader based on the message type (only leader
             // can send below message types).
@@ -628,86 +720,33 @@ private:
             req->set_extra_flags(
                 req->get_extra_flags() | req_msg::EXCLUDED_FROM_THE_QUORUM);
         }
+        if (flags_ & QUIESCING) {
+            req->set_extra_flags(req->get_extra_flags() | req_msg::QUIESCE);
+        }
 
         if (log_data_size > 0 && log_ctx) {
-            buffer_serializer ss(log_ctx);
-            size_t log_ctx_size = log_ctx->size();
-
-            // If flag is set, read meta first.
-            if (flags_ & INCLUDE_META) {
-                size_t meta_len = 0;
-                const byte* meta_raw = (const byte*)ss.get_bytes(meta_len);
-                if (meta_len) {
-                    meta_str = std::string((const char*)meta_raw, meta_len);
-                }
-            }
-
-            size_t LOG_ENTRY_SIZE = 8 + 1 + 4;
-            if (flags_ & INCLUDE_LOG_TIMESTAMP) {
-                LOG_ENTRY_SIZE += 8;
-            }
-            if (flags_ & CRC_ON_PAYLOAD) {
-                LOG_ENTRY_SIZE += 5;
-            }
-
-            while (log_ctx_size > ss.pos()) {
-                if (log_ctx_size - ss.pos() < LOG_ENTRY_SIZE) {
-                    // Possibly corrupted packet. Stop here.
-                    p_wn("wrong log ctx size %zu pos %zu, stop this session",
-                         log_ctx_size, ss.pos());
-
-                    if (impl_->get_options().corrupted_msg_handler_) {
-                        impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
-                    }
-
-                    this->stop();
-                    return;
-                }
-                ulong term = ss.get_u64();
-                log_val_type val_type = (log_val_type)ss.get_u8();
-                uint64_t timestamp = (flags_ & INCLUDE_LOG_TIMESTAMP) ? ss.get_u64() : 0;
-                bool has_crc32 = (flags_ & CRC_ON_PAYLOAD) ? (ss.get_u8() != 0) : false;
-                uint32_t crc32 = (flags_ & CRC_ON_PAYLOAD) ? ss.get_u32() : 0;
-
-                size_t val_size = ss.get_i32();
-                if (log_ctx_size - ss.pos() < val_size) {
-                    // Out-of-bound size.
-                    p_wn("wrong value size %zu log ctx %zu %zu, "
-                         "stop this session",
-                         val_size, log_ctx_size, ss.pos());
-
-                    if (impl_->get_options().corrupted_msg_handler_) {
-                        impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
-                    }
-
-                    this->stop();
-                    return;
+            std::string err_msg;
+            asio_rpc_codec::decode_result rc =
+                asio_rpc_codec::decode_log_entries( *log_ctx,
+                                                    payload_pos,
+                                                    flags_,
+                                                    meta_str,
+                                                    req->log_entries(),
+                                                    err_msg );
+            if (rc != asio_rpc_codec::OK) {
+                if (rc == asio_rpc_codec::LOG_ENTRY_CRC_MISMATCH) {
+                    p_er("%s", err_msg.c_str());
+                } else {
+                    // Possibly corrupted packet.
+                    p_wn("%s, stop this session", err_msg.c_str());
                 }
 
-                ptr<buffer> buf( buffer::alloc(val_size) );
-                ss.get_buffer(buf);
-                ptr<log_entry> entry(
-                    cs_new<log_entry>(term, buf, val_type, timestamp, has_crc32, crc32, false) );
-
-                if ((flags_ & CRC_ON_PAYLOAD) && has_crc32) {
-                    // Verify CRC.
-                    uint32_t crc_payload = crc32_8( buf->data_begin(),
-                                                    buf->size(),
-                                                    0 );
-                    if (crc_payload != crc32) {
-                        p_er("log entry CRC mismatch: local calculation %x, "
-                             "from message %x", crc_payload, crc32);
-
-                        if (impl_->get_options().corrupted_msg_handler_) {
-                            impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
-                        }
-
-                        this->stop();
-                        return;
-                    }
+                if (impl_->get_options().corrupted_msg_handler_) {
+                    impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
                 }
 
-                req->log_entries().push_back(entry);
+                this->stop();
+                return;
             }
         }
 
@@ -723,8 +762,25 @@ private:
             }
         }
 
+        if (multiplexed) {
+            // Streams are processed independently of each other, so that
+            // a slow one does not block the others. Read the next request
+            // without waiting for this one.
+            dispatch_stream_req(stream_id, target, req);
+            this->start(self);
+            return;
+        }
+
+        if ( can_defer_append(req) &&
+             next_req_available() ) {
+            // The response will be held until the next request is processed,
+            // let the server defer the end of this append batch as well.
+            req->set_extra_flags(req->get_extra_flags() | req_msg::MORE_IN_STREAM);
+            appends_deferred_ = true;
+        }
+
         // === RAFT server processes the request here. ===
-        ptr<resp_msg> resp = raft_server_handler::process_req(handler_.get(), *req);
+        ptr<resp_msg> resp = raft_server_handler::process_req(target.get(), *req);
         if (!resp) {
             p_wn("no response is returned from raft message handler");
             this->stop();
@@ -767,15 +823,111 @@ private:
        }
     }
 
-    void on_resp_ready(ptr<req_msg> req, ptr<resp_msg> resp) {
+    // Accepted responses of `append_entries` can be coalesced, as the latest
+    // one (including its appendix and hint) supersedes the previous ones.
+    bool can_coalesce_resp(ptr<req_msg>& req,
+                           ptr<resp_msg>& resp,
+                           uint32_t extra_flags) {
+        return (flags_ & CUMULATIVE_ACK) &&
+               !extra_flags &&
+               !ssl_enabled_ &&
+               req->get_type() == msg_type::append_entries_request &&
+               resp->get_type() == msg_type::append_entries_response &&
+               resp->get_accepted() &&
+               !resp->get_extra_flags() &&
+               !impl_->get_options().write_resp_meta_;
+    }
+
+    // Same conditions as `can_coalesce_resp`, that can be checked
+    // before processing the request.
+    bool can_defer_append(ptr<req_msg>& req) {
+        return (flags_ & CUMULATIVE_ACK) &&
+               !ssl_enabled_ &&
+               req->get_type() == msg_type::append_entries_request &&
+               !req->log_entries().empty() &&
+               !impl_->get_options().write_resp_meta_;
+    }
+
+    void flush_deferred_appends() {
+        if (!appends_deferred_) return;
+        appends_deferred_ = false;
+        if (!handler_) return;
+        raft_server_handler::flush_deferred_appends(handler_.get());
+    }
+
+    bool next_req_available() {
+        // With SSL, the socket does not tell whether a complete record
+        // is ready, this is only for plain TCP.
+        ERROR_CODE ec;
+        size_t avail = socket_.available(ec);
+        return !ec && avail >= RPC_REQ_HEADER_SIZE;
+    }
+
+    void on_resp_ready(ptr<req_msg> req,
+                       ptr<resp_msg> resp,
+                       uint32_t extra_flags = 0x0) {
         ptr<rpc_session> self = this->shared_from_this();
 
        try {
+        std::vector< ptr<buffer> > bufs;
+        if (can_coalesce_resp(req, resp, extra_flags)) {
+            if (held_resp_ && held_resp_->get_term() == resp->get_term()) {
+                // The new response acknowledges the held one as well.
+                num_omitted_resps_++;
+            } else if (held_resp_) {
+                bufs.push_back( make_resp_buf( held_req_, held_resp_,
+                                               0x0, num_omitted_resps_ ) );
+                num_omitted_resps_ = 0;
+            }
+            held_req_ = req;
+            held_resp_ = resp;
+
+            const uint32_t MAX_OMITTED_RESPS = 64;
+            if ( bufs.empty() &&
+                 num_omitted_resps_ < MAX_OMITTED_RESPS &&
+                 next_req_available() ) {
+                // The next request has already arrived,
+                // hold this response and process the next one.
+                this->start(self);
+                return;
+            }
+        }
+
+        if (held_resp_) {
+            bufs.push_back( make_resp_buf( held_req_, held_resp_,
+                                           0x0, num_omitted_resps_ ) );
+            num_omitted_resps_ = 0;
+            bool is_held = (held_resp_ == resp);
+            held_req_.reset();
+            held_resp_.reset();
+            if (is_held) {
+                // Already included above.
+                write_resp_bufs(bufs);
+                return;
+            }
+        }
+        bufs.push_back( make_resp_buf(req, resp, extra_flags, 0) );
+        write_resp_bufs(bufs);
+
+       } catch (std::exception& ex) {
+        p_er( "session %" PRIu64 " failed to process request message "
+              "due to error: %s",
+              this->session_id_,
+              ex.what() );
+        this->stop();
+       }
+    }
+
+    ptr<buffer> make_resp_buf(ptr<req_msg>& req,
+                              ptr<resp_msg>& resp,
+                              uint32_t extra_flags,
+                              uint32_t num_omitted_resps,
+                              uint64_t stream_id = 0) {
         ptr<buffer> resp_ctx = resp->get_ctx();
         int32 resp_ctx_size = (resp_ctx) ? resp_ctx->size() : 0;
         int32 result_code_size = sizeof(int32_t);
 
-        uint32_t flags = 0x0;
+        uint32_t flags = extra_flags;
         size_t resp_meta_size = 0;
         std::string resp_meta_str;
         if (impl_->get_options().write_resp_meta_) {
@@ -801,8 +953,21 @@ private:
             flags |= MARK_DOWN;
         }
 
+        if (resp->get_extra_flags() & resp_msg::QUIESCED) {
+            flags |= QUIESCING;
+        }
+
         size_t carried_data_size = resp_meta_size + resp_hint_size + resp_ctx_size;
 
+        if (flags & STREAM_ID) {
+            carried_data_size += sizeof(uint64_t);
+        }
+
+        if (num_omitted_resps) {
+            flags |= CUMULATIVE_ACK;
+            carried_data_size += sizeof(uint32_t);
+        }
+
         if (req->get_type() == msg_type::client_request ||
             req->get_type() == msg_type::add_server_request ||
             req->get_type() == msg_type::remove_server_request) {
@@ -832,6 +997,12 @@ private:
         uint64_t flags_crc = ((uint64_t)flags << 32) | crc_val;
         bs.put_u64(flags_crc);
 
+        // Stream ID comes first, so that the client can find
+        // the request before parsing the rest.
+        if (flags & STREAM_ID) {
+            bs.put_u64(stream_id);
+        }
+
         // Handling meta if the flag is set.
         if (flags & INCLUDE_META) {
             bs.put_str(resp_meta_str);
@@ -854,6 +1025,28 @@ private:
             bs.put_i32(resp->get_result_code());
         }
 
+        if (flags & CUMULATIVE_ACK) {
+            bs.put_u32(num_omitted_resps);
+        }
+        return resp_buf;
+    }
+
+    void write_resp_bufs(std::vector< ptr<buffer> >& bufs) {
+        ptr<rpc_session> self = this->shared_from_this();
+        // Logs should be durable before they are acknowledged.
+        flush_deferred_appends();
+
+        ptr<buffer> resp_buf = bufs[0];
+        if (bufs.size() > 1) {
+            size_t total_size = 0;
+            for (ptr<buffer>& bb: bufs) total_size += bb->size();
+            resp_buf = buffer::alloc(total_size);
+            buffer_serializer bs(resp_buf);
+            for (ptr<buffer>& bb: bufs) {
+                bs.put_raw(bb->data_begin(), bb->size());
+            }
+        }
+
         aa::write( ssl_enabled_, ssl_socket_, socket_,
                    asio::buffer(resp_buf->data_begin(), resp_buf->size()),
                    [this, self, resp_buf]
@@ -871,17 +1064,152 @@ private:
                 this->stop();
             }
         } );
+    }
+
+    // Queue the request to its stream, and start processing the stream
+    // if it is idle. Requests of the same stream are processed in order.
+    void dispatch_stream_req(uint64_t stream_id,
+                             ptr<msg_handler>& target,
+                             ptr<req_msg>& req) {
+        {   std::lock_guard<std::mutex> l(streams_lock_);
+            std::list<stream_req>& reqs = streams_[stream_id];
+            reqs.push_back( stream_req{target, req} );
+            if (reqs.size() > 1) {
+                // The one at the front is being processed.
+                return;
+            }
+        }
+        post_stream_req(stream_id);
+    }
+
+    void post_stream_req(uint64_t stream_id) {
+        ptr<rpc_session> self = this->shared_from_this();
+        asio::post( impl_->get_io_svc(),
+                    [this, self, stream_id]() {
+                        process_stream_req(stream_id);
+                    } );
+    }
+
+    // Process the request at the front of the given stream.
+    void process_stream_req(uint64_t stream_id) {
+        ptr<rpc_session> self = this->shared_from_this();
+        stream_req sr;
+        {   std::lock_guard<std::mutex> l(streams_lock_);
+            auto entry = streams_.find(stream_id);
+            if (entry == streams_.end() || entry->second.empty()) return;
+            sr = entry->second.front();
+        }
+
+       try {
+        ptr<resp_msg> resp =
+            raft_server_handler::process_req(sr.target_.get(), *sr.req_);
+        if (!resp) {
+            p_wn("no response is returned from raft message handler");
+            this->stop();
+            return;
+        }
+
+        if (resp->has_async_cb()) {
+            // The next request of this stream waits for this response,
+            // to keep the order of responses.
+            ptr< cmd_result< ptr<buffer> > > ret = resp->call_async_cb();
+            ptr<req_msg> req = sr.req_;
+            ret->when_ready(
+                [this, self, stream_id, req, resp]
+                ( cmd_result<ptr<buffer>, ptr<std::exception>>& res,
+                  ptr<std::exception>& exp ) {
+                    resp->set_ctx(res.get());
+                    write_stream_resp(stream_id, req, resp);
+                    // This is needed to avoid circular reference.
+                    res.reset();
+                    next_stream_req(stream_id);
+                }
+            );
+            return;
+        }
+
+        if (resp->has_cb()) {
+            resp = resp->call_cb(resp);
+        }
+        write_stream_resp(stream_id, sr.req_, resp);
+        next_stream_req(stream_id);
 
        } catch (std::exception& ex) {
         p_er( "session %" PRIu64 " failed to process request message "
-              "due to error: %s",
+              "of stream %" PRIu64 " due to error: %s",
               this->session_id_,
+              stream_id,
               ex.what() );
         this->stop();
        }
     }
 
+    // Retire the request at the front of the given stream,
+    // and process the next one if any.
+    void next_stream_req(uint64_t stream_id) {
+        {   std::lock_guard<std::mutex> l(streams_lock_);
+            auto entry = streams_.find(stream_id);
+            if (entry == streams_.end()) return;
+            if (!entry->second.empty()) entry->second.pop_front();
+            if (entry->second.empty()) {
+                streams_.erase(entry);
+                return;
+            }
+        }
+        post_stream_req(stream_id);
+    }
+
+    // Responses of multiplexed requests are written in the order they
+    // are ready, regardless of the order of their requests.
+    void write_stream_resp(uint64_t stream_id,
+                           ptr<req_msg> req,
+                           ptr<resp_msg> resp,
+                           uint32_t extra_flags = 0x0) {
+        ptr<buffer> resp_buf =
+            make_resp_buf(req, resp, STREAM_ID | extra_flags, 0, stream_id);
+        {   std::lock_guard<std::mutex> l(stream_resps_lock_);
+            stream_resps_.push_back(resp_buf);
+            if (writing_stream_resp_) return;
+            writing_stream_resp_ = true;
+        }
+        write_next_stream_resp(resp_buf);
+    }
+
+    void write_next_stream_resp(ptr<buffer> resp_buf) {
+        ptr<rpc_session> self = this->shared_from_this();
+        aa::write( ssl_enabled_, ssl_socket_, socket_,
+                   asio::buffer(resp_buf->data_begin(), resp_buf->size()),
+                   [this, self, resp_buf]
+                   (ERROR_CODE err_code, size_t) -> void
+        {
+            if (err_code) {
+                p_er( "session %" PRIu64 " failed to send response to peer due "
+                      "to error %d",
+                      session_id_,
+                      err_code.value() );
+                this->stop();
+                return;
+            }
+
+            ptr<buffer> next_buf;
+            {   std::lock_guard<std::mutex> l(stream_resps_lock_);
+                stream_resps_.pop_front();
+                if (stream_resps_.empty()) {
+                    writing_stream_resp_ = false;
+                    return;
+                }
+                next_buf = stream_resps_.front();
+            }
+            write_next_stream_resp(next_buf);
+        } );
+    }
+
 private:
+    struct stream_req {
+        ptr<msg_handler> target_;
+        ptr<req_msg> req_;
+    };
+
     uint64_t session_id_;
     asio_service_impl* impl_;
     ptr<msg_handler> handler_;
@@ -912,14 +1240,61 @@ private:
     uint32_t cached_port_;
 
     /**
-     * Locally calculated CRC number of the request header.
+     * Header of the request being read, including the CRC number
+     * from the message and the one calculated locally.
+     */
+    asio_rpc_codec::req_header req_hdr_;
+
+    /**
+     * The latest response not sent yet, to be coalesced with
+     * the responses of the following requests.
+     */
+    ptr<req_msg> held_req_;
+    ptr<resp_msg> held_resp_;
+
+    /**
+     * Number of responses omitted before `held_resp_`.
+     */
+    uint32_t num_omitted_resps_;
+
+    /**
+     * `true` if any request has been processed with `MORE_IN_STREAM`
+     * flag, since the last response was written.
+     */
+    bool appends_deferred_;
+
+    /**
+     * `true` if this session has received a multiplexed request.
+     * Then it keeps reading requests while they are being processed.
      */
-    uint32_t crc_header_;
+    bool multiplexed_;
 
     /**
-     * CRC number from the request header.
+     * Requests of each stream, in multiplexed mode. The one at the front
+     * is being processed, and a stream is removed once it is empty.
      */
-    uint32_t crc_from_msg_;
+    std::map< uint64_t, std::list<stream_req> > streams_;
+
+    /**
+     * Lock for `streams_`.
+     */
+    std::mutex streams_lock_;
+
+    /**
+     * Responses waiting to be written, in multiplexed mode.
+     * The one at the front is being written.
+     */
+    std::list< ptr<buffer> > stream_resps_;
+
+    /**
+     * `true` if a response in `stream_resps_` is being written.
+     */
+    bool writing_stream_resp_;
+
+    /**
+     * Lock for `stream_resps_` and `writing_stream_resp_`.
+     */
+    std::mutex stream_resps_lock_;
 };
 
 // rpc listener implementation
@@ -1058,6 +1433,152 @@ private:
     ptr<logger> l_;
 };
 
+// Plain HTTP endpoint serving metrics, one request per connection.
+class asio_metrics_endpoint
+    : public std::enable_shared_from_this<asio_metrics_endpoint>
+{
+public:
+    asio_metrics_endpoint( asio::io_service& io,
+                           const std::string& bind_address,
+                           ushort port,
+                           const std::function<std::string()>& renderer,
+                           ptr<logger>& l )
+        : io_svc_(io)
+        , acceptor_( io,
+                     asio::ip::tcp::endpoint
+                         ( asio::ip::make_address(bind_address), port ) )
+        , renderer_(renderer)
+        , stopped_(false)
+        , l_(l)
+    {
+        p_in("metrics endpoint initiated, address %s, port %u",
+             bind_address.c_str(), port);
+    }
+
+    __nocopy__(asio_metrics_endpoint);
+
+public:
+    void start() {
+        std::lock_guard<std::mutex> guard(lock_);
+        accept(guard);
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> guard(lock_);
+        stopped_ = true;
+        acceptor_.close();
+    }
+
+private:
+    // Requests larger than this are dropped.
+    static const size_t MAX_REQUEST_SIZE = 8192;
+
+    struct connection {
+        connection(asio::io_service& io)
+            : socket_(io)
+            , buf_(MAX_REQUEST_SIZE)
+            , read_timer_(io)
+            {}
+        asio::ip::tcp::socket socket_;
+        asio::streambuf buf_;
+        asio::steady_timer read_timer_;
+        std::string resp_;
+    };
+
+    void accept(std::lock_guard<std::mutex>& guard) {
+        if (stopped_ || !acceptor_.is_open()) return;
+
+        ptr<asio_metrics_endpoint> self = this->shared_from_this();
+        ptr<connection> conn = cs_new<connection>(io_svc_);
+        acceptor_.async_accept( conn->socket_,
+                                std::bind( &asio_metrics_endpoint::handle_accept,
+                                           this,
+                                           self,
+                                           conn,
+                                           std::placeholders::_1 ) );
+    }
+
+    void handle_accept(ptr<asio_metrics_endpoint> self,
+                       ptr<connection> conn,
+                       const ERROR_CODE& err)
+    {
+        if (!err) {
+            conn->read_timer_.expires_after
+                   ( std::chrono::duration_cast<std::chrono::nanoseconds>
+                     ( std::chrono::milliseconds( METRICS_READ_TIMEOUT_MS ) ) );
+            conn->read_timer_.async_wait( [self, conn](const ERROR_CODE& err) {
+                if (err) return;
+                // Not cancelled by `handle_read`, it aborts the read.
+                ERROR_CODE ignored;
+                conn->socket_.close(ignored);
+            } );
+            asio::async_read_until( conn->socket_, conn->buf_, "\r\n\r\n",
+                                    std::bind( &asio_metrics_endpoint::handle_read,
+                                               this,
+                                               self,
+                                               conn,
+                                               std::placeholders::_1,
+                                               std::placeholders::_2 ) );
+        } else {
+            p_db("metrics endpoint failed to accept: %s", err.message().c_str());
+        }
+
+        std::lock_guard<std::mutex> guard(lock_);
+        accept(guard);
+    }
+
+    void handle_read(ptr<asio_metrics_endpoint> self,
+                     ptr<connection> conn,
+                     const ERROR_CODE& err,
+                     size_t bytes_read)
+    {
+        conn->read_timer_.cancel();
+        if (err) {
+            p_db("metrics endpoint failed to read: %s", err.message().c_str());
+            return;
+        }
+
+        // Request line, e.g., "GET /metrics HTTP/1.1".
+        std::istream is(&conn->buf_);
+        std::string method, target;
+        is >> method >> target;
+        target = target.substr(0, target.find('?'));
+
+        std::string status = "200 OK";
+        std::string content_type = stat_exporter::CONTENT_TYPE;
+        std::string body;
+        if (method != "GET") {
+            status = "405 Method Not Allowed";
+        } else if (target != "/metrics") {
+            status = "404 Not Found";
+        } else {
+            body = renderer_();
+        }
+        if (body.empty()) content_type = "text/plain; charset=utf-8";
+
+        conn->resp_ =
+            "HTTP/1.1 " + status + "\r\n"
+            "Content-Type: " + content_type + "\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            "Connection: close\r\n\r\n" + body;
+        asio::async_write( conn->socket_,
+                           asio::buffer(conn->resp_),
+                           [self, conn](const ERROR_CODE&, size_t) {
+                               ERROR_CODE ignored;
+                               conn->socket_.shutdown
+                                   (asio::ip::tcp::socket::shutdown_both, ignored);
+                               conn->socket_.close(ignored);
+                           } );
+    }
+
+    asio::io_service& io_svc_;
+    std::mutex lock_;
+    asio::ip::tcp::acceptor acceptor_;
+    std::function<std::string()> renderer_;
+    bool stopped_;
+    ptr<logger> l_;
+};
+
 class asio_rpc_client
     : public rpc_client
     , public std::enable_shared_from_this<asio_rpc_client>
@@ -1069,7 +1590,8 @@ public:
                     std::string& host,
                     std::string& port,
                     bool ssl_enabled,
-                    ptr<logger> l)
+                    ptr<logger> l,
+                    bool multiplexed = false)
         : impl_(_impl)
         , resolver_(io_svc)
         , socket_(io_svc)
@@ -1082,8 +1604,10 @@ public:
         , num_send_fails_(0)
         , abandoned_(false)
         , socket_busy_(false)
+        , multiplexed_(multiplexed)
         , operation_timer_(io_svc)
         , l_(l)
+        , last_stream_id_(0)
     {
         client_id_ = impl_->assign_client_id();
         if (ssl_enabled_) {
@@ -1120,6 +1644,14 @@ public:
         return abandoned_;
     }
 
+    /**
+     * `true` if requests are pipelined, i.e., sent without waiting for
+     * the response of the previous one.
+     */
+    bool is_pipelined() const {
+        return multiplexed_ || impl_->get_options().streaming_mode_;
+    }
+
 #ifndef SSL_LIBRARY_NOT_FOUND
     bool verify_certificate(bool preverified,
                             asio::ssl::verify_context& ctx)
@@ -1169,13 +1701,26 @@ public:
                       rpc_handler& when_done,
                       uint64_t send_timeout_ms = 0) __override__
     {
-        if (impl_->get_options().streaming_mode_) {
+        if (is_pipelined()) {
             pre_send(req, when_done, send_timeout_ms);
         } else {
             register_req_send(req, when_done, send_timeout_ms);
         }
     }
 
+    /**
+     * Send a request of the given stream through this (multiplexed)
+     * connection. Requests of the same stream are sent and responded
+     * in order, and streams are scheduled in round-robin manner.
+     */
+    void send_stream(uint64_t stream_id,
+                     ptr<req_msg>& req,
+                     rpc_handler& when_done,
+                     uint64_t send_timeout_ms = 0)
+    {
+        pre_send(req, when_done, send_timeout_ms, stream_id);
+    }
+
     void handle_error(ptr<req_msg> req,
                       std::string& err_msg,
                       rpc_handler when_done) {
@@ -1184,7 +1729,7 @@ public:
         // In streaming mode, all `when_done` will be invoked in `close_socket()`.
         // Otherwise, `close_socket()` will do nothing, hence `when_done`
         // should directly be invoked here.
-        if (!impl_->get_options().streaming_mode_) {
+        if (!is_pipelined()) {
             ptr<resp_msg> resp;
             ptr<rpc_exception> except(cs_new<rpc_exception>(err_msg, req));
             when_done(resp, except);
@@ -1193,21 +1738,37 @@ public:
 
     void pre_send(ptr<req_msg>& req,
                   rpc_handler& when_done,
-                  uint64_t send_timeout_ms) {
-        bool immediate_action_needed = false;
+                  uint64_t send_timeout_ms,
+                  uint64_t stream_id = 0) {
+        ptr<pending_req_pkg> pkg =
+            cs_new<pending_req_pkg>(req, when_done, send_timeout_ms, stream_id);
+        ptr<pending_req_pkg> next_req_pkg{nullptr};
         {
             auto_lock(pending_write_reqs_lock_);
-            pending_write_reqs_.push_back(
-                cs_new<pending_req_pkg>(req, when_done, send_timeout_ms));
-            immediate_action_needed = (pending_write_reqs_.size() == 1);
+            if (multiplexed_) {
+                // Queue it to its own stream, the next request to write
+                // will be chosen among streams when the current write is done.
+                stream_write_reqs_[stream_id].push_back(pkg);
+                if (pending_write_reqs_.empty()) {
+                    next_req_pkg = pop_next_stream_req();
+                    pending_write_reqs_.push_back(next_req_pkg);
+                }
+            } else {
+                pending_write_reqs_.push_back(pkg);
+                if (pending_write_reqs_.size() == 1) {
+                    next_req_pkg = pkg;
+                }
+            }
             p_db("start to send msg to peer %d, start_log_idx: %" PRIu64 ", "
                  "size: %" PRIu64 ", pending write reqs: %" PRIu64 "",
                  req->get_dst(), req->get_last_log_idx(),
                  req->log_entries().size(), pending_write_reqs_.size());
         }
 
-        if (immediate_action_needed) {
-            register_req_send(req, when_done, send_timeout_ms);
+        if (next_req_pkg) {
+            register_req_send(next_req_pkg->req_,
+                              next_req_pkg->when_done_,
+                              next_req_pkg->timeout_ms_);
         }
     }
 
@@ -1325,133 +1886,59 @@ public:
         // Reset the counter.
         num_send_fails_ = 0;
 
-        // serialize req, send and read response
-        std::vector<ptr<buffer>> log_entry_bufs;
-        int32 log_data_size(0);
+        uint64_t stream_id = 0;
+        if (multiplexed_) {
+            if (!begin_stream_req(req, stream_id)) {
+                // Write queue has been cleared by `close_socket()`,
+                // `when_done` was already invoked there.
+                p_wn("request to peer %d is not in the write queue, "
+                     "connection to %s:%s may be closed",
+                     req->get_dst(), host_.c_str(), port_.c_str());
+                return;
+            }
+        }
 
+        // serialize req, send and read response
         uint32_t flags = 0x0;
-        size_t LOG_ENTRY_SIZE = 8 + 1 + 4;
         if (impl_->get_options().replicate_log_timestamp_) {
-            LOG_ENTRY_SIZE += 8;
             flags |= INCLUDE_LOG_TIMESTAMP;
         }
         if (impl_->get_options().crc_on_payload_) {
-            LOG_ENTRY_SIZE += 5;
             flags |= CRC_ON_PAYLOAD;
         }
+        if (impl_->get_options().crc_on_entire_message_) {
+            flags |= CRC_ON_ENTIRE_MESSAGE;
+        }
 
         if (req->get_extra_flags() & req_msg::EXCLUDED_FROM_THE_QUORUM) {
             // If the request is excluded from the quorum, set the flag.
             flags |= MARK_DOWN;
         }
 
-        for (auto& entry: req->log_entries()) {
-            ptr<log_entry>& le = entry;
-            ptr<buffer> entry_buf = buffer::alloc
-                                    ( LOG_ENTRY_SIZE + le->get_buf().size() );
-#if 0
-            entry_buf->put( le->get_term() );
-            entry_buf->put( (byte)le->get_val_type() );
-            entry_buf->put( (int32)le->get_buf().size() );
-            le->get_buf().pos(0);
-            entry_buf->put( le->get_buf() );
-            entry_buf->pos( 0 );
-#else
-            buffer_serializer ss(entry_buf);
-            ss.put_u64( le->get_term() );
-            ss.put_u8( le->get_val_type() );
-            if (impl_->get_options().replicate_log_timestamp_) {
-                ss.put_u64( le->get_timestamp() );
-            }
-            if (impl_->get_options().crc_on_payload_) {
-                ss.put_u8(le->has_crc32() ? 1 : 0);
-                ss.put_u32(le->get_crc32());
-            }
-            ss.put_i32( le->get_buf().size() );
-            ss.put_raw( le->get_buf().data_begin(), le->get_buf().size() );
-#endif
-            log_entry_bufs.push_back(entry_buf);
-            log_data_size += (int32)entry_buf->size();
+        if (req->get_extra_flags() & req_msg::QUIESCE) {
+            flags |= QUIESCING;
+        }
+
+        if (multiplexed_) {
+            flags |= STREAM_ID;
+        }
+
+        if ( impl_->get_options().streaming_cumulative_ack_ &&
+             impl_->get_options().streaming_mode_ &&
+             !multiplexed_ &&
+             req->get_type() == msg_type::append_entries_request ) {
+            flags |= CUMULATIVE_ACK;
         }
 
-        size_t meta_size = 0;
         std::string meta_str;
         if (impl_->get_options().write_req_meta_) {
+            // If the meta is not empty, `INCLUDE_META` flag will be set.
             meta_str = impl_->get_options().write_req_meta_
                        ( req_to_params(req.get(), nullptr) );
-            if (!meta_str.empty()) {
-                // If callback for meta is given, set flag.
-                flags |= INCLUDE_META;
-                meta_size = sizeof(int32) + meta_str.size();
-            }
         }
 
         ptr<buffer> req_buf =
-            buffer::alloc(RPC_REQ_HEADER_SIZE + meta_size + log_data_size);
-
-        // Deprecate `buffer::put` and use `buffer_serializer`.
-
-        // req_buf->pos(0);
-        // byte* req_buf_data = req_buf->data();
-
-        // byte marker = 0x0;
-        // req_buf->put(marker);
-        // req_buf->put((byte)req->get_type());
-        // req_buf->put(req->get_src());
-        // req_buf->put(req->get_dst());
-        // req_buf->put(req->get_term());
-        // req_buf->put(req->get_last_log_term());
-        // req_buf->put(req->get_last_log_idx());
-        // req_buf->put(req->get_commit_idx());
-        // req_buf->put((int32)meta_size + log_data_size);
-
-        buffer_serializer req_buf_bs(req_buf);
-        req_buf_bs.put_u8(0x0);
-        req_buf_bs.put_u8((byte)req->get_type());
-        req_buf_bs.put_i32(req->get_src());
-        req_buf_bs.put_i32(req->get_dst());
-        req_buf_bs.put_u64(req->get_term());
-        req_buf_bs.put_u64(req->get_last_log_term());
-        req_buf_bs.put_u64(req->get_last_log_idx());
-        req_buf_bs.put_u64(req->get_commit_idx());
-        req_buf_bs.put_i32((int32)meta_size + log_data_size);
-
-        // Calculate CRC32 on header-only.
-        uint32_t crc_header = crc32_8( req_buf->data_begin(),
-                                       RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
-                                       0 );
-
-        uint64_t flags_and_crc = ((uint64_t)flags << 32) | crc_header;
-        // req_buf->put((ulong)flags_and_crc);
-        size_t crc_pos = req_buf_bs.pos();
-        req_buf_bs.put_u64(flags_and_crc);
-
-        // From now on, it will contain the payload (== meta + log entries).
-        // byte* req_buf_payload = req_buf->data();
-        size_t payload_pos = req_buf_bs.pos();
-
-        // Handling meta if the flag is set.
-        if (flags & INCLUDE_META) {
-            // req_buf->put( (byte*)meta_str.data(), meta_str.size() );
-            req_buf_bs.put_bytes( (byte*)meta_str.data(), meta_str.size() );
-        }
-
-        for (auto& it: log_entry_bufs) {
-            // req_buf->put(*(it));
-            req_buf_bs.put_buffer(*(it));
-        }
-        // req_buf->pos(0);
-
-        if (impl_->get_options().crc_on_entire_message_) {
-            uint32_t crc_payload = crc32_8( req_buf->data_begin() + payload_pos,
-                                            meta_size + log_data_size,
-                                            crc_header );
-            // Overwrite CRC field.
-            flags |= CRC_ON_ENTIRE_MESSAGE;
-            flags_and_crc = ((uint64_t)flags << 32) | crc_payload;
-            req_buf_bs.pos(crc_pos);
-            req_buf_bs.put_u64(flags_and_crc);
-        }
+            asio_rpc_codec::encode_req(*req, flags, stream_id, meta_str);
 
         if (send_timeout_ms != 0)
         {
@@ -1474,6 +1961,7 @@ public:
                               req,
                               req_buf,
                               when_done,
+                              stream_id,
                               std::placeholders::_1,
                               std::placeholders::_2 ) );
     }
@@ -1526,7 +2014,7 @@ private:
     }
 
     void set_busy_flag(bool to) {
-        if (impl_->get_options().streaming_mode_) {
+        if (is_pipelined()) {
             return;
         }
 
@@ -1563,7 +2051,7 @@ private:
             }
         }
 #endif
-        if (!impl_->get_options().streaming_mode_) {
+        if (!is_pipelined()) {
             return;
         }
 
@@ -1572,8 +2060,86 @@ private:
 
         // clear write queue and read queue here
         // from oldest to latest, read queue first
-        cancel_pending_requests(pending_read_reqs_, pending_read_reqs_lock_, err_msg);
+        if (multiplexed_) {
+            // The request being written is in both queues,
+            // see `begin_stream_req()`.
+            std::list<ptr<pending_req_pkg>> reading;
+            {   auto_lock(pending_read_reqs_lock_);
+                reading = std::move(pending_read_reqs_);
+            }
+            {   auto_lock(pending_write_reqs_lock_);
+                for (ptr<pending_req_pkg>& pkg: reading) {
+                    pending_write_reqs_.remove(pkg);
+                }
+            }
+            cancel_pending_requests(reading, pending_read_reqs_lock_, err_msg);
+        } else {
+            cancel_pending_requests(pending_read_reqs_, pending_read_reqs_lock_, err_msg);
+        }
         cancel_pending_requests(pending_write_reqs_, pending_write_reqs_lock_, err_msg);
+
+        if (multiplexed_) {
+            // Then requests not yet scheduled.
+            std::list<ptr<pending_req_pkg>> queued_reqs;
+            {
+                auto_lock(pending_write_reqs_lock_);
+                ptr<pending_req_pkg> pkg = pop_next_stream_req();
+                while (pkg) {
+                    queued_reqs.push_back(pkg);
+                    pkg = pop_next_stream_req();
+                }
+            }
+            cancel_pending_requests(queued_reqs, pending_write_reqs_lock_, err_msg);
+        }
+    }
+
+    bool begin_stream_req(ptr<req_msg>& req, uint64_t& stream_id_out) {
+        ptr<pending_req_pkg> pkg;
+        {   auto_lock(pending_write_reqs_lock_);
+            // The request being written is always at the head of the queue.
+            if ( pending_write_reqs_.empty() ||
+                 pending_write_reqs_.front()->req_ != req ) {
+                return false;
+            }
+            pkg = pending_write_reqs_.front();
+        }
+        stream_id_out = pkg->stream_id_;
+
+        // Wait for its response before the write starts. Once written,
+        // the response of a fast stream may arrive before `sent()` is
+        // invoked, and it should find its request.
+        bool immediate_action_needed = false;
+        {   auto_lock(pending_read_reqs_lock_);
+            pending_read_reqs_.push_back(pkg);
+            immediate_action_needed = (pending_read_reqs_.size() == 1);
+        }
+        if (immediate_action_needed) {
+            register_response_read(pkg->req_, pkg->when_done_);
+        }
+        return true;
+    }
+
+    /**
+     * Pick the next request to write, from the stream next to
+     * the last one served, so that a busy stream cannot starve others.
+     * Should be called under `pending_write_reqs_lock_`.
+     */
+    ptr<pending_req_pkg> pop_next_stream_req() {
+        if (stream_write_reqs_.empty()) {
+            return nullptr;
+        }
+
+        auto entry = stream_write_reqs_.upper_bound(last_stream_id_);
+        if (entry == stream_write_reqs_.end()) {
+            entry = stream_write_reqs_.begin();
+        }
+        ptr<pending_req_pkg> pkg = entry->second.front();
+        entry->second.pop_front();
+        last_stream_id_ = entry->first;
+        if (entry->second.empty()) {
+            stream_write_reqs_.erase(entry);
+        }
+        return pkg;
     }
 
     void cancel_pending_requests(std::list<ptr<pending_req_pkg>>& reqs_list,
@@ -1681,14 +2247,15 @@ private:
     void sent( ptr<req_msg>& req,
                ptr<buffer>& buf,
                rpc_handler& when_done,
+               uint64_t stream_id,
                std::error_code err,
                size_t bytes_transferred )
     {
         // Now we can safely free the `req_buf`.
         (void)buf;
         if (!err) {
-            if (impl_->get_options().streaming_mode_) {
-                post_send(req, when_done);
+            if (is_pipelined()) {
+                post_send(req, when_done, stream_id);
             } else {
                 register_response_read(req, when_done);
             }
@@ -1754,21 +2321,37 @@ private:
               ( term, (msg_type)msg_type_val, src, dst,
                 nxt_idx, accepted_val == 1 ) );
 
-        if ( !(flags & INCLUDE_META) &&
+        if (flags & MARK_DOWN) {
+            // Mark down flag is set in the response.
+            rsp->set_extra_flags(rsp->get_extra_flags() | resp_msg::SELF_MARK_DOWN);
+        }
+
+        if (flags & QUIESCING) {
+            rsp->set_extra_flags(rsp->get_extra_flags() | resp_msg::QUIESCED);
+        }
+
+        if ( multiplexed_ &&
+             ( !(flags & STREAM_ID) ||
+               carried_data_size < (int32)sizeof(uint64_t) ) ) {
+            std::string err_msg = sstrfmt( "stream ID is missing in response "
+                                           "from %s:%s" )
+                                           .fmt( host_.c_str(), port_.c_str() );
+            handle_error(req, err_msg, when_done);
+            return;
+        }
+
+        if ( !multiplexed_ &&
+             !(flags & INCLUDE_META) &&
              impl_->get_options().read_resp_meta_ &&
              impl_->get_options().invoke_resp_cb_on_empty_meta_ ) {
             // If callback is given, but meta is empty, and
             // the "always invoke" flag is set, invoke it.
+            // In multiplexed mode, it is done once the request is found.
             bool meta_ok = handle_custom_resp_meta
                            ( req, rsp, when_done, std::string() );
             if (!meta_ok) return;
         }
 
-        if (flags & MARK_DOWN) {
-            // Mark down flag is set in the response.
-            rsp->set_extra_flags(rsp->get_extra_flags() | resp_msg::SELF_MARK_DOWN);
-        }
-
         if (carried_data_size) {
             ptr<buffer> ctx_buf = buffer::alloc(carried_data_size);
             aa::read( ssl_enabled_, ssl_socket_, socket_,
@@ -1798,26 +2381,83 @@ private:
                   uint32_t flags,
                   std::error_code err,
                   size_t bytes_transferred)
+    {
+        if (!(flags & STREAM_ID)) {
+            process_resp_ctx(req, rsp, when_done, ctx_buf, 0, flags, nullptr);
+            return;
+        }
+
+        // Multiplexed: responses of a stream are in order,
+        // but streams are not in order with each other.
+        buffer_serializer ss(ctx_buf);
+        uint64_t stream_id = ss.get_u64();
+        ptr<pending_req_pkg> pkg = find_stream_req(stream_id);
+        if (!pkg) {
+            std::string err_msg = sstrfmt( "got a response of stream %" PRIu64
+                                           " without request from %s:%s" )
+                                           .fmt( stream_id, host_.c_str(),
+                                                 port_.c_str() );
+            handle_error(req, err_msg, when_done);
+            return;
+        }
+
+        if (flags & UNKNOWN_STREAM) {
+            handle_unknown_stream(pkg->req_, pkg->when_done_, pkg);
+            return;
+        }
+
+        if ( !(flags & INCLUDE_META) &&
+             impl_->get_options().read_resp_meta_ &&
+             impl_->get_options().invoke_resp_cb_on_empty_meta_ ) {
+            bool meta_ok = handle_custom_resp_meta
+                           ( pkg->req_, rsp, pkg->when_done_, std::string() );
+            if (!meta_ok) return;
+        }
+
+        process_resp_ctx( pkg->req_, rsp, pkg->when_done_,
+                          ctx_buf, ss.pos(), flags, pkg );
+    }
+
+    // Parse the carried data of the response from `ctx_pos`,
+    // and pass the response to `when_done`. `done_pkg` is the request
+    // matched by stream ID, `nullptr` if not multiplexed.
+    void process_resp_ctx(ptr<req_msg>& req,
+                          ptr<resp_msg>& rsp,
+                          rpc_handler& when_done,
+                          ptr<buffer>& ctx_buf,
+                          size_t ctx_pos,
+                          uint32_t flags,
+                          ptr<pending_req_pkg> done_pkg)
     {
         if ( !(flags & INCLUDE_META) &&
              !(flags & INCLUDE_HINT) &&
-	     !(flags & INCLUDE_RESULT_CODE)) {
+             !(flags & INCLUDE_RESULT_CODE) &&
+             !(flags & CUMULATIVE_ACK) ) {
             // Neither meta nor hint nor result code exists,
             // just use the buffer as it is for ctx.
-            ctx_buf->pos(0);
-            rsp->set_ctx(ctx_buf);
+            if (!ctx_pos) {
+                ctx_buf->pos(0);
+                rsp->set_ctx(ctx_buf);
+            } else if (ctx_buf->size() > ctx_pos) {
+                ptr<buffer> actual_ctx = buffer::alloc(ctx_buf->size() - ctx_pos);
+                memcpy( actual_ctx->data_begin(),
+                        ctx_buf->data_begin() + ctx_pos,
+                        actual_ctx->size() );
+                rsp->set_ctx(actual_ctx);
+            }
 
             operation_timer_.cancel();
             set_busy_flag(false);
             ptr<rpc_exception> except;
             when_done(rsp, except);
-            post_read();
+            post_read(done_pkg);
             return;
         }
 
         // Otherwise: buffer contains composite data.
         buffer_serializer bs(ctx_buf);
-        int remaining_len = ctx_buf->size();
+        bs.pos(ctx_pos);
+        int remaining_len = ctx_buf->size() - ctx_pos;
 
         // 1) Custom meta.
         if (flags & INCLUDE_META) {
@@ -1855,6 +2495,9 @@ private:
         if (flags & INCLUDE_RESULT_CODE) {
             ctx_len -= sizeof(int32_t);
         }
+        if (flags & CUMULATIVE_ACK) {
+            ctx_len -= sizeof(uint32_t);
+        }
         if (ctx_len) {
             // It has context, read it.
             ptr<buffer> actual_ctx = buffer::alloc(ctx_len);
@@ -1870,11 +2513,79 @@ private:
             rsp->set_result_code(res);
         }
 
+        // 5) Number of omitted responses.
+        uint32_t num_omitted_resps = 0;
+        if (flags & CUMULATIVE_ACK) {
+            num_omitted_resps = bs.get_u32();
+        }
+
         operation_timer_.cancel();
         set_busy_flag(false);
         ptr<rpc_exception> except;
+        if (num_omitted_resps) {
+            complete_omitted_resps(rsp, num_omitted_resps);
+            // Now the request of `rsp` is at the front.
+            ptr<pending_req_pkg> pkg;
+            {   auto_lock(pending_read_reqs_lock_);
+                if (pending_read_reqs_.size()) pkg = pending_read_reqs_.front();
+            }
+            if (pkg) pkg->when_done_(rsp, except);
+        } else {
+            when_done(rsp, except);
+        }
+        post_read(done_pkg);
+    }
+
+    void complete_omitted_resps(ptr<resp_msg>& rsp, uint32_t num_omitted_resps) {
+        // The first `num_omitted_resps` requests waiting for responses
+        // have been acknowledged by `rsp`. Retire them at once, without
+        // passing them to Raft.
+        std::vector< ptr<pending_req_pkg> > omitted;
+        {   auto_lock(pending_read_reqs_lock_);
+            while ( omitted.size() < num_omitted_resps &&
+                    pending_read_reqs_.size() > 1 ) {
+                omitted.push_back(pending_read_reqs_.front());
+                pending_read_reqs_.pop_front();
+            }
+        }
+        p_tr("cumulative ack from peer %d covers %zu requests, next idx %" PRIu64,
+             rsp->get_src(), omitted.size() + 1, rsp->get_next_idx());
+
+        ptr<rpc_exception> except;
+        for (ptr<pending_req_pkg>& pkg: omitted) {
+            ptr<resp_msg> covered = cs_new<resp_msg>
+                                    ( rsp->get_term(), rsp->get_type(),
+                                      rsp->get_src(), rsp->get_dst(),
+                                      rsp->get_next_idx(), rsp->get_accepted() );
+            covered->set_extra_flags(resp_msg::CUMULATIVELY_ACKED);
+            pkg->when_done_(covered, except);
+        }
+    }
+
+    void handle_unknown_stream(ptr<req_msg>& req,
+                               rpc_handler& when_done,
+                               ptr<pending_req_pkg> done_pkg) {
+        operation_timer_.cancel();
+        set_busy_flag(false);
+        std::string err_msg = sstrfmt( "stream of request to peer %d is not "
+                                       "registered on %s:%s" )
+                                       .fmt( req->get_dst(), host_.c_str(),
+                                             port_.c_str() );
+        ptr<resp_msg> rsp;
+        ptr<rpc_exception> except(cs_new<rpc_exception>(err_msg, req));
         when_done(rsp, except);
-        post_read();
+        post_read(done_pkg);
+    }
+
+    /**
+     * Oldest request of the given stream waiting for its response.
+     */
+    ptr<pending_req_pkg> find_stream_req(uint64_t stream_id) {
+        auto_lock(pending_read_reqs_lock_);
+        for (ptr<pending_req_pkg>& pkg: pending_read_reqs_) {
+            if (pkg->stream_id_ == stream_id) return pkg;
+        }
+        return nullptr;
     }
 
     bool handle_custom_resp_meta(ptr<req_msg>& req,
@@ -1913,12 +2624,17 @@ private:
                              std::placeholders::_2 ) );
     }
 
-    void post_send(ptr<req_msg>& req, rpc_handler& when_done) {
+    void post_send(ptr<req_msg>& req,
+                   rpc_handler& when_done,
+                   uint64_t stream_id = 0) {
         // first process read
         bool immediate_action_needed = false;
-        {
+        if (!multiplexed_) {
+            // In multiplexed mode, it is already waiting for
+            // the response, see `begin_stream_req()`.
             auto_lock(pending_read_reqs_lock_);
-            pending_read_reqs_.push_back(cs_new<pending_req_pkg>(req, when_done));
+            pending_read_reqs_.push_back
+                ( cs_new<pending_req_pkg>(req, when_done, 0, stream_id) );
             immediate_action_needed = (pending_read_reqs_.size() == 1);
             p_db("msg to peer %d has been write down, start_log_idx: %" PRIu64 ", "
                  "size: %" PRIu64 ", pending read reqs: %" PRIu64 "", req->get_dst(),
@@ -1940,6 +2656,12 @@ private:
             if (pending_write_reqs_.size()) {
                 pending_write_reqs_.pop_front();
             }
+            if (multiplexed_ && pending_write_reqs_.empty()) {
+                ptr<pending_req_pkg> pkg = pop_next_stream_req();
+                if (pkg) {
+                    pending_write_reqs_.push_back(pkg);
+                }
+            }
             if (pending_write_reqs_.size() > 0) {
                 next_req_pkg = *pending_write_reqs_.begin();
                 p_db("trigger next write, start_log_idx: %" PRIu64 ", "
@@ -1956,8 +2678,15 @@ private:
         }
     }
 
-    void post_read() {
-        if (!impl_->get_options().streaming_mode_) {
+    /**
+     * Retire the request whose response has been handled, and read
+     * the next response if any request is waiting for it.
+     *
+     * @param done_pkg Request matched by stream ID in multiplexed mode.
+     *                 If `nullptr`, the oldest one.
+     */
+    void post_read(ptr<pending_req_pkg> done_pkg = nullptr) {
+        if (!is_pipelined()) {
             return;
         }
 
@@ -1968,7 +2697,9 @@ private:
             // NOTE:
             //   The queue can be empty even though there was no `pop_front`,
             //   due to `close_socket()` when connection is suddenly closed.
-            if (pending_read_reqs_.size()) {
+            if (done_pkg) {
+                pending_read_reqs_.remove(done_pkg);
+            } else if (pending_read_reqs_.size()) {
                 pending_read_reqs_.pop_front();
             }
             if (pending_read_reqs_.size() > 0) {
@@ -2000,10 +2731,23 @@ private:
     std::atomic<size_t> num_send_fails_;
     std::atomic<bool> abandoned_;
     std::atomic<bool> socket_busy_;
+    // `true` if this connection is shared by multiple streams.
+    bool multiplexed_;
     uint64_t client_id_;
     asio::steady_timer operation_timer_;
     ptr<logger> l_;
 
+    /**
+     * Requests waiting for their turn to be written, per stream.
+     * Only used in multiplexed mode, protected by `pending_write_reqs_lock_`.
+     */
+    std::map< uint64_t, std::list<ptr<pending_req_pkg>> > stream_write_reqs_;
+
+    /**
+     * Stream ID of the last request moved to `pending_write_reqs_`.
+     */
+    uint64_t last_stream_id_;
+
     /**
      * Queue of request which is pending for reading.
      */
@@ -2025,6 +2769,75 @@ private:
     std::mutex pending_write_reqs_lock_;
 };
 
+// Client of a group, sharing the connection with other groups.
+class asio_mux_client : public rpc_client {
+public:
+    asio_mux_client(asio_service_impl* _impl,
+                    ptr<asio_rpc_client>& transport,
+                    uint64_t group_id)
+        : transport_(transport)
+        , group_id_(group_id)
+        , client_id_(_impl->assign_client_id())
+        {}
+
+    __nocopy__(asio_mux_client);
+
+public:
+    virtual void send(ptr<req_msg>& req,
+                      rpc_handler& when_done,
+                      uint64_t send_timeout_ms = 0) __override__
+    {
+        transport_->send_stream(group_id_, req, when_done, send_timeout_ms);
+    }
+
+    uint64_t get_id() const override {
+        return client_id_;
+    }
+
+    bool is_abandoned() const override {
+        return transport_->is_abandoned();
+    }
+
+private:
+    ptr<asio_rpc_client> transport_;
+    uint64_t group_id_;
+    uint64_t client_id_;
+};
+
+class asio_mux_client_factory : public rpc_client_factory {
+public:
+    asio_mux_client_factory(asio_service_impl* _impl,
+                            uint64_t group_id,
+                            ptr<logger>& l)
+        : impl_(_impl)
+        , group_id_(group_id)
+        , l_(l)
+        {}
+
+    __nocopy__(asio_mux_client_factory);
+
+public:
+    virtual ptr<rpc_client> create_client(const std::string& endpoint)
+                            __override__
+    {
+        std::string hostname;
+        std::string port;
+        if (!parse_endpoint(endpoint, hostname, port)) {
+            p_er("invalid endpoint: %s", endpoint.c_str());
+            return ptr<rpc_client>();
+        }
+
+        ptr<asio_rpc_client> transport =
+            impl_->get_mux_transport(hostname, port, l_);
+        return cs_new<asio_mux_client>(impl_, transport, group_id_);
+    }
+
+private:
+    asio_service_impl* impl_;
+    uint64_t group_id_;
+    ptr<logger> l_;
+};
+
 } // namespace nuraft
 
 using namespace nuraft;
@@ -2091,6 +2904,9 @@ asio_service_impl::asio_service_impl(const asio_service::options& opt,
     , worker_id_(0)
     , my_opt_(opt)
     , asio_timer_(get_io_svc())
+    , timer_wheel_(nullptr)
+    , timer_wheel_tick_(get_io_svc())
+    , timer_wheel_running_(false)
     , client_id_counter_(1)
     , l_(l)
 {
@@ -2132,6 +2948,29 @@ asio_service_impl::asio_service_impl(const asio_service::options& opt,
 #endif
     }
 
+    if (my_opt_.timer_wheel_tick_ms_) {
+        // Single tick source for all delayed tasks. Expired tasks are
+        // posted so that they are distributed to worker threads.
+        timer_wheel_scheduler::options tw_opt;
+        tw_opt.tick_ms_ = my_opt_.timer_wheel_tick_ms_;
+        tw_opt.use_internal_thread_ = false;
+        tw_opt.dispatcher_ = [this](ptr<delayed_task>& task) {
+            ptr<delayed_task> task_to_run = task;
+            asio::post( get_io_svc(),
+                        [task_to_run]() { task_to_run->execute(); } );
+        };
+        timer_wheel_ = std::unique_ptr<timer_wheel_scheduler>
+                       ( new timer_wheel_scheduler(tw_opt) );
+        timer_wheel_running_ = true;
+        timer_wheel_tick_.expires_after
+            ( std::chrono::milliseconds(my_opt_.timer_wheel_tick_ms_) );
+        timer_wheel_tick_.async_wait
+            ( std::bind( &asio_service_impl::timer_wheel_handler,
+                         this,
+                         std::placeholders::_1 ) );
+        p_in("timer wheel is enabled, tick %zu ms", my_opt_.timer_wheel_tick_ms_);
+    }
+
     if (my_opt_.custom_io_context_) {
         // If the external io_context is provided, we should not create
         // internal threads.
@@ -2269,7 +3108,33 @@ void asio_service_impl::timer_handler(ERROR_CODE err) {
     }
 }
 
+void asio_service_impl::timer_wheel_handler(ERROR_CODE err) {
+    if (err || !timer_wheel_running_) return;
+
+    timer_wheel_->advance();
+
+    // No need to compensate drift here, the wheel catches up
+    // all elapsed ticks at once based on the clock.
+    timer_wheel_tick_.expires_after
+        ( std::chrono::milliseconds(my_opt_.timer_wheel_tick_ms_) );
+    timer_wheel_tick_.async_wait
+        ( std::bind( &asio_service_impl::timer_wheel_handler,
+                     this,
+                     std::placeholders::_1 ) );
+}
+
 void asio_service_impl::stop() {
+    {   std::lock_guard<std::mutex> guard(metrics_endpoint_lock_);
+        if (metrics_endpoint_) {
+            metrics_endpoint_->stop();
+            metrics_endpoint_.reset();
+        }
+    }
+
+    if (timer_wheel_running_.exchange(false)) {
+        timer_wheel_tick_.cancel();
+    }
+
     if (my_opt_.custom_io_context_) {
         // If custom io_context is provided, nothing to do here.
         p_in("custom io_context is provided, no need to stop the asio service "
@@ -2305,6 +3170,44 @@ void asio_service_impl::stop() {
     }
 }
 
+ptr<asio_rpc_client> asio_service_impl::get_mux_transport(const std::string& host,
+                                                         const std::string& port,
+                                                         ptr<logger>& l)
+{
+    std::string key = host + ":" + port;
+    std::lock_guard<std::mutex> guard(mux_transports_lock_);
+    ptr<asio_rpc_client>& transport = mux_transports_[key];
+    if (!transport || transport->is_abandoned()) {
+        // Connection is not re-used once it fails, the same as
+        // `asio_rpc_client`. Create a new one.
+        std::string host_str = host;
+        std::string port_str = port;
+        transport = cs_new< asio_rpc_client >
+                    ( this,
+                      get_io_svc(),
+                      ssl_client_ctx_,
+                      host_str,
+                      port_str,
+                      my_opt_.enable_ssl_,
+                      l,
+                      true );
+    }
+    return transport;
+}
+
+ptr<msg_handler> asio_service_impl::find_mux_group(uint64_t group_id) {
+    std::lock_guard<std::mutex> guard(mux_groups_lock_);
+    auto entry = mux_groups_.find(group_id);
+    if (entry == mux_groups_.end()) return nullptr;
+    return entry->second;
+}
+
+ptr<msg_handler> asio_service_impl::find_any_mux_group() {
+    std::lock_guard<std::mutex> guard(mux_groups_lock_);
+    if (mux_groups_.empty()) return nullptr;
+    return mux_groups_.begin()->second;
+}
+
 asio_service::asio_service(const options& _opt, ptr<logger> _l)
     : impl_(new asio_service_impl(_opt, _l))
     , l_(_l)
@@ -2315,6 +3218,11 @@ asio_service::~asio_service() {
 }
 
 void asio_service::schedule(ptr<delayed_task>& task, int32 milliseconds) {
+    if (impl_->timer_wheel_) {
+        impl_->timer_wheel_->schedule(task, milliseconds);
+        return;
+    }
+
     if (task->get_impl_context() == nilptr) {
         task->set_impl_context( new asio::steady_timer(impl_->get_io_svc()),
                                 &_free_timer_ );
@@ -2333,6 +3241,11 @@ void asio_service::schedule(ptr<delayed_task>& task, int32 milliseconds) {
 }
 
 void asio_service::cancel_impl(ptr<delayed_task>& task) {
+    if (impl_->timer_wheel_) {
+        impl_->timer_wheel_->cancel(task);
+        return;
+    }
+
     if (task->get_impl_context() != nilptr) {
         static_cast<asio::steady_timer*>( task->get_impl_context() )->cancel();
     }
@@ -2347,40 +3260,9 @@ uint32_t asio_service::get_active_workers() {
 }
 
 ptr<rpc_client> asio_service::create_client(const std::string& endpoint) {
-    // NOTE:
-    //   Abandoned regular expression due to bug in GCC < 4.9.
-    //   And also support `endpoint` which doesn't start with `tcp://`.
-#if 0
-    // the endpoint is expecting to be protocol://host:port,
-    // and we only support tcp for this factory
-    // which is endpoint must be tcp://hostname:port
-    static std::regex reg("^tcp://(([a-zA-Z0-9\\-]+\\.)*([a-zA-Z0-9]+)):([0-9]+)$");
-    std::smatch mresults;
-    if (!std::regex_match(endpoint, mresults, reg) || mresults.size() != 5) {
-        return ptr<rpc_client>();
-    }
-#endif
-    bool valid_address = false;
     std::string hostname;
     std::string port;
-    size_t pos = endpoint.rfind(":");
-    do {
-        if (pos == std::string::npos) break;
-        int port_num = std::stoi( endpoint.substr(pos + 1) );
-        if (!port_num) break;
-        port = std::to_string( port_num );
-
-        size_t pos2 = endpoint.rfind("://", pos - 1);
-        hostname = (pos2 == std::string::npos)
-                   ? endpoint.substr(0, pos)
-                   : endpoint.substr(pos2 + 3, pos - pos2 - 3);
-
-        if (hostname.empty()) break;
-        valid_address = true;
-
-    } while (false);
-
-    if (!valid_address) {
+    if (!parse_endpoint(endpoint, hostname, port)) {
         p_er("invalid endpoint: %s", endpoint.c_str());
         return ptr<rpc_client>();
     }
@@ -2413,6 +3295,62 @@ ptr<rpc_listener> asio_service::create_rpc_listener( ushort listening_port,
     }
 }
 
+ptr<rpc_client_factory> asio_service::create_mux_client_factory(uint64_t group_id) {
+    return cs_new<asio_mux_client_factory>(impl_, group_id, l_);
+}
+
+void asio_service::register_mux_group(uint64_t group_id,
+                                      ptr<msg_handler>& handler)
+{
+    std::lock_guard<std::mutex> guard(impl_->mux_groups_lock_);
+    impl_->mux_groups_[group_id] = handler;
+}
+
+void asio_service::deregister_mux_group(uint64_t group_id) {
+    ptr<msg_handler> handler;
+    {   std::lock_guard<std::mutex> guard(impl_->mux_groups_lock_);
+        auto entry = impl_->mux_groups_.find(group_id);
+        if (entry == impl_->mux_groups_.end()) return;
+        handler = entry->second;
+        impl_->mux_groups_.erase(entry);
+    }
+    // Release the handler outside the lock.
+    handler.reset();
+}
+
+bool asio_service::start_metrics_endpoint
+     ( ushort listening_port,
+       const std::function<std::string()>& renderer,
+       const std::string& bind_address )
+{
+    std::lock_guard<std::mutex> guard(impl_->metrics_endpoint_lock_);
+    if (impl_->metrics_endpoint_) {
+        p_er("metrics endpoint is already started");
+        return false;
+    }
+
+    try {
+        impl_->metrics_endpoint_ = cs_new< asio_metrics_endpoint >
+                                   ( impl_->get_io_svc(),
+                                     bind_address,
+                                     listening_port,
+                                     renderer,
+                                     l_ );
+    } catch (std::exception& ee) {
+        p_er("failed to start metrics endpoint: %s", ee.what());
+        return false;
+    }
+    impl_->metrics_endpoint_->start();
+    return true;
+}
+
+void asio_service::stop_metrics_endpoint() {
+    std::lock_guard<std::mutex> guard(impl_->metrics_endpoint_lock_);
+    if (!impl_->metrics_endpoint_) return;
+    impl_->metrics_endpoint_->stop();
+    impl_->metrics_endpoint_.reset();
+}
+
 // ==========================
 // NOTE:
 //   We put Asio-related global manager functions to here,
@@ -0,0 +1,88 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "batch_size_controller.hxx"
+
+#include <algorithm>
+#include <limits>
+
+namespace nuraft {
+
+const int64_t batch_size_controller::MIN_BATCH_SIZE;
+
+// Weight of the existing samples when a new one is added.
+static const double SAMPLE_DECAY = 0.9;
+
+// If bytes of the samples vary less than this (relative standard
+// deviation), the fixed cost cannot be told apart, and is assumed 0.
+static const double MIN_RELATIVE_STDEV = 0.1;
+
+batch_size_controller::batch_size_controller()
+    : num_(0)
+    , sum_b_(0)
+    , sum_l_(0)
+    , sum_bb_(0)
+    , sum_bl_(0)
+    {}
+
+void batch_size_controller::on_append_latency(uint64_t bytes,
+                                              uint64_t latency_us)
+{
+    std::lock_guard<std::mutex> l(lock_);
+    double b = bytes;
+    double lat = latency_us;
+    num_ = num_ * SAMPLE_DECAY + 1;
+    sum_b_ = sum_b_ * SAMPLE_DECAY + b;
+    sum_l_ = sum_l_ * SAMPLE_DECAY + lat;
+    sum_bb_ = sum_bb_ * SAMPLE_DECAY + b * b;
+    sum_bl_ = sum_bl_ * SAMPLE_DECAY + b * lat;
+}
+
+int64_t batch_size_controller::get_batch_size(uint64_t target_us) const {
+    std::lock_guard<std::mutex> l(lock_);
+    if (!num_ || !sum_b_) return 0;
+
+    double mean_b = sum_b_ / num_;
+    double mean_l = sum_l_ / num_;
+    double var_b = sum_bb_ / num_ - mean_b * mean_b;
+    double cov = sum_bl_ / num_ - mean_b * mean_l;
+
+    // Latency = fixed cost + cost per byte * bytes.
+    double fixed_cost = 0;
+    double cost_per_byte = mean_l / mean_b;
+    double min_stdev = mean_b * MIN_RELATIVE_STDEV;
+    if (var_b > min_stdev * min_stdev && cov > 0) {
+        cost_per_byte = cov / var_b;
+        fixed_cost = std::max(mean_l - cost_per_byte * mean_b, 0.0);
+    }
+
+    if (fixed_cost >= target_us || cost_per_byte <= 0) {
+        // Cannot meet the target anyway, or writes cost nothing.
+        return 0;
+    }
+    double size = (target_us - fixed_cost) / cost_per_byte;
+    if (size >= (double)std::numeric_limits<int64_t>::max()) return 0;
+    return std::max((int64_t)size, MIN_BATCH_SIZE);
+}
+
+uint64_t batch_size_controller::get_avg_latency_us() const {
+    std::lock_guard<std::mutex> l(lock_);
+    if (!num_) return 0;
+    return (uint64_t)(sum_l_ / num_);
+}
+
+}
+
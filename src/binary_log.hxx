@@ -0,0 +1,249 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "pp_util.hxx"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace nuraft {
+
+class binary_logger;
+
+/**
+ * Static location of a log site. Its address is recorded
+ * instead of the location itself.
+ */
+struct binary_log_site {
+    const char* file_;
+    const char* func_;
+    size_t line_;
+    const char* format_;
+};
+
+/**
+ * A log recorded by a log site, formatted later by `binary_logger`.
+ */
+struct binary_log_record {
+    static const size_t SIZE = 128;
+
+    const binary_log_site* site_;
+    binary_logger* dst_;
+    uint64_t timestamp_us_;
+
+    /**
+     * Encoded arguments allocated on heap,
+     * if they do not fit in `args_`. Otherwise `nullptr`.
+     */
+    std::string* spilled_;
+
+    uint16_t args_len_;
+    uint8_t level_;
+
+    char args_[SIZE - 32 - 3];
+};
+
+/**
+ * Records of a thread, written by that thread and read by
+ * the thread flushing them.
+ */
+class binary_log_ring {
+public:
+    static const size_t NUM_RECORDS = 2048;
+
+    binary_log_ring(uint64_t thread_id);
+
+    __nocopy__(binary_log_ring);
+
+public:
+    /**
+     * (Writer) Get the next free record, or `nullptr` if full.
+     */
+    binary_log_record* claim() {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= NUM_RECORDS) {
+            return nullptr;
+        }
+        return &records_[head % NUM_RECORDS];
+    }
+
+    /**
+     * (Writer) Publish the record given by `claim`.
+     *
+     * @return `true` if the ring has just become half full.
+     */
+    bool publish() {
+        uint64_t head = head_.load(std::memory_order_relaxed) + 1;
+        head_.store(head, std::memory_order_release);
+        return head - tail_.load(std::memory_order_relaxed) == NUM_RECORDS / 2;
+    }
+
+    /**
+     * (Reader) Records in [tail, head) are readable.
+     */
+    uint64_t get_head() const { return head_.load(std::memory_order_acquire); }
+    uint64_t get_tail() const { return tail_.load(std::memory_order_relaxed); }
+
+    binary_log_record& at(uint64_t pos) { return records_[pos % NUM_RECORDS]; }
+
+    /**
+     * (Reader) Free the records before `pos`.
+     */
+    void release(uint64_t pos) { tail_.store(pos, std::memory_order_release); }
+
+    uint64_t get_thread_id() const { return thread_id_; }
+
+    /**
+     * The writer thread has exited.
+     */
+    void set_orphaned() { orphaned_ = true; }
+    bool is_orphaned() const { return orphaned_; }
+
+private:
+    std::atomic<uint64_t> head_;
+    char padding_[64];
+    std::atomic<uint64_t> tail_;
+    uint64_t thread_id_;
+    std::atomic<bool> orphaned_;
+    binary_log_record records_[NUM_RECORDS];
+};
+
+/**
+ * Ring of the calling thread, created on the first call.
+ */
+binary_log_ring* get_thread_binary_log_ring();
+
+/**
+ * Encodes log arguments as <type, value> pairs. Strings are copied,
+ * as they may not be valid when the log is formatted.
+ *
+ * The type byte also has the original size of an integer in its upper
+ * 4 bits, as all integers are recorded as 64-bit ones.
+ */
+class binary_log_encoder {
+public:
+    enum arg_type : uint8_t {
+        SIGNED = 0,
+        UNSIGNED = 1,
+        FLOATING = 2,
+        POINTER = 3,
+        STRING = 4,
+    };
+
+    static const uint8_t TYPE_MASK = 0x0f;
+    static const int WIDTH_SHIFT = 4;
+
+    /**
+     * If `buf` is `nullptr`, only counts the size.
+     */
+    binary_log_encoder(char* buf, size_t size)
+        : buf_(buf), size_(size), pos_(0), overflow_(false)
+        {}
+
+    void put() {}
+
+    template<typename T, typename... Rest>
+    void put(const T& value, const Rest&... rest) {
+        put_one(value);
+        put(rest...);
+    }
+
+    size_t get_size() const { return pos_; }
+
+    bool is_overflow() const { return overflow_; }
+
+private:
+    template<typename T>
+    typename std::enable_if< std::is_integral<T>::value &&
+                             std::is_signed<T>::value >::type
+    put_one(T value) {
+        put_value( SIGNED, static_cast<int64_t>(value), sizeof(T) );
+    }
+
+    template<typename T>
+    typename std::enable_if< std::is_integral<T>::value &&
+                             !std::is_signed<T>::value >::type
+    put_one(T value) {
+        put_value( UNSIGNED, static_cast<uint64_t>(value), sizeof(T) );
+    }
+
+    template<typename T>
+    typename std::enable_if< std::is_enum<T>::value >::type
+    put_one(T value) {
+        put_value( SIGNED, static_cast<int64_t>(value), sizeof(T) );
+    }
+
+    template<typename T>
+    typename std::enable_if< std::is_floating_point<T>::value >::type
+    put_one(T value) {
+        put_value( FLOATING, static_cast<double>(value) );
+    }
+
+    template<typename T>
+    void put_one(T* value) {
+        put_value( POINTER, reinterpret_cast<uintptr_t>(value) );
+    }
+
+    void put_one(char* value) {
+        put_one( static_cast<const char*>(value) );
+    }
+
+    void put_one(const char* value) {
+        if (!value) value = "(null)";
+        size_t len = strlen(value);
+        if (len > UINT16_MAX) len = UINT16_MAX;
+        uint16_t len16 = static_cast<uint16_t>(len);
+        if (!reserve(1 + sizeof(len16) + len)) return;
+        if (buf_) {
+            buf_[pos_] = STRING;
+            memcpy(buf_ + pos_ + 1, &len16, sizeof(len16));
+            memcpy(buf_ + pos_ + 1 + sizeof(len16), value, len);
+        }
+        pos_ += 1 + sizeof(len16) + len;
+    }
+
+    template<typename T>
+    void put_value(arg_type type, T value, size_t width = sizeof(T)) {
+        if (!reserve(1 + sizeof(value))) return;
+        if (buf_) {
+            buf_[pos_] = static_cast<char>(type | (width << WIDTH_SHIFT));
+            memcpy(buf_ + pos_ + 1, &value, sizeof(value));
+        }
+        pos_ += 1 + sizeof(value);
+    }
+
+    bool reserve(size_t len) {
+        if (buf_ && pos_ + len > size_) {
+            overflow_ = true;
+            return false;
+        }
+        return true;
+    }
+
+    char* buf_;
+    size_t size_;
+    size_t pos_;
+    bool overflow_;
+};
+
+}
+
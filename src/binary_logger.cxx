@@ -0,0 +1,618 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "binary_logger.hxx"
+
+#include "binary_log.hxx"
+#include "internal_timer.hxx"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <inttypes.h>
+#include <stdio.h>
+
+namespace nuraft {
+
+const size_t binary_log_record::SIZE;
+const size_t binary_log_ring::NUM_RECORDS;
+
+namespace {
+
+struct decoded_arg {
+    decoded_arg()
+        : type_(binary_log_encoder::SIGNED), width_(0), i_(0)
+        , str_(nullptr), str_len_(0)
+        {}
+    uint8_t type_;
+    // Original size of an integer, 0 if not given.
+    uint8_t width_;
+    union {
+        int64_t i_;
+        uint64_t u_;
+        double d_;
+        uintptr_t p_;
+    };
+    const char* str_;
+    uint16_t str_len_;
+};
+
+class binary_log_decoder {
+public:
+    binary_log_decoder(const char* buf, size_t size)
+        : buf_(buf), size_(size), pos_(0)
+        {}
+
+    bool next(decoded_arg& arg) {
+        if (pos_ >= size_) return false;
+        uint8_t type = static_cast<uint8_t>(buf_[pos_++]);
+        arg.type_ = type & binary_log_encoder::TYPE_MASK;
+        arg.width_ = type >> binary_log_encoder::WIDTH_SHIFT;
+        if (arg.type_ == binary_log_encoder::STRING) {
+            if (pos_ + sizeof(arg.str_len_) > size_) return false;
+            memcpy(&arg.str_len_, buf_ + pos_, sizeof(arg.str_len_));
+            pos_ += sizeof(arg.str_len_);
+            if (pos_ + arg.str_len_ > size_) return false;
+            arg.str_ = buf_ + pos_;
+            pos_ += arg.str_len_;
+            return true;
+        }
+        if (pos_ + sizeof(arg.u_) > size_) return false;
+        memcpy(&arg.u_, buf_ + pos_, sizeof(arg.u_));
+        pos_ += sizeof(arg.u_);
+        return true;
+    }
+
+private:
+    const char* buf_;
+    size_t size_;
+    size_t pos_;
+};
+
+// Conversion specification being parsed, e.g., "%-10.3".
+class format_spec {
+public:
+    format_spec() : len_(0) { buf_[0] = 0; }
+
+    void add(char cc) {
+        if (len_ + 1 < sizeof(buf_)) {
+            buf_[len_++] = cc;
+            buf_[len_] = 0;
+        }
+    }
+
+    void add(const char* str) {
+        while (*str) add(*str++);
+    }
+
+    // Print the given value with this specification and the given suffix
+    // (length modifier and conversion), then remove the suffix.
+    template<typename T>
+    void print(std::string& out, const char* suffix, T value) {
+        size_t len_before = len_;
+        add(suffix);
+        char buf[128];
+        int len = snprintf(buf, sizeof(buf), buf_, value);
+        if (len >= 0 && static_cast<size_t>(len) < sizeof(buf)) {
+            out.append(buf, len);
+        } else if (len >= 0) {
+            std::string tmp(len + 1, '\0');
+            snprintf(&tmp[0], tmp.size(), buf_, value);
+            out.append(tmp.data(), len);
+        }
+        len_ = len_before;
+        buf_[len_] = 0;
+    }
+
+private:
+    char buf_[32];
+    size_t len_;
+};
+
+int64_t arg_as_int(const decoded_arg& arg) {
+    switch (arg.type_) {
+    case binary_log_encoder::FLOATING:  return static_cast<int64_t>(arg.d_);
+    case binary_log_encoder::STRING:    return 0;
+    default:                            return arg.i_;
+    }
+}
+
+// Unsigned value of an integer in its original size, e.g., `%x` of
+// a negative 32-bit integer is printed as 32-bit, as `printf` does.
+uint64_t arg_as_uint(const decoded_arg& arg) {
+    uint64_t value = static_cast<uint64_t>(arg_as_int(arg));
+    if (arg.width_ > 0 && arg.width_ < sizeof(value)) {
+        value &= (1ULL << (arg.width_ * 8)) - 1;
+    }
+    return value;
+}
+
+// Format the arguments as `vsnprintf` does. Length modifiers are
+// replaced, as all integers are recorded as 64-bit ones.
+std::string format_binary_log(const char* format, const char* args, size_t len) {
+    std::string out;
+    out.reserve(128);
+    binary_log_decoder dec(args, len);
+    decoded_arg arg;
+
+    for (const char* cc = format; *cc; ++cc) {
+        if (*cc != '%') {
+            const char* next = strchr(cc, '%');
+            size_t num = next ? (size_t)(next - cc) : strlen(cc);
+            out.append(cc, num);
+            cc += num - 1;
+            continue;
+        }
+        if (cc[1] == '%') {
+            out += '%';
+            ++cc;
+            continue;
+        }
+
+        const char* spec_start = cc;
+        format_spec spec;
+        spec.add('%');
+        ++cc;
+        while (*cc && strchr("-+ #0'", *cc)) spec.add(*cc++);
+        if (*cc == '*') {
+            if (!dec.next(arg)) break;
+            spec.add( std::to_string(arg_as_int(arg)).c_str() );
+            ++cc;
+        }
+        while (*cc >= '0' && *cc <= '9') spec.add(*cc++);
+        if (*cc == '.') {
+            spec.add(*cc++);
+            if (*cc == '*') {
+                if (!dec.next(arg)) break;
+                spec.add( std::to_string(arg_as_int(arg)).c_str() );
+                ++cc;
+            }
+            while (*cc >= '0' && *cc <= '9') spec.add(*cc++);
+        }
+        // Length modifiers, including `I64` of MSVC.
+        while (*cc && strchr("hlLqjzt", *cc)) ++cc;
+        if (*cc == 'I') {
+            ++cc;
+            while (*cc >= '0' && *cc <= '9') ++cc;
+        }
+        if (!*cc) {
+            out.append(spec_start);
+            break;
+        }
+
+        char conv = *cc;
+        if (!strchr("diouxXcfFeEgGaAsp", conv)) {
+            // Unknown conversion, leave it as it is.
+            out.append(spec_start, cc - spec_start + 1);
+            continue;
+        }
+        if (!dec.next(arg)) {
+            out += "<missing>";
+            continue;
+        }
+
+        char suffix[4] = {0};
+        switch (conv) {
+        case 'd': case 'i':
+            spec.print(out, "lld", (long long)arg_as_int(arg));
+            break;
+        case 'o': case 'u': case 'x': case 'X':
+            suffix[0] = 'l';
+            suffix[1] = 'l';
+            suffix[2] = conv;
+            spec.print(out, suffix, (unsigned long long)arg_as_uint(arg));
+            break;
+        case 'c':
+            spec.print(out, "c", (int)arg_as_int(arg));
+            break;
+        case 'p':
+            spec.print(out, "p", (void*)arg.p_);
+            break;
+        case 's':
+            if (arg.type_ != binary_log_encoder::STRING) {
+                out += "<not a string>";
+            } else if (cc == spec_start + 1) {
+                // Plain `%s`.
+                out.append(arg.str_, arg.str_len_);
+            } else {
+                spec.print(out, "s", std::string(arg.str_, arg.str_len_).c_str());
+            }
+            break;
+        default: {
+            double value = 0;
+            switch (arg.type_) {
+            case binary_log_encoder::FLOATING:  value = arg.d_;                  break;
+            case binary_log_encoder::SIGNED:    value = (double)arg.i_;          break;
+            case binary_log_encoder::UNSIGNED:  value = (double)arg.u_;          break;
+            default:                                                             break;
+            }
+            suffix[0] = conv;
+            spec.print(out, suffix, value);
+            break; }
+        }
+    }
+
+    // Get rid of newline at the end, as `msg_if_given` does.
+    if (!out.empty() && out.back() == '\n') out.pop_back();
+    return out;
+}
+
+}
+
+/**
+ * Rings of all threads, the live `binary_logger` instances,
+ * and the background thread flushing them.
+ */
+class binary_log_mgr {
+public:
+    static binary_log_mgr& get_instance() {
+        static binary_log_mgr mgr_instance;
+        return mgr_instance;
+    }
+
+    ~binary_log_mgr() {
+        stop_flusher();
+    }
+
+    binary_log_ring* add_ring(uint64_t thread_id) {
+        binary_log_ring* ring = new binary_log_ring(thread_id);
+        std::lock_guard<std::mutex> l(rings_lock_);
+        rings_.push_back(ring);
+        return ring;
+    }
+
+    void add_logger(binary_logger* bl) {
+        std::lock_guard<std::mutex> l(loggers_mgmt_lock_);
+        {   std::lock_guard<std::mutex> ll(flush_lock_);
+            loggers_.insert(bl);
+            update_flush_interval_locked();
+        }
+        std::lock_guard<std::mutex> ll(flusher_lock_);
+        if (!flusher_.joinable()) {
+            flusher_stopping_ = false;
+            flusher_ = std::thread(&binary_log_mgr::loop, this);
+        }
+    }
+
+    void remove_logger(binary_logger* bl) {
+        std::lock_guard<std::mutex> l(loggers_mgmt_lock_);
+        bool last = false;
+        {   std::lock_guard<std::mutex> ll(flush_lock_);
+            flush_locked();
+            loggers_.erase(bl);
+            update_flush_interval_locked();
+            last = loggers_.empty();
+        }
+        if (last) stop_flusher();
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> l(flush_lock_);
+        flush_locked();
+    }
+
+    void request_flush() {
+        {   std::lock_guard<std::mutex> l(flusher_lock_);
+            flush_requested_ = true;
+        }
+        flusher_cv_.notify_all();
+    }
+
+    void put_immediate(binary_logger* bl,
+                       int level,
+                       const char* source_file,
+                       const char* func_name,
+                       size_t line_number,
+                       const std::string& log_line)
+    {
+        immediate_log il;
+        il.dst_ = bl;
+        il.level_ = level;
+        il.file_ = source_file;
+        il.func_ = func_name;
+        il.line_ = line_number;
+        il.timestamp_us_ = timer_helper::get_timeofday_us();
+        il.thread_id_ = std::hash<std::thread::id>()(std::this_thread::get_id());
+        il.msg_ = log_line;
+        {   std::lock_guard<std::mutex> l(immediate_lock_);
+            immediates_.push_back(std::move(il));
+        }
+        request_flush();
+    }
+
+private:
+    binary_log_mgr()
+        : flush_interval_ms_(100)
+        , flush_requested_(false)
+        , flusher_stopping_(false)
+        {}
+
+    /**
+     * Log formatted on the calling thread, waiting to be passed
+     * to the sink in order.
+     */
+    struct immediate_log {
+        binary_logger* dst_;
+        int level_;
+        std::string file_;
+        std::string func_;
+        size_t line_;
+        uint64_t timestamp_us_;
+        uint64_t thread_id_;
+        std::string msg_;
+    };
+
+    struct item {
+        uint64_t timestamp_us_;
+        binary_log_ring* ring_;
+        uint64_t pos_;
+        // Not `nullptr` if this is not from a ring.
+        immediate_log* immediate_;
+    };
+
+    void loop() {
+        std::unique_lock<std::mutex> l(flusher_lock_);
+        while (!flusher_stopping_) {
+            flusher_cv_.wait_for
+                ( l, std::chrono::milliseconds(flush_interval_ms_.load()),
+                  [this]() { return flusher_stopping_ || flush_requested_; } );
+            flush_requested_ = false;
+            l.unlock();
+            flush();
+            l.lock();
+        }
+    }
+
+    void stop_flusher() {
+        std::thread tt;
+        {   std::lock_guard<std::mutex> l(flusher_lock_);
+            flusher_stopping_ = true;
+            tt = std::move(flusher_);
+        }
+        flusher_cv_.notify_all();
+        if (tt.joinable()) tt.join();
+    }
+
+    void update_flush_interval_locked() {
+        int32 interval_ms = 0;
+        for (binary_logger* bl: loggers_) {
+            int32 cur = std::max(1, bl->opt_.flush_interval_ms_);
+            if (!interval_ms || cur < interval_ms) interval_ms = cur;
+        }
+        if (interval_ms) flush_interval_ms_ = interval_ms;
+    }
+
+    void flush_locked() {
+        // Take immediate logs first, so that all ring records
+        // preceding them are read below.
+        std::vector<immediate_log> immediates;
+        {   std::lock_guard<std::mutex> l(immediate_lock_);
+            immediates.swap(immediates_);
+        }
+
+        std::vector<binary_log_ring*> rings;
+        {   std::lock_guard<std::mutex> l(rings_lock_);
+            rings.assign(rings_.begin(), rings_.end());
+        }
+
+        // Deliver all readable records in timestamp order.
+        std::vector<uint64_t> heads(rings.size());
+        std::vector<item> items;
+        for (size_t ii = 0; ii < rings.size(); ++ii) {
+            binary_log_ring* ring = rings[ii];
+            heads[ii] = ring->get_head();
+            for (uint64_t pos = ring->get_tail(); pos < heads[ii]; ++pos) {
+                items.push_back
+                    ( item{ ring->at(pos).timestamp_us_, ring, pos, nullptr } );
+            }
+        }
+        for (immediate_log& il: immediates) {
+            items.push_back( item{ il.timestamp_us_, nullptr, 0, &il } );
+        }
+        std::stable_sort( items.begin(), items.end(),
+                          [](const item& a, const item& b) {
+                              return a.timestamp_us_ < b.timestamp_us_;
+                          } );
+
+        for (item& ii: items) {
+            if (ii.immediate_) {
+                immediate_log& il = *ii.immediate_;
+                if (loggers_.count(il.dst_)) {
+                    il.dst_->put_recorded( il.level_,
+                                           il.file_.c_str(),
+                                           il.func_.c_str(),
+                                           il.line_,
+                                           il.timestamp_us_,
+                                           il.thread_id_,
+                                           il.msg_ );
+                }
+                continue;
+            }
+
+            binary_log_record& rec = ii.ring_->at(ii.pos_);
+            // Skip the ones of destroyed loggers.
+            if (loggers_.count(rec.dst_)) {
+                const binary_log_site& site = *rec.site_;
+                std::string msg = rec.spilled_
+                    ? format_binary_log( site.format_,
+                                         rec.spilled_->data(),
+                                         rec.spilled_->size() )
+                    : format_binary_log( site.format_,
+                                         rec.args_,
+                                         rec.args_len_ );
+                rec.dst_->put_recorded( rec.level_,
+                                        site.file_,
+                                        site.func_,
+                                        site.line_,
+                                        rec.timestamp_us_,
+                                        ii.ring_->get_thread_id(),
+                                        msg );
+            }
+            delete rec.spilled_;
+            rec.spilled_ = nullptr;
+        }
+        for (size_t ii = 0; ii < rings.size(); ++ii) {
+            rings[ii]->release(heads[ii]);
+        }
+
+        for (binary_logger* bl: loggers_) {
+            uint64_t num_dropped = bl->get_num_dropped();
+            if (num_dropped > bl->num_dropped_reported_) {
+                char msg[128];
+                snprintf( msg, sizeof(msg),
+                          "%" PRIu64 " logs were dropped as the buffer was full",
+                          num_dropped - bl->num_dropped_reported_ );
+                bl->sink_->put_details(3, __FILE__, __func__, __LINE__, msg);
+                bl->num_dropped_reported_ = num_dropped;
+            }
+        }
+
+        // Free the rings of exited threads, once they are empty.
+        std::lock_guard<std::mutex> l(rings_lock_);
+        for (auto itr = rings_.begin(); itr != rings_.end(); ) {
+            binary_log_ring* ring = *itr;
+            if (ring->is_orphaned() && ring->get_head() == ring->get_tail()) {
+                itr = rings_.erase(itr);
+                delete ring;
+            } else {
+                ++itr;
+            }
+        }
+    }
+
+    std::mutex rings_lock_;
+    std::list<binary_log_ring*> rings_;
+
+    /**
+     * Lock for adding and removing loggers, so that the background
+     * thread is started and stopped in order.
+     */
+    std::mutex loggers_mgmt_lock_;
+
+    /**
+     * Lock for flushing, and for `loggers_`.
+     */
+    std::mutex flush_lock_;
+    std::set<binary_logger*> loggers_;
+
+    std::mutex immediate_lock_;
+    std::vector<immediate_log> immediates_;
+
+    /**
+     * Shortest flush interval among `loggers_`.
+     */
+    std::atomic<int32> flush_interval_ms_;
+
+    std::thread flusher_;
+    std::mutex flusher_lock_;
+    std::condition_variable flusher_cv_;
+    bool flush_requested_;
+    bool flusher_stopping_;
+};
+
+binary_log_ring::binary_log_ring(uint64_t thread_id)
+    : head_(0)
+    , tail_(0)
+    , thread_id_(thread_id)
+    , orphaned_(false)
+    {}
+
+binary_log_ring* get_thread_binary_log_ring() {
+    struct holder {
+        holder() : ring_( binary_log_mgr::get_instance().add_ring
+                              ( std::hash<std::thread::id>()
+                                    ( std::this_thread::get_id() ) ) )
+            {}
+        ~holder() { ring_->set_orphaned(); }
+        binary_log_ring* ring_;
+    };
+    thread_local holder thread_ring;
+    return thread_ring.ring_;
+}
+
+binary_logger::binary_logger(ptr<logger> sink, const options& opt)
+    : opt_(opt)
+    , sink_(sink)
+    , level_(sink->get_level())
+    , num_dropped_(0)
+    , num_dropped_reported_(0)
+    , stopping_(false)
+{
+    binary_log_mgr::get_instance().add_logger(this);
+    binary_logger_ = this;
+}
+
+binary_logger::~binary_logger() {
+    shutdown();
+}
+
+void binary_logger::set_level(int l) {
+    sink_->set_level(l);
+    level_ = l;
+}
+
+void binary_logger::put_details(int level,
+                                const char* source_file,
+                                const char* func_name,
+                                size_t line_number,
+                                const std::string& log_line)
+{
+    if (stopping_) {
+        sink_->put_details(level, source_file, func_name, line_number, log_line);
+        return;
+    }
+    binary_log_mgr::get_instance().put_immediate
+        ( this, level, source_file, func_name, line_number, log_line );
+}
+
+void binary_logger::flush() {
+    binary_log_mgr::get_instance().flush();
+}
+
+void binary_logger::shutdown() {
+    if (stopping_.exchange(true)) return;
+    binary_logger_ = nullptr;
+    binary_log_mgr::get_instance().remove_logger(this);
+}
+
+void binary_logger::on_ring_full() {
+    num_dropped_.fetch_add(1);
+    request_flush();
+}
+
+void binary_logger::request_flush() {
+    binary_log_mgr::get_instance().request_flush();
+}
+
+void binary_logger::put_recorded(int level,
+                                 const char* source_file,
+                                 const char* func_name,
+                                 size_t line_number,
+                                 uint64_t timestamp_us,
+                                 uint64_t thread_id,
+                                 const std::string& log_line)
+{
+    sink_->put_deferred_details( level, source_file, func_name, line_number,
+                                 timestamp_us, thread_id, log_line );
+}
+
+}
@@ -0,0 +1,395 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "failure_detector.hxx"
+
+#include "buffer_serializer.hxx"
+#include "delayed_task_scheduler.hxx"
+#include "log_entry.hxx"
+#include "raft_server.hxx"
+#include "rpc_cli_factory.hxx"
+#include "timer_task.hxx"
+
+#include <cstring>
+#include <vector>
+
+namespace nuraft {
+
+//   << Request format >>
+// version                          1 byte
+// number of members (N)            4 bytes
+// N * {
+//   group ID                       8 bytes
+//   server ID                      4 bytes
+//   leader term (0 if any role)    8 bytes
+// }
+//
+//   << Response format >>
+// version                          1 byte
+// number of members (N)            4 bytes
+// N * {
+//   member status                  1 byte
+// }
+static const uint8_t LIVENESS_CHECK_VERSION = 0x0;
+
+// Size of each member in the request.
+static const size_t MEMBER_ELEM_SIZE = sizeof(uint64_t) * 2 + sizeof(int32);
+
+failure_detector::failure_detector(const ptr<rpc_client_factory>& factory,
+                                   const ptr<delayed_task_scheduler>& scheduler,
+                                   const options& opt)
+    : opt_(opt)
+    , factory_(factory)
+    , scheduler_(scheduler)
+    , check_scheduled_(false)
+    , next_watch_id_(1)
+    , stopped_(false)
+    , num_checks_sent_(0)
+{
+    if (opt_.max_failures_ < 1) opt_.max_failures_ = 1;
+
+    timer_task<void>::executor exec = [this]() {
+        check_scheduled_ = false;
+        check_now();
+        schedule_check();
+    };
+    check_task_ = cs_new< timer_task<void> >(exec);
+}
+
+failure_detector::~failure_detector() {
+    shutdown();
+}
+
+std::string failure_detector::get_dest_key(int32 srv_id,
+                                           const std::string& endpoint) const {
+    if (opt_.dest_key_func_) {
+        return opt_.dest_key_func_(srv_id, endpoint);
+    }
+    return endpoint;
+}
+
+uint64_t failure_detector::watch(uint64_t group_id,
+                                 int32 srv_id,
+                                 const std::string& endpoint,
+                                 ulong leader_term,
+                                 const failure_callback& on_failure)
+{
+    if (stopped_) return 0;
+
+    std::string key = get_dest_key(srv_id, endpoint);
+    uint64_t watch_id = 0;
+    {   std::lock_guard<std::mutex> l(lock_);
+        ptr<node>& nn = nodes_[key];
+        if (!nn) {
+            nn = cs_new<node>(srv_id, endpoint);
+        }
+        watch_id = next_watch_id_++;
+        nn->watchers_.insert( std::make_pair
+                              ( watch_id,
+                                watcher( group_id, srv_id,
+                                         leader_term, on_failure ) ) );
+        watch_keys_[watch_id] = key;
+    }
+    schedule_check();
+    return watch_id;
+}
+
+void failure_detector::unwatch(uint64_t watch_id) {
+    std::lock_guard<std::mutex> l(lock_);
+    auto w_entry = watch_keys_.find(watch_id);
+    if (w_entry == watch_keys_.end()) return;
+
+    auto n_entry = nodes_.find(w_entry->second);
+    if (n_entry != nodes_.end()) {
+        ptr<node>& nn = n_entry->second;
+        nn->watchers_.erase(watch_id);
+        if (nn->watchers_.empty()) {
+            // No one is interested in this node anymore.
+            nodes_.erase(n_entry);
+        }
+    }
+    watch_keys_.erase(w_entry);
+}
+
+void failure_detector::register_group(uint64_t group_id, raft_server* srv) {
+    std::lock_guard<std::mutex> l(members_lock_);
+    members_[std::make_pair(group_id, srv->get_id())] = srv;
+}
+
+void failure_detector::deregister_group(uint64_t group_id, raft_server* srv) {
+    std::lock_guard<std::mutex> l(members_lock_);
+    auto entry = members_.find( std::make_pair(group_id, srv->get_id()) );
+    if (entry == members_.end() || entry->second != srv) return;
+    members_.erase(entry);
+}
+
+void failure_detector::schedule_check() {
+    if ( !scheduler_ ||
+         opt_.check_interval_ms_ <= 0 ||
+         stopped_ ) {
+        return;
+    }
+
+    {   std::lock_guard<std::mutex> l(lock_);
+        if (nodes_.empty()) return;
+    }
+
+    bool exp = false;
+    if (check_scheduled_.compare_exchange_strong(exp, true)) {
+        scheduler_->schedule(check_task_, opt_.check_interval_ms_);
+    }
+}
+
+void failure_detector::check_now() {
+    if (stopped_) return;
+
+    std::vector< std::pair< std::string, ptr<node> > > to_check;
+    {   std::lock_guard<std::mutex> l(lock_);
+        for (auto& entry: nodes_) {
+            ptr<node>& nn = entry.second;
+            // Skip the node whose previous check is not done yet,
+            // its timeout will be counted as a failure.
+            if (nn->in_flight_) continue;
+            nn->in_flight_ = true;
+            to_check.push_back( std::make_pair(entry.first, nn) );
+        }
+    }
+
+    for (auto& entry: to_check) {
+        send_check(entry.first, entry.second);
+    }
+}
+
+void failure_detector::send_check(const std::string& key, ptr<node>& nn) {
+    ptr<rpc_client> client;
+    std::vector<uint64_t> watch_ids;
+    ptr<buffer> buf;
+    {   std::lock_guard<std::mutex> l(lock_);
+        if (!nn->client_ || nn->client_->is_abandoned()) {
+            nn->client_ = factory_ ? factory_->create_client(nn->endpoint_)
+                                   : nullptr;
+        }
+        client = nn->client_;
+
+        size_t num_elems = nn->watchers_.size();
+        buf = buffer::alloc( sizeof(uint8_t) +
+                             sizeof(uint32_t) +
+                             MEMBER_ELEM_SIZE * num_elems );
+        buffer_serializer bs(buf);
+        bs.put_u8(LIVENESS_CHECK_VERSION);
+        bs.put_u32(num_elems);
+        watch_ids.reserve(num_elems);
+        for (auto& entry: nn->watchers_) {
+            watcher& ww = entry.second;
+            bs.put_u64(ww.group_id_);
+            bs.put_i32(ww.srv_id_);
+            bs.put_u64(ww.leader_term_);
+            watch_ids.push_back(entry.first);
+        }
+    }
+
+    if (!client) {
+        ptr<resp_msg> no_resp;
+        ptr<rpc_exception> err;
+        handle_check_resp(key, nn, client, watch_ids, no_resp, err);
+        return;
+    }
+
+    ptr<req_msg> req = cs_new<req_msg>( 0,
+                                        msg_type::liveness_check_request,
+                                        0,
+                                        nn->srv_id_,
+                                        0, 0, 0 );
+    req->log_entries().push_back
+        ( cs_new<log_entry>(0, buf, log_val_type::custom) );
+    num_checks_sent_.fetch_add(1);
+
+    // Hold `this` until the response arrives, as the detector can be
+    // released in the meantime.
+    rpc_handler h = (rpc_handler)std::bind( &failure_detector::handle_check_resp,
+                                            shared_from_this(),
+                                            key,
+                                            nn,
+                                            client,
+                                            watch_ids,
+                                            std::placeholders::_1,
+                                            std::placeholders::_2 );
+    client->send(req, h, opt_.check_interval_ms_ > 0 ? opt_.check_interval_ms_ : 0);
+}
+
+void failure_detector::handle_check_resp(const std::string& key,
+                                         ptr<node> nn,
+                                         ptr<rpc_client> client,
+                                         std::vector<uint64_t> watch_ids,
+                                         ptr<resp_msg>& resp,
+                                         ptr<rpc_exception>& err)
+{
+    // Status of each member in the request. If the node does not respond,
+    // or does not answer for each member, every check is counted as
+    // a failure.
+    std::vector<uint8_t> statuses(watch_ids.size(), BUSY);
+    bool node_alive = !err && resp && resp->get_accepted();
+    ptr<buffer> resp_ctx = node_alive ? resp->get_ctx() : nullptr;
+    if ( resp_ctx &&
+         resp_ctx->size() >= sizeof(uint8_t) + sizeof(uint32_t) ) {
+        buffer_serializer bs(resp_ctx);
+        uint8_t version = bs.get_u8();
+        (void)version;
+        size_t num_statuses = bs.get_u32();
+        if ( num_statuses == watch_ids.size() &&
+             num_statuses <= resp_ctx->size() - bs.pos() ) {
+            for (size_t ii = 0; ii < num_statuses; ++ii) {
+                statuses[ii] = bs.get_u8();
+            }
+        }
+    }
+
+    std::vector<failure_callback> to_notify;
+    {   std::lock_guard<std::mutex> l(lock_);
+        nn->in_flight_ = false;
+
+        if (!node_alive && nn->client_ == client) {
+            // Connection may be broken, the next check will use a new one.
+            nn->client_.reset();
+        }
+
+        for (size_t ii = 0; ii < watch_ids.size(); ++ii) {
+            // Unwatched in the meantime.
+            auto w_entry = nn->watchers_.find(watch_ids[ii]);
+            if (w_entry == nn->watchers_.end()) continue;
+
+            watcher& ww = w_entry->second;
+            if (statuses[ii] == ALIVE) {
+                ww.num_failures_ = 0;
+                continue;
+            }
+            if ( statuses[ii] != GONE &&
+                 ++ww.num_failures_ < opt_.max_failures_ ) {
+                continue;
+            }
+
+            // Declare the member dead.
+            to_notify.push_back(ww.on_failure_);
+            watch_keys_.erase(w_entry->first);
+            nn->watchers_.erase(w_entry);
+        }
+
+        if (nn->watchers_.empty()) {
+            // Remove the node, only if it is still being watched.
+            auto entry = nodes_.find(key);
+            if (entry != nodes_.end() && entry->second == nn) {
+                nodes_.erase(entry);
+            }
+        }
+    }
+
+    if (stopped_) return;
+    for (failure_callback& cb: to_notify) {
+        if (cb) cb();
+    }
+}
+
+ptr<resp_msg> failure_detector::handle_check(req_msg& req) {
+    ptr<resp_msg> resp = cs_new<resp_msg>( 0,
+                                           msg_type::liveness_check_response,
+                                           req.get_dst(),
+                                           req.get_src() );
+    // This node is alive anyway.
+    resp->accept(0);
+
+    std::vector< ptr<log_entry> >& log_entries = req.log_entries();
+    if (log_entries.empty() || !log_entries[0]->get_buf_ptr()) {
+        return resp;
+    }
+
+    ptr<buffer> req_buf = log_entries[0]->get_buf_ptr();
+    if (req_buf->size() < sizeof(uint8_t) + sizeof(uint32_t)) {
+        return resp;
+    }
+    buffer_serializer bs(req_buf);
+    uint8_t version = bs.get_u8();
+    (void)version;
+    size_t num_elems = bs.get_u32();
+    if (num_elems > (req_buf->size() - bs.pos()) / MEMBER_ELEM_SIZE) {
+        // Corrupted message, the number of members exceeds the size.
+        return resp;
+    }
+
+    ptr<buffer> buf = buffer::alloc( sizeof(uint8_t) +
+                                     sizeof(uint32_t) +
+                                     sizeof(uint8_t) * num_elems );
+    buffer_serializer rs(buf);
+    rs.put_u8(LIVENESS_CHECK_VERSION);
+    rs.put_u32(num_elems);
+    {   std::lock_guard<std::mutex> l(members_lock_);
+        for (size_t ii = 0; ii < num_elems; ++ii) {
+            uint64_t group_id = bs.get_u64();
+            int32 srv_id = bs.get_i32();
+            ulong leader_term = bs.get_u64();
+
+            member_status status = GONE;
+            auto entry = members_.find( std::make_pair(group_id, srv_id) );
+            if (entry != members_.end() && !stopped_) {
+                status = get_member_status(entry->second, leader_term);
+            }
+            rs.put_u8(status);
+        }
+    }
+
+    resp->set_ctx(buf);
+    return resp;
+}
+
+failure_detector::member_status
+    failure_detector::get_member_status(raft_server* srv, ulong leader_term)
+{
+    // Should not block the caller (and other members), a member stuck
+    // on its lock is declared dead after consecutive checks.
+    std::unique_lock<profiled_recursive_mutex> l(srv->lock_, std::try_to_lock);
+    if (!l.owns_lock()) return BUSY;
+
+    if (srv->stopping_) return GONE;
+    if ( leader_term &&
+         ( srv->role_ != srv_role::leader ||
+           srv->state_->get_term() != leader_term ) ) {
+        return GONE;
+    }
+    return ALIVE;
+}
+
+void failure_detector::shutdown() {
+    bool exp = false;
+    if (!stopped_.compare_exchange_strong(exp, true)) return;
+
+    if (scheduler_) {
+        scheduler_->cancel(check_task_);
+    }
+
+    {   std::lock_guard<std::mutex> l(lock_);
+        nodes_.clear();
+        watch_keys_.clear();
+    }
+    std::lock_guard<std::mutex> l(members_lock_);
+    members_.clear();
+}
+
+size_t failure_detector::get_num_watched_nodes() const {
+    std::lock_guard<std::mutex> l(lock_);
+    return nodes_.size();
+}
+
+}
+
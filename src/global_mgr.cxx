@@ -24,6 +24,7 @@ limitations under the License.
 #include "raft_server.hxx"
 #include "tracer.hxx"
 
+#include <deque>
 #include <memory>
 
 namespace nuraft {
@@ -61,8 +62,9 @@ private:
 };
 
 struct nuraft_global_mgr::worker_handle {
-    worker_handle(size_t id = 0)
+    worker_handle(size_t id = 0, size_t idx_in_pool = 0)
         : id_(id)
+        , idx_in_pool_(idx_in_pool)
         , thread_(nullptr)
         , stopping_(false)
         , status_(SLEEPING)
@@ -89,15 +91,33 @@ struct nuraft_global_mgr::worker_handle {
     };
 
     size_t id_;
+    size_t idx_in_pool_;
     EventAwaiter ea_;
     ptr<std::thread> thread_;
     std::atomic<bool> stopping_;
     std::atomic<status> status_;
+
+    /**
+     * Servers to be served by this worker. The owner pops from the front,
+     * while other workers in the same pool steal from the back.
+     */
+    std::deque< ptr<raft_server> > queue_;
+
+    /**
+     * Lock for `queue_`.
+     */
+    std::mutex queue_lock_;
 };
 
+// `worker_handle` that the current thread is running,
+// if it is a global worker thread.
+static thread_local void* tls_cur_worker = nullptr;
+
 nuraft_global_mgr::nuraft_global_mgr()
     : asio_service_(nullptr)
     , thread_id_counter_(0)
+    , next_commit_worker_(0)
+    , next_append_worker_(0)
     {}
 
 nuraft_global_mgr::~nuraft_global_mgr() {
@@ -138,7 +158,7 @@ nuraft_global_mgr* nuraft_global_mgr::get_instance() {
 void nuraft_global_mgr::init_thread_pool() {
     for (size_t ii = 0; ii < config_.num_commit_threads_; ++ii) {
         ptr<worker_handle> w_hdl =
-            cs_new<worker_handle>( thread_id_counter_.fetch_add(1) );
+            cs_new<worker_handle>( thread_id_counter_.fetch_add(1), ii );
         w_hdl->thread_ = cs_new<std::thread>( &nuraft_global_mgr::commit_worker_loop,
                                               this,
                                               w_hdl );
@@ -147,7 +167,7 @@ void nuraft_global_mgr::init_thread_pool() {
 
     for (size_t ii = 0; ii < config_.num_append_threads_; ++ii) {
         ptr<worker_handle> w_hdl =
-            cs_new<worker_handle>( thread_id_counter_.fetch_add(1) );
+            cs_new<worker_handle>( thread_id_counter_.fetch_add(1), ii );
         w_hdl->thread_ = cs_new<std::thread>( &nuraft_global_mgr::append_worker_loop,
                                               this,
                                               w_hdl );
@@ -164,37 +184,29 @@ void nuraft_global_mgr::init_raft_server(raft_server* server) {
 
 void nuraft_global_mgr::close_raft_server(raft_server* server) {
     // Cancel all requests for this raft server.
-    size_t num_aborted_append = 0;
-    {
-        std::lock_guard<std::mutex> l(append_queue_lock_);
-        auto entry = append_queue_.begin();
-        while (entry != append_queue_.end()) {
-            if (entry->get() == server) {
-                append_server_set_.erase(*entry);
-                entry = append_queue_.erase(entry);
-                num_aborted_append++;
-                break;
-            } else {
-                entry++;
+    auto remove_from_pool = [server](std::vector< ptr<worker_handle> >& pool) {
+        size_t num_aborted = 0;
+        for (auto& entry: pool) {
+            worker_handle& wh = *entry;
+            std::lock_guard<std::mutex> l(wh.queue_lock_);
+            auto q_entry = wh.queue_.begin();
+            while (q_entry != wh.queue_.end()) {
+                if (q_entry->get() == server) {
+                    q_entry = wh.queue_.erase(q_entry);
+                    num_aborted++;
+                } else {
+                    q_entry++;
+                }
             }
         }
-    }
+        return num_aborted;
+    };
 
-    size_t num_aborted_commit = 0;
-    {
-        std::lock_guard<std::mutex> l(commit_queue_lock_);
-        auto entry = commit_queue_.begin();
-        while (entry != commit_queue_.end()) {
-            if (entry->get() == server) {
-                commit_server_set_.erase(*entry);
-                entry = commit_queue_.erase(entry);
-                num_aborted_commit++;
-                break;
-            } else {
-                entry++;
-            }
-        }
-    }
+    size_t num_aborted_append = remove_from_pool(append_workers_);
+    server->global_append_scheduled_ = false;
+
+    size_t num_aborted_commit = remove_from_pool(commit_workers_);
+    server->global_commit_scheduled_ = false;
 
     ptr<logger>& l_ = server->l_;
     p_in("global manager detected, %zu appends %zu commits are aborted",
@@ -202,68 +214,98 @@ void nuraft_global_mgr::close_raft_server(raft_server* server) {
          num_aborted_commit);
 }
 
-void nuraft_global_mgr::request_append(ptr<raft_server> server) {
-    {
-        std::lock_guard<std::mutex> l(append_queue_lock_);
-        // First search the set if the server is duplicate.
-        auto entry = append_server_set_.find(server);
-        if (entry != append_server_set_.end()) {
-            // `server` is already in the queue. Ignore it.
-            return;
-        }
-
-        // Put into queue.
-        append_queue_.push_back(server);
-        append_server_set_.insert(server);
+void nuraft_global_mgr::push_to_pool(std::vector< ptr<worker_handle> >& pool,
+                                     std::atomic<size_t>& next_worker,
+                                     ptr<raft_server>& server)
+{
+    if (pool.empty()) return;
+
+    // If the request comes from a worker of the same pool (e.g., re-push
+    // of the unfinished commit), keep it local. Otherwise, distribute
+    // requests in a round-robin manner.
+    worker_handle* target = static_cast<worker_handle*>(tls_cur_worker);
+    bool same_pool = target &&
+                     target->idx_in_pool_ < pool.size() &&
+                     pool[target->idx_in_pool_].get() == target;
+    if (!same_pool) {
+        target = pool[next_worker.fetch_add(1) % pool.size()].get();
+    }
 
-        ptr<logger>& l_ = server->l_;
-        p_tr("added append request to global queue, "
-             "server %p, queue length %zu",
-             server.get(),
-             append_queue_.size());
+    size_t queue_length = 0;
+    {   std::lock_guard<std::mutex> l(target->queue_lock_);
+        target->queue_.push_back(server);
+        queue_length = target->queue_.size();
     }
 
-    // Find a sleeping worker and invoke.
-    for (auto& entry: append_workers_) {
+    ptr<logger>& l_ = server->l_;
+    p_tr("added request to the queue of global worker %zu, "
+         "server %p, queue length %zu",
+         target->id_,
+         server.get(),
+         queue_length);
+
+    // Invoking a working one is cheap; it just skips the next sleep.
+    bool target_was_working = (target->status_ == worker_handle::WORKING);
+    target->ea_.invoke();
+    if (!target_was_working) return;
+
+    // Target is busy, find a sleeping worker to steal it.
+    for (auto& entry: pool) {
         ptr<worker_handle>& wh = entry;
-        if (wh->status_ == worker_handle::SLEEPING) {
+        if (wh.get() != target && wh->status_ == worker_handle::SLEEPING) {
             wh->ea_.invoke();
             break;
         }
     }
-    // If all workers are working, nothing to do for now.
 }
 
-void nuraft_global_mgr::request_commit(ptr<raft_server> server) {
-    {
-        std::lock_guard<std::mutex> l(commit_queue_lock_);
-        // First search the set if the server is duplicate.
-        auto entry = commit_server_set_.find(server);
-        if (entry != commit_server_set_.end()) {
-            // `server` is already in the queue. Ignore it.
-            return;
+ptr<raft_server> nuraft_global_mgr::pop_from_pool
+                 ( std::vector< ptr<worker_handle> >& pool,
+                   worker_handle& handle,
+                   size_t& queue_length_out )
+{
+    {   std::lock_guard<std::mutex> l(handle.queue_lock_);
+        if (!handle.queue_.empty()) {
+            ptr<raft_server> target = handle.queue_.front();
+            handle.queue_.pop_front();
+            queue_length_out = handle.queue_.size();
+            return target;
         }
+    }
 
-        // Put into queue.
-        commit_queue_.push_back(server);
-        commit_server_set_.insert(server);
+    // Own queue is empty, steal from others starting from the next one.
+    size_t num_workers = pool.size();
+    for (size_t ii = 1; ii < num_workers; ++ii) {
+        worker_handle& victim = *pool[(handle.idx_in_pool_ + ii) % num_workers];
+        // Wait for the lock, as it is held only for a single push or pop.
+        // Skipping a busy victim may leave its work behind while this
+        // worker goes to sleep.
+        std::lock_guard<std::mutex> l(victim.queue_lock_);
+        if (victim.queue_.empty()) continue;
+
+        ptr<raft_server> target = victim.queue_.back();
+        victim.queue_.pop_back();
+        queue_length_out = victim.queue_.size();
+        return target;
+    }
+    queue_length_out = 0;
+    return nullptr;
+}
 
-        ptr<logger>& l_ = server->l_;
-        p_tr("added commit request to global queue, "
-             "server %p, queue length %zu",
-             server.get(),
-             commit_queue_.size());
+void nuraft_global_mgr::request_append(ptr<raft_server> server) {
+    if (server->global_append_scheduled_.exchange(true)) {
+        // `server` is already in the queue. Ignore it.
+        return;
     }
+    push_to_pool(append_workers_, next_append_worker_, server);
+}
 
-    // Find a sleeping worker and invoke.
-    for (auto& entry: commit_workers_) {
-        ptr<worker_handle>& wh = entry;
-        if (wh->status_ == worker_handle::SLEEPING) {
-            wh->ea_.invoke();
-            break;
-        }
+void nuraft_global_mgr::request_commit(ptr<raft_server> server) {
+    if (server->global_commit_scheduled_.exchange(true)) {
+        // `server` is already in the queue. Ignore it.
+        return;
     }
-    // If all workers are working, nothing to do for now.
+    push_to_pool(commit_workers_, next_commit_worker_, server);
 }
 
 void nuraft_global_mgr::commit_worker_loop(ptr<worker_handle> handle) {
@@ -273,6 +315,7 @@ void nuraft_global_mgr::commit_worker_loop(ptr<worker_handle> handle) {
 #elif __APPLE__
     pthread_setname_np(thread_name.c_str());
 #endif
+    tls_cur_worker = handle.get();
 
     bool skip_sleeping = false;
     while (!handle->stopping_) {
@@ -287,23 +330,10 @@ void nuraft_global_mgr::commit_worker_loop(ptr<worker_handle> handle) {
 
         skip_sleeping = false;
         size_t queue_length = 0;
-        ptr<raft_server> target = nullptr;
-        {
-            std::lock_guard<std::mutex> l(commit_queue_lock_);
-            auto entry = commit_queue_.begin();
-            if (entry != commit_queue_.end()) {
-                target = *entry;
-                commit_server_set_.erase(target);
-                commit_queue_.pop_front();
-                queue_length = commit_queue_.size();
-                if (!commit_queue_.empty()) {
-                    // Other requests are waiting in the queue,
-                    // skip sleeping next time.
-                    skip_sleeping = true;
-                }
-            }
-        }
+        ptr<raft_server> target =
+            pop_from_pool(commit_workers_, *handle, queue_length);
         if (!target) continue;
+        target->global_commit_scheduled_ = false;
 
         ptr<logger>& l_ = target->l_;
 
@@ -349,6 +379,7 @@ void nuraft_global_mgr::append_worker_loop(ptr<worker_handle> handle) {
 #elif __APPLE__
     pthread_setname_np(thread_name.c_str());
 #endif
+    tls_cur_worker = handle.get();
 
     bool skip_sleeping = false;
     while (!handle->stopping_) {
@@ -363,23 +394,10 @@ void nuraft_global_mgr::append_worker_loop(ptr<worker_handle> handle) {
 
         skip_sleeping = false;
         size_t queue_length = 0;
-        ptr<raft_server> target = nullptr;
-        {
-            std::lock_guard<std::mutex> l(append_queue_lock_);
-            auto entry = append_queue_.begin();
-            if (entry != append_queue_.end()) {
-                target = *entry;
-                append_server_set_.erase(target);
-                append_queue_.pop_front();
-                queue_length = append_queue_.size();
-                if (!append_queue_.empty()) {
-                    // Other requests are waiting in the queue,
-                    // skip sleeping next time.
-                    skip_sleeping = true;
-                }
-            }
-        }
+        ptr<raft_server> target =
+            pop_from_pool(append_workers_, *handle, queue_length);
         if (!target) continue;
+        target->global_append_scheduled_ = false;
 
         ptr<logger>& l_ = target->l_;
 
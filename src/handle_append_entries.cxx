@@ -26,9 +26,13 @@ limitations under the License.
 #include "error_code.hxx"
 #include "event_awaiter.hxx"
 #include "exit_handler.hxx"
+#include "handle_append_entries.hxx"
 #include "handle_custom_notification.hxx"
 #include "peer.hxx"
+#include "peer_replicator.hxx"
+#include "request_tracer.hxx"
 #include "snapshot.hxx"
+#include "stat_mgr.hxx"
 #include "state_machine.hxx"
 #include "state_mgr.hxx"
 #include "tracer.hxx"
@@ -39,94 +43,6 @@ limitations under the License.
 
 namespace nuraft {
 
-/**
- * Additional information in addition to `append_entries_response`.
- */
-struct resp_appendix {
-    enum extra_order : uint8_t {
-        NONE = 0,
-        DO_NOT_REWIND = 1,
-        RECEIVING_SNAPSHOT = 2,
-        NOTIFYING_SM_COMMITTED_INDEX = 3,
-    };
-
-    resp_appendix()
-        : extra_order_(NONE)
-        , sm_committed_idx_(0)
-        {}
-
-    ptr<buffer> serialize() const {
-        const static uint8_t CUR_VERSION = 0;
-        size_t buf_len = sizeof(CUR_VERSION) + sizeof(extra_order_);
-        if (extra_order_ == NOTIFYING_SM_COMMITTED_INDEX) {
-            buf_len += sizeof(sm_committed_idx_);
-        }
-
-        //  << Format >>
-        // Format version       1 byte
-        // Extra order          1 byte
-
-        //  << Format (if order == NOTIFYING_SM_COMMITTED_INDEX) >>
-        // Format version       1 byte
-        // Extra order          1 byte
-        // SM committed index   8 bytes
-
-        ptr<buffer> result = buffer::alloc(buf_len);
-        buffer_serializer bs(*result);
-        bs.put_u8(CUR_VERSION);
-        bs.put_u8(extra_order_);
-        if (extra_order_ == NOTIFYING_SM_COMMITTED_INDEX) {
-            bs.put_u64(sm_committed_idx_);
-        }
-
-        return result;
-    }
-
-    static ptr<resp_appendix> deserialize(buffer& buf) {
-        buffer_serializer bs(buf);
-        ptr<resp_appendix> res = cs_new<resp_appendix>();
-
-        uint8_t cur_ver = bs.get_u8();
-        if (cur_ver != 0) {
-            // Not supported version.
-            return res;
-        }
-
-        res->extra_order_ = static_cast<extra_order>(bs.get_u8());
-        if (res->extra_order_ == NOTIFYING_SM_COMMITTED_INDEX &&
-            bs.pos() + sizeof(uint64_t) <= buf.size()) {
-            res->sm_committed_idx_ = bs.get_u64();
-        }
-        return res;
-    }
-
-    static const char* extra_order_msg(extra_order v) {
-        switch (v) {
-        case NONE:
-            return "NONE";
-        case DO_NOT_REWIND:
-            return "DO_NOT_REWIND";
-        case RECEIVING_SNAPSHOT:
-            return "RECEIVING_SNAPSHOT";
-        case NOTIFYING_SM_COMMITTED_INDEX:
-            return "NOTIFYING_SM_COMMITTED_INDEX";
-        default:
-            return "UNKNOWN";
-        }
-    };
-
-    /**
-     * Extra order for the response.
-     */
-    extra_order extra_order_;
-
-    /**
-     * If non-zero, it indicates the committed log index of
-     * the state machine of the follower who sent this response.
-     */
-    uint64_t sm_committed_idx_;
-};
-
 void raft_server::append_entries_in_bg() {
     std::string thread_name = "nuraft_append";
 #ifdef __linux__
@@ -148,11 +64,14 @@ void raft_server::append_entries_in_bg() {
 }
 
 void raft_server::append_entries_in_bg_exec() {
-    recur_lock(lock_);
+    profiled_lock(lock_);
     request_append_entries();
 }
 
 void raft_server::request_append_entries() {
+    // New log or commit, followers should get it.
+    wake_from_quiescence("new append");
+
     // Special case:
     //   1) one-node cluster, OR
     //   2) quorum size == 1 (including leader).
@@ -168,11 +87,103 @@ void raft_server::request_append_entries() {
     }
 
     for (peer_itor it = peers_.begin(); it != peers_.end(); ++it) {
-        request_append_entries(it->second);
+        request_replication(it->second);
     }
 }
 
-bool raft_server::request_append_entries(ptr<peer> p) {
+bool raft_server::request_replication(ptr<peer> p) {
+    if (!replicator_) {
+        return request_append_entries(p);
+    }
+    // Replicator will set the pending commit flag if the peer is busy.
+    replicator_->schedule(p);
+    return true;
+}
+
+bool raft_server::can_replicate_without_lock(peer& p) {
+    // Other than plain log replication, requests are handled
+    // by `request_append_entries` under the lock.
+    ptr<raft_params> params = ctx_->get_params();
+    int32 last_active_time_ms = p.get_active_timer_us() / 1000;
+    if ( p.get_rsv_msg() ||
+         p.need_to_reconnect() ||
+         last_active_time_ms > params->heart_beat_interval_ *
+                                   raft_server::raft_limits_.reconnect_limit_ ||
+         p.get_last_streamed_log_idx() ||
+         p.is_snapshot_sync_needed() ||
+         p.get_snapshot_sync_ctx() ) {
+        return false;
+    }
+    if ( params->use_bg_thread_for_snapshot_io_ &&
+         snapshot_io_mgr::instance().has_pending_request(this, p.get_id()) ) {
+        return false;
+    }
+    return true;
+}
+
+void raft_server::replicate_to_peer(ptr<peer> p) {
+    {   profiled_lock(lock_);
+        if (stopping_ || role_ != srv_role::leader) return;
+
+        // Peer may have been removed in the meantime.
+        auto entry = peers_.find(p->get_id());
+        if (entry == peers_.end() || entry->second != p) return;
+
+        if (!can_replicate_without_lock(*p)) {
+            if (!request_append_entries(p)) {
+                p->set_pending_commit();
+            }
+            return;
+        }
+
+        cb_func::Param cb_param(id_, leader_, p->get_id());
+        CbReturnCode rc =
+            ctx_->cb_func_.call(cb_func::RequestAppendEntries, &cb_param);
+        if (rc == CbReturnCode::ReturnNull) {
+            p_wn("by callback, abort replication to peer %d", p->get_id());
+            return;
+        }
+
+        if (!p->make_busy()) {
+            // The response of the in-flight request will trigger
+            // the next request.
+            p->set_pending_commit();
+            return;
+        }
+    }
+
+    // Reading logs may take long, do it without holding the lock.
+    // `busy_flag_` prevents others from sending requests to this peer.
+    ptr<req_msg> msg = create_append_entries_req(p, 0, true);
+
+    profiled_lock(lock_);
+    auto entry = peers_.find(p->get_id());
+    bool still_valid = !stopping_ &&
+                       role_ == srv_role::leader &&
+                       entry != peers_.end() &&
+                       entry->second == p;
+    if (!still_valid || (msg && msg->get_term() != state_->get_term())) {
+        p_db("leadership or peer %d has changed while replicating, "
+             "drop the request", p->get_id());
+        p->set_free();
+        return;
+    }
+
+    if (!msg) {
+        // Logs are not available anymore (e.g., log compaction).
+        // Let the original path send a snapshot or notification.
+        p->set_free();
+        if (!request_append_entries(p)) {
+            p->set_pending_commit();
+        }
+        return;
+    }
+
+    rpc_handler m_handler = resp_handler_;
+    send_request(p, msg, m_handler);
+}
+
+bool raft_server::request_append_entries(ptr<peer> p, bool heartbeat) {
     static timer_helper chk_timer(1000*1000);
 
     // Checking the validity of role first.
@@ -343,12 +354,21 @@ bool raft_server::request_append_entries(ptr<peer> p) {
                     int64_t max_stream_bytes =
                         params->max_bytes_in_flight_in_stream_ > 0
                         ? params->max_bytes_in_flight_in_stream_ : 0;
+                    int64_t max_stream_logs = max_gap_in_stream;
+                    if (params->stream_window_autotune_) {
+                        stream_window& sw = p->get_stream_window();
+                        max_stream_logs = sw.get_log_window(max_stream_logs);
+                        max_stream_bytes = sw.get_byte_window(max_stream_bytes);
+                    }
 
-                    if (max_gap_in_stream + p->get_next_log_idx() <=
+                    if (max_stream_logs + p->get_next_log_idx() <=
                             (last_streamed_log_idx + 1) ||
                         (max_stream_bytes &&
                          p->get_bytes_in_flight() > max_stream_bytes)) {
                         streaming = false;
+                        if (params->stream_window_autotune_) {
+                            p->get_stream_window().on_window_full();
+                        }
                     } else {
                         p_tr("send following request to %d in stream mode, "
                              "start idx: %" PRIu64 "", (int)p->get_id(),
@@ -362,7 +382,25 @@ bool raft_server::request_append_entries(ptr<peer> p) {
                 }
 
                 if (streaming || make_busy_result) {
-                    return send_request(p, msg, m_handler, streaming);
+                    if ( heartbeat &&
+                         !streaming &&
+                         msg->get_type() == msg_type::append_entries_request &&
+                         msg->log_entries().empty() &&
+                         can_quiesce() ) {
+                        // Group is idle, ask the follower to quiesce.
+                        msg->set_extra_flags( msg->get_extra_flags() |
+                                              req_msg::QUIESCE );
+                    }
+
+                    // Empty heartbeat can be coalesced with those of
+                    // other groups, if batcher is given.
+                    bool coalesce = heartbeat &&
+                                    !streaming &&
+                                    ctx_->hb_batcher_ &&
+                                    msg->get_type() ==
+                                        msg_type::append_entries_request &&
+                                    msg->log_entries().empty();
+                    return send_request(p, msg, m_handler, streaming, coalesce);
                 }
             } else {
                 if (!streaming) {
@@ -406,7 +444,8 @@ bool raft_server::request_append_entries(ptr<peer> p) {
 bool raft_server::send_request(ptr<peer>& p,
                                ptr<req_msg>& msg,
                                rpc_handler& m_handler,
-                               bool streaming) {
+                               bool streaming,
+                               bool coalesce) {
     if (!p->is_manual_free()) {
         // Actual recovery.
         if ( p->get_long_puase_warnings() >=
@@ -436,8 +475,15 @@ bool raft_server::send_request(ptr<peer>& p,
         p->reset_manual_free();
     }
 
-    p->send_req(p, msg, m_handler, streaming);
+    if (!msg->log_entries().empty()) {
+        ulong start_idx = msg->get_last_log_idx() + 1;
+        req_tracer_->on_sent( p->get_id(),
+                              start_idx,
+                              start_idx + msg->log_entries().size() );
+    }
+    p->send_req(p, msg, m_handler, streaming, coalesce);
     p->reset_ls_timer();
+    num_ae_sent_stat_->inc();
 
     cb_func::Param param(id_, leader_, p->get_id(), msg.get());
     ctx_->cb_func_.call(cb_func::SentAppendEntriesReq, &param);
@@ -463,7 +509,8 @@ bool raft_server::send_request(ptr<peer>& p,
 }
 
 ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
-                                                    ulong custom_last_log_idx) {
+                                                    ulong custom_last_log_idx,
+                                                    bool entries_only) {
     peer& p = *pp;
     ulong cur_nxt_idx(0L);
     ulong commit_idx(0L);
@@ -472,7 +519,7 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
     ulong starting_idx(1L);
 
     {
-        recur_lock(lock_);
+        profiled_lock(lock_);
         starting_idx = log_store_->start_index();
         cur_nxt_idx = precommit_index_ + 1;
         commit_idx = quick_commit_index_;
@@ -480,7 +527,7 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
     }
 
     {
-        std::lock_guard<std::mutex> guard(p.get_lock());
+        profiled_guard(guard, p.get_lock());
         if (p.get_next_log_idx() == 0L) {
             p.set_next_log_idx(cur_nxt_idx);
         }
@@ -547,8 +594,18 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
     if ((last_log_idx + 1) >= cur_nxt_idx) {
         log_entries = ptr<std::vector<ptr<log_entry>>>();
     } else if (entries_valid) {
+        int64 bs_hint = p.get_next_batch_size_hint_in_bytes();
+        if (params->target_append_latency_us_ > 0 && bs_hint >= 0) {
+            // Size of the batch meeting the target latency of the peer,
+            // but not bigger than the hint from its state machine.
+            int64 bs_target = p.get_batch_size_ctl().get_batch_size
+                              ( params->target_append_latency_us_ );
+            if (bs_target && (!bs_hint || bs_target < bs_hint)) {
+                bs_hint = bs_target;
+            }
+        }
         log_entries = log_store_->log_entries_ext(last_log_idx + 1, end_idx,
-                                                  p.get_next_batch_size_hint_in_bytes());
+                                                  bs_hint);
         if (log_entries == nullptr) {
             p_wn("failed to retrieve log entries: %" PRIu64 " - %" PRIu64,
                  last_log_idx + 1, end_idx);
@@ -556,6 +613,11 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
         }
     }
 
+    if (!entries_valid && entries_only) {
+        // Caller will handle it.
+        return nullptr;
+    }
+
     if (!entries_valid) {
         // Required log entries are missing. First, we try to use snapshot to recover.
         // To avoid inconsistency due to smart pointer, should have local varaible
@@ -646,6 +708,12 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
     }
     p.set_last_sent_idx(last_log_idx + 1);
 
+    set_excluded_flag(p, *req);
+    return req;
+}
+
+void raft_server::set_excluded_flag(peer& p, req_msg& req) {
+    ptr<raft_params> params = ctx_->get_params();
     if (params->use_full_consensus_among_healthy_members_) {
         // Full consensus mode: set flag indicating the member is excluded.
         uint64_t last_resp_time_ms = p.get_resp_timer_us() / 1000;
@@ -656,17 +724,18 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
             ? quick_commit_index_ - params->max_append_size_ : 0;
         if (last_resp_time_ms > expiry ||
             p.get_matched_idx() < required_log_idx) {
-            req->set_extra_flags(
-                req->get_extra_flags() | req_msg::EXCLUDED_FROM_THE_QUORUM);
+            req.set_extra_flags(
+                req.get_extra_flags() | req_msg::EXCLUDED_FROM_THE_QUORUM);
         }
     }
-
-    return req;
 }
 
 ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
 {
+    num_ae_rcvd_stat_->inc();
     ptr<raft_params> params = ctx_->get_params();
+    uint64_t received_us = params->trace_sample_interval_ > 0
+                           ? timer_helper::get_timeofday_us() : 0;
     uint64_t time_gap_ms = last_rcvd_append_entries_req_.get_ms();
     last_rcvd_append_entries_req_.reset();
     if (params->use_full_consensus_among_healthy_members_ &&
@@ -830,6 +899,26 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
             resp->set_ctx( appendix.serialize() );
             p_lv(log_lv, "appended extra order %s",
                  resp_appendix::extra_order_msg(appendix.extra_order_));
+
+        } else if ( req.get_term() >= state_->get_term() &&
+                    log_term &&
+                    log_term != req.get_last_log_term() ) {
+            // This node has a log at the given index, but with a different
+            // term. Let the leader know the conflicting term and the first
+            // index of it, so that the leader can skip the entire term
+            // at once, instead of rewinding one by one.
+            resp_appendix appendix;
+            appendix.extra_order_ = resp_appendix::CONFLICT_TERM_HINT;
+            appendix.conflict_term_ = log_term;
+            appendix.conflict_term_first_idx_ =
+                std::min( lower_bound_log_term(log_term, 1, req.get_last_log_idx()),
+                          req.get_last_log_idx() );
+            resp->set_ctx( appendix.serialize() );
+            p_lv(log_lv, "appended extra order %s, term %" PRIu64
+                 ", first idx %" PRIu64,
+                 resp_appendix::extra_order_msg(appendix.extra_order_),
+                 appendix.conflict_term_,
+                 appendix.conflict_term_first_idx_);
         }
         resp->set_next_batch_size_hint_in_bytes(
             state_machine_->get_next_batch_size_hint_in_bytes());
@@ -882,6 +971,10 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
     // Reset timer.
     last_rcvd_valid_append_entries_req_.reset();
 
+    // Time taken to write logs, and their size, reported to the leader.
+    uint64_t append_latency_us = 0;
+    uint64_t append_bytes = 0;
+
     if (req.log_entries().size() > 0) {
         // Write logs to store, start from overlapped logs
 
@@ -899,7 +992,7 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
         while ( log_idx < log_store_->next_slot() &&
                 cnt < req.log_entries().size() )
         {
-            if ( log_store_->term_at(log_idx) ==
+            if ( log_term_at(log_idx) ==
                      req.log_entries().at(cnt)->get_term() ) {
                 log_idx++;
                 cnt++;
@@ -909,6 +1002,12 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
         }
         p_db("[after SKIP] log_idx: %" PRIu64 ", count: %zu", log_idx, cnt);
 
+        timer_helper append_timer;
+        for (size_t ii = cnt; ii < req.log_entries().size(); ++ii) {
+            ptr<log_entry>& entry = req.log_entries()[ii];
+            if (!entry->is_buf_null()) append_bytes += entry->get_buf().size();
+        }
+
         // Rollback (only if necessary).
         // WARNING:
         //   1) Rollback should be done separately before overwriting,
@@ -946,6 +1045,14 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                       log_idx - 1 );
                 sm_commit_index_ = log_idx - 1;
             }
+            // Logs of the deferred batches will be overwritten, the log
+            // store may never make them durable.
+            if ( deferred_durable_idx_ >= log_idx ) {
+                p_in( "clamp deferred durable index from %" PRIu64 " to %" PRIu64,
+                      deferred_durable_idx_,
+                      log_idx - 1 );
+                deferred_durable_idx_ = log_idx - 1;
+            }
 
             for ( uint64_t ii = 0; ii < my_last_log_idx - log_idx + 1; ++ii ) {
                 uint64_t idx = my_last_log_idx - ii;
@@ -1001,12 +1108,18 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                  log_store_->next_slot() - 1);
         }
 
-        // Append new log entries
-        while (cnt < req.log_entries().size()) {
-            ptr<log_entry> entry = req.log_entries().at( cnt++ );
+        // Append new log entries, all at once.
+        std::vector< ptr<log_entry> > remaining_entries;
+        if (cnt && cnt < req.log_entries().size()) {
+            remaining_entries.assign( req.log_entries().begin() + cnt,
+                                      req.log_entries().end() );
+        }
+        std::vector< ptr<log_entry> >& entries_to_append =
+            cnt ? remaining_entries : req.log_entries();
+        ulong idx_for_entry = store_log_entries(entries_to_append);
+        for (ptr<log_entry>& entry: entries_to_append) {
             p_tr("append at %" PRIu64 ", term %" PRIu64 ", timestamp %" PRIu64 "\n",
-                 log_store_->next_slot(), entry->get_term(), entry->get_timestamp());
-            ulong idx_for_entry = store_log_entry(entry);
+                 idx_for_entry, entry->get_term(), entry->get_timestamp());
             if (entry->get_val_type() == log_val_type::conf) {
                 p_in( "receive a config change from leader at %" PRIu64,
                       idx_for_entry );
@@ -1018,30 +1131,27 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                 state_machine_->pre_commit_ext
                     ( state_machine::ext_op_params( idx_for_entry, buf ) );
             }
+            idx_for_entry++;
 
             if (stopping_) return resp;
         }
 
         // End of batch.
-        log_store_->end_of_append_batch( req.get_last_log_idx() + 1,
-                                         req.log_entries().size() );
-
-        if (params->parallel_log_appending_) {
-            uint64_t last_durable_index = log_store_->last_durable_index();
-            while ( last_durable_index <
-                    req.get_last_log_idx() + req.log_entries().size() ) {
-                // Some logs are not durable yet, wait here and block the thread.
-                p_tr( "durable index %" PRIu64
-                      ", sleep and wait for log appending completion",
-                      last_durable_index );
-                ea_follower_log_append_->wait_ms(params->heart_beat_interval_);
-
-                // --- `notify_log_append_completion` API will wake it up. ---
-
-                ea_follower_log_append_->reset();
-                last_durable_index = log_store_->last_durable_index();
-                p_tr( "wake up, durable index %" PRIu64, last_durable_index );
-            }
+        bool more_in_stream = req.get_extra_flags() & req_msg::MORE_IN_STREAM;
+        end_of_append_batch( req.get_last_log_idx() + 1,
+                             req.log_entries().size(),
+                             more_in_stream );
+        if (more_in_stream) {
+            // The end of batch (or the durability wait) is deferred,
+            // the elapsed time so far does not include it. Skip this sample,
+            // otherwise the leader will underestimate the append latency.
+            append_bytes = 0;
+        } else if (append_bytes) {
+            append_latency_us = append_timer.get_us();
+            log_append_latency_stat_->add_value(append_latency_us);
+        }
+        if (params->trace_sample_interval_ > 0) {
+            start_follower_traces(req, received_us);
         }
     }
 
@@ -1090,7 +1200,8 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
         // If updating `precommit_index_` failed, we SHOULD NOT update
         // commit index as well.
     } else {
-        commit( std::min( req.get_commit_idx(), target_precommit_index ) );
+        commit_appended_logs
+            ( std::min( req.get_commit_idx(), target_precommit_index ) );
     }
 
     resp->accept(target_precommit_index + 1);
@@ -1122,17 +1233,27 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
         );
     }
 
+    resp_appendix appendix;
     if (ctx_->get_params()->track_peers_sm_commit_idx_) {
         // If peer track mode is enabled, we should send
         // the current SM committed index to the leader.
-        resp_appendix appendix;
         appendix.extra_order_ = resp_appendix::NOTIFYING_SM_COMMITTED_INDEX;
         appendix.sm_committed_idx_ = sm_commit_index_.load();
-        resp->set_ctx( appendix.serialize() );
         p_tr("appended extra order %s, sm committed index: %" PRIu64,
              resp_appendix::extra_order_msg(appendix.extra_order_),
              appendix.sm_committed_idx_);
     }
+    if (ctx_->get_params()->target_append_latency_us_ > 0 && append_bytes) {
+        // For the leader to size the next batch.
+        appendix.append_latency_us_ = append_latency_us;
+        appendix.append_bytes_ = append_bytes;
+        p_tr("append latency %" PRIu64 " us, %" PRIu64 " bytes",
+             append_latency_us, append_bytes);
+    }
+    if ( appendix.extra_order_ != resp_appendix::NONE ||
+         appendix.has_append_latency() ) {
+        resp->set_ctx( appendix.serialize() );
+    }
 
     p_tr("batch size hint: %" PRId64 " bytes, flags: %" PRIx64,
          bs_hint, resp->get_extra_flags());
@@ -1165,6 +1286,29 @@ bool raft_server::try_update_precommit_index(ulong desired, const size_t MAX_ATT
     return false;
 }
 
+ulong raft_server::get_next_log_idx_by_conflict_term(ulong conflict_term,
+                                                     ulong conflict_term_first_idx,
+                                                     ulong prev_next_log)
+{
+    if (prev_next_log <= 1) return 0;
+
+    // If this leader also has logs of the conflicting term, the follower
+    // may have them too. Resume right after the last one.
+    // Otherwise, the entire term in the follower's log is divergent,
+    // resume from the first log of that term.
+    ulong new_next_log = conflict_term_first_idx;
+    ulong start_idx = log_store_->start_index();
+    ulong idx = lower_bound_log_term(conflict_term + 1, 1, prev_next_log - 1);
+    if ( idx > start_idx &&
+         log_term_at(idx - 1) == conflict_term ) {
+        new_next_log = idx;
+    }
+
+    // Should move backward only. If not, fall back to the normal rewind.
+    if (!new_next_log || new_next_log >= prev_next_log) return 0;
+    return new_next_log;
+}
+
 void raft_server::handle_append_entries_resp(resp_msg& resp) {
     peer_itor it = peers_.find(resp.get_src());
     if (it == peers_.end()) {
@@ -1215,21 +1359,26 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
         uint64_t prev_sm_committed_idx = p->get_sm_committed_idx();
         uint64_t new_sm_committed_idx = 0;
 
-        if (resp.get_ctx() &&
-            ctx_->get_params()->track_peers_sm_commit_idx_) {
+        if (resp.get_ctx()) {
             // If the response contains appendix, it should be
             // `resp_appendix` type.
             ptr<resp_appendix> appendix = resp_appendix::deserialize(*resp.get_ctx());
-            if (appendix->extra_order_ == resp_appendix::NOTIFYING_SM_COMMITTED_INDEX) {
+            if ( ctx_->get_params()->track_peers_sm_commit_idx_ &&
+                 appendix->extra_order_ ==
+                     resp_appendix::NOTIFYING_SM_COMMITTED_INDEX ) {
                 new_sm_committed_idx = appendix->sm_committed_idx_;
                 p_tr("sm committed index of peer %d: %" PRIu64 " -> %" PRIu64,
                      p->get_id(), prev_sm_committed_idx, new_sm_committed_idx);
                 p->set_sm_committed_idx(new_sm_committed_idx);
             }
+            if (appendix->has_append_latency()) {
+                p->get_batch_size_ctl().on_append_latency
+                    ( appendix->append_bytes_, appendix->append_latency_us_ );
+            }
         }
 
         {
-            std::lock_guard<std::mutex> l(p->get_lock());
+            profiled_guard(l, p->get_lock());
             p->set_next_log_idx(resp.get_next_idx());
             prev_matched_idx = p->get_matched_idx();
             new_matched_idx = resp.get_next_idx() - 1;
@@ -1238,6 +1387,7 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
             p->set_matched_idx(new_matched_idx);
             p->set_last_accepted_log_idx(new_matched_idx);
         }
+        req_tracer_->on_acked(p->get_id(), new_matched_idx);
         cb_func::Param param(id_, leader_, p->get_id());
         param.ctx = &new_matched_idx;
         CbReturnCode rc = ctx_->cb_func_.call
@@ -1284,13 +1434,14 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
                           next_idx_to_send < log_store_->next_slot();
 
     } else {
-        std::lock_guard<std::mutex> guard(p->get_lock());
+        profiled_guard(guard, p->get_lock());
         ulong prev_next_log = p->get_next_log_idx();
         if (resp.get_next_idx() > 0 && prev_next_log > resp.get_next_idx()) {
             // fast move for the peer to catch up
             p->set_next_log_idx(resp.get_next_idx());
         } else {
             bool do_log_rewind = true;
+            ulong hinted_next_log = 0;
             // If not, check an extra order exists.
             if (resp.get_ctx()) {
                 ptr<resp_appendix> appendix = resp_appendix::deserialize(*resp.get_ctx());
@@ -1300,6 +1451,13 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
                     p->set_snapshot_sync_is_needed(true);
                     p_in("peer %d was in snapshot sync mode, re-sending a snapshot",
                          p->get_id());
+                } else if ( appendix->extra_order_ ==
+                                resp_appendix::CONFLICT_TERM_HINT &&
+                            appendix->conflict_term_ ) {
+                    hinted_next_log = get_next_log_idx_by_conflict_term
+                                      ( appendix->conflict_term_,
+                                        appendix->conflict_term_first_idx_,
+                                        prev_next_log );
                 }
 
                 static timer_helper extra_order_timer(1000 * 1000, true);
@@ -1309,7 +1467,9 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
             }
             // if not, move one log backward.
             // WARNING: Make sure that `next_log_idx_` shouldn't be smaller than 0.
-            if (do_log_rewind && prev_next_log) {
+            if (do_log_rewind && hinted_next_log) {
+                p->set_next_log_idx(hinted_next_log);
+            } else if (do_log_rewind && prev_next_log) {
                 p->set_next_log_idx(prev_next_log - 1);
             }
         }
@@ -1451,7 +1611,7 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
         if (need_to_catchup) {
             p_db("reqeust append entries need to catchup, p %d\n",
                  (int)p->get_id());
-            request_append_entries(p);
+            request_replication(p);
         }
         if (status_check_timer_.timeout_and_reset()) {
             check_overall_status();
@@ -1473,33 +1633,24 @@ uint64_t raft_server::get_current_leader_index() {
 }
 
 ulong raft_server::get_expected_committed_log_idx() {
-    std::vector<ulong> matched_indexes;
-    state_machine::adjust_commit_index_params aci_params;
-    matched_indexes.reserve(16);
-    aci_params.peer_index_map_.reserve(16);
+    // This is called on every ack, reuse the buffer to avoid allocation.
+    // It is a public API that can be called without `lock_`,
+    // so the buffer should not be shared across threads.
+    static thread_local std::vector<ulong> matched_indexes;
+    matched_indexes.clear();
 
     // Put the index of leader itself.
     uint64_t leader_index = get_current_leader_index();
     matched_indexes.push_back( leader_index );
-    aci_params.peer_index_map_[id_] = leader_index;
 
     for (auto& entry: peers_) {
         ptr<peer>& p = entry.second;
-        aci_params.peer_index_map_[p->get_id()] = p->get_matched_idx();
-
         if (!is_regular_member(p)) continue;
         matched_indexes.push_back( p->get_matched_idx() );
     }
     int voting_members = get_num_voting_members();
     assert((int32)matched_indexes.size() == voting_members);
 
-    // NOTE: Descending order.
-    //       e.g.) 100 100 99 95 92
-    //             => commit on 99 if `quorum_idx == 2`.
-    std::sort( matched_indexes.begin(),
-               matched_indexes.end(),
-               std::greater<ulong>() );
-
     size_t quorum_idx = get_quorum_for_commit();
     if (ctx_->get_params()->use_full_consensus_among_healthy_members_) {
         ptr<raft_params> params = ctx_->get_params();
@@ -1537,7 +1688,24 @@ ulong raft_server::get_expected_committed_log_idx() {
         }
     }
 
-    if (l_ && l_->get_level() >= 6) {
+    // NOTE: Descending order.
+    //       e.g.) 100 100 99 95 92
+    //             => commit on 99 if `quorum_idx == 2`.
+    //       Only the `quorum_idx`-th element matters,
+    //       full sorting is needed only for the log below.
+    bool trace_on = l_ && l_->get_level() >= 6;
+    if (trace_on) {
+        std::sort( matched_indexes.begin(),
+                   matched_indexes.end(),
+                   std::greater<ulong>() );
+    } else {
+        std::nth_element( matched_indexes.begin(),
+                          matched_indexes.begin() + quorum_idx,
+                          matched_indexes.end(),
+                          std::greater<ulong>() );
+    }
+
+    if (trace_on) {
         std::string tmp_str = "[";
         for (size_t ii = 0; ii < matched_indexes.size(); ++ii) {
             tmp_str += std::to_string(matched_indexes[ii]);
@@ -1550,8 +1718,20 @@ ulong raft_server::get_expected_committed_log_idx() {
         p_tr("quorum idx %zu, %s", quorum_idx, tmp_str.c_str());
     }
 
+    uint64_t expected_commit_index = matched_indexes[quorum_idx];
+    if (!state_machine_->adjusts_commit_index()) {
+        return expected_commit_index;
+    }
+
+    state_machine::adjust_commit_index_params aci_params;
+    aci_params.peer_index_map_.reserve(peers_.size() + 1);
+    aci_params.peer_index_map_[id_] = leader_index;
+    for (auto& entry: peers_) {
+        ptr<peer>& p = entry.second;
+        aci_params.peer_index_map_[p->get_id()] = p->get_matched_idx();
+    }
     aci_params.current_commit_index_ = quick_commit_index_;
-    aci_params.expected_commit_index_ = matched_indexes[quorum_idx];
+    aci_params.expected_commit_index_ = expected_commit_index;
     uint64_t adjusted_commit_index = state_machine_->adjust_commit_index(aci_params);
     if (aci_params.expected_commit_index_ != adjusted_commit_index) {
         p_tr( "commit index adjusted: %" PRIu64 " -> %" PRIu64,
@@ -1560,11 +1740,119 @@ ulong raft_server::get_expected_committed_log_idx() {
     return adjusted_commit_index;
 }
 
+void raft_server::start_follower_traces(req_msg& req, uint64_t received_us) {
+    ulong interval = ctx_->get_params()->trace_sample_interval_;
+    std::vector< ptr<log_entry> >& entries = req.log_entries();
+    ulong start_idx = req.get_last_log_idx() + 1;
+    ulong end_idx = start_idx + entries.size();
+    uint64_t appended_us = timer_helper::get_timeofday_us();
+
+    // The same logs as the leader's, multiples of the interval.
+    ulong idx = start_idx + (interval - start_idx % interval) % interval;
+    for (; idx < end_idx; idx += interval) {
+        ptr<log_entry>& le = entries[idx - start_idx];
+        if (le->get_val_type() != log_val_type::app_log) continue;
+        req_tracer_->start_follower( idx,
+                                     le->get_term(),
+                                     received_us,
+                                     le->get_timestamp(),
+                                     appended_us );
+    }
+}
+
+void raft_server::end_of_append_batch(ulong start,
+                                      ulong cnt,
+                                      bool more_in_stream)
+{
+    ptr<raft_params> params = ctx_->get_params();
+    if (params->parallel_log_appending_) {
+        // Let the log store start writing now, so that it overlaps
+        // with receiving the next request. Only the wait is deferred.
+        log_store_->end_of_append_batch(start, cnt);
+        if (more_in_stream) {
+            deferred_durable_idx_ = std::max(deferred_durable_idx_, start + cnt - 1);
+            return;
+        }
+        deferred_durable_idx_ = 0;
+        wait_for_durable_log(start + cnt - 1);
+        return;
+    }
+
+    // The latest batch may overwrite the deferred one,
+    // the end is always that of the latest batch.
+    if (deferred_append_end_) {
+        start = std::min(start, deferred_append_start_);
+    }
+    ulong end = start + cnt;
+    if (more_in_stream) {
+        p_tr("defer end of append batch %" PRIu64 " - %" PRIu64, start, end - 1);
+        deferred_append_start_ = start;
+        deferred_append_end_ = end;
+        return;
+    }
+    deferred_append_start_ = deferred_append_end_ = 0;
+    log_store_->end_of_append_batch(start, end - start);
+}
+
+void raft_server::wait_for_durable_log(ulong log_idx) {
+    ptr<raft_params> params = ctx_->get_params();
+    uint64_t last_durable_index = log_store_->last_durable_index();
+    while (last_durable_index < log_idx) {
+        // Some logs are not durable yet, wait here and block the thread.
+        p_tr( "durable index %" PRIu64
+              ", sleep and wait for log appending completion",
+              last_durable_index );
+        ea_follower_log_append_->wait_ms(params->heart_beat_interval_);
+
+        // --- `notify_log_append_completion` API will wake it up. ---
+
+        ea_follower_log_append_->reset();
+        last_durable_index = log_store_->last_durable_index();
+        p_tr( "wake up, durable index %" PRIu64, last_durable_index );
+    }
+}
+
+void raft_server::flush_deferred_append_batch() {
+    profiled_lock(lock_);
+    if (deferred_append_end_) {
+        ulong start = deferred_append_start_;
+        ulong cnt = deferred_append_end_ - deferred_append_start_;
+        deferred_append_start_ = deferred_append_end_ = 0;
+        log_store_->end_of_append_batch(start, cnt);
+    }
+    if (deferred_durable_idx_) {
+        ulong log_idx = deferred_durable_idx_;
+        deferred_durable_idx_ = 0;
+        wait_for_durable_log(log_idx);
+    }
+    if (deferred_commit_idx_) {
+        // Logs held back by `commit_appended_logs` are durable now.
+        ulong target_idx = deferred_commit_idx_;
+        deferred_commit_idx_ = 0;
+        commit(target_idx);
+    }
+}
+
+void raft_server::commit_appended_logs(ulong target_idx) {
+    // Logs whose end of batch (or durability wait) is deferred may not be
+    // durable yet, they should not be applied to the state machine.
+    // The rest will be committed by `flush_deferred_append_batch`.
+    ulong capped_idx = target_idx;
+    if (deferred_append_end_) {
+        capped_idx = std::min(capped_idx, deferred_append_start_ - 1);
+    }
+    if (deferred_durable_idx_) {
+        capped_idx = std::min(capped_idx, log_store_->last_durable_index());
+    }
+    deferred_commit_idx_ = (capped_idx < target_idx) ? target_idx : 0;
+    commit(capped_idx);
+}
+
 void raft_server::notify_log_append_completion(bool ok) {
     p_tr("got log append completion notification: %s", ok ? "OK" : "FAILED");
 
     if (role_ == srv_role::leader) {
-        recur_lock(lock_);
+        profiled_lock(lock_);
         if (!ok) {
             // If log appending fails, leader should resign immediately.
             p_er("log appending failed, resign immediately");
@@ -1590,7 +1878,7 @@ void raft_server::notify_log_append_completion(bool ok) {
         if (!ok) {
             // If log appending fails for follower, there is no way to proceed it.
             // We should stop the server immediately.
-            recur_lock(lock_);
+            profiled_lock(lock_);
             p_ft("log appending failed, stop this server");
             ctx_->state_mgr_->system_exit(N21_log_flush_failed);
             return;
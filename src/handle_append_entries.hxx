@@ -0,0 +1,175 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "buffer.hxx"
+#include "buffer_serializer.hxx"
+#include "ptr.hxx"
+
+#include <cstdint>
+
+namespace nuraft {
+
+/**
+ * Additional information in addition to `append_entries_response`.
+ */
+struct resp_appendix {
+    enum extra_order : uint8_t {
+        NONE = 0,
+        DO_NOT_REWIND = 1,
+        RECEIVING_SNAPSHOT = 2,
+        NOTIFYING_SM_COMMITTED_INDEX = 3,
+        CONFLICT_TERM_HINT = 4,
+    };
+
+    resp_appendix()
+        : extra_order_(NONE)
+        , sm_committed_idx_(0)
+        , conflict_term_(0)
+        , conflict_term_first_idx_(0)
+        , append_latency_us_(0)
+        , append_bytes_(0)
+        {}
+
+    bool has_append_latency() const {
+        return append_latency_us_ || append_bytes_;
+    }
+
+    ptr<buffer> serialize() const {
+        const static uint8_t CUR_VERSION = 0;
+        size_t buf_len = sizeof(CUR_VERSION) + sizeof(extra_order_);
+        if (extra_order_ == NOTIFYING_SM_COMMITTED_INDEX) {
+            buf_len += sizeof(sm_committed_idx_);
+        } else if (extra_order_ == CONFLICT_TERM_HINT) {
+            buf_len += sizeof(conflict_term_) + sizeof(conflict_term_first_idx_);
+        }
+        if (has_append_latency()) {
+            buf_len += sizeof(append_latency_us_) + sizeof(append_bytes_);
+        }
+
+        //  << Format >>
+        // Format version       1 byte
+        // Extra order          1 byte
+
+        //  << Format (if order == NOTIFYING_SM_COMMITTED_INDEX) >>
+        // Format version       1 byte
+        // Extra order          1 byte
+        // SM committed index   8 bytes
+
+        //  << Format (if order == CONFLICT_TERM_HINT) >>
+        // Format version       1 byte
+        // Extra order          1 byte
+        // Conflict term        8 bytes
+        // First index of term  8 bytes
+
+        //  << Optional, after any of the above >>
+        // Append latency (us)  8 bytes
+        // Appended bytes       8 bytes
+
+        ptr<buffer> result = buffer::alloc(buf_len);
+        buffer_serializer bs(*result);
+        bs.put_u8(CUR_VERSION);
+        bs.put_u8(extra_order_);
+        if (extra_order_ == NOTIFYING_SM_COMMITTED_INDEX) {
+            bs.put_u64(sm_committed_idx_);
+        } else if (extra_order_ == CONFLICT_TERM_HINT) {
+            bs.put_u64(conflict_term_);
+            bs.put_u64(conflict_term_first_idx_);
+        }
+        if (has_append_latency()) {
+            bs.put_u64(append_latency_us_);
+            bs.put_u64(append_bytes_);
+        }
+
+        return result;
+    }
+
+    static ptr<resp_appendix> deserialize(buffer& buf) {
+        buffer_serializer bs(buf);
+        ptr<resp_appendix> res = cs_new<resp_appendix>();
+
+        uint8_t cur_ver = bs.get_u8();
+        if (cur_ver != 0) {
+            // Not supported version.
+            return res;
+        }
+
+        res->extra_order_ = static_cast<extra_order>(bs.get_u8());
+        if (res->extra_order_ == NOTIFYING_SM_COMMITTED_INDEX &&
+            bs.pos() + sizeof(uint64_t) <= buf.size()) {
+            res->sm_committed_idx_ = bs.get_u64();
+        } else if (res->extra_order_ == CONFLICT_TERM_HINT &&
+                   bs.pos() + sizeof(uint64_t) * 2 <= buf.size()) {
+            res->conflict_term_ = bs.get_u64();
+            res->conflict_term_first_idx_ = bs.get_u64();
+        }
+        if (bs.pos() + sizeof(uint64_t) * 2 <= buf.size()) {
+            res->append_latency_us_ = bs.get_u64();
+            res->append_bytes_ = bs.get_u64();
+        }
+        return res;
+    }
+
+    static const char* extra_order_msg(extra_order v) {
+        switch (v) {
+        case NONE:
+            return "NONE";
+        case DO_NOT_REWIND:
+            return "DO_NOT_REWIND";
+        case RECEIVING_SNAPSHOT:
+            return "RECEIVING_SNAPSHOT";
+        case NOTIFYING_SM_COMMITTED_INDEX:
+            return "NOTIFYING_SM_COMMITTED_INDEX";
+        case CONFLICT_TERM_HINT:
+            return "CONFLICT_TERM_HINT";
+        default:
+            return "UNKNOWN";
+        }
+    };
+
+    /**
+     * Extra order for the response.
+     */
+    extra_order extra_order_;
+
+    /**
+     * If non-zero, it indicates the committed log index of
+     * the state machine of the follower who sent this response.
+     */
+    uint64_t sm_committed_idx_;
+
+    /**
+     * If non-zero, it indicates the term of the follower's log
+     * that conflicts with the previous log of the request.
+     */
+    uint64_t conflict_term_;
+
+    /**
+     * The first log index of `conflict_term_` in the follower's log.
+     */
+    uint64_t conflict_term_first_idx_;
+
+    /**
+     * Time taken by the follower to write the logs of the request,
+     * and their size. Both 0 if not reported.
+     */
+    uint64_t append_latency_us_;
+    uint64_t append_bytes_;
+};
+
+} // namespace nuraft;
+
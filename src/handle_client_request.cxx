@@ -25,6 +25,7 @@ limitations under the License.
 #include "debugging_options.hxx"
 #include "error_code.hxx"
 #include "global_mgr.hxx"
+#include "request_tracer.hxx"
 #include "state_machine.hxx"
 #include "state_mgr.hxx"
 #include "tracer.hxx"
@@ -44,14 +45,14 @@ ptr<resp_msg> raft_server::handle_cli_req_prelock(req_msg& req,
 
     switch (params->locking_method_type_) {
         case raft_params::single_mutex: {
-            recur_lock(lock_);
+            profiled_lock(lock_);
             resp = handle_cli_req(req, ext_params, timestamp_us);
             break;
         }
         case raft_params::dual_mutex:
         default: {
             // TODO: Use RW lock here.
-            recur_lock(cli_lock_);
+            profiled_lock(cli_lock_);
             resp = handle_cli_req(req, ext_params, timestamp_us);
             break;
         }
@@ -77,7 +78,7 @@ void raft_server::request_append_entries_for_all() {
         }
     } else {
         // Directly generate request in user thread.
-        recur_lock(lock_);
+        profiled_lock(lock_);
         request_append_entries();
     }
 }
@@ -117,11 +118,13 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
         // force the log's term to current term
         entries.at(i)->set_term(cur_term);
         entries.at(i)->set_timestamp(timestamp_us);
+    }
+    ulong first_idx = store_log_entries(entries);
 
-        ulong next_slot = store_log_entry(entries.at(i));
+    for (size_t i = 0; i < num_entries; ++i) {
+        last_idx = first_idx + i;
         p_db("append at log_idx %" PRIu64 ", timestamp %" PRIu64,
-             next_slot, timestamp_us);
-        last_idx = next_slot;
+             last_idx, timestamp_us);
 
         ptr<buffer> buf = entries.at(i)->get_buf_ptr();
         buf->pos(0);
@@ -139,6 +142,18 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
     if (num_entries) {
         log_store_->end_of_append_batch(last_idx - num_entries + 1, num_entries);
     }
+    if ( num_entries &&
+         request_tracer::is_sampled( first_idx, last_idx,
+                                     params->trace_sample_interval_ ) ) {
+        // Should be done before updating the precommit index,
+        // so that the commit thread cannot finish the logs before this.
+        req_tracer_->start_leader( first_idx,
+                                   last_idx,
+                                   cur_term,
+                                   timestamp_us,
+                                   timer_helper::get_timeofday_us(),
+                                   !get_config()->is_async_replication() );
+    }
     try_update_precommit_index(last_idx);
     resp_idx = log_store_->next_slot();
 
@@ -155,6 +170,7 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
         timer_helper::sleep_us(sleep_us);
     }
 
+    std::vector<request_trace> traces;
     if (!get_config()->is_async_replication()) {
         // Sync replication:
         //   Set callback function for `last_idx`.
@@ -162,7 +178,7 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
         elem->idx_ = last_idx;
         elem->result_code_ = cmd_result_code::TIMEOUT;
 
-        {   auto_lock(commit_ret_elems_lock_);
+        {   profiled_lock(commit_ret_elems_lock_);
             auto entry = commit_ret_elems_.find(last_idx);
             if (entry != commit_ret_elems_.end()) {
                 // Commit thread was faster than this.
@@ -186,6 +202,9 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
                 // Async handler: create & set async result object.
                 if (!elem->async_result_) {
                     elem->async_result_ = cs_new< cmd_result< ptr<buffer> > >();
+                } else {
+                    // Already committed, the result is returned right away.
+                    req_tracer_->on_returned(last_idx, traces);
                 }
                 resp->set_async_cb
                       ( std::bind( &raft_server::handle_cli_req_callback_async,
@@ -202,6 +221,7 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
               last_idx, ret_value.get() );
         resp->set_ctx(ret_value);
     }
+    if (!traces.empty()) report_traces(traces);
 
     resp->accept(resp_idx);
     return resp;
@@ -217,7 +237,7 @@ ptr<resp_msg> raft_server::handle_cli_req_callback(ptr<commit_ret_elem> elem,
     uint64_t idx = 0;
     uint64_t elapsed_us = 0;
     ptr<buffer> ret_value = nullptr;
-    {   auto_lock(commit_ret_elems_lock_);
+    {   profiled_lock(commit_ret_elems_lock_);
         idx = elem->idx_;
         elapsed_us = elem->timer_.get_us();
         ret_value = elem->ret_value_;
@@ -249,6 +269,10 @@ ptr<resp_msg> raft_server::handle_cli_req_callback(ptr<commit_ret_elem> elem,
     resp->set_ctx(ret_value);
     resp->set_result_code(elem->result_code_);
 
+    std::vector<request_trace> traces;
+    req_tracer_->on_returned(idx, traces);
+    if (!traces.empty()) report_traces(traces);
+
     return resp;
 }
 
@@ -259,11 +283,16 @@ ptr< cmd_result< ptr<buffer> > >
     return async_res;
 }
 
+size_t raft_server::get_num_pending_commit_elems() {
+    profiled_lock(commit_ret_elems_lock_);
+    return commit_ret_elems_.size();
+}
+
 void raft_server::drop_all_pending_commit_elems() {
     // Blocking mode:
     //   Invoke all awaiting requests to return `CANCELLED`.
     if (ctx_->get_params()->return_method_ == raft_params::blocking) {
-        auto_lock(commit_ret_elems_lock_);
+        profiled_lock(commit_ret_elems_lock_);
         ulong min_idx = std::numeric_limits<ulong>::max();
         ulong max_idx = 0;
         for (auto& entry: commit_ret_elems_) {
@@ -293,7 +322,7 @@ void raft_server::drop_all_pending_commit_elems() {
     //   Set `CANCELLED` and set result & error.
     std::list< ptr<commit_ret_elem> > elems;
 
-    {   auto_lock(commit_ret_elems_lock_);
+    {   profiled_lock(commit_ret_elems_lock_);
         for (auto& entry: commit_ret_elems_) {
             ptr<commit_ret_elem>& ee = entry.second;
             elems.push_back(ee);
@@ -26,8 +26,11 @@ limitations under the License.
 #include "exit_handler.hxx"
 #include "handle_client_request.hxx"
 #include "global_mgr.hxx"
+#include "log_term_index.hxx"
 #include "peer.hxx"
+#include "request_tracer.hxx"
 #include "snapshot.hxx"
+#include "stat_mgr.hxx"
 #include "state_machine.hxx"
 #include "state_mgr.hxx"
 #include "tracer.hxx"
@@ -43,6 +46,7 @@ void raft_server::commit(ulong target_idx) {
     if (target_idx > quick_commit_index_) {
         quick_commit_index_ = target_idx;
         lagging_sm_target_index_ = target_idx;
+        req_tracer_->on_committed(target_idx);
         p_db( "trigger commit upto %" PRIu64 "", quick_commit_index_.load() );
 
         // if this is a leader notify peers to commit as well
@@ -51,7 +55,7 @@ void raft_server::commit(ulong target_idx) {
         if (role_ == srv_role::leader) {
             for (peer_itor it = peers_.begin(); it != peers_.end(); ++it) {
                 ptr<peer> pp = it->second;
-                if (!request_append_entries(pp)) {
+                if (!request_replication(pp)) {
                     pp->set_pending_commit();
                 }
             }
@@ -163,7 +167,7 @@ void raft_server::commit_in_bg() {
 }
 
 bool raft_server::commit_in_bg_exec(size_t timeout_ms) {
-    std::unique_lock<std::mutex> ll(commit_lock_, std::try_to_lock);
+    std::unique_lock<profiled_mutex> ll(commit_lock_, std::try_to_lock);
     if (!ll.owns_lock()) {
         // Other thread is already doing commit.
         // This is caused by global workers only, as there is only one
@@ -257,6 +261,7 @@ bool raft_server::commit_in_bg_exec(size_t timeout_ms) {
 
         ulong exp_idx = index_to_commit - 1;
         if (sm_commit_index_.compare_exchange_strong(exp_idx, index_to_commit)) {
+            num_committed_stat_->inc();
             snapshot_and_compact(sm_commit_index_);
 
             cb_func::Param param(id_, leader_);
@@ -341,9 +346,12 @@ void raft_server::commit_app_log(ulong idx_to_commit,
                 ( state_machine::ext_op_params( sm_idx, buf ) );
     if (ret_value) ret_value->pos(0);
 
+    std::vector<request_trace> traces;
+    req_tracer_->on_applied(sm_idx, traces);
+
     std::list< ptr<commit_ret_elem> > async_elems;
     if (need_to_handle_commit_elem) {
-        std::unique_lock<std::mutex> cre_lock(commit_ret_elems_lock_);
+        profiled_guard(cre_lock, commit_ret_elems_lock_);
         /// Sometimes user can batch requests to RAFT: for example send 30
         /// append entries requests in a single batch. For such request batch
         /// user will receive a single response: all was successful or all
@@ -426,12 +434,14 @@ void raft_server::commit_app_log(ulong idx_to_commit,
             elem->ret_value_.reset();
             elem->async_result_.reset();
         }
+        req_tracer_->on_returned(elem->idx_, traces);
     }
+    if (!traces.empty()) report_traces(traces);
 }
 
 void raft_server::commit_conf(ulong idx_to_commit,
                               ptr<log_entry>& le) {
-    recur_lock(lock_);
+    profiled_lock(lock_);
     le->get_buf().pos(0);
     ptr<cluster_config> new_conf =
         cluster_config::deserialize(le->get_buf());
@@ -502,7 +512,7 @@ ulong raft_server::create_snapshot(const create_snapshot_options& options) {
     };
 
     if (options.serialize_commit_) {
-        auto_lock(commit_lock_);
+        profiled_lock(commit_lock_);
         return exec_internal();
     } else {
         return exec_internal();
@@ -714,7 +724,7 @@ void raft_server::on_snapshot_completed
     }
 
     {
-        recur_lock(lock_);
+        profiled_lock(lock_);
         p_in("snapshot idx %" PRIu64 " log_term %" PRIu64 " created, "
              "compact the log store if needed",
              s->get_last_log_idx(), s->get_last_log_term());
@@ -761,7 +771,7 @@ void raft_server::on_log_compacted(ulong log_idx,
                                    bool result,
                                    ptr<std::exception>& err)
 {
-    // Place holder. Just move forward.
+    if (result) log_term_index_->compact(log_idx);
 }
 
 void raft_server::reconfigure(const ptr<cluster_config>& new_config) {
@@ -843,6 +853,7 @@ void raft_server::reconfigure(const ptr<cluster_config>& new_config) {
                               ptr<logger>& >
                             ( srv_added, *ctx_, exec, l_ );
         p->set_next_log_idx(log_store_->next_slot());
+        update_peer_lock_profiling(*p);
 
         str_buf << "add peer " << srv_added->get_id()
                 << ", " << srv_added->get_endpoint()
@@ -979,7 +990,7 @@ void raft_server::reconfigure(const ptr<cluster_config>& new_config) {
         // SHOULD update peer's srv_config.
         for (auto& entry_peer: peers_) {
             peer* pp = entry_peer.second.get();
-            std::lock_guard<std::mutex> l(pp->get_lock());
+            profiled_guard(l, pp->get_lock());
             if (pp->get_id() == s_conf->get_id()) {
                 pp->set_config(entry);
             }
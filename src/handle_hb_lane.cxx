@@ -0,0 +1,88 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "raft_server.hxx"
+
+#include "context.hxx"
+#include "peer.hxx"
+#include "tracer.hxx"
+
+namespace nuraft {
+
+void raft_server::send_lane_heartbeat(ptr<peer>& p) {
+    ptr<raft_params> params = ctx_->get_params();
+    if (!params->use_heartbeat_lane_) return;
+
+    // If the main connection is idle, the regular heartbeat
+    // will not be delayed.
+    if (!p->is_busy() && !p->get_bytes_in_flight()) return;
+
+    // Empty request at the matched index, which the follower accepts
+    // without changing its log. The next index of the peer should not
+    // be adjusted by its response, as it is in parallel with
+    // the requests on the main connection.
+    ulong matched_idx = p->get_matched_idx();
+    ptr<req_msg> req( cs_new<req_msg>
+                      ( state_->get_term(),
+                        msg_type::append_entries_request,
+                        id_,
+                        p->get_id(),
+                        term_for_log(matched_idx),
+                        matched_idx,
+                        quick_commit_index_.load() ) );
+    set_excluded_flag(*p, *req);
+
+    p_tr("heartbeat to peer %d on the lane, matched idx %" PRIu64,
+         p->get_id(), matched_idx);
+    p->send_lane_req(p, req, lane_hb_resp_handler_, *ctx_);
+}
+
+void raft_server::handle_lane_hb_resp(ptr<resp_msg>& resp,
+                                      ptr<rpc_exception>& err)
+{
+    if (err) {
+        // Failures are detected by the main connection.
+        p_db("heartbeat lane error: %s", err->what());
+        return;
+    }
+
+    profiled_lock(lock_);
+    if (update_term(resp->get_term())) return;
+    if (role_ != srv_role::leader || !resp->get_accepted()) return;
+
+    auto entry = peers_.find(resp->get_src());
+    if (entry == peers_.end()) return;
+
+    peer* pp = entry->second.get();
+    pp->set_recovered();
+    pp->reset_rpc_errs();
+    pp->reset_resp_timer();
+}
+
+bool raft_server::send_vote_req(ptr<peer>& pp, ptr<req_msg>& req) {
+    ptr<raft_params> params = ctx_->get_params();
+    if ( params->use_heartbeat_lane_ &&
+         pp->send_lane_req(pp, req, resp_handler_, *ctx_) ) {
+        return true;
+    }
+
+    if (!pp->make_busy()) return false;
+    pp->send_req(pp, req, resp_handler_);
+    return true;
+}
+
+} // namespace nuraft;
+
@@ -23,6 +23,7 @@ limitations under the License.
 
 #include "cluster_config.hxx"
 #include "event_awaiter.hxx"
+#include "log_term_index.hxx"
 #include "peer.hxx"
 #include "snapshot_sync_ctx.hxx"
 #include "state_machine.hxx"
@@ -359,6 +360,7 @@ ptr<resp_msg> raft_server::handle_log_sync_req(req_msg& req) {
     }
 
     log_store_->apply_pack(req.get_last_log_idx() + 1, entries[0]->get_buf());
+    rebuild_log_term_index();
     p_db("last log %" PRIu64, log_store_->next_slot() - 1);
     precommit_index_ = log_store_->next_slot() - 1;
     commit(log_store_->next_slot() - 1);
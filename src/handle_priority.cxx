@@ -36,7 +36,7 @@ raft_server::PrioritySetResult
 raft_server::set_priority(const int srv_id,
                           const int new_priority,
                           bool broadcast_when_leader_exists) {
-    recur_lock(lock_);
+    profiled_lock(lock_);
 
     if (id_ != leader_) {
         p_in("Got set_priority request but I'm not a leader: my ID %d, leader %d",
@@ -0,0 +1,294 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "raft_server.hxx"
+
+#include "context.hxx"
+#include "failure_detector.hxx"
+#include "peer.hxx"
+#include "tracer.hxx"
+
+namespace nuraft {
+
+bool raft_server::can_quiesce() {
+    ptr<raft_params> params = ctx_->get_params();
+    if ( params->quiesce_after_ms_ <= 0 ||
+         params->use_full_consensus_among_healthy_members_ ||
+         role_ != srv_role::leader ||
+         write_paused_ ||
+         config_changing_ ||
+         srv_to_join_ ||
+         srv_to_leave_ ) {
+        return false;
+    }
+    if (!ctx_->failure_detector_) {
+        // Followers would ask the detector of this node whether this
+        // server is still the leader, and the leader could not tell
+        // if quiesced followers are alive.
+        return false;
+    }
+
+    // Idle time is measured from the first time that the leader
+    // sees the current last log index.
+    ulong last_idx = log_store_->next_slot() - 1;
+    if (last_idx != quiesce_last_idx_) {
+        quiesce_last_idx_ = last_idx;
+        quiesce_timer_.reset();
+        return false;
+    }
+    if (quiesce_timer_.get_ms() < (uint64_t)params->quiesce_after_ms_) {
+        return false;
+    }
+
+    if (quick_commit_index_ != last_idx) return false;
+    for (auto& entry: peers_) {
+        if (entry.second->get_matched_idx() != last_idx) return false;
+    }
+    return true;
+}
+
+void raft_server::update_quiescence(resp_msg& resp) {
+    if (role_ != srv_role::leader) return;
+
+    auto entry = peers_.find(resp.get_src());
+    if (entry == peers_.end()) return;
+    ptr<peer> p = entry->second;
+
+    // Stale response sent before waking up should be ignored,
+    // which is filtered out by `can_quiesce()`, as the idle timer
+    // is reset on waking up.
+    bool quiesced = (resp.get_extra_flags() & resp_msg::QUIESCED) &&
+                    resp.get_accepted() &&
+                    resp.get_next_idx() == log_store_->next_slot() &&
+                    can_quiesce();
+    bool was_quiesced = p->set_quiesced(quiesced);
+    if (was_quiesced == quiesced) return;
+
+    if (quiesced) {
+        p_in("peer %d quiesced at log %" PRIu64 ", stop heartbeat",
+             p->get_id(), resp.get_next_idx() - 1);
+        watch_quiesced_peer(*p);
+    } else {
+        p_in("peer %d is not quiescent anymore, resume heartbeat",
+             p->get_id());
+        unwatch_quiesced_peer(*p);
+        enable_hb_for_peer(*p);
+    }
+
+    bool all_quiesced = true;
+    for (auto& ee: peers_) {
+        if (!ee.second->is_quiesced()) {
+            all_quiesced = false;
+            break;
+        }
+    }
+    quiescent_ = all_quiesced;
+}
+
+void raft_server::handle_quiesce_req(req_msg& req, ptr<resp_msg>& resp) {
+    if (!resp) return;
+
+    bool quiesce_requested = (req.get_extra_flags() & req_msg::QUIESCE);
+    bool can_quiesce_now = quiesce_requested &&
+                           ctx_->failure_detector_ &&
+                           resp->get_accepted() &&
+                           req.log_entries().empty() &&
+                           role_ == srv_role::follower &&
+                           leader_ == req.get_src() &&
+                           !state_->is_catching_up() &&
+                           log_store_->next_slot() - 1 == req.get_last_log_idx() &&
+                           quick_commit_index_ == req.get_commit_idx();
+    if (!can_quiesce_now) {
+        if (quiescent_) {
+            // Election timer has been restarted by `handle_append_entries`.
+            wake_from_quiescence("append_entries from leader");
+        }
+        return;
+    }
+
+    // `handle_append_entries` restarted the election timer,
+    // replace it with the backstop.
+    restart_quiesce_backstop_timer();
+    resp->set_extra_flags(resp->get_extra_flags() | resp_msg::QUIESCED);
+    if (quiescent_) return;
+
+    // Instead of the election timer, watch the leader of this term.
+    auto entry = peers_.find(leader_);
+    if (entry != peers_.end()) {
+        std::weak_ptr<raft_server> wp = shared_from_this();
+        // The callback needs the watch ID, to tell if it is outdated.
+        ptr<uint64_t> watch_id_holder = cs_new<uint64_t>(0);
+        uint64_t watch_id = ctx_->failure_detector_->watch
+                            ( ctx_->group_id_,
+                              leader_,
+                              entry->second->get_endpoint(),
+                              state_->get_term(),
+                              [wp, watch_id_holder]() {
+                                  ptr<raft_server> srv = wp.lock();
+                                  if (srv) {
+                                      srv->handle_leader_failure(*watch_id_holder);
+                                  }
+                              } );
+        *watch_id_holder = watch_id;
+        fd_watch_id_ = watch_id;
+    }
+
+    quiescent_ = true;
+    p_in("quiesced by leader %d at log %" PRIu64 ", commit %" PRIu64
+         ", suspend election timer",
+         leader_.load(), req.get_last_log_idx(), req.get_commit_idx());
+}
+
+void raft_server::wake_from_quiescence(const char* reason) {
+    // Should not quiesce again right after waking up.
+    quiesce_timer_.reset();
+
+    bool woken = quiescent_.exchange(false);
+    if (role_ == srv_role::leader) {
+        for (auto& entry: peers_) {
+            peer& pp = *entry.second;
+            if (!pp.set_quiesced(false)) continue;
+            unwatch_quiesced_peer(pp);
+            // Follower did not respond during quiescence.
+            pp.reset_resp_timer();
+            enable_hb_for_peer(pp);
+            woken = true;
+        }
+    }
+
+    if (fd_watch_id_) {
+        if (ctx_->failure_detector_) {
+            ctx_->failure_detector_->unwatch(fd_watch_id_);
+        }
+        fd_watch_id_ = 0;
+    }
+
+    if (woken) {
+        p_in("wake up from quiescence, reason: %s", reason);
+    }
+}
+
+void raft_server::reset_quiescence() {
+    quiescent_ = false;
+    quiesce_last_idx_ = 0;
+    quiesce_timer_.reset();
+    for (auto& entry: peers_) {
+        entry.second->set_quiesced(false);
+        unwatch_quiesced_peer(*entry.second);
+    }
+    if (fd_watch_id_) {
+        if (ctx_->failure_detector_) {
+            ctx_->failure_detector_->unwatch(fd_watch_id_);
+        }
+        fd_watch_id_ = 0;
+    }
+}
+
+void raft_server::handle_leader_failure(uint64_t watch_id) {
+    profiled_lock(lock_);
+    if ( stopping_ ||
+         !quiescent_ ||
+         !watch_id ||
+         fd_watch_id_ != watch_id ) {
+        return;
+    }
+
+    p_wn("leader %d is gone or not responding, wake up from quiescence",
+         leader_.load());
+    // Watch has been removed by the detector.
+    fd_watch_id_ = 0;
+    quiescent_ = false;
+    hb_alive_ = false;
+    restart_election_timer();
+}
+
+void raft_server::watch_quiesced_peer(peer& pp) {
+    // Quiesced followers do not respond, so that the leader watches
+    // them instead, to keep its leadership expiry working.
+    if (!ctx_->failure_detector_ || pp.get_fd_watch_id()) return;
+
+    std::weak_ptr<raft_server> wp = shared_from_this();
+    int32 peer_id = pp.get_id();
+    ptr<uint64_t> watch_id_holder = cs_new<uint64_t>(0);
+    uint64_t watch_id = ctx_->failure_detector_->watch
+                        ( ctx_->group_id_,
+                          peer_id,
+                          pp.get_endpoint(),
+                          0,
+                          [wp, peer_id, watch_id_holder]() {
+                              ptr<raft_server> srv = wp.lock();
+                              if (srv) {
+                                  srv->handle_follower_failure
+                                       ( peer_id, *watch_id_holder );
+                              }
+                          } );
+    *watch_id_holder = watch_id;
+    pp.set_fd_watch_id(watch_id);
+}
+
+void raft_server::unwatch_quiesced_peer(peer& pp) {
+    uint64_t watch_id = pp.get_fd_watch_id();
+    if (!watch_id) return;
+    if (ctx_->failure_detector_) {
+        ctx_->failure_detector_->unwatch(watch_id);
+    }
+    pp.set_fd_watch_id(0);
+}
+
+void raft_server::handle_follower_failure(int32 peer_id, uint64_t watch_id) {
+    profiled_lock(lock_);
+    if (stopping_ || role_ != srv_role::leader || !watch_id) return;
+
+    auto entry = peers_.find(peer_id);
+    if (entry == peers_.end()) return;
+    peer& pp = *entry->second;
+    if (pp.get_fd_watch_id() != watch_id) return;
+
+    p_wn("quiesced peer %d is gone or not responding, resume heartbeat",
+         peer_id);
+    // Watch has been removed by the detector.
+    pp.set_fd_watch_id(0);
+    quiescent_ = false;
+    if (!pp.set_quiesced(false)) return;
+
+    // Unlike waking up, the response timer is not reset. The peer has
+    // not responded since it quiesced, which counts toward
+    // the leadership expiry on the next heartbeat.
+    enable_hb_for_peer(pp);
+}
+
+void raft_server::restart_quiesce_backstop_timer() {
+    ptr<raft_params> params = ctx_->get_params();
+    int32 backstop_ms = params->quiesce_backstop_ms_;
+    if (backstop_ms <= 0) {
+        backstop_ms = params->election_timeout_upper_bound_ * 10;
+    }
+
+    if (election_task_) {
+        cancel_task(election_task_);
+    } else {
+        election_task_ = cs_new< timer_task<void> >
+                               ( election_exec_,
+                                 timer_task_type::election_timer );
+    }
+    last_election_timer_reset_.reset();
+
+    // Randomized as usual, so that followers do not wake up at once.
+    schedule_task(election_task_, backstop_ms + rand_timeout_());
+}
+
+} // namespace nuraft;
+
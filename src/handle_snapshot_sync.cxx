@@ -25,6 +25,7 @@ limitations under the License.
 #include "error_code.hxx"
 #include "event_awaiter.hxx"
 #include "exit_handler.hxx"
+#include "log_term_index.hxx"
 #include "peer.hxx"
 #include "snapshot.hxx"
 #include "snapshot_sync_ctx.hxx"
@@ -80,7 +81,7 @@ ptr<req_msg> raft_server::create_sync_snapshot_req(ptr<peer>& pp,
     succeeded_out = false;
     peer& p = *pp;
     ptr<raft_params> params = ctx_->get_params();
-    std::unique_lock<std::mutex> guard(p.get_lock());
+    profiled_guard(guard, p.get_lock());
     ptr<snapshot_sync_ctx> sync_ctx = p.get_snapshot_sync_ctx();
     ptr<snapshot> snp = nullptr;
     ulong prev_sync_snp_log_idx = 0;
@@ -238,7 +239,7 @@ ptr<req_msg> raft_server::create_sync_snapshot_req(ptr<peer>& pp,
     return req;
 }
 
-ptr<resp_msg> raft_server::handle_install_snapshot_req(req_msg& req, std::unique_lock<std::recursive_mutex>& guard) {
+ptr<resp_msg> raft_server::handle_install_snapshot_req(req_msg& req, std::unique_lock<profiled_recursive_mutex>& guard) {
     if (req.get_term() == state_->get_term() && !state_->is_catching_up()) {
         if (role_ == srv_role::candidate) {
             become_follower();
@@ -336,7 +337,7 @@ void raft_server::handle_install_snapshot_resp(resp_msg& resp) {
     bool need_to_catchup = true;
     ptr<peer> p = it->second;
     if (resp.get_accepted()) {
-        std::lock_guard<std::mutex> guard(p->get_lock());
+        profiled_guard(guard, p->get_lock());
         ptr<snapshot_sync_ctx> sync_ctx = p->get_snapshot_sync_ctx();
         if (sync_ctx == nullptr) {
             p_in("no snapshot sync context for this peer, drop the response");
@@ -392,7 +393,7 @@ void raft_server::handle_install_snapshot_resp(resp_msg& resp) {
 
         // Should reset current snapshot context,
         // to continue with more recent snapshot.
-        std::lock_guard<std::mutex> guard(p->get_lock());
+        profiled_guard(guard, p->get_lock());
         clear_snapshot_sync_ctx(*p);
     }
 
@@ -461,7 +462,7 @@ void raft_server::handle_install_snapshot_resp_new_member(resp_msg& resp) {
     sync_log_to_new_srv(srv_to_join_->get_next_log_idx());
 }
 
-bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_lock<std::recursive_mutex>& guard) {
+bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_lock<profiled_recursive_mutex>& guard) {
  try {
     // if offset == 0, it is the first object.
     bool is_first_obj = (req.get_offset()) ? false : true;
@@ -562,6 +563,7 @@ bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_l
               req.get_snapshot().get_last_log_idx(),
               req.get_snapshot().get_last_log_term() );
         if (log_store_->compact(req.get_snapshot().get_last_log_idx())) {
+            log_term_index_->compact(req.get_snapshot().get_last_log_idx());
             // The state machine will not be able to commit anything before the
             // snapshot is applied, so make this synchronously with election
             // timer stopped as usually applying a snapshot may take a very
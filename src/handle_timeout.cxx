@@ -55,7 +55,7 @@ void raft_server::check_srv_to_leave_timeout() {
 }
 
 void raft_server::handle_hb_timeout(int32 srv_id) {
-    recur_lock(lock_);
+    profiled_lock(lock_);
 
     check_srv_to_leave_timeout();
 
@@ -141,10 +141,16 @@ void raft_server::handle_hb_timeout(int32 srv_id) {
 
     p_db("heartbeat timeout for %d", p->get_id());
     if (role_ == srv_role::leader) {
+        if (p->is_quiesced()) {
+            // Heartbeat will be resumed on waking up.
+            p_db("peer %d is quiesced, stop heartbeat", p->get_id());
+            return;
+        }
         update_target_priority();
-        request_append_entries(p);
+        send_lane_heartbeat(p);
+        request_append_entries(p, true);
         {
-            std::lock_guard<std::mutex> guard(p->get_lock());
+            profiled_guard(guard, p->get_lock());
             if (p->is_hb_enabled()) {
                 // Schedule another heartbeat if heartbeat is still enabled
                 schedule_task(p->get_hb_task(), p->get_current_hb_interval());
@@ -162,7 +168,7 @@ void raft_server::handle_hb_timeout(int32 srv_id) {
 void raft_server::restart_election_timer() {
     // don't start the election timer while this server is still catching up the logs
     // or this server is the leader
-    recur_lock(lock_);
+    profiled_lock(lock_);
     if (state_->is_catching_up() || role_ == srv_role::leader) {
         return;
     }
@@ -201,12 +207,23 @@ void raft_server::stop_election_timer() {
 
 void raft_server::handle_election_timeout() {
     p_tr("election timeout");
-    recur_lock(lock_);
+    profiled_lock(lock_);
     if (stopping_) {
         p_wn("Triggered election timer but server is shutting down");
         return;
     }
 
+    if (quiescent_ && role_ != srv_role::leader) {
+        // Backstop of the failure detector, see
+        // `raft_params::quiesce_backstop_ms_`. If the leader is alive,
+        // the pre-vote request of this server will wake it up.
+        p_wn("backstop election timeout while quiescent");
+        wake_from_quiescence("backstop election timer");
+        hb_alive_ = false;
+        restart_election_timer();
+        return;
+    }
+
     if (steps_to_down_ > 0) {
         if (--steps_to_down_ == 0) {
             p_in("no hearing further news from leader, "
@@ -23,6 +23,7 @@ limitations under the License.
 
 #include "cluster_config.hxx"
 #include "event_awaiter.hxx"
+#include "failure_detector.hxx"
 #include "handle_custom_notification.hxx"
 #include "peer.hxx"
 #include "state_mgr.hxx"
@@ -164,9 +165,7 @@ void raft_server::request_prevote() {
                             term_for_log(log_store_->next_slot() - 1),
                             log_store_->next_slot() - 1,
                             quick_commit_index_.load() ) );
-        if (pp->make_busy()) {
-            pp->send_req(pp, req, resp_handler_);
-        } else {
+        if (!send_vote_req(pp, req)) {
             pre_vote_.connection_busy_++;
             p_wn("failed to send prevote request: peer %d (%s) is busy, count %d",
                  pp->get_id(), pp->get_endpoint().c_str(),
@@ -304,9 +303,7 @@ void raft_server::request_vote(bool force_vote) {
               msg_type_to_string(req->get_type()).c_str(),
               it->second->get_id(),
               state_->get_term() );
-        if (pp->make_busy()) {
-            pp->send_req(pp, req, resp_handler_);
-        } else {
+        if (!send_vote_req(pp, req)) {
             p_wn("failed to send vote request: peer %d (%s) is busy",
                  pp->get_id(), pp->get_endpoint().c_str());
         }
@@ -448,6 +445,23 @@ ptr<resp_msg> raft_server::handle_prevote_req(req_msg& req) {
          req.get_term(), state_->get_term(),
          (hb_alive_) ? "HB alive" : "HB dead");
 
+    if (quiescent_ || role_ == srv_role::leader) {
+        if (role_ == srv_role::leader) {
+            // Someone does not get heartbeats, resume them.
+            wake_from_quiescence("pre-vote request");
+
+        } else if (req.get_src() == leader_) {
+            // The leader has stepped down while this server is quiescent.
+            wake_from_quiescence("pre-vote request from leader");
+            hb_alive_ = false;
+            restart_election_timer();
+
+        } else if (ctx_->failure_detector_) {
+            // Check the leader now, instead of waiting for the next round.
+            ctx_->failure_detector_->check_now();
+        }
+    }
+
     ptr<resp_msg> resp
         ( cs_new<resp_msg>
           ( req.get_term(),
@@ -0,0 +1,381 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Log-linear (HDR-style) histogram.
+//
+// Values are grouped by their most significant bit, and each group is
+// split into `2^precision_bits` linear sub-buckets, so that the width of
+// a bucket is at most `2^-precision_bits` of its values (about 3% with
+// the default precision). Values below `2^(precision_bits + 1)` are
+// recorded exactly.
+//
+// Recording is lock-free. Histograms with the same precision can be
+// merged (`+=`) and subtracted (`-=`), e.g., to get the percentiles of
+// a time window by diffing two snapshots of the same histogram.
+class HdrHistogram;
+class HdrHistItr {
+public:
+    HdrHistItr() : idx(0), owner(nullptr) {}
+
+    HdrHistItr(size_t _idx, const HdrHistogram* _owner)
+        : idx(_idx), owner(_owner) {}
+
+    // ++A, skips empty buckets.
+    inline HdrHistItr& operator++();
+
+    // A++
+    HdrHistItr operator++(int) {
+        HdrHistItr ret = *this;
+        ++(*this);
+        return ret;
+    }
+
+    HdrHistItr& operator*() {
+        // Just return itself
+        return *this;
+    }
+
+    bool operator==(const HdrHistItr& val) const {
+        return (idx == val.idx);
+    }
+
+    bool operator!=(const HdrHistItr& val) const {
+        return (idx != val.idx);
+    }
+
+    size_t getIdx() const { return idx; }
+
+    inline uint64_t getCount() const;
+
+    // Lowest value of the bucket.
+    inline uint64_t getLowerBound() const;
+
+    // Highest value of the bucket (inclusive).
+    inline uint64_t getUpperBound() const;
+
+private:
+    size_t idx;
+    const HdrHistogram* owner;
+};
+
+class HdrHistogram {
+    friend class HdrHistItr;
+
+public:
+    using iterator = HdrHistItr;
+
+    static const int DEFAULT_PRECISION_BITS = 5;
+    static const int MAX_PRECISION_BITS = 16;
+
+    HdrHistogram(int precision_bits = DEFAULT_PRECISION_BITS)
+        : count(0)
+        , sum(0)
+        , max(0)
+    {
+        init(precision_bits);
+    }
+
+    HdrHistogram(const HdrHistogram& src)
+        : bins(nullptr)
+    {
+        // It will invoke `operator=()` below.
+        *this = src;
+    }
+
+    ~HdrHistogram() {
+        delete[] bins;
+    }
+
+    // this = src
+    HdrHistogram& operator=(const HdrHistogram& src) {
+        if (this == &src) return *this;
+        if (!bins || precision != src.precision) {
+            delete[] bins;
+            init(src.precision);
+        }
+        count = src.getTotal();
+        sum = src.getSum();
+        max = src.getMax();
+        for (size_t i=0; i<numBins; ++i) {
+            bins[i].store( src.bins[i].load(std::memory_order_relaxed),
+                           std::memory_order_relaxed );
+        }
+        return *this;
+    }
+
+    // this += rhs
+    HdrHistogram& operator+=(const HdrHistogram& rhs) {
+        sum += rhs.getSum();
+        updateMax(rhs.getMax());
+
+        uint64_t added = 0;
+        for (HdrHistItr& entry: rhs) {
+            uint64_t cnt = entry.getCount();
+            size_t idx = (rhs.precision == precision)
+                         ? entry.getIdx()
+                         : getIdx(entry.getLowerBound());
+            bins[idx].fetch_add(cnt, std::memory_order_relaxed);
+            added += cnt;
+        }
+        count += added;
+        return *this;
+    }
+
+    // this -= rhs
+    //
+    // `rhs` should be an earlier snapshot of this histogram, or a part
+    // merged into it. Counts saturate at zero otherwise. Max cannot be
+    // subtracted, so it is bounded by the highest remaining bucket.
+    HdrHistogram& operator-=(const HdrHistogram& rhs) {
+        uint64_t rhs_sum = rhs.getSum();
+        uint64_t cur_sum = getSum();
+        sum = (cur_sum > rhs_sum) ? cur_sum - rhs_sum : 0;
+
+        uint64_t removed = 0;
+        for (HdrHistItr& entry: rhs) {
+            uint64_t cnt = entry.getCount();
+            size_t idx = (rhs.precision == precision)
+                         ? entry.getIdx()
+                         : getIdx(entry.getLowerBound());
+            uint64_t cur = bins[idx].load(std::memory_order_relaxed);
+            cnt = std::min(cnt, cur);
+            bins[idx].store(cur - cnt, std::memory_order_relaxed);
+            removed += cnt;
+        }
+        uint64_t cur_count = getTotal();
+        count = (cur_count > removed) ? cur_count - removed : 0;
+
+        uint64_t upper = 0;
+        for (size_t i = numBins; i > 0; --i) {
+            if (bins[i-1].load(std::memory_order_relaxed)) {
+                upper = HdrHistItr(i-1, this).getUpperBound();
+                break;
+            }
+        }
+        max = std::min(getMax(), upper);
+        return *this;
+    }
+
+    // returning lhs + rhs
+    friend HdrHistogram operator+(HdrHistogram lhs,
+                                  const HdrHistogram& rhs) {
+        lhs += rhs;
+        return lhs;
+    }
+
+    // returning lhs - rhs
+    friend HdrHistogram operator-(HdrHistogram lhs,
+                                  const HdrHistogram& rhs) {
+        lhs -= rhs;
+        return lhs;
+    }
+
+    size_t getIdx(uint64_t val) const {
+        if (val < (subBins << 1)) return val;
+
+        // `shift` >= 1, as `val` >= `2^(precision + 1)`.
+        int shift = msb(val) - precision;
+        return (size_t)shift * subBins + (size_t)(val >> shift);
+    }
+
+    void add(uint64_t val) {
+        bins[getIdx(val)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(val, std::memory_order_relaxed);
+        updateMax(val);
+    }
+
+    // Only increase the bucket of the given value, for callers keeping
+    // track of the sum and max by themselves (e.g., per thread). They
+    // should call `setTotals` before reading the totals.
+    void addToBin(uint64_t val) {
+        bins[getIdx(val)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Set the sum and max tracked by the caller of `addToBin`,
+    // and recount the total from the buckets.
+    void setTotals(uint64_t new_sum, uint64_t new_max) {
+        uint64_t total = 0;
+        for (size_t i=0; i<numBins; ++i) {
+            total += bins[i].load(std::memory_order_relaxed);
+        }
+        count = total;
+        sum = new_sum;
+        max = new_max;
+    }
+
+    // Zero all buckets. Not atomic with respect to concurrent `add` calls.
+    void clear() {
+        for (size_t i=0; i<numBins; ++i) {
+            bins[i].store(0, std::memory_order_relaxed);
+        }
+        count = 0;
+        sum = 0;
+        max = 0;
+    }
+
+    int getPrecision() const { return precision; }
+    uint64_t getTotal() const { return count; }
+    uint64_t getSum() const { return sum; }
+    uint64_t getAverage() const {
+        uint64_t cnt = count;
+        return ( (cnt) ? (sum / cnt) : 0 );
+    }
+    uint64_t getMax() const { return max; }
+
+    // Bucket containing the given percentile, `end()` if empty.
+    iterator find(double percentile) const {
+        uint64_t total = getTotal();
+        if (!total) return end();
+
+        uint64_t rank = getRank(percentile, total);
+        uint64_t acc = 0;
+        for (size_t i=0; i<numBins; ++i) {
+            acc += bins[i].load(std::memory_order_relaxed);
+            if (acc >= rank) return HdrHistItr(i, this);
+        }
+        return end();
+    }
+
+    // Value at the given percentile, interpolated within its bucket,
+    // so that the error is bounded by the width of the bucket.
+    uint64_t estimate(double percentile) const {
+        uint64_t total = getTotal();
+        if (!total) return 0;
+        if (percentile >= 100) return getMax();
+
+        uint64_t rank = getRank(percentile, total);
+        uint64_t acc = 0;
+        for (size_t i=0; i<numBins; ++i) {
+            uint64_t n_entries = bins[i].load(std::memory_order_relaxed);
+            if (!n_entries) continue;
+            if (acc + n_entries < rank) {
+                acc += n_entries;
+                continue;
+            }
+
+            HdrHistItr itr(i, this);
+            uint64_t lower = itr.getLowerBound();
+            uint64_t upper = std::min(itr.getUpperBound(), getMax());
+            if (upper <= lower) return lower;
+
+            double ratio = (double)(rank - acc) / n_entries;
+            return lower + (uint64_t)( (upper - lower) * ratio );
+        }
+        return getMax();
+    }
+
+    iterator begin() const {
+        return HdrHistItr(nextIdx(0), this);
+    }
+
+    iterator end() const {
+        return HdrHistItr(numBins, this);
+    }
+
+private:
+    void init(int precision_bits) {
+        precision = precision_bits;
+        if (precision < 1) precision = 1;
+        if (precision > MAX_PRECISION_BITS) precision = MAX_PRECISION_BITS;
+        subBins = (uint64_t)1 << precision;
+        // Exact buckets for values below `2^(precision + 1)`, and then
+        // `subBins` buckets for each of the remaining most significant bits.
+        numBins = (size_t)(64 - precision + 1) * subBins;
+        bins = new std::atomic<uint64_t>[numBins];
+        for (size_t i=0; i<numBins; ++i) {
+            bins[i] = 0;
+        }
+    }
+
+    static int msb(uint64_t val) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(val);
+#else
+        int ret = 0;
+        while (val >>= 1) ret++;
+        return ret;
+#endif
+    }
+
+    static uint64_t getRank(double percentile, uint64_t total) {
+        if (percentile <= 0) return 1;
+        uint64_t rank = (uint64_t)std::ceil( (double)total * percentile / 100.0 );
+        return std::min( std::max(rank, (uint64_t)1), total );
+    }
+
+    void updateMax(uint64_t val) {
+        uint64_t cur = max.load(std::memory_order_relaxed);
+        while ( cur < val &&
+                !max.compare_exchange_weak(cur, val,
+                                           std::memory_order_relaxed) ) {
+            // `cur` is reloaded by the failed exchange.
+        }
+    }
+
+    size_t nextIdx(size_t idx) const {
+        while ( idx < numBins &&
+                !bins[idx].load(std::memory_order_relaxed) ) {
+            idx++;
+        }
+        return idx;
+    }
+
+    int precision;
+    uint64_t subBins;
+    size_t numBins;
+
+    std::atomic<uint64_t>* bins;
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+};
+
+HdrHistItr& HdrHistItr::operator++() {
+    idx = owner->nextIdx(idx + 1);
+    return *this;
+}
+
+uint64_t HdrHistItr::getCount() const {
+    return owner->bins[idx].load(std::memory_order_relaxed);
+}
+
+uint64_t HdrHistItr::getLowerBound() const {
+    uint64_t sub_bins = owner->subBins;
+    if (idx < (sub_bins << 1)) return idx;
+
+    size_t shift = idx / sub_bins - 1;
+    uint64_t mantissa = idx - shift * sub_bins;
+    return mantissa << shift;
+}
+
+uint64_t HdrHistItr::getUpperBound() const {
+    uint64_t sub_bins = owner->subBins;
+    if (idx < (sub_bins << 1)) return idx;
+
+    size_t shift = idx / sub_bins - 1;
+    return getLowerBound() + ( ((uint64_t)1 << shift) - 1 );
+}
+
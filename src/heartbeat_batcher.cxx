@@ -0,0 +1,496 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "heartbeat_batcher.hxx"
+
+#include "buffer_serializer.hxx"
+#include "delayed_task_scheduler.hxx"
+#include "log_entry.hxx"
+#include "rpc_cli_factory.hxx"
+#include "timer_task.hxx"
+
+#include <cstring>
+
+namespace nuraft {
+
+//   << Request format >>
+// version                          1 byte
+// number of heartbeats (N)         4 bytes
+// N * {
+//   group ID                       8 bytes
+//   source server ID               4 bytes
+//   destination server ID          4 bytes
+//   term                           8 bytes
+//   last log term                  8 bytes
+//   last log index                 8 bytes
+//   commit index                   8 bytes
+//   extra flags                    8 bytes
+// }
+//
+//   << Response format >>
+// version                          1 byte
+// number of heartbeats (N)         4 bytes
+// N * {
+//   has response                   1 byte
+//   (if has response) {
+//     term                         8 bytes
+//     source server ID             4 bytes
+//     destination server ID        4 bytes
+//     next log index               8 bytes
+//     accepted                     1 byte
+//     next batch size hint         8 bytes
+//     result code                  4 bytes
+//     extra flags                  8 bytes
+//     ctx length (X)               4 bytes
+//     ctx                          X bytes
+//   }
+// }
+static const uint8_t HB_BATCH_VERSION = 0x0;
+
+// Size of each heartbeat in the request.
+static const size_t HB_ELEM_SIZE = sizeof(uint64_t) * 6 + sizeof(int32) * 2;
+
+// Size of each response in the response, excluding
+// the `has response` flag and the ctx.
+static const size_t HB_RESP_ELEM_SIZE = sizeof(uint64_t) * 4 +
+                                        sizeof(int32) * 3 +
+                                        sizeof(uint8_t) +
+                                        sizeof(uint32_t);
+
+heartbeat_batcher::heartbeat_batcher(const ptr<rpc_client_factory>& factory,
+                                     const ptr<delayed_task_scheduler>& scheduler,
+                                     const options& opt)
+    : opt_(opt)
+    , factory_(factory)
+    , scheduler_(scheduler)
+    , flush_scheduled_(false)
+    , stopped_(false)
+    , num_batches_sent_(0)
+    , num_hbs_sent_(0)
+{
+    if (!opt_.max_batch_size_) opt_.max_batch_size_ = 1;
+
+    timer_task<void>::executor exec = [this]() {
+        flush_scheduled_ = false;
+        flush();
+    };
+    flush_task_ = cs_new< timer_task<void> >(exec);
+}
+
+heartbeat_batcher::~heartbeat_batcher() {
+    shutdown();
+}
+
+void heartbeat_batcher::register_group(uint64_t group_id, raft_server* srv) {
+    std::lock_guard<std::mutex> l(groups_lock_);
+    groups_[group_id] = cs_new<group_elem>(srv);
+}
+
+void heartbeat_batcher::deregister_group(uint64_t group_id, raft_server* srv) {
+    std::unique_lock<std::mutex> l(groups_lock_);
+    auto entry = groups_.find(group_id);
+    if (entry == groups_.end()) return;
+    if (entry->second->srv_ != srv) return;
+
+    // New batches will not find it from now on,
+    // wait for the ongoing dispatches only.
+    ptr<group_elem> ge = entry->second;
+    groups_.erase(entry);
+    dispatch_done_cv_.wait(l, [&ge]() { return ge->num_dispatching_ == 0; });
+}
+
+std::string heartbeat_batcher::get_dest_key(int32 srv_id,
+                                            const std::string& endpoint) const {
+    if (opt_.dest_key_func_) {
+        return opt_.dest_key_func_(srv_id, endpoint);
+    }
+    return endpoint;
+}
+
+void heartbeat_batcher::enqueue(uint64_t group_id,
+                                const std::string& endpoint,
+                                ptr<req_msg>& req,
+                                rpc_handler& when_done)
+{
+    if (stopped_) {
+        ptr<resp_msg> no_resp;
+        ptr<rpc_exception> err =
+            cs_new<rpc_exception>("heartbeat batcher is stopped", req);
+        when_done(no_resp, err);
+        return;
+    }
+
+    std::string key = get_dest_key(req->get_dst(), endpoint);
+    ptr<batch> full_batch;
+    {   std::lock_guard<std::mutex> l(lock_);
+        ptr<batch>& bb = pending_[key];
+        if (!bb) {
+            bb = cs_new<batch>();
+            bb->endpoint_ = endpoint;
+        }
+        bb->elems_.push_back( hb_elem(group_id, req, when_done) );
+
+        if (bb->elems_.size() >= opt_.max_batch_size_) {
+            full_batch = bb;
+            pending_.erase(key);
+        }
+    }
+
+    if (full_batch) {
+        send_batch(key, full_batch);
+        return;
+    }
+
+    if (opt_.flush_interval_ms_ > 0 && scheduler_) {
+        bool exp = false;
+        if (flush_scheduled_.compare_exchange_strong(exp, true)) {
+            scheduler_->schedule(flush_task_, opt_.flush_interval_ms_);
+        }
+    }
+}
+
+void heartbeat_batcher::flush() {
+    std::map< std::string, ptr<batch> > to_send;
+    {   std::lock_guard<std::mutex> l(lock_);
+        to_send.swap(pending_);
+    }
+
+    for (auto& entry: to_send) {
+        send_batch(entry.first, entry.second);
+    }
+}
+
+void heartbeat_batcher::send_batch(const std::string& key, ptr<batch>& bb) {
+    if (bb->elems_.empty()) return;
+
+    ptr<rpc_client> client;
+    {   std::lock_guard<std::mutex> l(lock_);
+        ptr<rpc_client>& cc = clients_[key];
+        if (!cc || cc->is_abandoned()) {
+            cc = factory_ ? factory_->create_client(bb->endpoint_) : nullptr;
+        }
+        client = cc;
+    }
+    if (!client) {
+        fail_batch(*bb, "failed to create rpc client for " + bb->endpoint_);
+        return;
+    }
+
+    size_t num_elems = bb->elems_.size();
+    ptr<buffer> buf = buffer::alloc( sizeof(uint8_t) +
+                                     sizeof(uint32_t) +
+                                     HB_ELEM_SIZE * num_elems );
+    buffer_serializer bs(buf);
+    bs.put_u8(HB_BATCH_VERSION);
+    bs.put_u32(num_elems);
+    for (hb_elem& ee: bb->elems_) {
+        req_msg& rr = *ee.req_;
+        bs.put_u64(ee.group_id_);
+        bs.put_i32(rr.get_src());
+        bs.put_i32(rr.get_dst());
+        bs.put_u64(rr.get_term());
+        bs.put_u64(rr.get_last_log_term());
+        bs.put_u64(rr.get_last_log_idx());
+        bs.put_u64(rr.get_commit_idx());
+        bs.put_u64(rr.get_extra_flags());
+    }
+
+    // Source and destination IDs of the first heartbeat represent
+    // the batch, only for the connection tracking of the receiver.
+    req_msg& first = *bb->elems_[0].req_;
+    ptr<req_msg> req = cs_new<req_msg>( 0,
+                                        msg_type::heartbeat_batch_request,
+                                        first.get_src(),
+                                        first.get_dst(),
+                                        0, 0, 0 );
+    req->log_entries().push_back
+        ( cs_new<log_entry>(0, buf, log_val_type::custom) );
+
+    num_batches_sent_.fetch_add(1);
+    num_hbs_sent_.fetch_add(num_elems);
+
+    // Hold `this` until the response arrives, as the batcher can be
+    // released in the meantime.
+    rpc_handler h = (rpc_handler)std::bind( &heartbeat_batcher::handle_batch_resp,
+                                            shared_from_this(),
+                                            key,
+                                            client,
+                                            bb,
+                                            std::placeholders::_1,
+                                            std::placeholders::_2 );
+    client->send(req, h);
+}
+
+void heartbeat_batcher::handle_batch_resp(const std::string& key,
+                                          ptr<rpc_client> client,
+                                          ptr<batch> bb,
+                                          ptr<resp_msg>& resp,
+                                          ptr<rpc_exception>& err)
+{
+    if (err || !resp || !resp->get_ctx()) {
+        if (err || !resp) {
+            // Connection is broken, the next batch will use a new one.
+            std::lock_guard<std::mutex> l(lock_);
+            auto entry = clients_.find(key);
+            if (entry != clients_.end() && entry->second == client) {
+                clients_.erase(entry);
+            }
+        }
+        fail_batch( *bb, err ? err->what()
+                             : "invalid heartbeat batch response" );
+        return;
+    }
+
+    // Parse all responses first, so that a corrupted message fails
+    // the entire batch, instead of a part of it.
+    std::vector< ptr<resp_msg> > sub_resps;
+    if (!parse_batch_resp(*resp->get_ctx(), bb->elems_.size(), sub_resps)) {
+        fail_batch(*bb, "corrupted heartbeat batch response");
+        return;
+    }
+
+    for (size_t ii = 0; ii < bb->elems_.size(); ++ii) {
+        hb_elem& ee = bb->elems_[ii];
+        if (sub_resps[ii]) {
+            ptr<rpc_exception> no_except;
+            ee.when_done_(sub_resps[ii], no_except);
+        } else {
+            // The destination does not have the member of this group.
+            ptr<resp_msg> no_resp;
+            ptr<rpc_exception> sub_err = cs_new<rpc_exception>
+                ( "no response for heartbeat of group " +
+                  std::to_string(ee.group_id_), ee.req_ );
+            ee.when_done_(no_resp, sub_err);
+        }
+    }
+}
+
+bool heartbeat_batcher::parse_batch_resp(buffer& buf,
+                                         size_t num_elems,
+                                         std::vector< ptr<resp_msg> >& sub_resps)
+{
+    if (buf.size() < sizeof(uint8_t) + sizeof(uint32_t)) return false;
+    buffer_serializer bs(buf);
+    if (bs.get_u8() != HB_BATCH_VERSION) return false;
+
+    // The receiver responds to every heartbeat in the batch,
+    // and each response takes at least 1 byte.
+    size_t num_resps = bs.get_u32();
+    if ( num_resps != num_elems ||
+         num_resps > buf.size() - bs.pos() ) {
+        return false;
+    }
+
+    sub_resps.resize(num_resps);
+    for (size_t ii = 0; ii < num_resps; ++ii) {
+        if (buf.size() - bs.pos() < sizeof(uint8_t)) return false;
+        if (!bs.get_u8()) continue;
+
+        if (buf.size() - bs.pos() < HB_RESP_ELEM_SIZE) return false;
+        ulong term = bs.get_u64();
+        int32 src = bs.get_i32();
+        int32 dst = bs.get_i32();
+        ulong next_idx = bs.get_u64();
+        bool accepted = bs.get_u8();
+        ptr<resp_msg> sub_resp = cs_new<resp_msg>( term,
+                                                   msg_type::append_entries_response,
+                                                   src,
+                                                   dst,
+                                                   next_idx,
+                                                   accepted );
+        sub_resp->set_next_batch_size_hint_in_bytes(bs.get_i64());
+        sub_resp->set_result_code( static_cast<cmd_result_code>
+                                   ( bs.get_i32() ) );
+        sub_resp->set_extra_flags(bs.get_u64());
+
+        size_t ctx_len = bs.get_u32();
+        if (ctx_len > buf.size() - bs.pos()) return false;
+        if (ctx_len) {
+            ptr<buffer> ctx = buffer::alloc(ctx_len);
+            bs.get_buffer(ctx);
+            sub_resp->set_ctx(ctx);
+        }
+        sub_resps[ii] = sub_resp;
+    }
+    return true;
+}
+
+void heartbeat_batcher::fail_batch(batch& bb, const std::string& err_msg) {
+    for (hb_elem& ee: bb.elems_) {
+        ptr<resp_msg> no_resp;
+        ptr<rpc_exception> err = cs_new<rpc_exception>(err_msg, ee.req_);
+        ee.when_done_(no_resp, err);
+    }
+}
+
+ptr<resp_msg> heartbeat_batcher::handle_batch(req_msg& req) {
+    ptr<resp_msg> resp = cs_new<resp_msg>( 0,
+                                           msg_type::heartbeat_batch_response,
+                                           req.get_dst(),
+                                           req.get_src() );
+    std::vector< ptr<log_entry> >& log_entries = req.log_entries();
+    if (log_entries.empty() || !log_entries[0]->get_buf_ptr()) {
+        return resp;
+    }
+
+    ptr<buffer> req_buf = log_entries[0]->get_buf_ptr();
+    if (req_buf->size() < sizeof(uint8_t) + sizeof(uint32_t)) {
+        return resp;
+    }
+    buffer_serializer bs(req_buf);
+    if (bs.get_u8() != HB_BATCH_VERSION) {
+        // Unknown format, the sender will fail the entire batch.
+        return resp;
+    }
+    size_t num_elems = bs.get_u32();
+    if (num_elems > (req_buf->size() - bs.pos()) / HB_ELEM_SIZE) {
+        // Corrupted message, the number of heartbeats exceeds the size.
+        return resp;
+    }
+
+    struct sub_req_elem {
+        uint64_t group_id_;
+        ptr<req_msg> req_;
+        ptr<group_elem> target_;
+    };
+    std::vector<sub_req_elem> sub_reqs(num_elems);
+
+    // Release the targets not dispatched yet, even on exception.
+    struct dispatch_guard {
+        dispatch_guard(heartbeat_batcher* bb, std::vector<sub_req_elem>& reqs)
+            : bb_(bb), reqs_(reqs), pos_(0) {}
+        ~dispatch_guard() {
+            {   std::lock_guard<std::mutex> l(bb_->groups_lock_);
+                for (size_t ii = pos_; ii < reqs_.size(); ++ii) {
+                    if (reqs_[ii].target_) reqs_[ii].target_->num_dispatching_--;
+                }
+            }
+            bb_->dispatch_done_cv_.notify_all();
+        }
+        heartbeat_batcher* bb_;
+        std::vector<sub_req_elem>& reqs_;
+        size_t pos_;
+    } guard(this, sub_reqs);
+    for (size_t ii = 0; ii < num_elems; ++ii) {
+        uint64_t group_id = bs.get_u64();
+        int32 src = bs.get_i32();
+        int32 dst = bs.get_i32();
+        ulong term = bs.get_u64();
+        ulong last_log_term = bs.get_u64();
+        ulong last_log_idx = bs.get_u64();
+        ulong commit_idx = bs.get_u64();
+        uint64_t extra_flags = bs.get_u64();
+
+        sub_reqs[ii].group_id_ = group_id;
+        sub_reqs[ii].req_ = cs_new<req_msg>
+                            ( term, msg_type::append_entries_request,
+                              src, dst, last_log_term, last_log_idx,
+                              commit_idx );
+        sub_reqs[ii].req_->set_extra_flags(extra_flags);
+    }
+
+    // Pick up the targets, and release the lock before dispatching.
+    {   std::lock_guard<std::mutex> l(groups_lock_);
+        for (sub_req_elem& ee: sub_reqs) {
+            auto entry = groups_.find(ee.group_id_);
+            if (entry == groups_.end() || stopped_) continue;
+            if (entry->second->srv_->get_id() != ee.req_->get_dst()) continue;
+
+            ee.target_ = entry->second;
+            ee.target_->num_dispatching_++;
+        }
+    }
+
+    std::vector< ptr<resp_msg> > sub_resps(num_elems);
+    size_t resp_size = sizeof(uint8_t) + sizeof(uint32_t);
+    for (size_t ii = 0; ii < num_elems; ++ii) {
+        resp_size += sizeof(uint8_t);
+
+        ptr<group_elem>& target = sub_reqs[ii].target_;
+        if (!target) continue;
+
+        // A member busy with something else (e.g., a slow disk write)
+        // should not delay the heartbeats of the others. Its response is
+        // left empty, and its leader will retry with the next heartbeat.
+        ptr<resp_msg> sub_resp =
+            raft_server_handler::try_process_req(target->srv_, *sub_reqs[ii].req_);
+        if (sub_resp && sub_resp->has_cb()) {
+            sub_resp = sub_resp->call_cb(sub_resp);
+        }
+
+        {   std::lock_guard<std::mutex> l(groups_lock_);
+            target->num_dispatching_--;
+            guard.pos_ = ii + 1;
+        }
+        dispatch_done_cv_.notify_all();
+
+        if (!sub_resp) continue;
+        ptr<buffer> ctx = sub_resp->get_ctx();
+        resp_size += HB_RESP_ELEM_SIZE + (ctx ? ctx->size() : 0);
+        sub_resps[ii] = sub_resp;
+    }
+
+    ptr<buffer> buf = buffer::alloc(resp_size);
+    buffer_serializer rs(buf);
+    rs.put_u8(HB_BATCH_VERSION);
+    rs.put_u32(num_elems);
+    for (ptr<resp_msg>& sub_resp: sub_resps) {
+        if (!sub_resp) {
+            rs.put_u8(0);
+            continue;
+        }
+        rs.put_u8(1);
+        rs.put_u64(sub_resp->get_term());
+        rs.put_i32(sub_resp->get_src());
+        rs.put_i32(sub_resp->get_dst());
+        rs.put_u64(sub_resp->get_next_idx());
+        rs.put_u8(sub_resp->get_accepted() ? 1 : 0);
+        rs.put_i64(sub_resp->get_next_batch_size_hint_in_bytes());
+        rs.put_i32(static_cast<int32>(sub_resp->get_result_code()));
+        rs.put_u64(sub_resp->get_extra_flags());
+        ptr<buffer> ctx = sub_resp->get_ctx();
+        if (ctx) {
+            rs.put_bytes(ctx->data_begin(), ctx->size());
+        } else {
+            rs.put_u32(0);
+        }
+    }
+
+    resp->accept(0);
+    resp->set_ctx(buf);
+    return resp;
+}
+
+void heartbeat_batcher::shutdown() {
+    bool exp = false;
+    if (!stopped_.compare_exchange_strong(exp, true)) return;
+
+    if (scheduler_) {
+        scheduler_->cancel(flush_task_);
+    }
+
+    std::map< std::string, ptr<batch> > to_fail;
+    {   std::lock_guard<std::mutex> l(lock_);
+        to_fail.swap(pending_);
+        clients_.clear();
+    }
+    for (auto& entry: to_fail) {
+        fail_batch(*entry.second, "heartbeat batcher is stopped");
+    }
+}
+
+}
+
@@ -0,0 +1,178 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "lock_profiler.hxx"
+
+#include "peer.hxx"
+#include "raft_server.hxx"
+#include "stat_mgr.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace nuraft {
+
+namespace {
+
+const char* get_base_name(const char* path) {
+    const char* last_slash = strrchr(path, '/');
+    return last_slash ? last_slash + 1 : path;
+}
+
+}
+
+lock_profile::lock_profile(const std::string& name, ptr<stat_mgr> stats)
+    : name_(name)
+    , stats_(stats)
+{
+    num_acquisitions_stat_ = stats_->create_stat
+        (stat_elem::COUNTER, name_ + "_acquisitions");
+    num_contentions_stat_ = stats_->create_stat
+        (stat_elem::COUNTER, name_ + "_contentions");
+    wait_us_stat_ = stats_->create_stat
+        (stat_elem::HISTOGRAM, name_ + "_wait_us");
+    hold_us_stat_ = stats_->create_stat
+        (stat_elem::HISTOGRAM, name_ + "_hold_us");
+}
+
+lock_profile::~lock_profile() {}
+
+uint64_t lock_profile::now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>
+           ( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void lock_profile::on_acquired(const lock_site* site,
+                               bool contended,
+                               uint64_t wait_us)
+{
+    num_acquisitions_stat_->inc();
+    if (!contended) return;
+
+    num_contentions_stat_->inc();
+    wait_us_stat_->add_value(wait_us);
+
+    std::lock_guard<std::mutex> l(sites_lock_);
+    auto entry = sites_.find(site);
+    if (entry == sites_.end()) {
+        site_entry new_entry;
+        stat_mgr::labels labels = stats_->get_labels();
+        labels["lock"] = name_;
+        labels["site"] = site
+                         ? std::string(get_base_name(site->file_)) + ":" +
+                           std::to_string(site->line_)
+                         : "unknown";
+        new_entry.stats_ = stat_mgr::create_scope(labels);
+        new_entry.num_contentions_stat_ = new_entry.stats_->create_stat
+            (stat_elem::COUNTER, "lock_site_contentions");
+        new_entry.wait_us_stat_ = new_entry.stats_->create_stat
+            (stat_elem::COUNTER, "lock_site_wait_us");
+        entry = sites_.insert( std::make_pair(site, new_entry) ).first;
+    }
+
+    site_entry& ss = entry->second;
+    ss.num_contentions_++;
+    ss.total_wait_us_ += wait_us;
+    ss.max_wait_us_ = std::max(ss.max_wait_us_, wait_us);
+    ss.num_contentions_stat_->inc();
+    ss.wait_us_stat_->inc(wait_us);
+}
+
+void lock_profile::on_released(uint64_t hold_us) {
+    hold_us_stat_->add_value(hold_us);
+}
+
+void lock_profile::get_contentions
+     ( std::vector<lock_contention>& contentions_out ) const
+{
+    std::lock_guard<std::mutex> l(sites_lock_);
+    for (auto& entry: sites_) {
+        const lock_site* site = entry.first;
+        const site_entry& ss = entry.second;
+        lock_contention cc;
+        cc.lock_name_ = name_;
+        if (site) {
+            cc.file_ = get_base_name(site->file_);
+            cc.func_ = site->func_;
+            cc.line_ = site->line_;
+        }
+        cc.num_contentions_ = ss.num_contentions_;
+        cc.total_wait_us_ = ss.total_wait_us_;
+        cc.max_wait_us_ = ss.max_wait_us_;
+        contentions_out.push_back(cc);
+    }
+}
+
+
+// === raft_server ============================================================
+
+void raft_server::update_lock_profiling() {
+    ptr<raft_params> params = ctx_->get_params();
+    if (params->profile_locks_ && !raft_lock_profile_) {
+        raft_lock_profile_ = cs_new<lock_profile>("raft_lock", stats_);
+        cli_lock_profile_ = cs_new<lock_profile>("cli_lock", stats_);
+        commit_lock_profile_ = cs_new<lock_profile>("commit_lock", stats_);
+        commit_ret_elems_lock_profile_ =
+            cs_new<lock_profile>("commit_ret_elems_lock", stats_);
+        peer_lock_profile_ = cs_new<lock_profile>("peer_lock", stats_);
+    }
+
+    ptr<lock_profile> none;
+    bool enabled = params->profile_locks_;
+    lock_.set_profile(enabled ? raft_lock_profile_ : none);
+    cli_lock_.set_profile(enabled ? cli_lock_profile_ : none);
+    commit_lock_.set_profile(enabled ? commit_lock_profile_ : none);
+    commit_ret_elems_lock_.set_profile
+        (enabled ? commit_ret_elems_lock_profile_ : none);
+    for (auto& entry: peers_) {
+        update_peer_lock_profiling(*entry.second);
+    }
+}
+
+void raft_server::update_peer_lock_profiling(peer& p) {
+    bool enabled = ctx_->get_params()->profile_locks_;
+    p.get_lock().set_profile(enabled ? peer_lock_profile_ : ptr<lock_profile>());
+}
+
+void raft_server::get_lock_contentions
+     ( std::vector<lock_contention>& contentions_out, size_t max_num )
+{
+    std::vector<lock_contention> contentions;
+    {   profiled_lock(lock_);
+        for (const ptr<lock_profile>& pp: { raft_lock_profile_,
+                                            cli_lock_profile_,
+                                            commit_lock_profile_,
+                                            commit_ret_elems_lock_profile_,
+                                            peer_lock_profile_ }) {
+            if (pp) pp->get_contentions(contentions);
+        }
+    }
+
+    std::sort( contentions.begin(), contentions.end(),
+               []( const lock_contention& a,
+                   const lock_contention& b ) -> bool {
+                   return a.total_wait_us_ > b.total_wait_us_;
+               } );
+    if (max_num && contentions.size() > max_num) {
+        contentions.resize(max_num);
+    }
+    contentions_out.insert( contentions_out.end(),
+                            contentions.begin(),
+                            contentions.end() );
+}
+
+} // namespace nuraft
@@ -0,0 +1,131 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "log_term_index.hxx"
+
+#include <algorithm>
+
+namespace nuraft {
+
+using run = std::pair<ulong, ulong>;
+
+log_term_index::log_term_index()
+    : end_(0)
+    {}
+
+void log_term_index::append(ulong idx, ulong term, ulong cnt) {
+    if (!cnt) return;
+    std::lock_guard<std::mutex> l(lock_);
+    if (!runs_.empty() && idx < end_) {
+        truncate_unsafe(idx);
+    }
+    if (runs_.empty() || idx > end_) {
+        // Empty or there is a gap (e.g., after installing snapshot).
+        runs_.clear();
+        runs_.push_back( run(idx, term) );
+    } else if (runs_.back().second != term) {
+        runs_.push_back( run(idx, term) );
+    }
+    end_ = idx + cnt;
+}
+
+void log_term_index::truncate(ulong idx) {
+    std::lock_guard<std::mutex> l(lock_);
+    truncate_unsafe(idx);
+}
+
+void log_term_index::truncate_unsafe(ulong idx) {
+    if (runs_.empty() || idx >= end_) return;
+    if (idx <= runs_.front().first) {
+        runs_.clear();
+        end_ = 0;
+        return;
+    }
+    // Remove all runs starting at or after `idx`.
+    auto itr = std::lower_bound( runs_.begin(), runs_.end(), idx,
+                                 [](const run& r, ulong ii) {
+                                     return r.first < ii;
+                                 } );
+    runs_.erase(itr, runs_.end());
+    end_ = idx;
+}
+
+void log_term_index::compact(ulong idx) {
+    std::lock_guard<std::mutex> l(lock_);
+    if (runs_.empty() || idx < runs_.front().first) return;
+    if (idx + 1 >= end_) {
+        runs_.clear();
+        end_ = 0;
+        return;
+    }
+    // Keep the run containing `idx + 1`, starting from `idx + 1`.
+    auto itr = std::upper_bound( runs_.begin(), runs_.end(), idx + 1,
+                                 [](ulong ii, const run& r) {
+                                     return ii < r.first;
+                                 } );
+    runs_.erase(runs_.begin(), itr - 1);
+    runs_.front().first = idx + 1;
+}
+
+void log_term_index::clear() {
+    std::lock_guard<std::mutex> l(lock_);
+    runs_.clear();
+    end_ = 0;
+}
+
+bool log_term_index::get_term(ulong idx, ulong& term_out) const {
+    std::lock_guard<std::mutex> l(lock_);
+    if (runs_.empty() || idx < runs_.front().first || idx >= end_) {
+        return false;
+    }
+    auto itr = std::upper_bound( runs_.begin(), runs_.end(), idx,
+                                 [](ulong ii, const run& r) {
+                                     return ii < r.first;
+                                 } );
+    term_out = (itr - 1)->second;
+    return true;
+}
+
+bool log_term_index::lower_bound(ulong term,
+                                 ulong lo,
+                                 ulong hi,
+                                 ulong& idx_out) const
+{
+    if (lo > hi) {
+        idx_out = lo;
+        return true;
+    }
+    std::lock_guard<std::mutex> l(lock_);
+    if (runs_.empty() || lo < runs_.front().first || hi >= end_) {
+        return false;
+    }
+    // Terms are non-decreasing.
+    auto itr = std::lower_bound( runs_.begin(), runs_.end(), term,
+                                 [](const run& r, ulong tt) {
+                                     return r.second < tt;
+                                 } );
+    ulong idx = (itr == runs_.end()) ? end_ : std::max(itr->first, lo);
+    idx_out = std::min(idx, hi + 1);
+    return true;
+}
+
+size_t log_term_index::num_runs() const {
+    std::lock_guard<std::mutex> l(lock_);
+    return runs_.size();
+}
+
+}
+
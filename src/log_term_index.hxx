@@ -0,0 +1,125 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "basic_types.hxx"
+#include "pp_util.hxx"
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace nuraft {
+
+/**
+ * Run-length index of log terms, <first log index of a run, term>.
+ *
+ * Consecutive logs of the same term form a single run, so the index
+ * has as many elements as the number of leader changes in the range
+ * it covers, and term lookups become binary searches on a small array,
+ * instead of `log_store::term_at` calls.
+ *
+ * It covers a contiguous range of log indexes [`start`, `end`), and
+ * lookups outside the range fail, so that the caller can fall back to
+ * the log store. Lookups inside the range never reach the log store,
+ * hence it is not a cache: once logs are overwritten, the index should be
+ * truncated at the same time, otherwise it returns their old terms.
+ * Thread-safe.
+ */
+class log_term_index {
+public:
+    log_term_index();
+
+    __nocopy__(log_term_index);
+
+public:
+    /**
+     * Record the term of logs [`idx`, `idx` + `cnt`). If `idx` is smaller
+     * than the end of the range, logs from `idx` are truncated first.
+     * If it is beyond the end, the index is reset to start from `idx`.
+     *
+     * @param idx Log index.
+     * @param term Term of the logs.
+     * @param cnt Number of logs.
+     */
+    void append(ulong idx, ulong term, ulong cnt = 1);
+
+    /**
+     * Remove all logs equal to or greater than `idx`.
+     *
+     * @param idx Log index.
+     */
+    void truncate(ulong idx);
+
+    /**
+     * Remove all logs up to `idx` (inclusive).
+     *
+     * @param idx Log index.
+     */
+    void compact(ulong idx);
+
+    /**
+     * Remove all logs.
+     */
+    void clear();
+
+    /**
+     * Get the term of the log at `idx`.
+     *
+     * @param idx Log index.
+     * @param[out] term_out Term of the log.
+     * @return `false` if `idx` is not covered by this index.
+     */
+    bool get_term(ulong idx, ulong& term_out) const;
+
+    /**
+     * Find the first log whose term is equal to or greater than
+     * the given term, within [`lo`, `hi`].
+     *
+     * @param term Term to find.
+     * @param lo Lower bound of log index.
+     * @param hi Upper bound of log index.
+     * @param[out] idx_out Log index, greater than `hi` if not found.
+     * @return `false` if the range is not covered by this index.
+     */
+    bool lower_bound(ulong term, ulong lo, ulong hi, ulong& idx_out) const;
+
+    /**
+     * Get the number of runs.
+     *
+     * @return Number of runs.
+     */
+    size_t num_runs() const;
+
+private:
+    void truncate_unsafe(ulong idx);
+
+    /**
+     * Runs of the same term, <first log index, term>, in log index order.
+     */
+    std::vector< std::pair<ulong, ulong> > runs_;
+
+    /**
+     * Last log index covered + 1. The first one is the start of the first run.
+     */
+    ulong end_;
+
+    mutable std::mutex lock_;
+};
+
+}
+
@@ -21,6 +21,7 @@ limitations under the License.
 #include "peer.hxx"
 
 #include "debugging_options.hxx"
+#include "heartbeat_batcher.hxx"
 #include "raft_server.hxx"
 #include "tracer.hxx"
 
@@ -31,7 +32,8 @@ namespace nuraft {
 void peer::send_req( ptr<peer> myself,
                      ptr<req_msg>& req,
                      rpc_handler& handler,
-                     bool streaming )
+                     bool streaming,
+                     bool coalesce )
 {
     if (abandoned_) {
         p_er("peer %d has been shut down, cannot send request",
@@ -66,6 +68,24 @@ void peer::send_req( ptr<peer> myself,
         }
     }
 
+    if (coalesce && hb_batcher_) {
+        // Will be sent along with heartbeats of other groups. A successful
+        // response is handled the same as if it was sent by `rpc_local`,
+        // but a failure of the batch should not reset `rpc_local`.
+        rpc_handler hb_h = (rpc_handler)std::bind
+                           ( &peer::handle_batched_hb_result,
+                             this,
+                             myself,
+                             rpc_local,
+                             req,
+                             pending,
+                             timer_helper::get_timeofday_us(),
+                             std::placeholders::_1,
+                             std::placeholders::_2 );
+        hb_batcher_->enqueue(group_id_, config_->get_endpoint(), req, hb_h);
+        return;
+    }
+
     rpc_handler h = (rpc_handler)std::bind
                     ( &peer::handle_rpc_result,
                       this,
@@ -75,8 +95,10 @@ void peer::send_req( ptr<peer> myself,
                       pending,
                       streaming,
                       req_size_bytes,
+                      timer_helper::get_timeofday_us(),
                       std::placeholders::_1,
                       std::placeholders::_2 );
+
     if (rpc_local) {
         myself->bytes_in_flight_add(req_size_bytes);
         rpc_local->send(req, h);
@@ -95,6 +117,7 @@ void peer::handle_rpc_result( ptr<peer> myself,
                               ptr<rpc_result>& pending_result,
                               bool streaming,
                               size_t req_size_bytes,
+                              uint64_t sent_us,
                               ptr<resp_msg>& resp,
                               ptr<rpc_exception>& err )
 {
@@ -142,17 +165,30 @@ void peer::handle_rpc_result( ptr<peer> myself,
                 reset_stale_rpc_responses();
                 bytes_in_flight_sub(req_size_bytes);
                 try_set_free(req->get_type(), streaming);
+
+                if ( req->get_type() == append_entries_request &&
+                     !req->log_entries().empty() &&
+                     resp->get_accepted() ) {
+                    uint64_t now_us = timer_helper::get_timeofday_us();
+                    stream_window_.on_ack( req->log_entries().size(),
+                                           req_size_bytes,
+                                           now_us - std::min(now_us, sent_us),
+                                           now_us );
+                }
             }
         }
 
         reset_active_timer();
         {
-            auto_lock(lock_);
+            profiled_lock(lock_);
             resume_hb_speed();
         }
         ptr<rpc_exception> no_except;
         resp->set_peer(myself);
-        pending_result->set_result(resp, no_except);
+        if ( !(resp->get_extra_flags() & resp_msg::CUMULATIVELY_ACKED) ) {
+            // Otherwise, Raft will process the following response only.
+            pending_result->set_result(resp, no_except);
+        }
 
         reconn_backoff_.reset();
         reconn_backoff_.set_duration_ms(1);
@@ -164,7 +200,7 @@ void peer::handle_rpc_result( ptr<peer> myself,
         //       of that connection.
         reset_active_timer();
         {
-            auto_lock(lock_);
+            profiled_lock(lock_);
             slow_down_hb();
         }
         ptr<resp_msg> no_resp;
@@ -185,6 +221,7 @@ void peer::handle_rpc_result( ptr<peer> myself,
                 }
                 reset_stale_rpc_responses();
                 reset_bytes_in_flight();
+                stream_window_.on_failure();
                 try_set_free(req->get_type(), streaming);
 
                 // On disconnection, reset `snapshot_sync_is_needed` flag.
@@ -221,6 +258,107 @@ void peer::handle_rpc_result( ptr<peer> myself,
     }
 }
 
+void peer::handle_batched_hb_result( ptr<peer> myself,
+                                     ptr<rpc_client> my_rpc_client,
+                                     ptr<req_msg>& req,
+                                     ptr<rpc_result>& pending_result,
+                                     uint64_t sent_us,
+                                     ptr<resp_msg>& resp,
+                                     ptr<rpc_exception>& err )
+{
+    if (!err) {
+        handle_rpc_result( myself, my_rpc_client, req, pending_result,
+                           false, 0, sent_us, resp, err );
+        return;
+    }
+
+    if (abandoned_) {
+        p_in("peer %d has been shut down, ignore response.", config_->get_id());
+        return;
+    }
+
+    // The batch was sent through the connection of the batcher, which
+    // is shared by other groups. Unlike `handle_rpc_result`, the main
+    // connection and the stream state of this peer are kept as they are.
+    reset_active_timer();
+    {
+        profiled_lock(lock_);
+        slow_down_hb();
+    }
+    ptr<resp_msg> no_resp;
+    pending_result->set_result(no_resp, err);
+
+    {   std::lock_guard<std::mutex> l(rpc_protector_);
+        // Free the busy flag only if the RPC hasn't been changed,
+        // the same as `handle_rpc_result`.
+        uint64_t cur_rpc_id = rpc_ ? rpc_->get_id() : 0;
+        uint64_t given_rpc_id = my_rpc_client ? my_rpc_client->get_id() : 0;
+        if (cur_rpc_id == given_rpc_id) {
+            try_set_free(req->get_type(), false);
+        }
+    }
+}
+
+bool peer::send_lane_req( ptr<peer> myself,
+                          ptr<req_msg>& req,
+                          rpc_handler& handler,
+                          context& ctx )
+{
+    if (abandoned_) return false;
+
+    ptr<rpc_client> rpc_local = nullptr;
+    {   std::lock_guard<std::mutex> l(rpc_protector_);
+        if (!lane_rpc_) {
+            ptr<rpc_client_factory> factory = nullptr;
+            {   std::lock_guard<std::mutex> ll(ctx.ctx_lock_);
+                factory = ctx.rpc_cli_factory_;
+            }
+            if (!factory) return false;
+            lane_rpc_ = factory->create_client(config_->get_endpoint());
+            p_tr("%p heartbeat lane to peer %d",
+                 lane_rpc_.get(), config_->get_id());
+        }
+        rpc_local = lane_rpc_;
+    }
+    if (!rpc_local) return false;
+
+    p_tr("send lane req %d -> %d, type %s",
+         req->get_src(),
+         req->get_dst(),
+         msg_type_to_string( req->get_type() ).c_str() );
+
+    rpc_handler h = (rpc_handler)std::bind
+                    ( &peer::handle_lane_result,
+                      this,
+                      myself,
+                      rpc_local,
+                      handler,
+                      std::placeholders::_1,
+                      std::placeholders::_2 );
+    rpc_local->send(req, h);
+    return true;
+}
+
+void peer::handle_lane_result( ptr<peer> myself,
+                               ptr<rpc_client> my_rpc_client,
+                               rpc_handler& handler,
+                               ptr<resp_msg>& resp,
+                               ptr<rpc_exception>& err )
+{
+    if (abandoned_) return;
+
+    if (err) {
+        // Same as the main connection, a failed one should not be re-used.
+        std::lock_guard<std::mutex> l(rpc_protector_);
+        if (lane_rpc_ == my_rpc_client) {
+            lane_rpc_.reset();
+        }
+    } else {
+        resp->set_peer(myself);
+    }
+    handler(resp, err);
+}
+
 void peer::try_set_free(msg_type type, bool streaming) {
     const static std::unordered_set<int> msg_types_to_free( {
         // msg_type::append_entries_request,
@@ -304,10 +442,12 @@ void peer::shutdown() {
 
     // Cut off all shared pointers related to ASIO and Raft server.
     scheduler_.reset();
+    hb_batcher_.reset();
     {   // To guarantee atomic reset
         // (race between send_req()).
         std::lock_guard<std::mutex> l(rpc_protector_);
         rpc_.reset();
+        lane_rpc_.reset();
     }
     hb_task_.reset();
 }
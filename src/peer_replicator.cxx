@@ -0,0 +1,103 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "peer_replicator.hxx"
+
+#include "peer.hxx"
+#include "raft_server.hxx"
+
+#include <string>
+
+namespace nuraft {
+
+peer_replicator::peer_replicator(raft_server* srv, size_t num_threads)
+    : srv_(srv)
+    , stopping_(false)
+{
+    for (size_t ii = 0; ii < num_threads; ++ii) {
+        threads_.push_back( std::thread(&peer_replicator::loop, this, ii) );
+    }
+}
+
+peer_replicator::~peer_replicator() {
+    stop();
+}
+
+void peer_replicator::schedule(const ptr<peer>& p) {
+    if (stopping_) return;
+    // Already queued or running, it will run again.
+    if (!p->request_replication()) return;
+
+    {   std::lock_guard<std::mutex> l(queue_lock_);
+        queue_.push_back(p);
+    }
+    queue_cv_.notify_one();
+}
+
+void peer_replicator::stop() {
+    std::deque< ptr<peer> > dropped;
+    {   std::lock_guard<std::mutex> l(queue_lock_);
+        if (stopping_) return;
+        stopping_ = true;
+        dropped.swap(queue_);
+    }
+    queue_cv_.notify_all();
+
+    for (std::thread& tt: threads_) {
+        if (tt.joinable()) tt.join();
+    }
+
+    // Reset the flags, so that the peers can be scheduled
+    // by another replicator later.
+    for (ptr<peer>& p: dropped) {
+        p->clear_replication_request();
+        p->finish_replication();
+    }
+}
+
+void peer_replicator::loop(size_t thread_idx) {
+    std::string thread_name = "nuraft_repl_" + std::to_string(thread_idx);
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), thread_name.c_str());
+#elif __APPLE__
+    pthread_setname_np(thread_name.c_str());
+#endif
+
+    while (true) {
+        ptr<peer> p;
+        {   std::unique_lock<std::mutex> l(queue_lock_);
+            queue_cv_.wait( l, [this]() {
+                                return stopping_ || !queue_.empty();
+                            } );
+            if (stopping_) break;
+            p = queue_.front();
+            queue_.pop_front();
+        }
+
+        do {
+            p->clear_replication_request();
+            srv_->replicate_to_peer(p);
+        } while (p->finish_replication() && !stopping_);
+
+        if (stopping_) {
+            p->clear_replication_request();
+            p->finish_replication();
+        }
+    }
+}
+
+}
+
@@ -0,0 +1,87 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "pp_util.hxx"
+#include "ptr.hxx"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nuraft {
+
+class peer;
+class raft_server;
+
+/**
+ * Thread pool running per-peer replicator tasks of a leader.
+ *
+ * Each peer is processed by at most one thread at a time, and requests
+ * arriving while the peer is queued or running are merged into a single
+ * re-run, so that a replicator behaves as an actor owning the peer's
+ * replication state.
+ */
+class peer_replicator {
+public:
+    peer_replicator(raft_server* srv, size_t num_threads);
+
+    ~peer_replicator();
+
+    __nocopy__(peer_replicator);
+
+public:
+    /**
+     * Request replication to the given peer.
+     *
+     * @param p Peer.
+     */
+    void schedule(const ptr<peer>& p);
+
+    /**
+     * Stop all threads, and wait for their termination.
+     * Queued peers will be dropped.
+     */
+    void stop();
+
+private:
+    void loop(size_t thread_idx);
+
+    raft_server* srv_;
+
+    std::vector<std::thread> threads_;
+
+    /**
+     * Peers waiting for their replicator to run.
+     */
+    std::deque< ptr<peer> > queue_;
+
+    /**
+     * Lock for `queue_`.
+     */
+    std::mutex queue_lock_;
+
+    std::condition_variable queue_cv_;
+
+    std::atomic<bool> stopping_;
+};
+
+}
+
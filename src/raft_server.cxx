@@ -25,11 +25,16 @@ limitations under the License.
 #include "error_code.hxx"
 #include "event_awaiter.hxx"
 #include "exit_handler.hxx"
+#include "failure_detector.hxx"
 #include "global_mgr.hxx"
 #include "handle_client_request.hxx"
 #include "handle_custom_notification.hxx"
+#include "heartbeat_batcher.hxx"
 #include "internal_timer.hxx"
+#include "log_term_index.hxx"
 #include "peer.hxx"
+#include "peer_replicator.hxx"
+#include "request_tracer.hxx"
 #include "snapshot.hxx"
 #include "snapshot_sync_ctx.hxx"
 #include "stat_mgr.hxx"
@@ -76,6 +81,8 @@ raft_server::raft_server(context* ctx, const init_options& opt)
     , next_leader_candidate_(-1)
     , im_learner_(false)
     , serving_req_(false)
+    , global_commit_scheduled_(false)
+    , global_append_scheduled_(false)
     , steps_to_down_(0)
     , snp_in_progress_(false)
     , snp_creation_scheduled_(false)
@@ -107,15 +114,33 @@ raft_server::raft_server(context* ctx, const init_options& opt)
                                                 this,
                                                 std::placeholders::_1,
                                                 std::placeholders::_2 ) )
+    , lane_hb_resp_handler_
+      ( (rpc_handler)std::bind( &raft_server::handle_lane_hb_resp,
+                                this,
+                                std::placeholders::_1,
+                                std::placeholders::_2 ) )
     , last_snapshot_(ctx->state_machine_->last_snapshot())
     , ea_follower_log_append_(new EventAwaiter())
     , test_mode_flag_(opt.test_mode_flag_)
     , self_mark_down_(false)
     , excluded_from_the_quorum_(false)
+    , quiescent_(false)
+    , quiesce_last_idx_(0)
+    , fd_watch_id_(0)
+    , deferred_append_start_(0)
+    , deferred_append_end_(0)
+    , deferred_durable_idx_(0)
+    , deferred_commit_idx_(0)
+    , req_tracer_(cs_new<request_tracer>())
+    , num_ae_sent_stat_(nullptr)
+    , num_ae_rcvd_stat_(nullptr)
+    , num_committed_stat_(nullptr)
+    , log_append_latency_stat_(nullptr)
 {
     if (opt.raft_callback_) {
         ctx->set_cb_func(opt.raft_callback_);
     }
+    init_stats();
 
     ptr<raft_params> params = ctx_->get_params();
     if (params->stale_log_gap_ < params->fresh_log_gap_) {
@@ -198,6 +223,9 @@ raft_server::raft_server(context* ctx, const init_options& opt)
      *          Majority(S0 - 1) + Majority(S0) > S0 => Vote(A) < Majority(S0)
      * -|
      */
+    log_term_index_ = cs_new<log_term_index>();
+    rebuild_log_term_index();
+
     for ( ulong i = std::max( sm_commit_index_ + 1,
                               log_store_->start_index() );
           i < log_store_->next_slot();
@@ -221,14 +249,14 @@ raft_server::raft_server(context* ctx, const init_options& opt)
                 std::bind( &raft_server::handle_hb_timeout,
                            this,
                            std::placeholders::_1 );
-            peers_.insert( std::make_pair
-                           ( cur_srv->get_id(),
-                             cs_new< peer,
-                                     ptr<srv_config>&,
-                                     context&,
-                                     timer_task<int32>::executor&,
-                                     ptr<logger>& >
-                                   ( cur_srv, *ctx_, exec, l_ ) ) );
+            ptr<peer> p = cs_new< peer,
+                                  ptr<srv_config>&,
+                                  context&,
+                                  timer_task<int32>::executor&,
+                                  ptr<logger>& >
+                                ( cur_srv, *ctx_, exec, l_ );
+            update_peer_lock_profiling(*p);
+            peers_.insert( std::make_pair(cur_srv->get_id(), p) );
         } else {
             // Myself.
             im_learner_ = cur_srv->is_learner();
@@ -286,6 +314,19 @@ void raft_server::start_server(bool skip_initial_election_timeout)
         bg_append_thread_ = std::thread(std::bind(&raft_server::append_entries_in_bg, this));
     }
 
+    update_replicator();
+
+    if (ctx_->hb_batcher_) {
+        p_in("heartbeat batcher is detected, group id %" PRIu64,
+             ctx_->group_id_);
+        ctx_->hb_batcher_->register_group(ctx_->group_id_, this);
+    }
+
+    if (ctx_->failure_detector_) {
+        // To answer liveness checks from the followers of other nodes.
+        ctx_->failure_detector_->register_group(ctx_->group_id_, this);
+    }
+
     if (skip_initial_election_timeout) {
         // Issue #23:
         //   During remediation, the node (to be added) shouldn't be
@@ -322,8 +363,18 @@ raft_server::~raft_server() {
     // For the case that user does not call shutdown() and directly
     // destroy the current `raft_server` instance.
     cancel_global_requests();
+    if (ctx_->hb_batcher_) {
+        ctx_->hb_batcher_->deregister_group(ctx_->group_id_, this);
+    }
+    if (ctx_->failure_detector_) {
+        ctx_->failure_detector_->deregister_group(ctx_->group_id_, this);
+    }
+    if (replicator_) {
+        // Replicator may be waiting for the lock.
+        replicator_->stop();
+    }
 
-    recur_lock(lock_);
+    profiled_lock(lock_);
     stopping_ = true;
     std::unique_lock<std::mutex> commit_lock(commit_cv_lock_);
     commit_cv_.notify_all();
@@ -354,21 +405,43 @@ void raft_server::update_rand_timeout() {
 }
 
 void raft_server::update_params(const raft_params& new_params) {
-    recur_lock(lock_);
+    {   profiled_lock(lock_);
 
-    ptr<raft_params> clone = cs_new<raft_params>(new_params);
-    ctx_->set_params(clone);
-    apply_and_log_current_params();
+        ptr<raft_params> clone = cs_new<raft_params>(new_params);
+        ctx_->set_params(clone);
+        apply_and_log_current_params();
 
-    update_rand_timeout();
-    if (role_ != srv_role::leader) {
-        restart_election_timer();
+        update_rand_timeout();
+        if (role_ != srv_role::leader) {
+            restart_election_timer();
+        }
+        for (auto& entry: peers_) {
+            peer* p = entry.second.get();
+            profiled_lock(p->get_lock());
+            p->set_hb_interval(clone->heart_beat_interval_);
+            p->resume_hb_speed();
+        }
     }
-    for (auto& entry: peers_) {
-        peer* p = entry.second.get();
-        auto_lock(p->get_lock());
-        p->set_hb_interval(clone->heart_beat_interval_);
-        p->resume_hb_speed();
+    update_replicator();
+}
+
+void raft_server::update_replicator() {
+    ptr<raft_params> params = ctx_->get_params();
+    ptr<peer_replicator> old_replicator;
+    {   profiled_lock(lock_);
+        if (params->num_replicator_threads_ > 0 && !replicator_ && !stopping_) {
+            p_in("start %d per-peer replicator threads",
+                 params->num_replicator_threads_);
+            replicator_ = cs_new<peer_replicator>
+                          ( this, (size_t)params->num_replicator_threads_ );
+        } else if (params->num_replicator_threads_ <= 0 && replicator_) {
+            p_in("stop per-peer replicator threads");
+            old_replicator.swap(replicator_);
+        }
+    }
+    // Replicator threads may be waiting for the lock.
+    if (old_replicator) {
+        old_replicator->stop();
     }
 }
 
@@ -407,6 +480,11 @@ void raft_server::apply_and_log_current_params() {
           "snapshot IO: %s, "
           "parallel log appending: %s, "
           "streaming mode max log gap %d, max bytes %" PRIu64 ", "
+          "autotune %s, "
+          "target append latency %d us, "
+          "heartbeat lane: %s, "
+          "trace sample interval %d, "
+          "lock profiling: %s, "
           "full consensus mode: %s",
           params->election_timeout_lower_bound_,
           params->election_timeout_upper_bound_,
@@ -432,6 +510,11 @@ void raft_server::apply_and_log_current_params() {
           params->parallel_log_appending_ ? "ON" : "OFF",
           params->max_log_gap_in_stream_,
           params->max_bytes_in_flight_in_stream_,
+          params->stream_window_autotune_ ? "ON" : "OFF",
+          params->target_append_latency_us_,
+          params->use_heartbeat_lane_ ? "ON" : "OFF",
+          params->trace_sample_interval_,
+          params->profile_locks_ ? "ON" : "OFF",
           params->use_full_consensus_among_healthy_members_ ? "ON" : "OFF" );
 
     status_check_timer_.set_duration_ms(params->heart_beat_interval_);
@@ -439,6 +522,8 @@ void raft_server::apply_and_log_current_params() {
 
     leadership_transfer_timer_.set_duration_ms
         (params->leadership_transfer_min_wait_time_);
+
+    update_lock_profiling();
 }
 
 raft_params raft_server::get_current_params() const {
@@ -468,6 +553,17 @@ void raft_server::shutdown() {
     // If the global manager exists, cancel all pending requests.
     cancel_global_requests();
 
+    // Stop receiving heartbeats from other nodes' batchers.
+    if (ctx_->hb_batcher_) {
+        ctx_->hb_batcher_->deregister_group(ctx_->group_id_, this);
+    }
+
+    // Quiesced followers watching this server will wake up by
+    // their next liveness check.
+    if (ctx_->failure_detector_) {
+        ctx_->failure_detector_->deregister_group(ctx_->group_id_, this);
+    }
+
     // Cancel snapshot requests if exist.
     ptr<raft_params> params = ctx_->get_params();
     if (params->use_bg_thread_for_snapshot_io_) {
@@ -475,8 +571,9 @@ void raft_server::shutdown() {
     }
 
     // Terminate background commit thread.
-    {   recur_lock(lock_);
+    {   profiled_lock(lock_);
         stopping_ = true;
+        reset_quiescence();
         {   std::unique_lock<std::mutex> commit_lock(commit_cv_lock_);
             commit_cv_.notify_all();
         }
@@ -484,6 +581,11 @@ void raft_server::shutdown() {
 
     p_in("sent stop signal to the commit thread.");
 
+    if (replicator_) {
+        replicator_->stop();
+        p_in("replicator threads stopped.");
+    }
+
     // Cancel all scheduler tasks.
     // TODO: how do we guarantee all tasks are done?
     cancel_schedulers();
@@ -574,7 +676,7 @@ int32 raft_server::get_num_voting_members() {
     int32 count = 0;
     for (auto& entry: peers_) {
         ptr<peer>& p = entry.second;
-        auto_lock(p->get_lock());
+        profiled_lock(p->get_lock());
         if (!is_regular_member(p)) continue;
         count++;
     }
@@ -686,6 +788,11 @@ size_t raft_server::get_not_responding_peers_count(
                 non_responding_peer = true;
             }
 
+        } else if (pp->is_quiesced()) {
+            // Quiesced peer does not get heartbeats, hence
+            // does not respond. It is not a failure, unless its node
+            // is declared dead (see `handle_follower_failure`).
+
         } else {
             non_responding_peer = true;
         }
@@ -750,6 +857,22 @@ ptr<resp_msg> raft_server::process_req(req_msg& req,
           req.get_term(),
           req.get_extra_flags() );
 
+    if ( req.get_type() == msg_type::liveness_check_request ) {
+        // Liveness check from the failure detector of other node, for
+        // the members of this node. Answered by the shared detector
+        // even if this server is shutting down, without `lock_`.
+        if (ctx_->failure_detector_) {
+            return ctx_->failure_detector_->handle_check(req);
+        }
+        // Node is alive, but cannot tell about any member.
+        ptr<resp_msg> resp = cs_new<resp_msg>( state_->get_term(),
+                                               msg_type::liveness_check_response,
+                                               id_,
+                                               req.get_src() );
+        resp->accept(0);
+        return resp;
+    }
+
     if (stopping_) {
         // Shutting down, ignore all incoming messages.
         p_wn("stopping, return null");
@@ -761,7 +884,25 @@ ptr<resp_msg> raft_server::process_req(req_msg& req,
         return handle_cli_req_prelock(req, ext_params);
     }
 
-    recur_lock(lock_);
+    if ( req.get_type() == msg_type::heartbeat_batch_request ) {
+        // Heartbeats for all groups on this node, which will be
+        // dispatched by the batcher. Should not hold `lock_` here.
+        if (ctx_->hb_batcher_) {
+            return ctx_->hb_batcher_->handle_batch(req);
+        }
+        p_wn("got heartbeat batch from %d, but batcher is not set",
+             req.get_src());
+        return cs_new<resp_msg>( state_->get_term(),
+                                 msg_type::heartbeat_batch_response,
+                                 id_,
+                                 req.get_src() );
+    }
+
+    profiled_lock(lock_);
+    if (req.get_type() != msg_type::append_entries_request) {
+        // Logs of the stream should be durable before anything else.
+        flush_deferred_append_batch();
+    }
     if ( req.get_type() == msg_type::append_entries_request ||
          req.get_type() == msg_type::request_vote_request ||
          req.get_type() == msg_type::install_snapshot_request ) {
@@ -797,6 +938,7 @@ ptr<resp_msg> raft_server::process_req(req_msg& req,
             }
         }
         resp = handle_append_entries(req);
+        handle_quiesce_req(req, resp);
         {
             cb_func::Param param(id_, leader_, req.get_src(), resp.get());
             cb_func::ReturnCode rc =
@@ -875,7 +1017,7 @@ void raft_server::reset_peer_info() {
 }
 
 void raft_server::handle_peer_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err) {
-    recur_lock(lock_);
+    profiled_lock(lock_);
     if (err) {
         int32 peer_id = err->req()->get_dst();
         ptr<peer> pp = nullptr;
@@ -972,6 +1114,7 @@ void raft_server::handle_peer_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err)
             ctx_->cb_func_.call(cb_func::ReceivedAppendEntriesResp, &param);
         }
         handle_append_entries_resp(*resp);
+        update_quiescence(*resp);
         break;
 
     case msg_type::install_snapshot_response:
@@ -998,7 +1141,7 @@ void raft_server::handle_peer_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err)
 }
 
 void raft_server::send_reconnect_request() {
-    recur_lock(lock_);
+    profiled_lock(lock_);
 
     if (leader_ == id_) {
         p_er("this node %d is leader, "
@@ -1091,14 +1234,17 @@ bool raft_server::reconnect_client(peer& p) {
 
 void raft_server::become_leader() {
     stop_election_timer();
+    reset_quiescence();
+    flush_deferred_append_batch();
+    req_tracer_->clear();
 
-    {   auto_lock(commit_ret_elems_lock_);
+    {   profiled_lock(commit_ret_elems_lock_);
         p_in("number of pending commit elements: %zu",
              commit_ret_elems_.size());
     }
 
     ptr<raft_params> params = ctx_->get_params();
-    {   recur_lock(cli_lock_);
+    {   profiled_lock(cli_lock_);
         role_ = srv_role::leader;
         leader_ = id_;
         self_mark_down_ = excluded_from_the_quorum_ = false;
@@ -1190,7 +1336,7 @@ void raft_server::become_leader() {
 }
 
 bool raft_server::check_leadership_validity() {
-    recur_lock(lock_);
+    profiled_lock(lock_);
 
     if (role_ != leader)
         return false;
@@ -1269,7 +1415,7 @@ void raft_server::check_leadership_transfer() {
 
     size_t election_lower = ctx_->get_params()->election_timeout_lower_bound_;
 
-    recur_lock(lock_);
+    profiled_lock(lock_);
 
     int32 successor_id = -1;
     int32 max_priority = my_priority_;
@@ -1348,7 +1494,7 @@ void raft_server::yield_leadership(bool immediate_yield,
         return;
     }
 
-    recur_lock(lock_);
+    profiled_lock(lock_);
 
     if (immediate_yield) {
         p_in("got immediate re-elect request, resign now");
@@ -1359,6 +1505,9 @@ void raft_server::yield_leadership(bool immediate_yield,
         return;
     }
 
+    // Followers should get heartbeats to respond to the resignation.
+    wake_from_quiescence("leadership yield");
+
     // Not immediate yield, nominate the successor.
     int max_priority = 0;
     int candidate_id = -1;
@@ -1441,7 +1590,7 @@ bool raft_server::request_leadership() {
         return false;
     }
 
-    recur_lock(lock_);
+    profiled_lock(lock_);
     auto entry = peers_.find(leader_);
     if (entry == peers_.end()) {
         p_er("cannot request leadership: cannot find peer for "
@@ -1477,7 +1626,9 @@ bool raft_server::request_leadership() {
 void raft_server::become_follower() {
     // stop hb for all peers
     p_in("[BECOME FOLLOWER] term %" PRIu64 "", state_->get_term());
-    {   std::lock_guard<std::recursive_mutex> ll(cli_lock_);
+    reset_quiescence();
+    req_tracer_->clear();
+    {   profiled_guard(ll, cli_lock_);
         for (peer_itor it = peers_.begin(); it != peers_.end(); ++it) {
             it->second->enable_hb(false);
             it->second->reset_stream();
@@ -1538,7 +1689,7 @@ bool raft_server::update_term(ulong term) {
             //
             //   To avoid this issue, we acquire `cli_lock_`,
             //   and change `role_` first before setting the term.
-            std::lock_guard<std::recursive_mutex> ll(cli_lock_);
+            profiled_guard(ll, cli_lock_);
             role_ = srv_role::follower;
             state_->set_term(term);
         }
@@ -1554,7 +1705,7 @@ bool raft_server::update_term(ulong term) {
     return false;
 }
 
-ptr<resp_msg> raft_server::handle_ext_msg(req_msg& req, std::unique_lock<std::recursive_mutex>& guard) {
+ptr<resp_msg> raft_server::handle_ext_msg(req_msg& req, std::unique_lock<profiled_recursive_mutex>& guard) {
     switch (req.get_type()) {
     case msg_type::add_server_request:
         return handle_add_srv_req(req);
@@ -1590,7 +1741,7 @@ ptr<resp_msg> raft_server::handle_ext_msg(req_msg& req, std::unique_lock<std::re
 }
 
 void raft_server::handle_ext_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err) {
-    recur_lock(lock_);
+    profiled_lock(lock_);
     if (err) {
         handle_ext_resp_err(*err);
         return;
@@ -1704,7 +1855,7 @@ ulong raft_server::term_for_log(ulong log_idx) {
     }
 
     if (log_idx >= log_store_->start_index()) {
-        return log_store_->term_at(log_idx);
+        return log_term_at(log_idx);
     }
 
     ptr<snapshot> last_snapshot(state_machine_->last_snapshot());
@@ -1728,6 +1879,48 @@ ulong raft_server::term_for_log(ulong log_idx) {
     return last_snapshot->get_last_log_term();
 }
 
+ulong raft_server::log_term_at(ulong log_idx) {
+    ulong term = 0;
+    if (log_term_index_->get_term(log_idx, term)) return term;
+    return log_store_->term_at(log_idx);
+}
+
+void raft_server::rebuild_log_term_index() {
+    log_term_index_->clear();
+    ulong next_slot = log_store_->next_slot();
+    ulong idx = log_store_->start_index();
+    while (idx < next_slot) {
+        // Find the end of the run, with the log store only.
+        ulong term = log_store_->term_at(idx);
+        ulong run_end = lower_bound_log_term(term + 1, idx, next_slot - 1);
+        log_term_index_->append(idx, term, run_end - idx);
+        idx = run_end;
+    }
+    p_db("log term index: %zu runs for log %" PRIu64 " - %" PRIu64,
+         log_term_index_->num_runs(), log_store_->start_index(), next_slot - 1);
+}
+
+ulong raft_server::lower_bound_log_term(ulong term, ulong lo, ulong hi) {
+    // Terms in a log are non-decreasing, so that binary search
+    // finds the first log whose term is equal to or greater than
+    // the given term, within [lo, hi]. Returns a value greater than `hi` if not found.
+    ulong start_idx = log_store_->start_index();
+    if (lo < start_idx) lo = start_idx;
+    ulong idx = 0;
+    if (log_term_index_->lower_bound(term, lo, hi, idx)) return idx;
+
+    ulong end = hi + 1;
+    while (lo < end) {
+        ulong mid = lo + (end - lo) / 2;
+        if (log_store_->term_at(mid) < term) {
+            lo = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return lo;
+}
+
 void raft_server::set_user_ctx(const std::string& ctx) {
     // Clone current cluster config.
     ptr<cluster_config> c_conf = get_config();
@@ -1857,34 +2050,54 @@ bool raft_server::update_srv_config(const srv_config& new_config) {
 raft_server::peer_info raft_server::get_peer_info(int32 srv_id) const {
     if (!is_leader()) return peer_info();
 
-    recur_lock(lock_);
+    profiled_lock(lock_);
     auto entry = peers_.find(srv_id);
     if (entry == peers_.end()) return peer_info();
 
-    peer_info ret;
-    ptr<peer> pp = entry->second;
-    ret.id_ = pp->get_id();
-    ret.last_log_idx_ = pp->get_last_accepted_log_idx();
-    ret.last_succ_resp_us_ = pp->get_resp_timer_us();
-    return ret;
+    return make_peer_info(*entry->second);
 }
 
 std::vector<raft_server::peer_info> raft_server::get_peer_info_all() const {
     std::vector<raft_server::peer_info> ret;
     if (!is_leader()) return ret;
 
-    recur_lock(lock_);
+    profiled_lock(lock_);
     for (auto entry: peers_) {
-        peer_info pi;
-        ptr<peer> pp = entry.second;
-        pi.id_ = pp->get_id();
-        pi.last_log_idx_ = pp->get_last_accepted_log_idx();
-        pi.last_succ_resp_us_ = pp->get_resp_timer_us();
-        ret.push_back(pi);
+        ret.push_back( make_peer_info(*entry.second) );
     }
     return ret;
 }
 
+raft_server::peer_info raft_server::make_peer_info(peer& pp) const {
+    ptr<raft_params> params = ctx_->get_params();
+    peer_info ret;
+    ret.id_ = pp.get_id();
+    ret.last_log_idx_ = pp.get_last_accepted_log_idx();
+    ret.last_succ_resp_us_ = pp.get_resp_timer_us();
+
+    stream_window& sw = pp.get_stream_window();
+    ret.stream_log_window_ = params->max_log_gap_in_stream_;
+    ret.stream_byte_window_ = std::max( params->max_bytes_in_flight_in_stream_,
+                                        (int64_t)0 );
+    if (params->stream_window_autotune_ && params->max_log_gap_in_stream_ > 0) {
+        ret.stream_log_window_ = sw.get_log_window(ret.stream_log_window_);
+        ret.stream_byte_window_ = sw.get_byte_window(ret.stream_byte_window_);
+    }
+    ret.min_rtt_us_ = sw.get_min_rtt_us();
+    ret.smoothed_rtt_us_ = sw.get_smoothed_rtt_us();
+    ret.ack_bytes_per_sec_ = sw.get_byte_rate();
+
+    batch_size_controller& bsc = pp.get_batch_size_ctl();
+    ret.append_latency_us_ = bsc.get_avg_latency_us();
+    if (params->target_append_latency_us_ > 0) {
+        ret.batch_size_bytes_ =
+            bsc.get_batch_size(params->target_append_latency_us_);
+    }
+    ret.hb_lane_connected_ = pp.has_lane_rpc();
+    ret.bytes_in_flight_ = pp.get_bytes_in_flight();
+    return ret;
+}
+
 ptr<cluster_config> raft_server::get_config() const {
     std::lock_guard<std::mutex> l(config_lock_);
     ptr<cluster_config> ret = config_;
@@ -1915,6 +2128,7 @@ ulong raft_server::store_log_entry(ptr<log_entry>& entry, ulong index) {
     } else {
         log_store_->write_at(log_index, entry);
     }
+    log_term_index_->append(log_index, entry->get_term());
 
     if ( entry->get_val_type() == log_val_type::conf ) {
         // Force persistence of config_change logs to guarantee the durability of
@@ -1956,7 +2170,7 @@ ulong raft_server::store_log_entry(ptr<log_entry>& entry, ulong index) {
             // cannot update the precommit index between T1's `store_log_entry()`
             // and `state_machine::pre_commit()` calls, maintaining the correct
             // order of operations.
-            recur_lock(cli_lock_);
+            profiled_lock(cli_lock_);
 
             // Need to progress precommit index for config.
             try_update_precommit_index(log_index);
@@ -1966,6 +2180,37 @@ ulong raft_server::store_log_entry(ptr<log_entry>& entry, ulong index) {
     return log_index;
 }
 
+ulong raft_server::store_log_entries(std::vector< ptr<log_entry> >& entries) {
+    if (entries.empty()) return log_store_->next_slot();
+    if (entries.size() == 1) return store_log_entry(entries[0]);
+
+    for (ptr<log_entry>& entry: entries) {
+        if (entry->get_val_type() != log_val_type::conf) continue;
+
+        // Config change needs the extra steps in `store_log_entry`,
+        // append them one by one (rare).
+        ulong first_idx = store_log_entry(entries[0]);
+        for (size_t ii = 1; ii < entries.size(); ++ii) {
+            store_log_entry(entries[ii]);
+        }
+        return first_idx;
+    }
+    ulong first_idx = log_store_->append_batch(entries);
+    for (size_t ii = 0; ii < entries.size(); ++ii) {
+        log_term_index_->append(first_idx + ii, entries[ii]->get_term());
+    }
+    return first_idx;
+}
+
+void raft_server::report_traces(std::vector<request_trace>& traces) {
+    for (request_trace& tt: traces) {
+        cb_func::Param param(id_, leader_);
+        param.ctx = &tt;
+        invoke_callback(cb_func::Type::RequestTraced, &param);
+    }
+    traces.clear();
+}
+
 CbReturnCode raft_server::invoke_callback( cb_func::Type type,
                                            cb_func::Param* param )
 {
@@ -1974,7 +2219,7 @@ CbReturnCode raft_server::invoke_callback( cb_func::Type type,
 }
 
 void raft_server::set_inc_term_func(srv_state::inc_term_func func) {
-    recur_lock(lock_);
+    profiled_lock(lock_);
     if (!state_) return;
     state_->set_inc_term_func(func);
 }
@@ -2026,7 +2271,7 @@ bool raft_server::is_part_of_full_consensus() {
     if (is_leader()) {
         // If it is a leader, check if responding peers are enough
         // to form a full consensus.
-        recur_lock(lock_);
+        profiled_lock(lock_);
         int32_t num_voting_members = get_num_voting_members();
         int32_t nr_peers = (int32_t)get_not_responding_peers_count(
             params.heart_beat_interval_ * raft_limits_.full_consensus_follower_limit_);
@@ -0,0 +1,163 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "request_tracer.hxx"
+
+#include "internal_timer.hxx"
+
+namespace nuraft {
+
+const size_t request_tracer::MAX_TRACES;
+
+request_tracer::request_tracer()
+    : num_traces_(0)
+    {}
+
+bool request_tracer::is_sampled(ulong first_idx, ulong last_idx, int32 interval) {
+    if (interval <= 0 || last_idx < first_idx) return false;
+    // The last multiple of `interval` not greater than `last_idx`.
+    ulong sampled_idx = last_idx - (last_idx % interval);
+    return sampled_idx >= first_idx && sampled_idx > 0;
+}
+
+void request_tracer::start_leader(ulong first_idx,
+                                  ulong last_idx,
+                                  ulong term,
+                                  uint64_t accepted_us,
+                                  uint64_t appended_us,
+                                  bool wait_return)
+{
+    entry ee;
+    ee.trace_.is_leader_ = true;
+    ee.trace_.first_log_idx_ = first_idx;
+    ee.trace_.last_log_idx_ = last_idx;
+    ee.trace_.term_ = term;
+    ee.trace_.accepted_us_ = accepted_us;
+    ee.trace_.appended_us_ = appended_us;
+    ee.wait_return_ = wait_return;
+    add(last_idx, ee);
+}
+
+void request_tracer::start_follower(ulong idx,
+                                    ulong term,
+                                    uint64_t received_us,
+                                    uint64_t leader_timestamp_us,
+                                    uint64_t appended_us)
+{
+    entry ee;
+    ee.trace_.first_log_idx_ = idx;
+    ee.trace_.last_log_idx_ = idx;
+    ee.trace_.term_ = term;
+    ee.trace_.received_us_ = received_us;
+    ee.trace_.leader_timestamp_us_ = leader_timestamp_us;
+    ee.trace_.appended_us_ = appended_us;
+    ee.wait_return_ = false;
+    add(idx, ee);
+}
+
+void request_tracer::add(ulong key, const entry& ee) {
+    std::lock_guard<std::mutex> l(lock_);
+    // Overwritten log (e.g., by a new leader) replaces the old trace.
+    traces_[key] = ee;
+    while (traces_.size() > MAX_TRACES) {
+        traces_.erase(traces_.begin());
+    }
+    num_traces_ = traces_.size();
+}
+
+void request_tracer::on_sent(int32 peer_id, ulong start_idx, ulong end_idx) {
+    if (empty() || start_idx >= end_idx) return;
+
+    uint64_t now_us = timer_helper::get_timeofday_us();
+    std::lock_guard<std::mutex> l(lock_);
+    auto itr = traces_.lower_bound(start_idx);
+    for (; itr != traces_.end() && itr->first < end_idx; ++itr) {
+        request_trace& tt = itr->second.trace_;
+        if (!tt.is_leader_) continue;
+        // Keep the first one, retries are not the request's own latency.
+        tt.sent_us_.insert( std::make_pair(peer_id, now_us) );
+    }
+}
+
+void request_tracer::on_acked(int32 peer_id, ulong matched_idx) {
+    if (empty()) return;
+
+    uint64_t now_us = timer_helper::get_timeofday_us();
+    std::lock_guard<std::mutex> l(lock_);
+    auto end = traces_.upper_bound(matched_idx);
+    for (auto itr = traces_.begin(); itr != end; ++itr) {
+        request_trace& tt = itr->second.trace_;
+        if (!tt.is_leader_) continue;
+        tt.acked_us_.insert( std::make_pair(peer_id, now_us) );
+    }
+}
+
+void request_tracer::on_committed(ulong commit_idx) {
+    if (empty()) return;
+
+    uint64_t now_us = timer_helper::get_timeofday_us();
+    std::lock_guard<std::mutex> l(lock_);
+    auto end = traces_.upper_bound(commit_idx);
+    for (auto itr = traces_.begin(); itr != end; ++itr) {
+        request_trace& tt = itr->second.trace_;
+        if (!tt.committed_us_) tt.committed_us_ = now_us;
+    }
+}
+
+void request_tracer::on_applied(ulong idx,
+                                std::vector<request_trace>& finished_out)
+{
+    if (empty()) return;
+
+    std::lock_guard<std::mutex> l(lock_);
+    auto itr = traces_.find(idx);
+    if (itr == traces_.end()) return;
+
+    itr->second.trace_.applied_us_ = timer_helper::get_timeofday_us();
+    if (!itr->second.wait_return_) {
+        finish(itr, finished_out);
+    }
+}
+
+void request_tracer::on_returned(ulong idx,
+                                 std::vector<request_trace>& finished_out)
+{
+    if (empty()) return;
+
+    std::lock_guard<std::mutex> l(lock_);
+    auto itr = traces_.find(idx);
+    if (itr == traces_.end() || !itr->second.wait_return_) return;
+
+    itr->second.trace_.returned_us_ = timer_helper::get_timeofday_us();
+    finish(itr, finished_out);
+}
+
+void request_tracer::clear() {
+    std::lock_guard<std::mutex> l(lock_);
+    traces_.clear();
+    num_traces_ = 0;
+}
+
+void request_tracer::finish(std::map<ulong, entry>::iterator itr,
+                            std::vector<request_trace>& finished_out)
+{
+    finished_out.push_back(itr->second.trace_);
+    traces_.erase(itr);
+    num_traces_ = traces_.size();
+}
+
+}
+
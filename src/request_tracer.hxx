@@ -0,0 +1,127 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "pp_util.hxx"
+#include "request_trace.hxx"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace nuraft {
+
+/**
+ * Traces of sampled requests in progress, keyed by the last log index.
+ * Finished traces are returned to the caller, which reports them
+ * outside the lock.
+ *
+ * Thread-safe.
+ */
+class request_tracer {
+public:
+    request_tracer();
+
+    __nocopy__(request_tracer);
+
+public:
+    /**
+     * `true` if any log in [first_idx, last_idx] is sampled.
+     */
+    static bool is_sampled(ulong first_idx, ulong last_idx, int32 interval);
+
+    /**
+     * `true` if no trace is in progress, without acquiring the lock.
+     */
+    bool empty() const { return num_traces_.load(std::memory_order_relaxed) == 0; }
+
+    /**
+     * Start a trace of a request accepted and appended by the leader.
+     *
+     * @param wait_return `true` if the result will be returned to the client
+     *                    after commit, so that `on_returned` finishes the trace.
+     */
+    void start_leader(ulong first_idx,
+                      ulong last_idx,
+                      ulong term,
+                      uint64_t accepted_us,
+                      uint64_t appended_us,
+                      bool wait_return);
+
+    /**
+     * Start a trace of a log appended by a follower.
+     */
+    void start_follower(ulong idx,
+                        ulong term,
+                        uint64_t received_us,
+                        uint64_t leader_timestamp_us,
+                        uint64_t appended_us);
+
+    /**
+     * Logs in [start_idx, end_idx) were sent to the given peer.
+     */
+    void on_sent(int32 peer_id, ulong start_idx, ulong end_idx);
+
+    /**
+     * The given peer has logs up to `matched_idx`.
+     */
+    void on_acked(int32 peer_id, ulong matched_idx);
+
+    /**
+     * Logs up to `commit_idx` were committed.
+     */
+    void on_committed(ulong commit_idx);
+
+    /**
+     * `state_machine::commit` of the given log returned.
+     */
+    void on_applied(ulong idx, std::vector<request_trace>& finished_out);
+
+    /**
+     * The result of the request ending at the given log was returned.
+     */
+    void on_returned(ulong idx, std::vector<request_trace>& finished_out);
+
+    /**
+     * Drop all traces in progress, e.g., on role change.
+     */
+    void clear();
+
+    /**
+     * Traces in progress beyond this are dropped, oldest first.
+     */
+    static const size_t MAX_TRACES = 1024;
+
+private:
+    struct entry {
+        request_trace trace_;
+        bool wait_return_;
+    };
+
+    void add(ulong key, const entry& ee);
+
+    void finish(std::map<ulong, entry>::iterator itr,
+                std::vector<request_trace>& finished_out);
+
+    std::map<ulong, entry> traces_;
+    std::atomic<size_t> num_traces_;
+    std::mutex lock_;
+};
+
+}
+
@@ -175,7 +175,7 @@ void snapshot_io_mgr::async_io_loop() {
 
             int dst_id = elem->dst_->get_id();
 
-            std::unique_lock<std::mutex> lock(elem->dst_->get_lock());
+            profiled_guard(lock, elem->dst_->get_lock());
             // ---- lock acquired
             logger* l_ = elem->raft_->l_.get();
             ulong obj_idx = elem->sync_ctx_->get_offset();
@@ -201,7 +201,7 @@ void snapshot_io_mgr::async_io_loop() {
                       "for peer %d failed: %d",
                       snp_log_idx, snp_log_term, obj_idx, dst_id, rc );
 
-                recur_lock(elem->raft_->lock_);
+                profiled_lock(elem->raft_->lock_);
                 auto entry = elem->raft_->peers_.find(dst_id);
                 if (entry != elem->raft_->peers_.end()) {
                     // If normal member (already in the peer list):
@@ -219,7 +219,7 @@ void snapshot_io_mgr::async_io_loop() {
             if (data) data->pos(0);
 
             // Send snapshot message with the given response handler.
-            recur_lock(elem->raft_->lock_);
+            profiled_lock(elem->raft_->lock_);
             ulong term = elem->raft_->state_->get_term();
             ulong commit_idx = elem->raft_->quick_commit_index_;
 
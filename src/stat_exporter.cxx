@@ -0,0 +1,325 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "stat_exporter.hxx"
+
+#include "raft_server.hxx"
+#include "stat_mgr.hxx"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <sstream>
+
+namespace nuraft {
+
+const char* stat_exporter::CONTENT_TYPE =
+    "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+namespace {
+
+using labels = std::map<std::string, std::string>;
+
+// Samples of one metric family, which should be rendered together.
+struct family {
+    std::string type_;
+    std::string help_;
+    std::string samples_;
+};
+
+class family_set {
+public:
+    // Returns `nullptr` if the name is already used by another type.
+    family* get(const std::string& name,
+                const std::string& type,
+                const std::string& help)
+    {
+        auto entry = index_.find(name);
+        if (entry != index_.end()) {
+            family& ff = families_[entry->second].second;
+            return (ff.type_ == type) ? &ff : nullptr;
+        }
+        index_[name] = families_.size();
+        families_.push_back( std::make_pair(name, family{type, help, ""}) );
+        return &families_.back().second;
+    }
+
+    std::string render() const {
+        std::stringstream ss;
+        for (auto& entry: families_) {
+            const family& ff = entry.second;
+            ss << "# TYPE " << entry.first << " " << ff.type_ << "\n";
+            if (!ff.help_.empty()) {
+                ss << "# HELP " << entry.first << " " << ff.help_ << "\n";
+            }
+            ss << ff.samples_;
+        }
+        ss << "# EOF\n";
+        return ss.str();
+    }
+
+private:
+    std::vector< std::pair<std::string, family> > families_;
+    std::map<std::string, size_t> index_;
+};
+
+// Metric and label names: [a-zA-Z_:][a-zA-Z0-9_:]*
+std::string sanitize_name(const std::string& name) {
+    std::string ret = name;
+    for (char& cc: ret) {
+        bool valid = (cc >= 'a' && cc <= 'z') || (cc >= 'A' && cc <= 'Z') ||
+                     (cc >= '0' && cc <= '9') || cc == '_' || cc == ':';
+        if (!valid) cc = '_';
+    }
+    if (ret.empty() || (ret[0] >= '0' && ret[0] <= '9')) ret = "_" + ret;
+    return ret;
+}
+
+std::string escape_label_value(const std::string& value) {
+    std::string ret;
+    for (char cc: value) {
+        switch (cc) {
+        case '\\':  ret += "\\\\";  break;
+        case '"':   ret += "\\\"";  break;
+        case '\n':  ret += "\\n";   break;
+        default:    ret += cc;      break;
+        }
+    }
+    return ret;
+}
+
+std::string render_labels(const labels& ll) {
+    if (ll.empty()) return std::string();
+    std::string ret = "{";
+    for (auto& entry: ll) {
+        if (ret.size() > 1) ret += ",";
+        ret += sanitize_name(entry.first) + "=\"" +
+               escape_label_value(entry.second) + "\"";
+    }
+    ret += "}";
+    return ret;
+}
+
+template<typename T>
+void add_sample(family* ff,
+                const std::string& name,
+                const labels& ll,
+                T value)
+{
+    if (!ff) return;
+    std::stringstream ss;
+    ss.precision(15);
+    ss << name << render_labels(ll) << " " << value << "\n";
+    ff->samples_ += ss.str();
+}
+
+template<typename T>
+void add_gauge(family_set& fs,
+               const std::string& name,
+               const std::string& help,
+               const labels& ll,
+               T value)
+{
+    add_sample( fs.get(name, "gauge", help), name, ll, value );
+}
+
+// Upper bounds of histogram buckets: 1, 2, 5, 10, 20, 50, ...
+uint64_t next_bucket_bound(uint64_t bound) {
+    uint64_t base = 1;
+    while (bound >= base * 10) base *= 10;
+    uint64_t mantissa = bound / base;
+    if (mantissa < 2) return base * 2;
+    if (mantissa < 5) return base * 5;
+    return base * 10;
+}
+
+void add_histogram(family_set& fs,
+                   const std::string& name,
+                   const labels& ll,
+                   const HdrHistogram& hist)
+{
+    family* ff = fs.get(name, "histogram", "");
+    if (!ff) return;
+
+    // An HDR bucket is counted in the first bound not less than its
+    // lower bound, so counts are off by at most the width of a bucket.
+    uint64_t max = hist.getMax();
+    uint64_t cumulative = 0;
+    HdrHistItr itr = hist.begin();
+    uint64_t bound = 1;
+    while (true) {
+        while ( itr != hist.end() && itr.getLowerBound() <= bound ) {
+            cumulative += itr.getCount();
+            ++itr;
+        }
+        labels bucket_labels = ll;
+        bucket_labels["le"] = std::to_string(bound);
+        add_sample(ff, name + "_bucket", bucket_labels, cumulative);
+
+        if ( bound >= max ||
+             bound > std::numeric_limits<uint64_t>::max() / 10 ) {
+            break;
+        }
+        bound = next_bucket_bound(bound);
+    }
+
+    labels inf_labels = ll;
+    inf_labels["le"] = "+Inf";
+    add_sample(ff, name + "_bucket", inf_labels, hist.getTotal());
+    add_sample(ff, name + "_count", ll, hist.getTotal());
+    add_sample(ff, name + "_sum", ll, hist.getSum());
+}
+
+void add_stats(family_set& fs) {
+    stat_mgr::for_each_scope([&](stat_mgr& mgr) {
+        std::vector<stat_elem*> stats;
+        mgr.get_all_stats(stats);
+        const labels& ll = mgr.get_labels();
+        for (stat_elem* elem: stats) {
+            std::string name = "nuraft_" + sanitize_name(elem->get_name());
+            switch (elem->get_type()) {
+            case stat_elem::COUNTER:
+                add_sample( fs.get(name, "counter", ""),
+                            name + "_total", ll, elem->get_counter() );
+                break;
+            case stat_elem::GAUGE:
+                add_sample( fs.get(name, "gauge", ""),
+                            name, ll, elem->get_gauge() );
+                break;
+            case stat_elem::HISTOGRAM:
+                add_histogram(fs, name, ll, elem->get_histogram());
+                break;
+            default: break;
+            }
+        }
+    });
+}
+
+double us_to_sec(uint64_t us) {
+    return (double)us / 1000000.0;
+}
+
+void add_server_state(family_set& fs, raft_server& srv) {
+    labels ll = srv.get_stat_labels();
+
+    add_gauge(fs, "nuraft_term", "Current term.",
+              ll, srv.get_term());
+    add_gauge(fs, "nuraft_leader", "1 if this server is the leader.",
+              ll, srv.is_leader() ? 1 : 0);
+    add_gauge(fs, "nuraft_leader_id", "ID of the current leader, -1 if none.",
+              ll, srv.get_leader());
+
+    ulong last_log_idx = srv.get_last_log_idx();
+    add_gauge(fs, "nuraft_last_log_index", "Last log index in the log store.",
+              ll, last_log_idx);
+    add_gauge(fs, "nuraft_precommit_index",
+              "Last log index appended as a leader.",
+              ll, srv.get_precommit_log_idx());
+    add_gauge(fs, "nuraft_commit_index",
+              "Log index to be committed.",
+              ll, srv.get_target_committed_log_idx());
+    add_gauge(fs, "nuraft_sm_commit_index",
+              "Last log index committed by the state machine.",
+              ll, srv.get_committed_log_idx());
+    add_gauge(fs, "nuraft_pending_commit_requests",
+              "Client requests waiting for their logs to be committed.",
+              ll, srv.get_num_pending_commit_elems());
+
+    for (raft_server::peer_info& pi: srv.get_peer_info_all()) {
+        labels pl = ll;
+        pl["peer_id"] = std::to_string(pi.id_);
+
+        add_gauge(fs, "nuraft_peer_last_log_index",
+                  "Last log index of the peer.",
+                  pl, pi.last_log_idx_);
+        add_gauge(fs, "nuraft_peer_log_lag",
+                  "Number of logs the peer is behind the leader.",
+                  pl, last_log_idx > pi.last_log_idx_
+                      ? last_log_idx - pi.last_log_idx_ : 0);
+        add_gauge(fs, "nuraft_peer_bytes_in_flight",
+                  "Bytes sent to the peer and not acknowledged yet.",
+                  pl, pi.bytes_in_flight_);
+        add_gauge(fs, "nuraft_peer_last_response_seconds",
+                  "Time since the last successful response of the peer.",
+                  pl, us_to_sec(pi.last_succ_resp_us_));
+        add_gauge(fs, "nuraft_peer_min_rtt_seconds",
+                  "Minimum round trip time of append requests.",
+                  pl, us_to_sec(pi.min_rtt_us_));
+        add_gauge(fs, "nuraft_peer_smoothed_rtt_seconds",
+                  "Smoothed round trip time of append requests.",
+                  pl, us_to_sec(pi.smoothed_rtt_us_));
+        add_gauge(fs, "nuraft_peer_ack_bytes_per_second",
+                  "Recent delivery rate of logs acknowledged by the peer.",
+                  pl, pi.ack_bytes_per_sec_);
+        add_gauge(fs, "nuraft_peer_append_latency_seconds",
+                  "Average time for the peer to write the logs of a request.",
+                  pl, us_to_sec(pi.append_latency_us_));
+        add_gauge(fs, "nuraft_peer_stream_window_logs",
+                  "In-flight window in streaming mode, in logs.",
+                  pl, pi.stream_log_window_);
+        add_gauge(fs, "nuraft_peer_stream_window_bytes",
+                  "In-flight window in streaming mode, in bytes, "
+                  "0 if unlimited.",
+                  pl, pi.stream_byte_window_);
+        add_gauge(fs, "nuraft_peer_batch_size_bytes",
+                  "Size of the next batch to the peer, 0 if not limited.",
+                  pl, pi.batch_size_bytes_);
+        add_gauge(fs, "nuraft_peer_heartbeat_lane_connected",
+                  "1 if the heartbeat lane to the peer is connected.",
+                  pl, pi.hb_lane_connected_ ? 1 : 0);
+    }
+}
+
+}
+
+stat_exporter::stat_exporter() {}
+
+void stat_exporter::add_server(ptr<raft_server> server) {
+    std::lock_guard<std::mutex> l(lock_);
+    servers_.push_back(server);
+}
+
+void stat_exporter::remove_server(ptr<raft_server> server) {
+    std::lock_guard<std::mutex> l(lock_);
+    servers_.erase
+        ( std::remove_if( servers_.begin(), servers_.end(),
+                          [&](const wptr<raft_server>& entry) {
+                              ptr<raft_server> srv = entry.lock();
+                              // Also clean up destroyed ones.
+                              return !srv || srv == server;
+                          } ),
+          servers_.end() );
+}
+
+std::string stat_exporter::render() {
+    std::vector< ptr<raft_server> > servers;
+    {   std::lock_guard<std::mutex> l(lock_);
+        for (wptr<raft_server>& entry: servers_) {
+            ptr<raft_server> srv = entry.lock();
+            if (srv) servers.push_back(srv);
+        }
+    }
+
+    family_set fs;
+    add_stats(fs);
+    for (ptr<raft_server>& srv: servers) {
+        add_server_state(fs, *srv);
+    }
+    return fs.render();
+}
+
+}
+
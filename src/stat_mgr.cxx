@@ -15,23 +15,111 @@ limitations under the License.
 **************************************************************************/
 
 #include "raft_server.hxx"
+
+#include "context.hxx"
 #include "stat_mgr.hxx"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
 
 namespace nuraft {
 
+// === sharded_counter ========================================================
+
+sharded_counter::sharded_counter()
+    : shards_( new shard[get_num_shards()] )
+{
+    for (size_t ii = 0; ii < get_num_shards(); ++ii) {
+        shards_[ii].value_ = 0;
+    }
+}
+
+sharded_counter::~sharded_counter() {
+    delete[] shards_;
+}
+
+int64_t sharded_counter::get() const {
+    int64_t sum = 0;
+    for (size_t ii = 0; ii < get_num_shards(); ++ii) {
+        sum += shards_[ii].value_.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+void sharded_counter::set(int64_t value) {
+    shards_[0].value_.store(value, std::memory_order_relaxed);
+    for (size_t ii = 1; ii < get_num_shards(); ++ii) {
+        shards_[ii].value_.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t sharded_counter::get_num_shards() {
+    static size_t num_shards = []() {
+        // Up to 64 shards, rounded up to a power of 2.
+        size_t num_threads =
+            std::min( std::max(std::thread::hardware_concurrency(), 1u), 64u );
+        size_t ret = 1;
+        while (ret < num_threads) ret <<= 1;
+        return ret;
+    }();
+    return num_shards;
+}
+
+size_t sharded_counter::get_shard_idx() {
+    static std::atomic<size_t> next_idx(0);
+    static thread_local size_t shard_idx =
+        next_idx.fetch_add(1, std::memory_order_relaxed) &
+        (get_num_shards() - 1);
+    return shard_idx;
+}
+
+
+// === sharded_histogram ======================================================
+
+sharded_histogram::sharded_histogram()
+    : shards_( new shard[sharded_counter::get_num_shards()] )
+{
+    for (size_t ii = 0; ii < sharded_counter::get_num_shards(); ++ii) {
+        shards_[ii].sum_ = 0;
+        shards_[ii].max_ = 0;
+    }
+}
+
+sharded_histogram::~sharded_histogram() {
+    delete[] shards_;
+}
+
+HdrHistogram sharded_histogram::get() const {
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    for (size_t ii = 0; ii < sharded_counter::get_num_shards(); ++ii) {
+        sum += shards_[ii].sum_.load(std::memory_order_relaxed);
+        max = std::max(max, shards_[ii].max_.load(std::memory_order_relaxed));
+    }
+    HdrHistogram ret(hist_);
+    ret.setTotals(sum, max);
+    return ret;
+}
+
+void sharded_histogram::reset() {
+    hist_.clear();
+    for (size_t ii = 0; ii < sharded_counter::get_num_shards(); ++ii) {
+        shards_[ii].sum_.store(0, std::memory_order_relaxed);
+        shards_[ii].max_.store(0, std::memory_order_relaxed);
+    }
+}
+
+
 // === stat_elem ==============================================================
 
 stat_elem::stat_elem(Type _type, const std::string& _name)
     : stat_type_(_type)
     , stat_name_(_name)
-    , counter_(0)
-    , gauge_(0)
     , hist_( ( _type == HISTOGRAM )
-             ? ( new Histogram() )
+             ? ( new sharded_histogram() )
              : nullptr )
     {}
 
@@ -42,10 +130,19 @@ stat_elem::~stat_elem() {
 
 // === stat_mgr ===============================================================
 
-stat_mgr::stat_mgr() {
-}
+stat_mgr::stat_mgr(const labels& scope_labels, bool is_scope)
+    : labels_(scope_labels)
+    , is_scope_(is_scope)
+    {}
 
 stat_mgr::~stat_mgr() {
+    if (is_scope_) {
+        // Should be invisible before deleting stats.
+        stat_mgr* global = get_instance();
+        std::unique_lock<std::mutex> l(global->scopes_lock_);
+        global->scopes_.erase(this);
+    }
+
     std::unique_lock<std::mutex> l(stat_map_lock_);
     for (auto& entry: stat_map_) {
         delete entry.second;
@@ -54,10 +151,28 @@ stat_mgr::~stat_mgr() {
 }
 
 stat_mgr* stat_mgr::get_instance() {
-    static stat_mgr mgr_instance;
+    static stat_mgr mgr_instance(labels(), false);
     return &mgr_instance;
 }
 
+ptr<stat_mgr> stat_mgr::create_scope(const labels& scope_labels) {
+    ptr<stat_mgr> scope( new stat_mgr(scope_labels, true) );
+    stat_mgr* global = get_instance();
+    std::unique_lock<std::mutex> l(global->scopes_lock_);
+    global->scopes_.insert(scope.get());
+    return scope;
+}
+
+void stat_mgr::for_each_scope(const std::function<void(stat_mgr&)>& func) {
+    stat_mgr* global = get_instance();
+    func(*global);
+
+    std::unique_lock<std::mutex> l(global->scopes_lock_);
+    for (stat_mgr* scope: global->scopes_) {
+        func(*scope);
+    }
+}
+
 stat_elem* stat_mgr::get_stat(const std::string& stat_name) {
     std::unique_lock<std::mutex> l(stat_map_lock_);
     auto entry = stat_map_.find(stat_name);
@@ -118,22 +233,11 @@ void stat_mgr::reset_all_stats() {
 
 // === raft_server ============================================================
 
-uint64_t raft_server::get_stat_counter(const std::string& name) {
-    stat_elem* elem = stat_mgr::get_instance()->get_stat(name);
-    if (!elem) return 0;
-    // Tolerate type cast between counter and gauge.
-    if (elem->get_type() == stat_elem::COUNTER) {
-        return elem->get_counter();
-    } else if (elem->get_type() == stat_elem::GAUGE) {
-        return elem->get_gauge();
-    }
-    return 0;
-}
+namespace {
 
-int64_t raft_server::get_stat_gauge(const std::string& name) {
-    stat_elem* elem = stat_mgr::get_instance()->get_stat(name);
+// Tolerate type cast between counter and gauge.
+int64_t get_stat_value(stat_elem* elem) {
     if (!elem) return 0;
-    // Tolerate type cast between counter and gauge.
     if (elem->get_type() == stat_elem::COUNTER) {
         return elem->get_counter();
     } else if (elem->get_type() == stat_elem::GAUGE) {
@@ -142,28 +246,120 @@ int64_t raft_server::get_stat_gauge(const std::string& name) {
     return 0;
 }
 
-bool raft_server::get_stat_histogram(const std::string& name,
-                                     std::map<double, uint64_t>& histogram_out ) {
-    stat_elem* elem = stat_mgr::get_instance()->get_stat(name);
+bool dump_stat_histogram(stat_elem* elem,
+                         std::map<double, uint64_t>& histogram_out)
+{
     if (!elem) return false;
     if (elem->get_type() != stat_elem::HISTOGRAM) return false;
 
-    for (HistItr& entry: *elem->get_histogram()) {
+    HdrHistogram hist = elem->get_histogram();
+    for (HdrHistItr& entry: hist) {
         uint64_t cnt = entry.getCount();
         if (cnt) {
-            histogram_out.insert( std::make_pair(entry.getUpperBound(), cnt) );
+            histogram_out[entry.getUpperBound()] += cnt;
         }
     }
     return true;
 }
 
+}
+
+uint64_t raft_server::get_stat_counter(const std::string& name) {
+    int64_t sum = 0;
+    stat_mgr::for_each_scope([&](stat_mgr& mgr) {
+        sum += get_stat_value( mgr.get_stat(name) );
+    });
+    return sum;
+}
+
+int64_t raft_server::get_stat_gauge(const std::string& name) {
+    int64_t sum = 0;
+    stat_mgr::for_each_scope([&](stat_mgr& mgr) {
+        sum += get_stat_value( mgr.get_stat(name) );
+    });
+    return sum;
+}
+
+bool raft_server::get_stat_histogram(const std::string& name,
+                                     std::map<double, uint64_t>& histogram_out ) {
+    bool found = false;
+    stat_mgr::for_each_scope([&](stat_mgr& mgr) {
+        if (dump_stat_histogram( mgr.get_stat(name), histogram_out )) {
+            found = true;
+        }
+    });
+    return found;
+}
+
 void raft_server::reset_stat(const std::string& name) {
-    stat_mgr::get_instance()->reset_stat(name);
+    stat_mgr::for_each_scope([&](stat_mgr& mgr) {
+        mgr.reset_stat(name);
+    });
 }
 
 void raft_server::reset_all_stats() {
-    stat_mgr::get_instance()->reset_all_stats();
+    stat_mgr::for_each_scope([](stat_mgr& mgr) {
+        mgr.reset_all_stats();
+    });
 }
 
-} // namespace nuraft
+void raft_server::get_all_stat_scopes(std::vector<stat_scope>& scopes_out) {
+    stat_mgr::for_each_scope([&](stat_mgr& mgr) {
+        stat_scope scope;
+        scope.labels_ = mgr.get_labels();
+
+        std::vector<stat_elem*> elems;
+        mgr.get_all_stats(elems);
+        for (stat_elem* elem: elems) {
+            if (elem->get_type() == stat_elem::HISTOGRAM) {
+                dump_stat_histogram(elem, scope.histograms_[elem->get_name()]);
+            } else {
+                scope.values_[elem->get_name()] = get_stat_value(elem);
+            }
+        }
+        scopes_out.push_back(scope);
+    });
+}
 
+void raft_server::init_stats() {
+    stat_mgr::labels labels;
+    labels["server_id"] = std::to_string(id_);
+    if (ctx_->group_id_) {
+        labels["group_id"] = std::to_string(ctx_->group_id_);
+    }
+    stats_ = stat_mgr::create_scope(labels);
+
+    num_ae_sent_stat_ = stats_->create_stat
+        (stat_elem::COUNTER, "append_entries_sent");
+    num_ae_rcvd_stat_ = stats_->create_stat
+        (stat_elem::COUNTER, "append_entries_received");
+    num_committed_stat_ = stats_->create_stat
+        (stat_elem::COUNTER, "committed_logs");
+    log_append_latency_stat_ = stats_->create_stat
+        (stat_elem::HISTOGRAM, "log_append_latency_us");
+}
+
+std::map<std::string, std::string> raft_server::get_stat_labels() const {
+    return stats_->get_labels();
+}
+
+uint64_t raft_server::get_server_stat_counter(const std::string& name) const {
+    return get_stat_value( stats_->get_stat(name) );
+}
+
+int64_t raft_server::get_server_stat_gauge(const std::string& name) const {
+    return get_stat_value( stats_->get_stat(name) );
+}
+
+bool raft_server::get_server_stat_histogram
+     ( const std::string& name,
+       std::map<double, uint64_t>& histogram_out ) const
+{
+    return dump_stat_histogram( stats_->get_stat(name), histogram_out );
+}
+
+void raft_server::reset_server_stats() {
+    stats_->reset_all_stats();
+}
+
+} // namespace nuraft
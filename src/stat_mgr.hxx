@@ -16,18 +16,100 @@ limitations under the License.
 
 #pragma once
 
-#include "histogram.h"
+#include "hdr_histogram.h"
+#include "ptr.hxx"
 
 #include <atomic>
 #include <cassert>
+#include <functional>
 #include <map>
 #include <mutex>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace nuraft {
 
+// Counter sharded by thread, so that threads updating the same counter
+// do not contend on the same cache line. Shards are summed only on read.
+class sharded_counter {
+public:
+    sharded_counter();
+
+    ~sharded_counter();
+
+    sharded_counter(const sharded_counter&) = delete;
+    sharded_counter& operator=(const sharded_counter&) = delete;
+
+    inline void add(int64_t amount) {
+        shards_[get_shard_idx()].value_.fetch_add
+            (amount, std::memory_order_relaxed);
+    }
+
+    int64_t get() const;
+
+    // Not atomic with respect to concurrent `add` calls.
+    void set(int64_t value);
+
+    // Power of 2, based on the number of hardware threads.
+    static size_t get_num_shards();
+
+    // Shard assigned to the calling thread, round-robin.
+    static size_t get_shard_idx();
+
+private:
+    struct shard {
+        std::atomic<int64_t> value_;
+        char padding_[64 - sizeof(std::atomic<int64_t>)];
+    };
+
+    shard* shards_;
+};
+
+// Histogram whose sum and max are sharded by thread, as every `add`
+// would update them otherwise. The buckets are shared, as a copy per
+// shard would cost too much memory with many stat scopes, and threads
+// recording different values update different buckets. The total count
+// is summed from the buckets on read.
+class sharded_histogram {
+public:
+    sharded_histogram();
+
+    ~sharded_histogram();
+
+    sharded_histogram(const sharded_histogram&) = delete;
+    sharded_histogram& operator=(const sharded_histogram&) = delete;
+
+    inline void add(uint64_t val) {
+        hist_.addToBin(val);
+        shard& ss = shards_[sharded_counter::get_shard_idx()];
+        ss.sum_.fetch_add(val, std::memory_order_relaxed);
+        uint64_t cur_max = ss.max_.load(std::memory_order_relaxed);
+        while ( cur_max < val &&
+                !ss.max_.compare_exchange_weak(cur_max, val,
+                                               std::memory_order_relaxed) ) {
+            // `cur_max` is reloaded by the failed exchange.
+        }
+    }
+
+    HdrHistogram get() const;
+
+    // Not atomic with respect to concurrent `add` calls.
+    void reset();
+
+private:
+    struct shard {
+        std::atomic<uint64_t> sum_;
+        std::atomic<uint64_t> max_;
+        char padding_[64 - sizeof(std::atomic<uint64_t>) * 2];
+    };
+
+    HdrHistogram hist_;
+
+    shard* shards_;
+};
+
 // NOTE: Accessing a stat_elem instance using multiple threads is safe.
 class stat_elem {
 public:
@@ -46,11 +128,7 @@ public:
         return;
 #endif
         assert(stat_type_ != HISTOGRAM);
-        if (stat_type_ == COUNTER) {
-            counter_.fetch_add(amount, std::memory_order_relaxed);
-        } else {
-            gauge_.fetch_add(amount, std::memory_order_relaxed);
-        }
+        value_.add(amount);
     }
 
     inline void dec(size_t amount = 1) {
@@ -58,11 +136,7 @@ public:
         return;
 #endif
         assert(stat_type_ != HISTOGRAM);
-        if (stat_type_ == COUNTER) {
-            counter_.fetch_sub(amount, std::memory_order_relaxed);
-        } else {
-            gauge_.fetch_sub(amount, std::memory_order_relaxed);
-        }
+        value_.add( -(int64_t)amount );
     }
 
     inline void add_value(uint64_t val) {
@@ -78,11 +152,7 @@ public:
         return;
 #endif
         assert(stat_type_ != HISTOGRAM);
-        if (stat_type_ == COUNTER) {
-            counter_.store(value, std::memory_order_relaxed);
-        } else {
-            gauge_.store(value, std::memory_order_relaxed);
-        }
+        value_.set(value);
     }
 
     stat_elem& operator+=(size_t amount) {
@@ -132,11 +202,14 @@ public:
 
     Type get_type() const { return stat_type_; }
 
-    uint64_t get_counter() const { return counter_; }
+    uint64_t get_counter() const { return value_.get(); }
 
-    int64_t get_gauge() const { return gauge_; }
+    int64_t get_gauge() const { return value_.get(); }
 
-    Histogram* get_histogram() const { return hist_; }
+    // Copy of the histogram, empty if not histogram type.
+    HdrHistogram get_histogram() const {
+        return hist_ ? hist_->get() : HdrHistogram();
+    }
 
     void reset() {
         switch (stat_type_) {
@@ -144,10 +217,9 @@ public:
         case GAUGE:
             set(0);
             break;
-        case HISTOGRAM: {
-            Histogram empty_histogram;
-            *hist_ = empty_histogram;
-            break; }
+        case HISTOGRAM:
+            hist_->reset();
+            break;
         default: break;
         }
     }
@@ -155,16 +227,38 @@ public:
 private:
     Type stat_type_;
     std::string stat_name_;
-    std::atomic<uint64_t> counter_;
-    std::atomic<int64_t> gauge_;
-    Histogram* hist_;
+    sharded_counter value_;
+    sharded_histogram* hist_;
 };
 
-// Singleton class
+// Global instance (process-wide stats such as buffer allocations),
+// and per-instance scopes (e.g., stats of a Raft server).
 class stat_mgr {
 public:
+    using labels = std::map<std::string, std::string>;
+
     static stat_mgr* get_instance();
 
+    /**
+     * Create a new scope of stats, which is visible through
+     * `for_each_scope` until it is destroyed.
+     *
+     * @param scope_labels Labels identifying the scope,
+     *                     e.g., {"server_id": "1"}.
+     * @return Scope.
+     */
+    static ptr<stat_mgr> create_scope(const labels& scope_labels);
+
+    /**
+     * Call the given function for the global instance first,
+     * and then for each live scope.
+     */
+    static void for_each_scope(const std::function<void(stat_mgr&)>& func);
+
+    ~stat_mgr();
+
+    const labels& get_labels() const { return labels_; }
+
     stat_elem* get_stat(const std::string& stat_name);
 
     stat_elem* create_stat(stat_elem::Type type, const std::string& stat_name);
@@ -176,11 +270,18 @@ public:
     void reset_all_stats();
 
 private:
-    stat_mgr();
-    ~stat_mgr();
+    stat_mgr(const labels& scope_labels, bool is_scope);
+
+    labels labels_;
+
+    bool is_scope_;
 
     std::mutex stat_map_lock_;
     std::map<std::string, stat_elem*> stat_map_;
+
+    // Live scopes, used by the global instance only.
+    std::mutex scopes_lock_;
+    std::set<stat_mgr*> scopes_;
 };
 
 } // namespace nuraft
@@ -0,0 +1,156 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "stream_window.hxx"
+
+#include <algorithm>
+
+namespace nuraft {
+
+const int64_t stream_window::INIT_LOG_WINDOW;
+const int64_t stream_window::MIN_LOG_WINDOW;
+const int64_t stream_window::MAX_LOG_WINDOW;
+const int64_t stream_window::INIT_BYTE_WINDOW;
+const int64_t stream_window::MIN_BYTE_WINDOW;
+const int64_t stream_window::MAX_BYTE_WINDOW;
+
+// Minimum RTT older than this is replaced by the next sample.
+static const uint64_t MIN_RTT_EXPIRY_US = 10 * 1000 * 1000;
+
+// Minimum length of a delivery rate sample.
+static const uint64_t MIN_SAMPLE_US = 1000;
+
+// Smoothed RTT beyond this multiple of the minimum means queueing.
+static const uint64_t CONGESTION_RTT_FACTOR = 2;
+
+// Decay of the maximum delivery rate, per sample.
+static const double RATE_DECAY = 0.875;
+
+stream_window::stream_window()
+    : min_rtt_us_(0)
+    , min_rtt_stamp_us_(0)
+    , srtt_us_(0)
+    , sample_start_us_(0)
+    , sample_logs_(0)
+    , sample_bytes_(0)
+    , sample_window_full_(false)
+    , max_log_rate_(0)
+    , max_byte_rate_(0)
+    , log_window_(INIT_LOG_WINDOW)
+    , byte_window_(INIT_BYTE_WINDOW)
+    {}
+
+void stream_window::on_ack(size_t num_logs,
+                           size_t num_bytes,
+                           uint64_t rtt_us,
+                           uint64_t now_us)
+{
+    std::lock_guard<std::mutex> l(lock_);
+    rtt_us = std::max(rtt_us, (uint64_t)1);
+    if ( !min_rtt_us_ ||
+         rtt_us <= min_rtt_us_ ||
+         now_us > min_rtt_stamp_us_ + MIN_RTT_EXPIRY_US ) {
+        min_rtt_us_ = rtt_us;
+        min_rtt_stamp_us_ = now_us;
+    }
+    srtt_us_ = srtt_us_ ? (srtt_us_ * 7 + rtt_us) / 8 : rtt_us;
+
+    if (!sample_start_us_) {
+        // The first ack starts the sample, its logs are not counted
+        // as they were sent before the sample started.
+        sample_start_us_ = now_us;
+        return;
+    }
+    sample_logs_ += num_logs;
+    sample_bytes_ += num_bytes;
+    if (now_us >= sample_start_us_ + std::max(srtt_us_, MIN_SAMPLE_US)) {
+        close_sample(now_us);
+    }
+}
+
+void stream_window::close_sample(uint64_t now_us) {
+    double elapsed_sec = (now_us - sample_start_us_) / 1000000.0;
+    double log_rate = sample_logs_ / elapsed_sec;
+    double byte_rate = sample_bytes_ / elapsed_sec;
+    bool window_full = sample_window_full_;
+    sample_start_us_ = now_us;
+    sample_logs_ = sample_bytes_ = 0;
+    sample_window_full_ = false;
+    if (!window_full) {
+        // The application did not send enough to fill the window,
+        // this sample does not tell how much the peer can take.
+        return;
+    }
+
+    max_log_rate_ = std::max(log_rate, max_log_rate_ * RATE_DECAY);
+    max_byte_rate_ = std::max(byte_rate, max_byte_rate_ * RATE_DECAY);
+
+    double gain = (srtt_us_ > min_rtt_us_ * CONGESTION_RTT_FACTOR) ? 1.0 : 2.0;
+    double min_rtt_sec = min_rtt_us_ / 1000000.0;
+    int64_t log_target = (int64_t)(gain * max_log_rate_ * min_rtt_sec);
+    int64_t byte_target = (int64_t)(gain * max_byte_rate_ * min_rtt_sec);
+
+    // Shrink right away, but grow at most twice per sample.
+    log_window_ = std::min(log_target, log_window_ * 2);
+    log_window_ = std::min( std::max(log_window_, MIN_LOG_WINDOW),
+                            MAX_LOG_WINDOW );
+    byte_window_ = std::min(byte_target, byte_window_ * 2);
+    byte_window_ = std::min( std::max(byte_window_, MIN_BYTE_WINDOW),
+                             MAX_BYTE_WINDOW );
+}
+
+void stream_window::on_window_full() {
+    std::lock_guard<std::mutex> l(lock_);
+    sample_window_full_ = true;
+}
+
+void stream_window::on_failure() {
+    std::lock_guard<std::mutex> l(lock_);
+    sample_start_us_ = 0;
+    sample_logs_ = sample_bytes_ = 0;
+    sample_window_full_ = false;
+    max_log_rate_ = max_byte_rate_ = 0;
+    log_window_ = std::min(log_window_, INIT_LOG_WINDOW);
+    byte_window_ = std::min(byte_window_, INIT_BYTE_WINDOW);
+}
+
+int64_t stream_window::get_log_window(int64_t cap) const {
+    std::lock_guard<std::mutex> l(lock_);
+    return cap > 0 ? std::min(log_window_, cap) : log_window_;
+}
+
+int64_t stream_window::get_byte_window(int64_t cap) const {
+    std::lock_guard<std::mutex> l(lock_);
+    return cap > 0 ? std::min(byte_window_, cap) : byte_window_;
+}
+
+uint64_t stream_window::get_min_rtt_us() const {
+    std::lock_guard<std::mutex> l(lock_);
+    return min_rtt_us_;
+}
+
+uint64_t stream_window::get_smoothed_rtt_us() const {
+    std::lock_guard<std::mutex> l(lock_);
+    return srtt_us_;
+}
+
+uint64_t stream_window::get_byte_rate() const {
+    std::lock_guard<std::mutex> l(lock_);
+    return (uint64_t)max_byte_rate_;
+}
+
+}
+
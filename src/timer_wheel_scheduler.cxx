@@ -0,0 +1,273 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "timer_wheel_scheduler.hxx"
+
+#include <string>
+#include <vector>
+
+namespace nuraft {
+
+// Intrusive list node, attached to each task as its impl context.
+// A slot's sentinel is also a `node`, whose list is empty if it points
+// to itself.
+struct timer_wheel_scheduler::node {
+    node()
+        : prev_(this)
+        , next_(this)
+        , expire_tick_(0)
+        {}
+
+    bool linked() const { return next_ != this; }
+
+    node* prev_;
+    node* next_;
+    uint64_t expire_tick_;
+
+    // Holds the task while it is linked in the wheel,
+    // the same as a pending `async_wait` handler does.
+    ptr<delayed_task> task_;
+};
+
+timer_wheel_scheduler::timer_wheel_scheduler(const options& opt)
+    : opt_(opt)
+    , start_(std::chrono::steady_clock::now())
+    , cur_tick_(0)
+    , overflow_(new node())
+    , num_active_(0)
+    , stopping_(false)
+{
+    if (!opt_.tick_ms_) opt_.tick_ms_ = 1;
+
+    for (size_t ll = 0; ll < NUM_LEVELS; ++ll) {
+        for (size_t ss = 0; ss < NUM_SLOTS; ++ss) {
+            slots_[ll][ss] = new node();
+        }
+    }
+
+    if (opt_.use_internal_thread_) {
+        tick_thread_ = std::thread(&timer_wheel_scheduler::tick_thread_loop, this);
+    }
+}
+
+timer_wheel_scheduler::~timer_wheel_scheduler() {
+    stop();
+
+    // Release all pending tasks outside the lock, as it may destroy them
+    // (and their nodes).
+    std::vector< ptr<delayed_task> > pending;
+    {   std::lock_guard<std::mutex> l(lock_);
+        for (size_t ll = 0; ll < NUM_LEVELS; ++ll) {
+            for (size_t ss = 0; ss < NUM_SLOTS; ++ss) {
+                node* head = slots_[ll][ss];
+                while (head->linked()) {
+                    node* nn = head->next_;
+                    unlink(nn);
+                    pending.push_back( std::move(nn->task_) );
+                }
+                delete head;
+                slots_[ll][ss] = nullptr;
+            }
+        }
+        while (overflow_->linked()) {
+            node* nn = overflow_->next_;
+            unlink(nn);
+            pending.push_back( std::move(nn->task_) );
+        }
+        delete overflow_;
+        overflow_ = nullptr;
+        num_active_ = 0;
+    }
+    pending.clear();
+}
+
+void timer_wheel_scheduler::schedule(ptr<delayed_task>& task, int32 milliseconds) {
+    if (task->get_impl_context() == nilptr) {
+        task->set_impl_context( new node(),
+                                [](void* ptr) {
+                                    delete static_cast<node*>(ptr);
+                                } );
+    }
+    // ensure it's not in cancelled state
+    task->reset();
+
+    uint64_t ticks = (milliseconds > 0)
+                     ? ((uint64_t)milliseconds + opt_.tick_ms_ - 1) / opt_.tick_ms_
+                     : 0;
+    node* nn = static_cast<node*>( task->get_impl_context() );
+
+    std::lock_guard<std::mutex> l(lock_);
+    if (nn->linked()) {
+        // Re-scheduling the pending task, same as `expires_after`.
+        unlink(nn);
+    } else {
+        nn->task_ = task;
+        num_active_++;
+    }
+    // The current tick is partially elapsed, hence `+ 1` so as not to
+    // fire the task earlier than the given time.
+    nn->expire_tick_ = now_tick() + 1 + ticks;
+    link(nn);
+}
+
+void timer_wheel_scheduler::cancel_impl(ptr<delayed_task>& task) {
+    node* nn = static_cast<node*>( task->get_impl_context() );
+    if (!nn) return;
+
+    std::lock_guard<std::mutex> l(lock_);
+    if (!nn->linked()) return;
+    unlink(nn);
+    // Caller still holds `task`, it will not be destroyed here.
+    nn->task_.reset();
+    num_active_--;
+}
+
+size_t timer_wheel_scheduler::advance() {
+    std::vector< ptr<delayed_task> > expired;
+    {   std::lock_guard<std::mutex> l(lock_);
+        uint64_t target_tick = now_tick();
+        while (cur_tick_ <= target_tick) {
+            size_t slot_idx = cur_tick_ & SLOT_MASK;
+            if (!slot_idx) {
+                // Level 0 wrapped around, pull down the tasks
+                // of the next period from upper levels.
+                size_t ll = 1;
+                for (; ll < NUM_LEVELS; ++ll) {
+                    size_t upper_idx = (cur_tick_ >> (SLOT_BITS * ll)) & SLOT_MASK;
+                    cascade(slots_[ll][upper_idx]);
+                    if (upper_idx) break;
+                }
+                if (ll == NUM_LEVELS) {
+                    // The entire wheel wrapped around, tasks beyond
+                    // its range may be within the range now.
+                    cascade_overflow();
+                }
+            }
+            cur_tick_++;
+
+            node* head = slots_[0][slot_idx];
+            while (head->linked()) {
+                node* nn = head->next_;
+                unlink(nn);
+                expired.push_back( std::move(nn->task_) );
+            }
+        }
+        num_active_ -= expired.size();
+    }
+
+    // Execute tasks without holding the lock, as they may re-schedule
+    // themselves.
+    for (ptr<delayed_task>& task: expired) {
+        if (opt_.dispatcher_) {
+            opt_.dispatcher_(task);
+        } else {
+            task->execute();
+        }
+    }
+    return expired.size();
+}
+
+void timer_wheel_scheduler::stop() {
+    stopping_ = true;
+    if (tick_thread_.joinable()) {
+        tick_ea_.invoke();
+        tick_thread_.join();
+    }
+}
+
+uint64_t timer_wheel_scheduler::now_tick() const {
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    uint64_t elapsed_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+    return elapsed_ms / opt_.tick_ms_;
+}
+
+void timer_wheel_scheduler::link(node* nn) {
+    const uint64_t MAX_TICKS = (uint64_t)1 << (SLOT_BITS * NUM_LEVELS);
+
+    if (nn->expire_tick_ < cur_tick_) {
+        // Already expired, will fire at the next tick.
+        nn->expire_tick_ = cur_tick_;
+    }
+
+    node* head = nullptr;
+    uint64_t delta = nn->expire_tick_ - cur_tick_;
+    if (delta >= MAX_TICKS) {
+        // Beyond the range of the wheel, keep it aside
+        // until the wheel wraps around.
+        head = overflow_;
+    } else {
+        size_t level = 0;
+        while ( level < NUM_LEVELS - 1 &&
+                delta >= ((uint64_t)1 << (SLOT_BITS * (level + 1))) ) {
+            level++;
+        }
+        size_t slot_idx = (nn->expire_tick_ >> (SLOT_BITS * level)) & SLOT_MASK;
+        head = slots_[level][slot_idx];
+    }
+
+    nn->prev_ = head->prev_;
+    nn->next_ = head;
+    head->prev_->next_ = nn;
+    head->prev_ = nn;
+}
+
+void timer_wheel_scheduler::unlink(node* nn) {
+    nn->prev_->next_ = nn->next_;
+    nn->next_->prev_ = nn->prev_;
+    nn->prev_ = nn->next_ = nn;
+}
+
+void timer_wheel_scheduler::cascade(node* head) {
+    while (head->linked()) {
+        node* nn = head->next_;
+        unlink(nn);
+        link(nn);
+    }
+}
+
+void timer_wheel_scheduler::cascade_overflow() {
+    if (!overflow_->linked()) return;
+
+    // Move them to a temporary list first, as tasks still beyond
+    // the range will be linked to `overflow_` again.
+    node pending;
+    pending.next_ = overflow_->next_;
+    pending.prev_ = overflow_->prev_;
+    pending.next_->prev_ = &pending;
+    pending.prev_->next_ = &pending;
+    overflow_->prev_ = overflow_->next_ = overflow_;
+    cascade(&pending);
+}
+
+void timer_wheel_scheduler::tick_thread_loop() {
+    std::string thread_name = "nuraft_tw";
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), thread_name.c_str());
+#elif __APPLE__
+    pthread_setname_np(thread_name.c_str());
+#endif
+
+    while (!stopping_) {
+        tick_ea_.wait_ms(opt_.tick_ms_);
+        tick_ea_.reset();
+        if (stopping_) break;
+        advance();
+    }
+}
+
+}
+
@@ -17,7 +17,10 @@ limitations under the License.
 
 #pragma once
 
+#include "binary_log.hxx"
+#include "binary_logger.hxx"
 #include "fix_format.hxx"
+#include "internal_timer.hxx"
 #include "logger.hxx"
 
 #include <string>
@@ -66,42 +69,88 @@ static inline std::string msg_if_given(const char* format, ...) {
 #define L_ERROR (2)
 #define L_FATAL (1)
 
+// Level of the given logger, without another virtual call
+// in binary log mode.
+static inline int _log_level(nuraft::logger& l, nuraft::binary_logger* bl) {
+    return bl ? bl->binary_logger::get_level() : l.get_level();
+}
+
+// Record a log into the ring of this thread, see `binary_logger`.
+template<typename... Args>
+static inline void _put_binary_log(nuraft::binary_logger& bl,
+                                   int level,
+                                   const nuraft::binary_log_site& site,
+                                   const char* /* format */,
+                                   const Args&... args)
+{
+    nuraft::binary_log_ring* ring = nuraft::get_thread_binary_log_ring();
+    nuraft::binary_log_record* rec = ring->claim();
+    if (!rec) {
+        bl.on_ring_full();
+        return;
+    }
+    rec->site_ = &site;
+    rec->dst_ = &bl;
+    rec->level_ = static_cast<uint8_t>(level);
+    rec->timestamp_us_ = nuraft::timer_helper::get_timeofday_us();
+
+    nuraft::binary_log_encoder enc(rec->args_, sizeof(rec->args_));
+    enc.put(args...);
+    if (!enc.is_overflow()) {
+        rec->args_len_ = static_cast<uint16_t>(enc.get_size());
+        rec->spilled_ = nullptr;
+    } else {
+        // Too long (mostly strings), allocate a buffer for it.
+        nuraft::binary_log_encoder counter(nullptr, 0);
+        counter.put(args...);
+        rec->args_len_ = 0;
+        rec->spilled_ = new std::string(counter.get_size(), '\0');
+        nuraft::binary_log_encoder spill_enc(&(*rec->spilled_)[0],
+                                             rec->spilled_->size());
+        spill_enc.put(args...);
+    }
+    if (ring->publish()) bl.request_flush();
+}
+
+#define _LOG_EXPAND_(x) x
+#define _LOG_FORMAT_(format, ...) format
+
+// If `l_` is a `binary_logger` and the level is deferred, only the
+// address of the static site and the arguments are recorded.
 #define p_lv(lv, ...) \
-    if (l_ && l_->get_level() >= (lv)) \
-        l_->put_details((lv), __FILE__, __func__, __LINE__, msg_if_given(__VA_ARGS__))
+    do { \
+        int _lv_ = (lv); \
+        if (!l_) break; \
+        nuraft::binary_logger* _bl_ = l_->get_binary_logger(); \
+        if (_log_level(*l_, _bl_) < _lv_) break; \
+        if (_bl_ && _lv_ >= _bl_->get_deferred_level()) { \
+            static const nuraft::binary_log_site _site_ = \
+                { __FILE__, __func__, __LINE__, \
+                  _LOG_EXPAND_(_LOG_FORMAT_(__VA_ARGS__, 0)) }; \
+            _put_binary_log(*_bl_, _lv_, _site_, __VA_ARGS__); \
+        } else { \
+            l_->put_details(_lv_, __FILE__, __func__, __LINE__, \
+                            msg_if_given(__VA_ARGS__)); \
+        } \
+    } while (0)
 
 // trace.
-#define p_tr(...) \
-    if (l_ && l_->get_level() >= 6) \
-        l_->put_details(6, __FILE__, __func__, __LINE__, msg_if_given(__VA_ARGS__))
+#define p_tr(...)   p_lv(6, __VA_ARGS__)
 
 // debug verbose.
-#define p_dv(...) \
-    if (l_ && l_->get_level() >= 5) \
-        l_->put_details(5, __FILE__, __func__, __LINE__, msg_if_given(__VA_ARGS__))
+#define p_dv(...)   p_lv(5, __VA_ARGS__)
 
 // debug.
-#define p_db(...) \
-    if (l_ && l_->get_level() >= 5) \
-        l_->put_details(5, __FILE__, __func__, __LINE__, msg_if_given(__VA_ARGS__))
+#define p_db(...)   p_lv(5, __VA_ARGS__)
 
 // info.
-#define p_in(...) \
-    if (l_ && l_->get_level() >= 4) \
-        l_->put_details(4, __FILE__, __func__, __LINE__, msg_if_given(__VA_ARGS__))
+#define p_in(...)   p_lv(4, __VA_ARGS__)
 
 // warning.
-#define p_wn(...) \
-    if (l_ && l_->get_level() >= 3) \
-        l_->put_details(3, __FILE__, __func__, __LINE__, msg_if_given(__VA_ARGS__))
+#define p_wn(...)   p_lv(3, __VA_ARGS__)
 
 // error.
-#define p_er(...) \
-    if (l_ && l_->get_level() >= 2) \
-        l_->put_details(2, __FILE__, __func__, __LINE__, msg_if_given(__VA_ARGS__))
+#define p_er(...)   p_lv(2, __VA_ARGS__)
 
 // fatal.
-#define p_ft(...) \
-    if (l_ && l_->get_level() >= 1) \
-        l_->put_details(1, __FILE__, __func__, __LINE__, msg_if_given(__VA_ARGS__))
-
+#define p_ft(...)   p_lv(1, __VA_ARGS__)
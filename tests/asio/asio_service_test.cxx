@@ -20,6 +20,7 @@ limitations under the License.
 #include "in_memory_log_store.hxx"
 #include "raft_package_asio.hxx"
 #include "asio_test_common.hxx"
+#include "stat_exporter.hxx"
 
 #include "event_awaiter.hxx"
 #include "test_common.h"
@@ -33,6 +34,7 @@ limitations under the License.
     using asio_error_code = asio::error_code;
 #endif
 
+#include <thread>
 #include <unordered_map>
 
 #include <stdio.h>
@@ -532,6 +534,14 @@ int global_mgr_heavy_test() {
     }
     TestSuite::sleep_sec(1, "wait for replication");
 
+    // Requests are spread over per-worker queues, and idle workers
+    // steal from busy ones. All of them should be executed.
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pkg = entry;
+        CHK_EQ( pkg->raftServer->get_last_log_idx(),
+                pkg->raftServer->get_committed_log_idx() );
+    }
+
     for (auto& entry: pkgs) {
         RaftAsioPkg* pkg = entry;
         pkg->raftServer->shutdown();
@@ -1704,6 +1714,112 @@ int parallel_log_append_test() {
     return 0;
 }
 
+int peer_replicator_test() {
+    reset_log_files();
+
+    const size_t NUM_SERVERS = 5;
+    std::vector<RaftAsioPkg*> pkgs;
+    for (size_t ii = 0; ii < NUM_SERVERS; ++ii) {
+        std::string addr = "tcp://127.0.0.1:" + std::to_string(20000 + (ii+1) * 10);
+        pkgs.push_back( new RaftAsioPkg(ii+1, addr) );
+    }
+    RaftAsioPkg& s1 = *pkgs[0];
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.num_replicator_threads_ = 2;
+        // Keep logs, so that lagging followers catch up by replication.
+        param.reserved_log_items_ = 10000;
+        pp->raftServer->update_params(param);
+    }
+
+    // Append messages from multiple threads.
+    const size_t NUM_THREADS = 4;
+    const size_t NUM = 200;
+    auto do_append = [&](size_t thread_idx) {
+        for (size_t ii = 0; ii < NUM; ++ii) {
+            std::string test_msg = "test" + std::to_string(thread_idx) +
+                                   "_" + std::to_string(ii);
+            ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+            msg->put(test_msg);
+            s1.raftServer->append_entries( {msg} );
+        }
+    };
+    auto check_all = [&]() -> int {
+        // Followers may lag behind, give them enough time.
+        for (size_t ii = 0; ii < 100; ++ii) {
+            bool done = true;
+            for (auto& entry: pkgs) {
+                RaftAsioPkg* pp = entry;
+                if ( pp->raftServer->get_committed_log_idx() !=
+                         s1.raftServer->get_last_log_idx() ) {
+                    done = false;
+                    break;
+                }
+            }
+            if (done) break;
+            TestSuite::sleep_ms(100);
+        }
+
+        uint64_t last_idx = s1.raftServer->get_last_log_idx();
+        CHK_EQ( last_idx, s1.raftServer->get_committed_log_idx() );
+        for (auto& entry: pkgs) {
+            RaftAsioPkg* pp = entry;
+            CHK_EQ( last_idx, pp->raftServer->get_last_log_idx() );
+            CHK_EQ( last_idx, pp->raftServer->get_committed_log_idx() );
+            if (pp == &s1) continue;
+            CHK_OK( pp->getTestSm()->isSame( *s1.getTestSm() ) );
+        }
+        return 0;
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < NUM_THREADS; ++ii) {
+        threads.push_back( std::thread(do_append, ii) );
+    }
+    for (std::thread& tt: threads) tt.join();
+    TestSuite::sleep_sec(1, "wait for replication");
+    CHK_Z( check_all() );
+
+    // Disable replicators at runtime, the original path should work.
+    {   raft_params param = s1.raftServer->get_current_params();
+        param.num_replicator_threads_ = 0;
+        s1.raftServer->update_params(param);
+    }
+    do_append(NUM_THREADS);
+    TestSuite::sleep_sec(1, "wait for replication");
+    CHK_Z( check_all() );
+
+    // And enable them again.
+    {   raft_params param = s1.raftServer->get_current_params();
+        param.num_replicator_threads_ = 1;
+        s1.raftServer->update_params(param);
+    }
+    do_append(NUM_THREADS + 1);
+    TestSuite::sleep_sec(1, "wait for replication");
+    CHK_Z( check_all() );
+
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pp = entry;
+        pp->raftServer->shutdown();
+    }
+    TestSuite::sleep_sec(1, "shutting down");
+    for (auto& entry: pkgs) {
+        delete entry;
+    }
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
 int custom_resolver_test() {
     reset_log_files();
 
@@ -2032,6 +2148,360 @@ int custom_io_context_test() {
     return 0;
 }
 
+int multiplexed_connection_test() {
+    reset_log_files();
+
+    const size_t NUM_NODES = 3;
+    const size_t NUM_GROUPS = 2;
+
+    // One asio service and listener per node, shared by all groups.
+    std::vector< ptr<asio_service> > svcs;
+    std::vector< ptr<rpc_listener> > listeners;
+    ptr<logger> no_log;
+    for (size_t ii = 1; ii <= NUM_NODES; ++ii) {
+        asio_service::options asio_opt;
+        asio_opt.thread_pool_size_ = 4;
+        ptr<asio_service> svc = cs_new<asio_service>(asio_opt);
+        ptr<rpc_listener> listener =
+            svc->create_rpc_listener(20000 + ii * 10, no_log);
+        CHK_NONNULL(listener);
+        ptr<msg_handler> no_handler;
+        listener->listen(no_handler);
+        svcs.push_back(svc);
+        listeners.push_back(listener);
+    }
+
+    // Members of all groups on the same node use the same endpoint.
+    std::vector< std::vector< ptr<RaftAsioPkg> > > groups(NUM_GROUPS);
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        for (size_t ii = 1; ii <= NUM_NODES; ++ii) {
+            std::string endpoint = "localhost:" + std::to_string(20000 + ii * 10);
+            ptr<RaftAsioPkg> pkg = cs_new<RaftAsioPkg>(ii, endpoint);
+            pkg->initMuxServer(svcs[ii - 1], listeners[ii - 1], gg + 1);
+            groups[gg].push_back(pkg);
+        }
+    }
+    TestSuite::sleep_sec(1, "launching servers");
+
+    _msg("organizing raft groups\n");
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        std::vector<RaftAsioPkg*> pkgs;
+        for (auto& entry: groups[gg]) pkgs.push_back(entry.get());
+        CHK_Z( make_group(pkgs) );
+        CHK_TRUE( pkgs[0]->raftServer->is_leader() );
+    }
+
+    // Append different messages to each group.
+    const size_t NUM = 10;
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        for (size_t ii = 0; ii < NUM; ++ii) {
+            std::string test_msg = "g" + std::to_string(gg + 1) +
+                                   "_test" + std::to_string(ii);
+            ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+            msg->put(test_msg);
+            groups[gg][0]->raftServer->append_entries( {msg} );
+        }
+    }
+    TestSuite::sleep_sec(1, "replication");
+
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        RaftAsioPkg* leader = groups[gg][0].get();
+        for (size_t ii = 1; ii < NUM_NODES; ++ii) {
+            CHK_OK( groups[gg][ii]->getTestSm()->isSame( *leader->getTestSm() ) );
+        }
+    }
+    // Each group has its own data.
+    CHK_FALSE( groups[1][0]->getTestSm()->isSame( *groups[0][0]->getTestSm() ) );
+
+    // Request to unknown group should fail, without affecting others.
+    {
+        ptr<rpc_client_factory> factory = svcs[0]->create_mux_client_factory(99);
+        ptr<rpc_client> client = factory->create_client("localhost:20020");
+        CHK_NONNULL(client);
+
+        EventAwaiter ea;
+        ptr<rpc_exception> got_err;
+        ptr<req_msg> req = cs_new<req_msg>
+                           ( 1, msg_type::append_entries_request, 1, 2, 0, 0, 0 );
+        rpc_handler handler = [&](ptr<resp_msg>& resp, ptr<rpc_exception>& err) {
+            got_err = err;
+            ea.invoke();
+        };
+        client->send(req, handler);
+        ea.wait_ms(1000);
+        CHK_NONNULL(got_err);
+        CHK_FALSE( client->is_abandoned() );
+    }
+
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        std::string test_msg = "after";
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        groups[gg][0]->raftServer->append_entries( {msg} );
+    }
+    TestSuite::sleep_sec(1, "replication");
+
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        RaftAsioPkg* leader = groups[gg][0].get();
+        for (size_t ii = 1; ii < NUM_NODES; ++ii) {
+            CHK_OK( groups[gg][ii]->getTestSm()->isSame( *leader->getTestSm() ) );
+        }
+    }
+
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        for (size_t ii = 0; ii < NUM_NODES; ++ii) {
+            groups[gg][ii]->raftServer->shutdown();
+            svcs[ii]->deregister_mux_group(gg + 1);
+        }
+    }
+    for (size_t ii = 0; ii < NUM_NODES; ++ii) {
+        listeners[ii]->stop();
+        listeners[ii]->shutdown();
+        svcs[ii]->stop();
+    }
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int multiplexed_slow_stream_test() {
+    reset_log_files();
+
+    const size_t NUM_NODES = 3;
+    const size_t NUM_GROUPS = 2;
+
+    std::vector< ptr<asio_service> > svcs;
+    std::vector< ptr<rpc_listener> > listeners;
+    ptr<logger> no_log;
+    for (size_t ii = 1; ii <= NUM_NODES; ++ii) {
+        asio_service::options asio_opt;
+        asio_opt.thread_pool_size_ = 4;
+        ptr<asio_service> svc = cs_new<asio_service>(asio_opt);
+        ptr<rpc_listener> listener =
+            svc->create_rpc_listener(20000 + ii * 10, no_log);
+        CHK_NONNULL(listener);
+        ptr<msg_handler> no_handler;
+        listener->listen(no_handler);
+        svcs.push_back(svc);
+        listeners.push_back(listener);
+    }
+
+    std::vector< std::vector< ptr<RaftAsioPkg> > > groups(NUM_GROUPS);
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        for (size_t ii = 1; ii <= NUM_NODES; ++ii) {
+            std::string endpoint = "localhost:" + std::to_string(20000 + ii * 10);
+            ptr<RaftAsioPkg> pkg = cs_new<RaftAsioPkg>(ii, endpoint);
+            pkg->initMuxServer(svcs[ii - 1], listeners[ii - 1], gg + 1);
+            groups[gg].push_back(pkg);
+        }
+    }
+    TestSuite::sleep_sec(1, "launching servers");
+
+    _msg("organizing raft groups\n");
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        std::vector<RaftAsioPkg*> pkgs;
+        for (auto& entry: groups[gg]) pkgs.push_back(entry.get());
+        CHK_Z( make_group(pkgs) );
+        CHK_TRUE( pkgs[0]->raftServer->is_leader() );
+    }
+
+    // Followers of group 1 get stuck while processing new logs,
+    // which share the connections with group 2. Group 1 should neither
+    // start an election nor lose its leadership meanwhile, while group 2
+    // keeps the default timeouts so that missing heartbeats are detected.
+    const size_t SLOW_MS = 3000;
+    for (size_t ii = 0; ii < NUM_NODES; ++ii) {
+        raft_server* raft = groups[0][ii]->raftServer.get();
+        raft_params params = raft->get_current_params();
+        params.with_election_timeout_lower(SLOW_MS * 3);
+        params.with_election_timeout_upper(SLOW_MS * 4);
+        params.with_leadership_expiry(-1);
+        raft->update_params(params);
+        if (ii) groups[0][ii]->getTestSm()->setPreCommitDelay(SLOW_MS);
+    }
+    // Appending in blocking mode waits for the commit,
+    // so group 1's append is done by another thread.
+    auto append_msg = [&](size_t gg) -> ptr< cmd_result< ptr<buffer> > > {
+        std::string test_msg = "g" + std::to_string(gg + 1) + "_test";
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        return groups[gg][0]->raftServer->append_entries( {msg} );
+    };
+    ptr< cmd_result< ptr<buffer> > > slow_ret;
+    std::thread slow_appender([&]() { slow_ret = append_msg(0); });
+    TestSuite::sleep_ms(100, "group 1 gets stuck");
+
+    // Group 2 should not wait for group 1: its leader can commit only
+    // after a follower responds over the shared connection.
+    // The state machine commit index is advanced after the append
+    // returns, so poll it.
+    raft_server* g2_leader = groups[1][0]->raftServer.get();
+    TestSuite::Timer timer;
+    ptr< cmd_result< ptr<buffer> > > ret = append_msg(1);
+    uint64_t last_idx = g2_leader->get_last_log_idx();
+    while ( g2_leader->get_committed_log_idx() < last_idx &&
+            timer.getTimeMs() < SLOW_MS / 2 ) {
+        TestSuite::sleep_ms(1);
+    }
+    uint64_t elapsed_ms = timer.getTimeMs();
+    uint64_t committed_idx = g2_leader->get_committed_log_idx();
+
+    for (size_t ii = 1; ii < NUM_NODES; ++ii) {
+        groups[0][ii]->getTestSm()->setPreCommitDelay(0);
+    }
+    slow_appender.join();
+
+    CHK_TRUE( ret->get_accepted() );
+    CHK_EQ( cmd_result_code::OK, ret->get_result_code() );
+    CHK_EQ( last_idx, committed_idx );
+    CHK_GT( SLOW_MS / 2, elapsed_ms );
+    CHK_TRUE( slow_ret->get_accepted() );
+    CHK_EQ( cmd_result_code::OK, slow_ret->get_result_code() );
+    TestSuite::sleep_ms(500, "replication");
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        RaftAsioPkg* leader = groups[gg][0].get();
+        for (size_t ii = 1; ii < NUM_NODES; ++ii) {
+            CHK_OK( groups[gg][ii]->getTestSm()->isSame( *leader->getTestSm() ) );
+        }
+    }
+
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        for (size_t ii = 0; ii < NUM_NODES; ++ii) {
+            groups[gg][ii]->raftServer->shutdown();
+            svcs[ii]->deregister_mux_group(gg + 1);
+        }
+    }
+    for (size_t ii = 0; ii < NUM_NODES; ++ii) {
+        listeners[ii]->stop();
+        listeners[ii]->shutdown();
+        svcs[ii]->stop();
+    }
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int metrics_endpoint_test() {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    for (size_t ii = 0; ii < 10; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s1.raftServer->append_entries( {msg} );
+    }
+    TestSuite::sleep_sec(1, "replication");
+
+    ptr<stat_exporter> exporter = cs_new<stat_exporter>();
+    for (RaftAsioPkg* pp: pkgs) exporter->add_server(pp->raftServer);
+
+    const ushort PORT = 20100;
+    CHK_TRUE( s1.asioSvc->start_metrics_endpoint
+                  ( PORT, [exporter]() { return exporter->render(); } ) );
+    // Only one endpoint.
+    CHK_FALSE( s1.asioSvc->start_metrics_endpoint
+                   ( PORT + 1, [exporter]() { return exporter->render(); } ) );
+
+    // Send a request and read the response until the server closes it.
+    auto http_get = [&](const std::string& target, std::string& resp_out) -> bool {
+        asio::io_context io;
+        asio::ip::tcp::socket sock(io);
+        asio_error_code ec;
+        sock.connect( asio::ip::tcp::endpoint
+                          ( asio::ip::make_address("127.0.0.1"), PORT ),
+                      ec );
+        if (ec) return false;
+
+        std::string req = "GET " + target + " HTTP/1.1\r\n"
+                          "Host: localhost\r\n\r\n";
+        asio::write(sock, asio::buffer(req), ec);
+        if (ec) return false;
+
+        resp_out.clear();
+        char buf[4096];
+        while (true) {
+            size_t len = sock.read_some(asio::buffer(buf), ec);
+            resp_out.append(buf, len);
+            if (ec) break;
+        }
+        return true;
+    };
+
+    std::string resp;
+    CHK_TRUE( http_get("/metrics", resp) );
+    TestSuite::_msg("%s", resp.c_str());
+    auto contains = [&](const std::string& str) {
+        return resp.find(str) != std::string::npos;
+    };
+    CHK_TRUE( contains("HTTP/1.1 200 OK\r\n") );
+    CHK_TRUE( contains(stat_exporter::CONTENT_TYPE) );
+    CHK_TRUE( contains("nuraft_leader{server_id=\"1\"} 1\n") );
+    CHK_TRUE( contains("nuraft_leader{server_id=\"2\"} 0\n") );
+    CHK_TRUE( contains("nuraft_leader_id{server_id=\"3\"} 1\n") );
+
+    // All logs are replicated, so no lag or bytes in flight.
+    std::string last_idx = std::to_string( s1.raftServer->get_last_log_idx() );
+    CHK_TRUE( contains( "nuraft_sm_commit_index{server_id=\"2\"} " +
+                        last_idx + "\n" ) );
+    CHK_TRUE( contains( "nuraft_peer_last_log_index"
+                        "{peer_id=\"3\",server_id=\"1\"} " + last_idx + "\n" ) );
+    CHK_TRUE( contains( "nuraft_peer_log_lag{peer_id=\"2\",server_id=\"1\"} 0\n" ) );
+    CHK_TRUE( contains( "nuraft_peer_bytes_in_flight"
+                        "{peer_id=\"2\",server_id=\"1\"} 0\n" ) );
+    CHK_TRUE( contains("# EOF\n") );
+
+    CHK_TRUE( http_get("/unknown", resp) );
+    CHK_TRUE( contains("HTTP/1.1 404 Not Found\r\n") );
+
+    // Idle connection should be closed by the endpoint.
+    {
+        asio::io_context io;
+        asio::ip::tcp::socket sock(io);
+        asio_error_code ec;
+        sock.connect( asio::ip::tcp::endpoint
+                          ( asio::ip::make_address("127.0.0.1"), PORT ),
+                      ec );
+        CHK_FALSE( ec );
+        asio::write(sock, asio::buffer(std::string("GET /metr")), ec);
+        CHK_FALSE( ec );
+        TestSuite::sleep_sec(6, "idle connection");
+
+        char buf[16];
+        sock.non_blocking(true);
+        sock.read_some(asio::buffer(buf), ec);
+        CHK_TRUE( ec == asio::error::eof );
+    }
+
+    // Stopped endpoint should not accept connections.
+    s1.asioSvc->stop_metrics_endpoint();
+    TestSuite::sleep_ms(100);
+    CHK_FALSE( http_get("/metrics", resp) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
 
 }  // namespace asio_service_test;
 using namespace asio_service_test;
@@ -2116,6 +2586,9 @@ int main(int argc, char** argv) {
     ts.doTest( "parallel log append test",
                parallel_log_append_test );
 
+    ts.doTest( "peer replicator test",
+               peer_replicator_test );
+
     ts.doTest( "custom resolver test",
                custom_resolver_test );
 
@@ -2125,6 +2598,15 @@ int main(int argc, char** argv) {
     ts.doTest( "custom io_context test",
                custom_io_context_test );
 
+    ts.doTest( "multiplexed connection test",
+               multiplexed_connection_test );
+
+    ts.doTest( "multiplexed slow stream test",
+               multiplexed_slow_stream_test );
+
+    ts.doTest( "metrics endpoint test",
+               metrics_endpoint_test );
+
 #ifdef ENABLE_RAFT_STATS
     _msg("raft stats: ENABLED\n");
 #else
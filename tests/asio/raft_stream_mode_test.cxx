@@ -184,7 +184,7 @@ void update_max_fly_bytes_params(const std::vector<RaftPkg*>& pkgs,
     }
 }
 
-int stream_basic_function_test() {
+int stream_basic_function_test(bool cumulative_ack) {
     reset_log_files();
 
     std::string s1_addr = "tcp://127.0.0.1:20010";
@@ -195,6 +195,9 @@ int stream_basic_function_test() {
     RaftAsioPkg s2(2, s2_addr);
     RaftAsioPkg s3(3, s3_addr);
     std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+    for (RaftAsioPkg* pp: pkgs) {
+        pp->useCumulativeAck = cumulative_ack;
+    }
 
     _msg("launching asio-raft servers\n");
     CHK_Z( launch_asio_servers(pkgs, false) );
@@ -253,6 +256,240 @@ int stream_basic_function_test() {
     return 0;
 }
 
+int stream_follower_pipeline_test() {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+    for (RaftAsioPkg* pp: pkgs) {
+        pp->useCumulativeAck = true;
+    }
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_asio_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_asio_group(pkgs) );
+
+    // Followers' log writes are slow, and their durability
+    // waits can be deferred across back-to-back requests.
+    s2.getTestMgr()->set_disk_delay(s2.raftServer.get(), 10);
+    s3.getTestMgr()->set_disk_delay(s3.raftServer.get(), 10);
+
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.parallel_log_appending_ = true;
+        pp->raftServer->update_params(param);
+    }
+
+    const size_t NUM = 100;
+    std::list< ptr< cmd_result< ptr<buffer> > > > handlers;
+    std::list<ulong> idx_list;
+    std::mutex idx_list_lock;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+
+        cmd_result< ptr<buffer> >::handler_type my_handler =
+            std::bind( async_handler,
+                       &idx_list,
+                       &idx_list_lock,
+                       std::placeholders::_1,
+                       std::placeholders::_2 );
+        ret->when_ready( my_handler );
+
+        handlers.push_back(ret);
+    }
+    TestSuite::sleep_sec(2, "replication");
+
+    {
+        std::lock_guard<std::mutex> l(idx_list_lock);
+        CHK_EQ(NUM, idx_list.size());
+    }
+
+    // Committed logs should have been durable on at least one follower,
+    // as acknowledgements are sent only after the deferred waits.
+    ulong committed_idx = s1.raftServer->get_committed_log_idx();
+    ulong max_durable_idx =
+        std::max( s2.getTestMgr()->load_log_store()->last_durable_index(),
+                  s3.getTestMgr()->load_log_store()->last_durable_index() );
+    CHK_GTEQ(max_durable_idx, committed_idx);
+
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int stream_window_autotune_test() {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_asio_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_asio_group(pkgs) );
+
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.stream_window_autotune_ = true;
+        pp->raftServer->update_params(param);
+    }
+
+    const size_t NUM = 100;
+    std::list<ulong> idx_list;
+    std::mutex idx_list_lock;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+
+        cmd_result< ptr<buffer> >::handler_type my_handler =
+            std::bind( async_handler,
+                       &idx_list,
+                       &idx_list_lock,
+                       std::placeholders::_1,
+                       std::placeholders::_2 );
+        ret->when_ready( my_handler );
+    }
+    TestSuite::sleep_sec(1, "replication");
+
+    {
+        std::lock_guard<std::mutex> l(idx_list_lock);
+        CHK_EQ(NUM, idx_list.size());
+    }
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    // Window and RTT of each peer should be exposed.
+    raft_params param = s1.raftServer->get_current_params();
+    std::vector<raft_server::peer_info> pi_all = s1.raftServer->get_peer_info_all();
+    CHK_EQ(2, pi_all.size());
+    for (raft_server::peer_info& pi: pi_all) {
+        CHK_GT(pi.min_rtt_us_, 0);
+        CHK_GTEQ(pi.smoothed_rtt_us_, pi.min_rtt_us_);
+        CHK_GT(pi.stream_log_window_, 0);
+        CHK_SMEQ(pi.stream_log_window_, param.max_log_gap_in_stream_);
+        CHK_GT(pi.stream_byte_window_, 0);
+    }
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int heartbeat_lane_test() {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_asio_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_asio_group(pkgs) );
+
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.parallel_log_appending_ = true;
+        param.use_heartbeat_lane_ = true;
+        pp->raftServer->update_params(param);
+    }
+
+    // Followers' log writes are slow, and logs keep coming, so that
+    // the main connections have requests in flight across heartbeats.
+    s2.getTestMgr()->set_disk_delay(s2.raftServer.get(), 20);
+    s3.getTestMgr()->set_disk_delay(s3.raftServer.get(), 20);
+
+    const size_t NUM = 100;
+    std::list<ulong> idx_list;
+    std::mutex idx_list_lock;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+
+        cmd_result< ptr<buffer> >::handler_type my_handler =
+            std::bind( async_handler,
+                       &idx_list,
+                       &idx_list_lock,
+                       std::placeholders::_1,
+                       std::placeholders::_2 );
+        ret->when_ready( my_handler );
+        TestSuite::sleep_ms(10);
+    }
+    TestSuite::sleep_sec(3, "replication");
+
+    {
+        std::lock_guard<std::mutex> l(idx_list_lock);
+        CHK_EQ(NUM, idx_list.size());
+    }
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    // Heartbeats should have been sent through the lane,
+    // and the leader should not have changed.
+    CHK_TRUE( s1.raftServer->is_leader() );
+    std::vector<raft_server::peer_info> pi_all = s1.raftServer->get_peer_info_all();
+    CHK_EQ(2, pi_all.size());
+    for (raft_server::peer_info& pi: pi_all) {
+        CHK_TRUE( pi.hb_lane_connected_ );
+    }
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
 int enable_and_disable_stream_mode_test() {
     reset_log_files();
     ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
@@ -614,8 +851,18 @@ int main(int argc, char** argv) {
     ts.options.printTestMessage = true;
     // with asio
     ts.doTest( "stream basic function test",
-               stream_basic_function_test );
-    
+               stream_basic_function_test,
+               TestRange<bool>( {false, true} ) );
+
+    ts.doTest( "stream follower pipeline test",
+               stream_follower_pipeline_test );
+
+    ts.doTest( "stream window autotune test",
+               stream_window_autotune_test );
+
+    ts.doTest( "heartbeat lane test",
+               heartbeat_lane_test );
+
     // with fake network
     // Enable and disable stream mode by runtime config
     ts.doTest( "enable and disable stream mode test",
@@ -0,0 +1,108 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "nuraft.hxx"
+
+#include <mutex>
+
+namespace raft_bench {
+
+using namespace nuraft;
+
+// State machine doing nothing on commit, to measure
+// the replication logic only.
+class dummy_sm : public state_machine {
+public:
+    dummy_sm() : last_commit_idx_(0) {}
+    ~dummy_sm() {}
+
+    ptr<buffer> commit(const ulong log_idx, buffer& data) {
+        ptr<buffer> ret = buffer::alloc(sizeof(ulong));
+        ret->put(log_idx);
+        ret->pos(0);
+        last_commit_idx_ = log_idx;
+        return ret;
+    }
+
+    ptr<buffer> pre_commit(const ulong log_idx, buffer& data) {
+        return nullptr;
+    }
+
+    void rollback(const ulong log_idx, buffer& data) { }
+    void save_snapshot_data(snapshot& s, const ulong offset, buffer& data) { }
+    void save_logical_snp_obj(snapshot& s,
+                              ulong& obj_id,
+                              buffer& data,
+                              bool is_first_obj,
+                              bool is_last_obj)
+    {
+        obj_id++;
+    }
+    bool apply_snapshot(snapshot& s) {
+        return true;
+    }
+    int read_snapshot_data(snapshot& s, const ulong offset, buffer& data) {
+        return 0;
+    }
+
+    int read_logical_snp_obj(snapshot& s,
+                             void*& user_snp_ctx,
+                             ulong obj_id,
+                             ptr<buffer>& data_out,
+                             bool& is_last_obj)
+    {
+        is_last_obj = true;
+        data_out = buffer::alloc(sizeof(ulong));
+        data_out->put(obj_id);
+        data_out->pos(0);
+        return 0;
+    }
+
+    void free_user_snp_ctx(void*& user_snp_ctx) { }
+
+    bool adjusts_commit_index() const { return false; }
+
+    ptr<snapshot> last_snapshot() {
+        std::lock_guard<std::mutex> ll(last_snapshot_lock_);
+        return last_snapshot_;
+    }
+
+    ulong last_commit_index() {
+        return last_commit_idx_;
+    }
+
+    void create_snapshot(snapshot& s,
+                         async_result<bool>::handler_type& when_done)
+    {
+        {   std::lock_guard<std::mutex> ll(last_snapshot_lock_);
+            // NOTE: We only handle logical snapshot.
+            ptr<buffer> snp_buf = s.serialize();
+            last_snapshot_ = snapshot::deserialize(*snp_buf);
+        }
+        ptr<std::exception> except(nullptr);
+        bool ret = true;
+        when_done(ret, except);
+    }
+
+private:
+    ptr<snapshot> last_snapshot_;
+    std::mutex last_snapshot_lock_;
+    uint64_t last_commit_idx_;
+};
+
+}; // namespace raft_bench;
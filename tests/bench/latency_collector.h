@@ -22,7 +22,7 @@ limitations under the License.
 #pragma once
 
 #include "ashared_ptr.h"
-#include "histogram.h"
+#include "hdr_histogram.h"
 
 #include <atomic>
 #include <chrono>
@@ -107,6 +107,20 @@ public:
         return lhs;
     }
 
+    // this -= rhs, where `rhs` is an earlier snapshot of this item.
+    LatencyItem& operator-=(const LatencyItem& rhs) {
+        hist -= rhs.hist;
+        return *this;
+    }
+
+    // returning lhs - rhs, latencies added between two snapshots.
+    friend LatencyItem operator-(LatencyItem lhs,
+                                 const LatencyItem& rhs)
+    {
+        lhs.hist -= rhs.hist;
+        return lhs;
+    }
+
     std::string getName() const {
         return statName;
     }
@@ -116,7 +130,7 @@ public:
     uint64_t getTotalTime() const { return hist.getSum(); }
     uint64_t getNumCalls() const { return hist.getTotal(); }
     uint64_t getMaxLatency() const { return hist.getMax(); }
-    uint64_t getMinLatency() { return hist.estimate(1); }
+    uint64_t getMinLatency() { return hist.estimate(0); }
     uint64_t getPercentile(double percentile) { return hist.estimate(percentile); }
 
     size_t getNumStacks() const {
@@ -147,7 +161,7 @@ public:
     std::map<double, uint64_t> dumpHistogram() const {
         std::map<double, uint64_t> ret;
         for (auto& entry: hist) {
-            HistItr& itr = entry;
+            HdrHistItr& itr = entry;
             uint64_t cnt = itr.getCount();
             if (cnt) {
                 ret.insert( std::make_pair(itr.getUpperBound(), cnt) );
@@ -158,7 +172,7 @@ public:
 
 private:
     std::string statName;
-    Histogram hist;
+    HdrHistogram hist;
 };
 
 class LatencyCollector;
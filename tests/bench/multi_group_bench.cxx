@@ -0,0 +1,813 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "raft_functional_common.hxx"
+
+#include "nuraft.hxx"
+
+#include "dummy_sm.hxx"
+#include "hdr_histogram.h"
+#include "test_common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace nuraft;
+using namespace raft_functional_common;
+
+namespace multi_group_bench {
+
+using raft_bench::dummy_sm;
+using raft_result = cmd_result< ptr<buffer> >;
+
+struct bench_config {
+    bench_config()
+        : num_groups_(100)
+        , num_replicas_(3)
+        , node_id_(0)
+        , base_port_(26000)
+        , duration_(10)
+        , idle_duration_(5)
+        , rate_(10000)
+        , num_threads_(1)
+        , payload_size_(128)
+        , zipf_(0.99)
+        , seed_(0)
+        , asio_threads_(8)
+        , commit_threads_(1)
+        , append_threads_(1)
+        , mux_(false)
+        , hb_batch_(false)
+        , quiesce_ms_(0)
+        , top_groups_(10)
+        {}
+
+    size_t num_groups_;
+    size_t num_replicas_;
+    // If non-zero, this process runs only the given node (1 - # replicas),
+    // and other nodes are run by other processes.
+    size_t node_id_;
+    size_t base_port_;
+    size_t duration_;
+    // Time to measure the CPU usage without traffic, before the load.
+    size_t idle_duration_;
+    // Total rate of all groups.
+    size_t rate_;
+    size_t num_threads_;
+    size_t payload_size_;
+    // Skew of the load across groups. Group 1 is the hottest one,
+    // 0 means uniform.
+    double zipf_;
+    uint64_t seed_;
+    size_t asio_threads_;
+    size_t commit_threads_;
+    size_t append_threads_;
+    // Use multiplexed connections, one listener per node.
+    bool mux_;
+    // Coalesce heartbeats of groups by `heartbeat_batcher`.
+    bool hb_batch_;
+    // `raft_params::quiesce_after_ms_`, with a `failure_detector` per node.
+    size_t quiesce_ms_;
+    // Number of the hottest groups to show.
+    size_t top_groups_;
+};
+
+// Node 1 drives the load, and leads all groups.
+bool is_driver(const bench_config& config) {
+    return config.node_id_ <= 1;
+}
+
+size_t get_port(const bench_config& config, size_t node_id, size_t group_idx) {
+    if (config.mux_) {
+        // All groups share the listener of the node.
+        return config.base_port_ + node_id - 1;
+    }
+    return config.base_port_ + (node_id - 1) * config.num_groups_ + group_idx;
+}
+
+std::string get_endpoint(const bench_config& config,
+                         size_t node_id,
+                         size_t group_idx)
+{
+    return "tcp://127.0.0.1:" +
+           std::to_string( get_port(config, node_id, group_idx) );
+}
+
+// Member of a group running on a node.
+struct member_stuff {
+    ptr<state_mgr> smgr_;
+    ptr<state_machine> sm_;
+    // Not used with multiplexed connections.
+    ptr<rpc_listener> listener_;
+    ptr<raft_server> raft_instance_;
+};
+
+struct node_stuff {
+    node_stuff() : node_id_(0) {}
+
+    // Server ID of all members on this node.
+    size_t node_id_;
+    ptr<asio_service> asio_svc_;
+    // Only with multiplexed connections.
+    ptr<rpc_listener> listener_;
+    ptr<heartbeat_batcher> hb_batcher_;
+    ptr<failure_detector> detector_;
+    std::vector<member_stuff> members_;
+};
+
+// Members on the same node have the same server ID in all groups.
+std::string get_node_key(int32 srv_id, const std::string& endpoint) {
+    return std::to_string(srv_id);
+}
+
+int init_node(node_stuff& node,
+              const bench_config& config,
+              ptr<logger> raft_logger)
+{
+    asio_service::options asio_opt;
+    asio_opt.thread_pool_size_ = config.asio_threads_;
+    if (config.mux_ && nuraft_global_mgr::get_asio_service()) {
+        // Members of the same group cannot share an Asio service with
+        // multiplexed connections, as they have the same group ID.
+        // Other nodes in the same process get their own.
+        node.asio_svc_ = cs_new<asio_service>(asio_opt, raft_logger);
+    } else {
+        node.asio_svc_ =
+            nuraft_global_mgr::init_asio_service(asio_opt, raft_logger);
+    }
+    ptr<delayed_task_scheduler> scheduler = node.asio_svc_;
+    ptr<rpc_client_factory> plain_factory = node.asio_svc_;
+
+    if (config.hb_batch_) {
+        heartbeat_batcher::options hb_opt;
+        hb_opt.dest_key_func_ = get_node_key;
+        node.hb_batcher_ =
+            cs_new<heartbeat_batcher>(plain_factory, scheduler, hb_opt);
+    }
+    if (config.quiesce_ms_) {
+        failure_detector::options fd_opt;
+        fd_opt.dest_key_func_ = get_node_key;
+        node.detector_ =
+            cs_new<failure_detector>(plain_factory, scheduler, fd_opt);
+    }
+    if (config.mux_) {
+        node.listener_ = node.asio_svc_->create_rpc_listener
+                         ( get_port(config, node.node_id_, 0), raft_logger );
+        if (!node.listener_) return -1;
+    }
+
+    raft_params params;
+    params.heart_beat_interval_ = 500;
+    params.election_timeout_lower_bound_ = 1000;
+    params.election_timeout_upper_bound_ = 2000;
+    params.reserved_log_items_ = 10000;
+    params.snapshot_distance_ = 100000;
+    params.client_req_timeout_ = 4000;
+    params.return_method_ = raft_params::async_handler;
+    params.quiesce_after_ms_ = config.quiesce_ms_;
+    // Groups that elected other nodes before node 1 started
+    // will hand over the leadership to node 1.
+    params.leadership_transfer_min_wait_time_ = 1000;
+
+    node.members_.resize(config.num_groups_);
+    for (size_t gg = 0; gg < config.num_groups_; ++gg) {
+        member_stuff& mm = node.members_[gg];
+        uint64_t group_id = gg + 1;
+        std::string endpoint = get_endpoint(config, node.node_id_, gg);
+
+        // All members are given in the initial config,
+        // with node 1 having the highest priority.
+        ptr<TestMgr> smgr = cs_new<TestMgr>(node.node_id_, endpoint);
+        cluster_config c_conf;
+        for (size_t nn = 1; nn <= config.num_replicas_; ++nn) {
+            c_conf.get_servers().push_back
+                ( cs_new<srv_config>( nn, 0, get_endpoint(config, nn, gg),
+                                      std::string(), false,
+                                      nn == 1 ? 100 : 1 ) );
+        }
+        smgr->save_config(c_conf);
+        mm.smgr_ = smgr;
+        mm.sm_ = cs_new<dummy_sm>();
+
+        ptr<rpc_listener> listener = node.listener_;
+        ptr<rpc_client_factory> factory = plain_factory;
+        if (config.mux_) {
+            factory = node.asio_svc_->create_mux_client_factory(group_id);
+        } else {
+            mm.listener_ = node.asio_svc_->create_rpc_listener
+                           ( get_port(config, node.node_id_, gg), raft_logger );
+            if (!mm.listener_) return -1;
+            listener = mm.listener_;
+        }
+
+        context* ctx = new context( mm.smgr_, mm.sm_, listener, raft_logger,
+                                    factory, scheduler, params );
+        if (node.hb_batcher_) ctx->set_hb_batcher(node.hb_batcher_, group_id);
+        if (node.detector_) ctx->set_failure_detector(node.detector_, group_id);
+        mm.raft_instance_ = cs_new<raft_server>(ctx);
+
+        if (config.mux_) {
+            ptr<msg_handler> handler = mm.raft_instance_;
+            node.asio_svc_->register_mux_group(group_id, handler);
+        } else {
+            mm.listener_->listen(mm.raft_instance_);
+        }
+    }
+
+    if (config.mux_) {
+        // Heartbeat batches and liveness checks come through plain
+        // connections. Any member can handle them, as they are
+        // dispatched by the shared batcher and detector.
+        ptr<msg_handler> handler = node.members_[0].raft_instance_;
+        node.listener_->listen(handler);
+    }
+    return 0;
+}
+
+void shutdown_node(node_stuff& node, const bench_config& config) {
+    for (size_t gg = 0; gg < node.members_.size(); ++gg) {
+        member_stuff& mm = node.members_[gg];
+        if (!mm.raft_instance_) continue;
+        mm.raft_instance_->shutdown();
+        if (config.mux_) {
+            node.asio_svc_->deregister_mux_group(gg + 1);
+        } else if (mm.listener_) {
+            mm.listener_->stop();
+        }
+    }
+    if (node.listener_) node.listener_->stop();
+
+    // The global Asio service is shut down by `nuraft_global_mgr`.
+    if (node.asio_svc_ != nuraft_global_mgr::get_asio_service()) {
+        node.asio_svc_->stop();
+        size_t count = 0;
+        while (node.asio_svc_->get_active_workers() && count < 500) {
+            TestSuite::sleep_ms(10);
+            count++;
+        }
+    }
+}
+
+// Wait until node 1 becomes the leader of all groups.
+int wait_for_leaders(node_stuff& node, const bench_config& config) {
+    const size_t MAX_WAIT_SEC = 60;
+    TestSuite::Timer timer(MAX_WAIT_SEC * 1000);
+    _msg("wait for leaders ");
+    while (!timer.timeout()) {
+        size_t num_led = 0;
+        for (member_stuff& mm: node.members_) {
+            if (mm.raft_instance_->is_leader()) num_led++;
+        }
+        if (num_led == node.members_.size()) {
+            _msg(" done (%zu ms)\n", (size_t)timer.getTimeMs());
+            return 0;
+        }
+
+        _msg(".");
+        fflush(stdout);
+        TestSuite::sleep_ms(250);
+    }
+    size_t num_led = 0, num_others = 0;
+    for (member_stuff& mm: node.members_) {
+        if (mm.raft_instance_->is_leader()) {
+            num_led++;
+        } else if (mm.raft_instance_->get_leader() > 0) {
+            num_others++;
+        }
+    }
+    _msg( " FAILED: %zu groups led by node %zu, %zu by other nodes, "
+          "%zu without leader\n",
+          num_led, node.node_id_, num_others,
+          node.members_.size() - num_led - num_others );
+    return -1;
+}
+
+// Number of threads of this process, or 0 if unknown.
+size_t get_num_threads() {
+    std::ifstream fs("/proc/self/status");
+    std::string line;
+    while (std::getline(fs, line)) {
+        if (line.compare(0, 8, "Threads:") == 0) {
+            return atoi( line.substr(8).c_str() );
+        }
+    }
+    return 0;
+}
+
+// User + system CPU time of this process in microseconds.
+uint64_t get_cpu_time_us() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// CPU usage in percent of a single core.
+double measure_cpu_usage(size_t duration_sec) {
+    uint64_t cpu_start_us = get_cpu_time_us();
+    TestSuite::Timer timer;
+    TestSuite::sleep_sec(duration_sec);
+    uint64_t wall_us = timer.getTimeUs();
+    return (get_cpu_time_us() - cpu_start_us) * 100.0 / wall_us;
+}
+
+struct group_stats {
+    group_stats() : num_ops_(0), num_failed_(0) {}
+    HdrHistogram lat_;
+    std::atomic<uint64_t> num_ops_;
+    std::atomic<uint64_t> num_failed_;
+};
+
+// Shared with the result handlers, which may be invoked
+// after the load is over.
+struct load_stats {
+    load_stats(size_t num_groups)
+        : groups_(num_groups)
+        , num_outstanding_(0)
+        {}
+    HdrHistogram all_lat_;
+    std::vector<group_stats> groups_;
+    std::atomic<int64_t> num_outstanding_;
+};
+
+// Picks a group following Zipf's law, by the inverse of its CDF.
+class zipf_sampler {
+public:
+    zipf_sampler(size_t num_items, double skew)
+        : cdf_(num_items)
+    {
+        double sum = 0;
+        for (size_t ii = 0; ii < num_items; ++ii) {
+            sum += 1.0 / std::pow(ii + 1, skew);
+            cdf_[ii] = sum;
+        }
+        for (double& cc: cdf_) cc /= sum;
+    }
+
+    size_t next(std::mt19937_64& rng) {
+        double pp = dist_(rng);
+        size_t idx = std::lower_bound(cdf_.begin(), cdf_.end(), pp) - cdf_.begin();
+        return std::min(idx, cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_;
+    std::uniform_real_distribution<double> dist_;
+};
+
+struct worker_params : public TestSuite::ThreadArgs {
+    worker_params(const bench_config& _config,
+                  node_stuff& _node,
+                  ptr<load_stats> _stats)
+        : config_(_config)
+        , node_(_node)
+        , stats_(_stats)
+        , stop_signal_(false)
+        , next_thread_idx_(0)
+        {}
+    const bench_config& config_;
+    node_stuff& node_;
+    ptr<load_stats> stats_;
+    std::atomic<bool> stop_signal_;
+    std::atomic<size_t> next_thread_idx_;
+};
+
+uint64_t elapsed_us(std::chrono::steady_clock::time_point from,
+                    std::chrono::steady_clock::time_point to)
+{
+    if (to <= from) return 0;
+    return std::chrono::duration_cast<std::chrono::microseconds>
+           (to - from).count();
+}
+
+// Open-loop generator: Poisson arrivals of the given rate, and
+// latencies measured from the intended time, the same as
+// `raft_bench --open-loop`.
+int worker_func(TestSuite::ThreadArgs* _args) {
+    worker_params* args = static_cast<worker_params*>(_args);
+    const bench_config& config = args->config_;
+    size_t thread_idx = args->next_thread_idx_.fetch_add(1);
+    std::mt19937_64 rng(config.seed_ + thread_idx);
+    zipf_sampler groups(config.num_groups_, config.zipf_);
+
+    double rate_per_us = (double)config.rate_ / config.num_threads_ / 1000000;
+    std::exponential_distribution<double> inter_arrival(rate_per_us);
+
+    ptr<load_stats> stats = args->stats_;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    double next_us = inter_arrival(rng);
+    while (!args->stop_signal_) {
+        std::chrono::steady_clock::time_point intended =
+            start + std::chrono::microseconds( (uint64_t)next_us );
+        uint64_t wait_us = elapsed_us(std::chrono::steady_clock::now(),
+                                      intended);
+        if (wait_us > 200) {
+            TestSuite::sleep_us( std::min(wait_us - 100, (uint64_t)10000) );
+            continue;
+        }
+        if (wait_us) {
+            std::this_thread::yield();
+            continue;
+        }
+        next_us += inter_arrival(rng);
+
+        size_t group_idx = groups.next(rng);
+        group_stats* gs = &stats->groups_[group_idx];
+        ptr<buffer> msg = buffer::alloc(config.payload_size_);
+        msg->put( (byte)0x0 );
+        msg->pos(0);
+
+        stats->num_outstanding_.fetch_add(1);
+        ptr<raft_result> ret =
+            args->node_.members_[group_idx].raft_instance_->append_entries( {msg} );
+        if (!ret->get_accepted()) {
+            gs->num_failed_.fetch_add(1);
+            stats->num_outstanding_.fetch_sub(1);
+            continue;
+        }
+
+        ret->when_ready( [stats, gs, intended]
+                         ( raft_result& result,
+                           ptr<std::exception>& err ) {
+            if (result.get_result_code() == cmd_result_code::OK) {
+                uint64_t lat_us =
+                    elapsed_us(intended, std::chrono::steady_clock::now());
+                gs->lat_.add(lat_us);
+                stats->all_lat_.add(lat_us);
+                gs->num_ops_.fetch_add(1);
+            } else {
+                gs->num_failed_.fetch_add(1);
+            }
+            stats->num_outstanding_.fetch_sub(1);
+        } );
+    }
+
+    return 0;
+}
+
+void worker_killer_func(TestSuite::ThreadArgs* _args) {
+    worker_params* args = static_cast<worker_params*>(_args);
+    args->stop_signal_ = true;
+}
+
+void print_config(const bench_config& config) {
+    _msg("-----\n");
+    _msg("%zu groups x %zu replicas\n", config.num_groups_, config.num_replicas_);
+    if (config.node_id_) {
+        _msg("node %zu of %zu in this process\n",
+             config.node_id_, config.num_replicas_);
+    } else {
+        _msg("all nodes in this process\n");
+    }
+    _msg("asio threads: %zu, commit threads: %zu, append threads: %zu\n",
+         config.asio_threads_, config.commit_threads_, config.append_threads_);
+    _msg("multiplexed connection: %s, heartbeat batching: %s, "
+         "quiescence: %s\n",
+         config.mux_ ? "on" : "off",
+         config.hb_batch_ ? "on" : "off",
+         config.quiesce_ms_ ? (std::to_string(config.quiesce_ms_) + " ms").c_str()
+                            : "off");
+    if (is_driver(config)) {
+        _msg("traffic: %zu ops/sec, zipf %.2f, %zu threads, seed %zu\n",
+             config.rate_, config.zipf_, config.num_threads_,
+             (size_t)config.seed_);
+        _msg("payload size: %zu bytes\n", config.payload_size_);
+    }
+    _msg("run duration: %zu seconds\n", config.duration_);
+    _msg("-----\n");
+}
+
+void print_group_latency(const char* name,
+                         uint64_t num_ops,
+                         uint64_t num_failed,
+                         uint64_t elapsed_us,
+                         const HdrHistogram& lat)
+{
+    TestSuite::_msg("%10s%10zu%12s%10s%10s%10s%10s%8zu\n",
+        name,
+        (size_t)num_ops,
+        TestSuite::throughputStr(num_ops, elapsed_us).c_str(),
+        TestSuite::usToString( lat.estimate(50) ).c_str(),
+        TestSuite::usToString( lat.estimate(99) ).c_str(),
+        TestSuite::usToString( lat.estimate(99.9) ).c_str(),
+        TestSuite::usToString( lat.getMax() ).c_str(),
+        (size_t)num_failed);
+}
+
+void print_results(const bench_config& config,
+                   load_stats& stats,
+                   uint64_t elapsed_us)
+{
+    uint64_t total_ops = 0, total_failed = 0;
+    std::vector<size_t> order;
+    for (size_t gg = 0; gg < stats.groups_.size(); ++gg) {
+        total_ops += stats.groups_[gg].num_ops_;
+        total_failed += stats.groups_[gg].num_failed_;
+        order.push_back(gg);
+    }
+    std::sort( order.begin(), order.end(),
+               [&](size_t a, size_t b) -> bool {
+                   return stats.groups_[a].num_ops_ > stats.groups_[b].num_ops_;
+               } );
+
+    _msg("-----\n");
+    TestSuite::_msg("%10s%10s%12s%10s%10s%10s%10s%8s\n",
+                    "group", "ops", "ops/s", "p50", "p99", "p99.9", "max",
+                    "failed");
+    print_group_latency("all", total_ops, total_failed, elapsed_us,
+                        stats.all_lat_);
+    for (size_t ii = 0; ii < std::min(config.top_groups_, order.size()); ++ii) {
+        group_stats& gs = stats.groups_[order[ii]];
+        print_group_latency( std::to_string(order[ii] + 1).c_str(),
+                             gs.num_ops_, gs.num_failed_, elapsed_us, gs.lat_ );
+    }
+
+    // Spread of p99 across groups that have enough samples.
+    const uint64_t MIN_SAMPLES = 100;
+    std::vector<uint64_t> p99s;
+    for (group_stats& gs: stats.groups_) {
+        if (gs.num_ops_ >= MIN_SAMPLES) p99s.push_back( gs.lat_.estimate(99) );
+    }
+    if (!p99s.empty()) {
+        std::sort(p99s.begin(), p99s.end());
+        _msg("-----\n");
+        _msg("p99 of %zu groups with >= %zu ops: "
+             "min %s, median %s, p90 %s, max %s\n",
+             p99s.size(), (size_t)MIN_SAMPLES,
+             TestSuite::usToString( p99s.front() ).c_str(),
+             TestSuite::usToString( p99s[p99s.size() / 2] ).c_str(),
+             TestSuite::usToString( p99s[p99s.size() * 9 / 10] ).c_str(),
+             TestSuite::usToString( p99s.back() ).c_str());
+    }
+}
+
+int run_load(const bench_config& config, node_stuff& node) {
+    ptr<load_stats> stats = cs_new<load_stats>(config.num_groups_);
+    worker_params param(config, node, stats);
+
+    uint64_t cpu_start_us = get_cpu_time_us();
+    std::vector<TestSuite::ThreadHolder> h_workers(config.num_threads_);
+    for (size_t ii=0; ii<h_workers.size(); ++ii) {
+        TestSuite::ThreadHolder& h_worker = h_workers[ii];
+        h_worker.spawn(&param, worker_func, worker_killer_func);
+    }
+
+    TestSuite::Displayer dd(1, 4);
+    dd.init();
+    std::vector<size_t> col_width(4, 15);
+    dd.setWidth(col_width);
+    TestSuite::Timer duration_timer(config.duration_ * 1000);
+
+    // p99 of all groups in the last second, by diffing snapshots.
+    HdrHistogram last_snapshot = stats->all_lat_;
+    TestSuite::Timer window_timer(1000);
+    uint64_t window_p99 = 0;
+    while (!duration_timer.timeout()) {
+        TestSuite::sleep_ms(80);
+        uint64_t cur_us = duration_timer.getTimeUs();
+        if (!cur_us) continue;
+
+        HdrHistogram snapshot = stats->all_lat_;
+        uint64_t cur_ops = snapshot.getTotal();
+        if (window_timer.timeout()) {
+            HdrHistogram window = snapshot;
+            window -= last_snapshot;
+            window_p99 = window.estimate(99);
+            last_snapshot = snapshot;
+            window_timer.reset();
+        }
+
+        dd.set( 0, 0, "%zu/%zu", cur_us / 1000000, config.duration_ );
+        dd.set( 0, 1, "%zu", cur_ops );
+        dd.set( 0, 2, "%s ops/s", TestSuite::throughputStr(cur_ops, cur_us).c_str() );
+        dd.set( 0, 3, "p99 %s", TestSuite::usToString(window_p99).c_str() );
+        dd.print();
+    }
+    param.stop_signal_ = true;
+    for (size_t ii=0; ii<h_workers.size(); ++ii) {
+        h_workers[ii].join();
+    }
+
+    const size_t MAX_DRAIN_MS = 10000;
+    TestSuite::Timer drain_timer(MAX_DRAIN_MS);
+    while (stats->num_outstanding_ > 0 && !drain_timer.timeout()) {
+        TestSuite::sleep_ms(10);
+    }
+    uint64_t elapsed_us = duration_timer.getTimeUs();
+    double load_cpu = (get_cpu_time_us() - cpu_start_us) * 100.0 / elapsed_us;
+
+    print_results(config, *stats, elapsed_us);
+    _msg("-----\n");
+    _msg("threads: %zu, CPU under load: %.1f%% of a core\n",
+         get_num_threads(), load_cpu);
+    return 0;
+}
+
+int bench_main(const bench_config& config) {
+    print_config(config);
+
+    std::string log_file_name = config.node_id_
+                                ? "./multi_group_bench_node" +
+                                  std::to_string(config.node_id_) + ".log"
+                                : "./multi_group_bench.log";
+    ptr<logger_wrapper> log_wrap = cs_new<logger_wrapper>(log_file_name, 3);
+    ptr<logger> raft_logger = log_wrap;
+
+    nuraft_global_config g_config;
+    g_config.num_commit_threads_ = config.commit_threads_;
+    g_config.num_append_threads_ = config.append_threads_;
+    nuraft_global_mgr::init(g_config);
+
+    // Node 1 should be the first one, to use the global Asio service.
+    std::vector<node_stuff> nodes;
+    for (size_t nn = 1; nn <= config.num_replicas_; ++nn) {
+        if (config.node_id_ && config.node_id_ != nn) continue;
+        nodes.push_back(node_stuff());
+        nodes.back().node_id_ = nn;
+    }
+
+    TestSuite::Timer setup_timer;
+    _msg("launch %zu servers ", nodes.size() * config.num_groups_);
+    for (node_stuff& node: nodes) {
+        CHK_Z( init_node(node, config, raft_logger) );
+        _msg(".");
+        fflush(stdout);
+    }
+    _msg(" done (%zu ms)\n", (size_t)setup_timer.getTimeMs());
+
+    if (is_driver(config)) {
+        CHK_Z( wait_for_leaders(nodes[0], config) );
+        _msg("-----\n");
+
+        // Let followers catch up and settle (or quiesce).
+        TestSuite::sleep_sec(1, "wait for groups to settle");
+        if (config.idle_duration_) {
+            double idle_cpu = measure_cpu_usage(config.idle_duration_);
+            _msg("threads: %zu, idle CPU: %.1f%% of a core, "
+                 "%.1f us/sec per group\n",
+                 get_num_threads(), idle_cpu,
+                 idle_cpu * 10000 / config.num_groups_);
+        }
+
+        CHK_Z( run_load(config, nodes[0]) );
+    } else {
+        // Other nodes, just report the cost.
+        double cpu = measure_cpu_usage(config.duration_);
+        _msg("threads: %zu, CPU: %.1f%% of a core\n", get_num_threads(), cpu);
+    }
+    _msg("-----\n");
+
+    for (node_stuff& node: nodes) shutdown_node(node, config);
+    nodes.clear();
+    nuraft_global_mgr::shutdown();
+    log_wrap->destroy();
+    return 0;
+}
+
+void usage(int argc, char** argv) {
+    std::stringstream ss;
+    ss <<
+    "Usage: \n" <<
+    "    multi_group_bench [options]\n" <<
+    std::endl <<
+    "    - Options:\n" <<
+    "    --groups=<N>: number of Raft groups (default: 100).\n" <<
+    "    --replicas=<M>: number of members of each group (default: 3).\n" <<
+    "    --node=<ID>: run only the given node (1 - M) in this process,\n"
+    "                 others should be run by other processes with\n"
+    "                 the same options. Node 1 drives the load.\n" <<
+    "    --port=<port>: first port number (default: 26000).\n" <<
+    "    --duration=<sec>: duration of the load (default: 10).\n" <<
+    "    --idle=<sec>: duration of measuring idle CPU usage (default: 5).\n" <<
+    "    --rate=<ops/sec>: total request rate of all groups "
+    "(default: 10000).\n" <<
+    "    --zipf=<skew>: skew of the load across groups, 0 for uniform "
+    "(default: 0.99).\n" <<
+    "    --threads=<N>: number of load generator threads (default: 1).\n" <<
+    "    --payload=<bytes>: payload size (default: 128).\n" <<
+    "    --seed=<seed>: random seed of arrivals and groups.\n" <<
+    "    --asio-threads=<N>: Asio thread pool size (default: 8).\n" <<
+    "    --commit-threads=<N>, --append-threads=<N>:\n"
+    "                 threads of nuraft_global_mgr (default: 1).\n" <<
+    "    --mux: use multiplexed connections.\n" <<
+    "    --hb-batch: coalesce heartbeats across groups.\n" <<
+    "    --quiesce=<ms>: quiesce idle groups after the given time.\n" <<
+    "    --top=<N>: number of the hottest groups to show (default: 10).\n" <<
+    std::endl;
+
+    std::cout << ss.str();
+    exit(0);
+}
+
+bench_config parse_config(int argc, char** argv) {
+    bench_config ret;
+    for (int ii=1; ii<argc; ++ii) {
+        std::string arg = argv[ii];
+        size_t eq_pos = arg.find('=');
+        std::string key = arg.substr(0, eq_pos);
+        std::string value = (eq_pos == std::string::npos)
+                            ? std::string()
+                            : arg.substr(eq_pos + 1);
+        size_t num = atoi( value.c_str() );
+
+        if (key == "--groups") {
+            ret.num_groups_ = num;
+        } else if (key == "--replicas") {
+            ret.num_replicas_ = num;
+        } else if (key == "--node") {
+            ret.node_id_ = num;
+        } else if (key == "--port") {
+            ret.base_port_ = num;
+        } else if (key == "--duration") {
+            ret.duration_ = num;
+        } else if (key == "--idle") {
+            ret.idle_duration_ = num;
+        } else if (key == "--rate") {
+            ret.rate_ = num;
+        } else if (key == "--zipf") {
+            ret.zipf_ = atof( value.c_str() );
+        } else if (key == "--threads") {
+            ret.num_threads_ = num;
+        } else if (key == "--payload") {
+            ret.payload_size_ = num;
+        } else if (key == "--seed") {
+            ret.seed_ = strtoull( value.c_str(), nullptr, 10 );
+        } else if (key == "--asio-threads") {
+            ret.asio_threads_ = num;
+        } else if (key == "--commit-threads") {
+            ret.commit_threads_ = num;
+        } else if (key == "--append-threads") {
+            ret.append_threads_ = num;
+        } else if (key == "--mux") {
+            ret.mux_ = true;
+        } else if (key == "--hb-batch") {
+            ret.hb_batch_ = true;
+        } else if (key == "--quiesce") {
+            ret.quiesce_ms_ = num;
+        } else if (key == "--top") {
+            ret.top_groups_ = num;
+        } else {
+            // Including `--usage`.
+            usage(argc, argv);
+        }
+    }
+
+    if (ret.num_groups_ < 1 || ret.num_replicas_ < 1 ||
+        ret.node_id_ > ret.num_replicas_) {
+        std::cout << "wrong number of groups, replicas, or node ID." << std::endl;
+        exit(0);
+    }
+    if ( ret.base_port_ < 1000 ||
+         get_port(ret, ret.num_replicas_, ret.num_groups_ - 1) > 65535 ) {
+        std::cout << "port numbers should be in 1000 - 65535." << std::endl;
+        exit(0);
+    }
+    if (ret.rate_ < 1 || ret.num_threads_ < 1 || ret.payload_size_ < 1 ||
+        ret.duration_ < 1 || ret.asio_threads_ < 1) {
+        std::cout << "rate, threads, payload size, and duration "
+                     "should be greater than zero." << std::endl;
+        exit(0);
+    }
+    if (ret.zipf_ < 0) {
+        std::cout << "zipf skew should not be negative." << std::endl;
+        exit(0);
+    }
+    return ret;
+}
+
+}; // namespace multi_group_bench;
+using namespace multi_group_bench;
+
+int main(int argc, char** argv) {
+    TestSuite ts(argc, argv);
+
+    bench_config config = parse_config(argc, argv);
+
+    ts.options.printTestMessage = true;
+
+    ts.doTest("bench main", bench_main, config);
+
+    return 0;
+}
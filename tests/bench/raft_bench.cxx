@@ -19,9 +19,12 @@ limitations under the License.
 
 #include "nuraft.hxx"
 
+#include "dummy_sm.hxx"
 #include "latency_collector.h"
 #include "test_common.h"
 
+#include <random>
+
 using namespace nuraft;
 using namespace raft_functional_common;
 
@@ -31,84 +34,16 @@ LatencyCollector global_lat;
 
 using raft_result = cmd_result< ptr<buffer> >;
 
-class dummy_sm : public state_machine {
-public:
-    dummy_sm() : last_commit_idx_(0) {}
-    ~dummy_sm() {}
-
-    ptr<buffer> commit(const ulong log_idx, buffer& data) {
-        ptr<buffer> ret = buffer::alloc(sizeof(ulong));
-        ret->put(log_idx);
-        ret->pos(0);
-        last_commit_idx_ = log_idx;
-        return ret;
-    }
-
-    ptr<buffer> pre_commit(const ulong log_idx, buffer& data) {
-        return nullptr;
-    }
-
-    void rollback(const ulong log_idx, buffer& data) { }
-    void save_snapshot_data(snapshot& s, const ulong offset, buffer& data) { }
-    void save_logical_snp_obj(snapshot& s,
-                              ulong& obj_id,
-                              buffer& data,
-                              bool is_first_obj,
-                              bool is_last_obj)
-    {
-        obj_id++;
-    }
-    bool apply_snapshot(snapshot& s) {
-        return true;
-    }
-    int read_snapshot_data(snapshot& s, const ulong offset, buffer& data) {
-        return 0;
-    }
-
-    int read_logical_snp_obj(snapshot& s,
-                             void*& user_snp_ctx,
-                             ulong obj_id,
-                             ptr<buffer>& data_out,
-                             bool& is_last_obj)
-    {
-        is_last_obj = true;
-        data_out = buffer::alloc(sizeof(ulong));
-        data_out->put(obj_id);
-        data_out->pos(0);
-        return 0;
-    }
-
-    void free_user_snp_ctx(void*& user_snp_ctx) { }
-
-    ptr<snapshot> last_snapshot() {
-        std::lock_guard<std::mutex> ll(last_snapshot_lock_);
-        return last_snapshot_;
-    }
-
-    ulong last_commit_index() {
-        return last_commit_idx_;
-    }
-
-    void create_snapshot(snapshot& s,
-                         async_result<bool>::handler_type& when_done)
-    {
-        {   std::lock_guard<std::mutex> ll(last_snapshot_lock_);
-            // NOTE: We only handle logical snapshot.
-            ptr<buffer> snp_buf = s.serialize();
-            last_snapshot_ = snapshot::deserialize(*snp_buf);
-        }
-        ptr<std::exception> except(nullptr);
-        bool ret = true;
-        when_done(ret, except);
-    }
-
-private:
-    ptr<snapshot> last_snapshot_;
-    std::mutex last_snapshot_lock_;
-    uint64_t last_commit_idx_;
-};
-
 struct bench_config {
+    enum payload_dist_type {
+        // Always `payload_size_`.
+        FIXED = 0,
+        // Uniform in [1, 2 * `payload_size_` - 1].
+        UNIFORM = 1,
+        // Exponential with mean `payload_size_`, upto 16 MB.
+        EXPONENTIAL = 2,
+    };
+
     bench_config(size_t _srv_id = 1,
                  const std::string& _my_endpoint = "tcp://localhost:25000",
                  size_t _duration = 30,
@@ -121,17 +56,81 @@ struct bench_config {
         , iops_(_iops)
         , num_threads_(_num_threads)
         , payload_size_(_payload_size)
+        , append_batch_(true)
+        , open_loop_(false)
+        , payload_dist_(FIXED)
+        , seed_(0)
         {}
 
+    // Target rates to run, one after another for `duration_` each.
+    std::vector<size_t> get_rates() const {
+        return rates_.empty() ? std::vector<size_t>(1, iops_) : rates_;
+    }
+
     size_t srv_id_;
     std::string my_endpoint_;
     size_t duration_;
     size_t iops_;
     size_t num_threads_;
     size_t payload_size_;
+    // If `false`, log store appends logs one by one.
+    bool append_batch_;
+    // If `true`, requests are issued at Poisson arrivals without
+    // waiting for the previous ones (open-loop), instead of by
+    // threads waiting for each request (closed-loop).
+    bool open_loop_;
+    // If given, `iops_` is ignored and each rate is run in turn.
+    std::vector<size_t> rates_;
+    payload_dist_type payload_dist_;
+    uint64_t seed_;
+    // If given, results are written to the files.
+    std::string csv_path_;
+    std::string json_path_;
     std::vector<std::string> endpoints_;
 };
 
+const char* payload_dist_name(bench_config::payload_dist_type dist) {
+    switch (dist) {
+    case bench_config::FIXED:       return "fixed";
+    case bench_config::UNIFORM:     return "uniform";
+    case bench_config::EXPONENTIAL: return "exp";
+    }
+    return "unknown";
+}
+
+class payload_sampler {
+public:
+    static const size_t MAX_SIZE = 16 * 1024 * 1024;
+
+    payload_sampler(const bench_config& config)
+        : dist_(config.payload_dist_)
+        , size_(config.payload_size_)
+        , uniform_(1, 2 * config.payload_size_ - 1)
+        , exponential_(1.0 / config.payload_size_)
+        {}
+
+    size_t next(std::mt19937_64& rng) {
+        switch (dist_) {
+        case bench_config::UNIFORM:
+            return uniform_(rng);
+        case bench_config::EXPONENTIAL: {
+            double size = exponential_(rng);
+            if (size < 1) return 1;
+            if (size > MAX_SIZE) return MAX_SIZE;
+            return (size_t)size;
+        }
+        default:
+            return size_;
+        }
+    }
+
+private:
+    bench_config::payload_dist_type dist_;
+    size_t size_;
+    std::uniform_int_distribution<size_t> uniform_;
+    std::exponential_distribution<double> exponential_;
+};
+
 struct server_stuff {
     server_stuff()
         : server_id_(1)
@@ -167,7 +166,7 @@ struct server_stuff {
     ptr<raft_server> raft_instance_;
 };
 
-int init_raft(server_stuff& stuff) {
+int init_raft(server_stuff& stuff, const bench_config& config) {
     // Create logger for this server.
     std::string log_file_name = "./srv" +
                                 std::to_string( stuff.server_id_ ) +
@@ -180,6 +179,10 @@ int init_raft(server_stuff& stuff) {
                                    stuff.endpoint_ );
     stuff.sm_ = cs_new<dummy_sm>();
 
+    ptr<log_store> ls = stuff.smgr_->load_log_store();
+    static_cast<inmem_log_store*>(ls.get())->set_append_batch_enabled
+                                            ( config.append_batch_ );
+
     // Start ASIO service.
     asio_service::options asio_opt;
     asio_opt.thread_pool_size_ = 32;
@@ -199,7 +202,10 @@ int init_raft(server_stuff& stuff) {
     params.reserved_log_items_ = 10000000;
     params.snapshot_distance_ = 100000;
     params.client_req_timeout_ = 4000;
-    params.return_method_ = raft_params::blocking;
+    // Open-loop generators should not wait for the result.
+    params.return_method_ = config.open_loop_
+                            ? raft_params::async_handler
+                            : raft_params::blocking;
     context* ctx = new context( stuff.smgr_,
                                 stuff.sm_,
                                 stuff.asio_listener_,
@@ -264,28 +270,54 @@ int add_servers(server_stuff& stuff, const bench_config& config) {
     return 0;
 }
 
+// Shared with the result handlers of open-loop requests,
+// which may be invoked after the step is over.
+struct request_counters {
+    request_counters()
+        : num_ops_done_(0)
+        , num_failed_(0)
+        , num_outstanding_(0)
+        {}
+    std::atomic<uint64_t> num_ops_done_;
+    std::atomic<uint64_t> num_failed_;
+    std::atomic<int64_t> num_outstanding_;
+};
+
 struct worker_params : public TestSuite::ThreadArgs {
     worker_params(const bench_config& _config,
-                  server_stuff& _stuff)
+                  server_stuff& _stuff,
+                  size_t _rate)
         : config_(_config)
         , stuff_(_stuff)
+        , rate_(_rate)
         , stop_signal_(false)
-        , num_ops_done_(0)
-        , wg_(config_.iops_)
+        , counters_(cs_new<request_counters>())
+        , next_thread_idx_(0)
+        , wg_(_rate)
         {}
     const bench_config& config_;
     server_stuff& stuff_;
+    size_t rate_;
     std::atomic<bool> stop_signal_;
-    std::atomic<uint64_t> num_ops_done_;
+    ptr<request_counters> counters_;
+    std::atomic<size_t> next_thread_idx_;
     TestSuite::WorkloadGenerator wg_;
     std::mutex wg_lock_;
 };
 
+uint64_t elapsed_us(std::chrono::steady_clock::time_point from,
+                    std::chrono::steady_clock::time_point to)
+{
+    if (to <= from) return 0;
+    return std::chrono::duration_cast<std::chrono::microseconds>
+           (to - from).count();
+}
+
 int worker_func(TestSuite::ThreadArgs* _args) {
     worker_params* args = static_cast<worker_params*>(_args);
-
-    ptr<buffer> msg = buffer::alloc(args->config_.payload_size_);
-    msg->put( (byte)0x0 );
+    size_t thread_idx = args->next_thread_idx_.fetch_add(1);
+    std::mt19937_64 rng(args->config_.seed_ + thread_idx);
+    payload_sampler payload(args->config_);
 
     while (!args->stop_signal_) {
         size_t num_ops = 0;
@@ -297,9 +329,12 @@ int worker_func(TestSuite::ThreadArgs* _args) {
             continue;
         }
 
+        ptr<buffer> msg = buffer::alloc(payload.next(rng));
+        msg->put( (byte)0x0 );
+        msg->pos(0);
+
         TestSuite::Timer timer;
 
-        msg->pos(0);
         ptr<raft_result> ret =
             args->stuff_.raft_instance_->append_entries( {msg} );
         global_lat.addLatency("rep", timer.getTimeUs());
@@ -310,7 +345,79 @@ int worker_func(TestSuite::ThreadArgs* _args) {
         {   std::lock_guard<std::mutex> l(args->wg_lock_);
             args->wg_.addNumOpsDone(1);
         }
-        args->num_ops_done_.fetch_add(1);
+        args->counters_->num_ops_done_.fetch_add(1);
+    }
+
+    return 0;
+}
+
+int open_loop_worker_func(TestSuite::ThreadArgs* _args) {
+    worker_params* args = static_cast<worker_params*>(_args);
+    const bench_config& config = args->config_;
+    size_t thread_idx = args->next_thread_idx_.fetch_add(1);
+    std::mt19937_64 rng(config.seed_ + thread_idx);
+    payload_sampler payload(config);
+
+    // Each thread generates its share of the target rate. The sum of
+    // independent Poisson processes is again a Poisson process.
+    double rate_per_us = (double)args->rate_ / config.num_threads_ / 1000000;
+    std::exponential_distribution<double> inter_arrival(rate_per_us);
+
+    ptr<request_counters> counters = args->counters_;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    double next_us = inter_arrival(rng);
+    while (!args->stop_signal_) {
+        std::chrono::steady_clock::time_point intended =
+            start + std::chrono::microseconds( (uint64_t)next_us );
+        uint64_t wait_us = elapsed_us(std::chrono::steady_clock::now(),
+                                      intended);
+        if (wait_us > 200) {
+            // Wake up a bit earlier, and check the stop signal
+            // at least every 10 ms.
+            TestSuite::sleep_us( std::min(wait_us - 100, (uint64_t)10000) );
+            continue;
+        }
+        if (wait_us) {
+            std::this_thread::yield();
+            continue;
+        }
+        next_us += inter_arrival(rng);
+
+        // If the previous request was issued late, this one is issued
+        // right away. Latency measured from the intended time includes
+        // such a delay, which closed-loop clients hide by not issuing
+        // requests while waiting (coordinated omission).
+        ptr<buffer> msg = buffer::alloc(payload.next(rng));
+        msg->put( (byte)0x0 );
+        msg->pos(0);
+
+        std::chrono::steady_clock::time_point issued =
+            std::chrono::steady_clock::now();
+        counters->num_outstanding_.fetch_add(1);
+        ptr<raft_result> ret =
+            args->stuff_.raft_instance_->append_entries( {msg} );
+        if (!ret->get_accepted()) {
+            counters->num_failed_.fetch_add(1);
+            counters->num_outstanding_.fetch_sub(1);
+            continue;
+        }
+
+        ret->when_ready( [counters, intended, issued]
+                         ( raft_result& result,
+                           ptr<std::exception>& err ) {
+            std::chrono::steady_clock::time_point done =
+                std::chrono::steady_clock::now();
+            if (result.get_result_code() == cmd_result_code::OK) {
+                global_lat.addLatency("rep", elapsed_us(issued, done));
+                global_lat.addLatency("rep_corrected",
+                                      elapsed_us(intended, done));
+                counters->num_ops_done_.fetch_add(1);
+            } else {
+                counters->num_failed_.fetch_add(1);
+            }
+            counters->num_outstanding_.fetch_sub(1);
+        } );
     }
 
     return 0;
@@ -325,10 +432,17 @@ void print_config(const bench_config& config) {
     _msg("-----\n");
     _msg("server id: %zu\n", config.srv_id_);
     _msg("run duration: %zu seconds\n", config.duration_);
+    _msg("log append: %s\n", config.append_batch_ ? "batch" : "one by one");
     if (config.srv_id_ == 1) {
-        _msg("traffic: %zu ops/sec\n", config.iops_);
+        _msg("mode: %s\n", config.open_loop_ ? "open-loop" : "closed-loop");
+        std::string rates_str;
+        for (size_t rate: config.get_rates()) {
+            rates_str += (rates_str.empty() ? "" : ", ") + std::to_string(rate);
+        }
+        _msg("traffic: %s ops/sec\n", rates_str.c_str());
         _msg("%zu threads\n", config.num_threads_);
-        _msg("payload size: %zu bytes\n", config.payload_size_);
+        _msg("payload size: %zu bytes (%s)\n",
+             config.payload_size_, payload_dist_name(config.payload_dist_));
     }
     _msg("-----\n");
 }
@@ -348,6 +462,221 @@ void write_latency_distribution() {
     fs.close();
 }
 
+struct latency_summary {
+    latency_summary() : p50_(0), p99_(0), p999_(0), max_(0) {}
+    latency_summary(LatencyItem& item)
+        : p50_(item.getPercentile(50))
+        , p99_(item.getPercentile(99))
+        , p999_(item.getPercentile(99.9))
+        , max_(item.getNumCalls() ? item.getMaxLatency() : 0)
+        {}
+    uint64_t p50_;
+    uint64_t p99_;
+    uint64_t p999_;
+    uint64_t max_;
+};
+
+// Result of each second of a step.
+struct window_result {
+    size_t sec_;
+    uint64_t num_ops_;
+    double throughput_;
+    latency_summary lat_;
+};
+
+// Result of running a target rate for `duration_`.
+struct step_result {
+    size_t target_rate_;
+    uint64_t num_ops_;
+    uint64_t num_failed_;
+    double throughput_;
+    // Corrected latency in open-loop mode.
+    latency_summary lat_;
+    // Latency measured from the actual issue time.
+    latency_summary uncorrected_lat_;
+    std::vector<window_result> windows_;
+};
+
+step_result run_step(const bench_config& config,
+                     server_stuff& stuff,
+                     size_t rate)
+{
+    _msg("target rate: %zu ops/sec\n", rate);
+
+    // Latencies of this step only, by diffing snapshots.
+    const std::string lat_name = config.open_loop_ ? "rep_corrected" : "rep";
+    LatencyItem step_start_snapshot = global_lat.getAggrItem(lat_name);
+    LatencyItem step_start_uncorrected = global_lat.getAggrItem("rep");
+
+    worker_params param(config, stuff, rate);
+    ptr<request_counters> counters = param.counters_;
+    std::vector<TestSuite::ThreadHolder> h_workers(config.num_threads_);
+    for (size_t ii=0; ii<h_workers.size(); ++ii) {
+        TestSuite::ThreadHolder& h_worker = h_workers[ii];
+        h_worker.spawn( &param,
+                        config.open_loop_ ? open_loop_worker_func : worker_func,
+                        worker_killer_func );
+    }
+
+    step_result ret;
+    ret.target_rate_ = rate;
+
+    TestSuite::Displayer dd(1, 4);
+    dd.init();
+    std::vector<size_t> col_width(4, 15);
+    dd.setWidth(col_width);
+    TestSuite::Timer duration_timer(config.duration_ * 1000);
+
+    // Latency of the last second, by diffing snapshots.
+    LatencyItem last_snapshot = step_start_snapshot;
+    uint64_t last_ops = 0;
+    TestSuite::Timer window_timer(1000);
+    uint64_t window_p99 = 0;
+    while (!duration_timer.timeout()) {
+        TestSuite::sleep_ms(80);
+        uint64_t cur_us = duration_timer.getTimeUs();
+        if (!cur_us) continue;
+
+        uint64_t cur_ops = counters->num_ops_done_;
+
+        if (window_timer.timeout()) {
+            uint64_t window_us = window_timer.getTimeUs();
+            LatencyItem snapshot = global_lat.getAggrItem(lat_name);
+            LatencyItem window = snapshot - last_snapshot;
+            window_result ww;
+            ww.sec_ = ret.windows_.size() + 1;
+            ww.num_ops_ = cur_ops - last_ops;
+            ww.throughput_ = TestSuite::calcThroughput(ww.num_ops_, window_us);
+            ww.lat_ = latency_summary(window);
+            ret.windows_.push_back(ww);
+
+            window_p99 = ww.lat_.p99_;
+            last_snapshot = snapshot;
+            last_ops = cur_ops;
+            window_timer.reset();
+        }
+
+        dd.set( 0, 0, "%zu/%zu", cur_us / 1000000, config.duration_ );
+        dd.set( 0, 1, "%zu", cur_ops );
+        dd.set( 0, 2, "%s ops/s", TestSuite::throughputStr(cur_ops, cur_us).c_str() );
+        dd.set( 0, 3, "p99 %s", TestSuite::usToString(window_p99).c_str() );
+        dd.print();
+    }
+    param.stop_signal_ = true;
+
+    for (size_t ii=0; ii<h_workers.size(); ++ii) {
+        TestSuite::ThreadHolder& tt = h_workers[ii];
+        tt.join();
+    }
+
+    // Wait for the requests in flight, which will either be
+    // committed or time out by `client_req_timeout_`.
+    const size_t MAX_DRAIN_MS = 10000;
+    TestSuite::Timer drain_timer(MAX_DRAIN_MS);
+    while (counters->num_outstanding_ > 0 && !drain_timer.timeout()) {
+        TestSuite::sleep_ms(10);
+    }
+    if (counters->num_outstanding_ > 0) {
+        _msg("%zu requests are still in flight\n",
+             (size_t)counters->num_outstanding_);
+    }
+    uint64_t total_us = duration_timer.getTimeUs();
+
+    LatencyItem step_lat = global_lat.getAggrItem(lat_name) - step_start_snapshot;
+    LatencyItem step_uncorrected =
+        global_lat.getAggrItem("rep") - step_start_uncorrected;
+    ret.num_ops_ = counters->num_ops_done_;
+    ret.num_failed_ = counters->num_failed_;
+    ret.throughput_ = TestSuite::calcThroughput(ret.num_ops_, total_us);
+    ret.lat_ = latency_summary(step_lat);
+    ret.uncorrected_lat_ = latency_summary(step_uncorrected);
+    return ret;
+}
+
+void write_csv(const std::string& filename,
+               const std::vector<step_result>& results)
+{
+    std::ofstream fs;
+    fs.open(filename);
+    if (!fs.good()) {
+        std::cerr << "cannot open " << filename << std::endl;
+        return;
+    }
+
+    // Rows of each second, followed by the row of the whole step.
+    fs << "target_rate,sec,ops,throughput,"
+       << "p50_us,p99_us,p999_us,max_us,"
+       << "uncorrected_p99_us,failed" << std::endl;
+    for (const step_result& rr: results) {
+        for (const window_result& ww: rr.windows_) {
+            fs << rr.target_rate_ << "," << ww.sec_ << ","
+               << ww.num_ops_ << "," << ww.throughput_ << ","
+               << ww.lat_.p50_ << "," << ww.lat_.p99_ << ","
+               << ww.lat_.p999_ << "," << ww.lat_.max_ << ",," << std::endl;
+        }
+        fs << rr.target_rate_ << ",all,"
+           << rr.num_ops_ << "," << rr.throughput_ << ","
+           << rr.lat_.p50_ << "," << rr.lat_.p99_ << ","
+           << rr.lat_.p999_ << "," << rr.lat_.max_ << ","
+           << rr.uncorrected_lat_.p99_ << "," << rr.num_failed_ << std::endl;
+    }
+    fs.close();
+}
+
+void write_json_latency(std::ofstream& fs, const latency_summary& lat) {
+    fs << "{\"p50\": " << lat.p50_
+       << ", \"p99\": " << lat.p99_
+       << ", \"p99.9\": " << lat.p999_
+       << ", \"max\": " << lat.max_ << "}";
+}
+
+void write_json(const std::string& filename,
+                const bench_config& config,
+                const std::vector<step_result>& results)
+{
+    std::ofstream fs;
+    fs.open(filename);
+    if (!fs.good()) {
+        std::cerr << "cannot open " << filename << std::endl;
+        return;
+    }
+
+    fs << "{" << std::endl
+       << "  \"mode\": \""
+       << (config.open_loop_ ? "open-loop" : "closed-loop") << "\"," << std::endl
+       << "  \"threads\": " << config.num_threads_ << "," << std::endl
+       << "  \"payload_size\": " << config.payload_size_ << "," << std::endl
+       << "  \"payload_dist\": \""
+       << payload_dist_name(config.payload_dist_) << "\"," << std::endl
+       << "  \"seed\": " << config.seed_ << "," << std::endl
+       << "  \"steps\": [" << std::endl;
+    for (size_t ii=0; ii<results.size(); ++ii) {
+        const step_result& rr = results[ii];
+        fs << "    {\"target_rate\": " << rr.target_rate_
+           << ", \"ops\": " << rr.num_ops_
+           << ", \"failed\": " << rr.num_failed_
+           << ", \"throughput\": " << rr.throughput_ << "," << std::endl
+           << "     \"latency_us\": ";
+        write_json_latency(fs, rr.lat_);
+        fs << "," << std::endl << "     \"uncorrected_latency_us\": ";
+        write_json_latency(fs, rr.uncorrected_lat_);
+        fs << "," << std::endl << "     \"timeline\": [";
+        for (size_t jj=0; jj<rr.windows_.size(); ++jj) {
+            const window_result& ww = rr.windows_[jj];
+            fs << (jj ? "," : "") << std::endl
+               << "       {\"sec\": " << ww.sec_
+               << ", \"ops\": " << ww.num_ops_
+               << ", \"throughput\": " << ww.throughput_
+               << ", \"latency_us\": ";
+            write_json_latency(fs, ww.lat_);
+            fs << "}";
+        }
+        fs << "]}" << (ii + 1 < results.size() ? "," : "") << std::endl;
+    }
+    fs << "  ]" << std::endl << "}" << std::endl;
+    fs.close();
+}
+
 int bench_main(const bench_config& config) {
     server_stuff stuff;
     stuff.server_id_ = config.srv_id_;
@@ -367,7 +696,7 @@ int bench_main(const bench_config& config) {
 
     print_config(config);
 
-    CHK_Z( init_raft(stuff) );
+    CHK_Z( init_raft(stuff, config) );
     _msg("-----\n");
 
     if (stuff.server_id_ > 1) {
@@ -379,55 +708,58 @@ int bench_main(const bench_config& config) {
     CHK_Z( add_servers(stuff, config) );
     _msg("-----\n");
 
-    worker_params param(config, stuff);
-    std::vector<TestSuite::ThreadHolder> h_workers(config.num_threads_);
-    for (size_t ii=0; ii<h_workers.size(); ++ii) {
-        TestSuite::ThreadHolder& h_worker = h_workers[ii];
-        h_worker.spawn(&param, worker_func, worker_killer_func);
-    }
-
-    TestSuite::Displayer dd(1, 3);
-    dd.init();
-    std::vector<size_t> col_width(3, 15);
-    dd.setWidth(col_width);
-    TestSuite::Timer duration_timer(config.duration_ * 1000);
-    while (!duration_timer.timeout()) {
-        TestSuite::sleep_ms(80);
-        uint64_t cur_us = duration_timer.getTimeUs();
-        if (!cur_us) continue;
-
-        uint64_t cur_ops = param.num_ops_done_;
-
-        dd.set( 0, 0, "%zu/%zu", cur_us / 1000000, config.duration_ );
-        dd.set( 0, 1, "%zu", cur_ops );
-        dd.set( 0, 2, "%s ops/s", TestSuite::throughputStr(cur_ops, cur_us).c_str() );
-        dd.print();
-    }
-    param.stop_signal_ = true;
-
-    for (size_t ii=0; ii<h_workers.size(); ++ii) {
-        TestSuite::ThreadHolder& tt = h_workers[ii];
-        tt.join();
+    std::vector<step_result> results;
+    for (size_t rate: config.get_rates()) {
+        results.push_back( run_step(config, stuff, rate) );
     }
 
     _msg("-----\n");
     TestSuite::_msg("%15s%10s%10s%10s%10s%10s\n",
                     "OP", "p50", "p95", "p99", "p99.9", "p99.99");
 
-    TestSuite::_msg("%15s%10s%10s%10s%10s%10s\n",
-        "replication",
-        TestSuite::usToString
-        ( global_lat.getPercentile("rep", 50) ).c_str(),
-        TestSuite::usToString
-        ( global_lat.getPercentile("rep", 95) ).c_str(),
-        TestSuite::usToString
-        ( global_lat.getPercentile("rep", 99) ).c_str(),
-        TestSuite::usToString
-        ( global_lat.getPercentile("rep", 99.9) ).c_str(),
-        TestSuite::usToString
-        ( global_lat.getPercentile("rep", 99.99) ).c_str());
+    std::vector<std::string> lat_names(1, "rep");
+    if (config.open_loop_) lat_names.push_back("rep_corrected");
+    for (const std::string& lat_name: lat_names) {
+        TestSuite::_msg("%15s%10s%10s%10s%10s%10s\n",
+            lat_name == "rep" ? "replication" : "corrected",
+            TestSuite::usToString
+            ( global_lat.getPercentile(lat_name, 50) ).c_str(),
+            TestSuite::usToString
+            ( global_lat.getPercentile(lat_name, 95) ).c_str(),
+            TestSuite::usToString
+            ( global_lat.getPercentile(lat_name, 99) ).c_str(),
+            TestSuite::usToString
+            ( global_lat.getPercentile(lat_name, 99.9) ).c_str(),
+            TestSuite::usToString
+            ( global_lat.getPercentile(lat_name, 99.99) ).c_str());
+    }
     _msg("-----\n");
 
+    if (results.size() > 1) {
+        // Throughput vs. latency curve.
+        TestSuite::_msg("%12s%12s%10s%10s%10s%10s%8s\n",
+                        "target", "ops/s", "p50", "p99", "p99.9", "max",
+                        "failed");
+        for (const step_result& rr: results) {
+            TestSuite::_msg("%12zu%12.1f%10s%10s%10s%10s%8zu\n",
+                rr.target_rate_,
+                rr.throughput_,
+                TestSuite::usToString(rr.lat_.p50_).c_str(),
+                TestSuite::usToString(rr.lat_.p99_).c_str(),
+                TestSuite::usToString(rr.lat_.p999_).c_str(),
+                TestSuite::usToString(rr.lat_.max_).c_str(),
+                (size_t)rr.num_failed_);
+        }
+        _msg("-----\n");
+    }
+
+    if (!config.csv_path_.empty()) {
+        write_csv(config.csv_path_, results);
+    }
+    if (!config.json_path_.empty()) {
+        write_json(config.json_path_, config, results);
+    }
+
     write_latency_distribution();
 
     return 0;
@@ -445,6 +777,17 @@ void usage(int argc, char** argv) {
     std::endl <<
     "    - Follower:\n" <<
     "    raft_bench <server ID> <address:port>\n" <<
+    std::endl <<
+    "    - Options:\n" <<
+    "    --no-append-batch: append logs to the log store one by one.\n" <<
+    "    --open-loop: issue requests at Poisson arrivals of the target rate,\n"
+    "                 without waiting for the previous ones (leader only).\n" <<
+    "    --rates=<rate1>,<rate2>,...: run each rate for <duration> in turn,\n"
+    "                 instead of <IOPS>.\n" <<
+    "    --payload-dist=fixed|uniform|exp: distribution of payload size,\n"
+    "                 whose mean is <payload size>.\n" <<
+    "    --seed=<seed>: random seed of arrivals and payload sizes.\n" <<
+    "    --csv=<file>, --json=<file>: write results to the file.\n" <<
     std::endl;
 
     std::cout << ss.str();
@@ -456,6 +799,63 @@ bench_config parse_config(int argc, char** argv) {
     // <exec> <server ID> <endpoint> <duration>
     // 4      5             6              7         8
     // <IOPS> <# pipelines> <payload size> <S2 addr> <S3 addr> ...
+    //
+    // Options can be given at any position, exclude them first.
+    bench_config opts;
+    std::vector<char*> args;
+    for (int ii=0; ii<argc; ++ii) {
+        std::string arg = argv[ii];
+        if (arg.compare(0, 2, "--") != 0) {
+            args.push_back(argv[ii]);
+            continue;
+        }
+
+        size_t eq_pos = arg.find('=');
+        std::string key = arg.substr(0, eq_pos);
+        std::string value = (eq_pos == std::string::npos)
+                            ? std::string()
+                            : arg.substr(eq_pos + 1);
+        if (key == "--no-append-batch") {
+            opts.append_batch_ = false;
+        } else if (key == "--open-loop") {
+            opts.open_loop_ = true;
+        } else if (key == "--rates") {
+            std::stringstream ss(value);
+            std::string rate_str;
+            while (std::getline(ss, rate_str, ',')) {
+                size_t rate = atoi( rate_str.c_str() );
+                if (rate < 1 || rate > 1000000) {
+                    std::cout << "valid rate range: 1 - 1M." << std::endl;
+                    exit(0);
+                }
+                opts.rates_.push_back(rate);
+            }
+        } else if (key == "--payload-dist") {
+            if (value == "fixed") {
+                opts.payload_dist_ = bench_config::FIXED;
+            } else if (value == "uniform") {
+                opts.payload_dist_ = bench_config::UNIFORM;
+            } else if (value == "exp") {
+                opts.payload_dist_ = bench_config::EXPONENTIAL;
+            } else {
+                std::cout << "unknown payload distribution: "
+                          << value << std::endl;
+                exit(0);
+            }
+        } else if (key == "--seed") {
+            opts.seed_ = strtoull( value.c_str(), nullptr, 10 );
+        } else if (key == "--csv") {
+            opts.csv_path_ = value;
+        } else if (key == "--json") {
+            opts.json_path_ = value;
+        } else {
+            std::cout << "unknown option: " << arg << std::endl;
+            usage(argc, argv);
+        }
+    }
+    argc = args.size();
+    argv = args.data();
+
     if (argc < 4) usage(argc, argv);
 
     size_t srv_id = atoi( argv[1] );
@@ -477,7 +877,9 @@ bench_config parse_config(int argc, char** argv) {
 
     if (srv_id > 1) {
         // Follower.
-        return bench_config(srv_id, my_endpoint, duration);
+        bench_config ret(srv_id, my_endpoint, duration);
+        ret.append_batch_ = opts.append_batch_;
+        return ret;
     }
 
     if (argc < 7) usage(argc, argv);
@@ -500,7 +902,13 @@ bench_config parse_config(int argc, char** argv) {
         exit(0);
     }
 
-    bench_config ret(srv_id, my_endpoint, duration, iops, num_threads, payload_size);
+    bench_config ret = opts;
+    ret.srv_id_ = srv_id;
+    ret.my_endpoint_ = my_endpoint;
+    ret.duration_ = duration;
+    ret.iops_ = iops;
+    ret.num_threads_ = num_threads;
+    ret.payload_size_ = payload_size;
 
     for (int ii=7; ii<argc; ++ii) {
         std::string cur_endpoint = argv[ii];
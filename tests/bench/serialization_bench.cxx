@@ -0,0 +1,481 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "asio_rpc_codec.hxx"
+#include "buffer_serializer.hxx"
+#include "crc32.hxx"
+#include "handle_append_entries.hxx"
+#include "nuraft.hxx"
+
+#include "test_common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace nuraft;
+
+namespace serialization_bench {
+
+struct bench_config {
+    bench_config()
+        : num_ops_(1000000)
+        , num_repeats_(5)
+        , payload_size_(256)
+        , num_entries_(16)
+        , num_servers_(5)
+        , seed_(0)
+        , cpu_(-1)
+        {}
+
+    // Number of operations in each round.
+    size_t num_ops_;
+
+    // Number of rounds of each case, after one warm-up round.
+    size_t num_repeats_;
+
+    size_t payload_size_;
+
+    // Number of log entries in each request.
+    size_t num_entries_;
+
+    // Number of servers in the cluster config.
+    size_t num_servers_;
+
+    // Random seed of the payload.
+    uint64_t seed_;
+
+    // If non-negative, pin the benchmark thread to the CPU.
+    int cpu_;
+
+    // If not empty, write the result of each case to the CSV file.
+    std::string csv_path_;
+};
+
+// Accumulates results, so that the compiler cannot skip the work.
+static uint64_t sink = 0;
+
+ptr<buffer> make_payload(const bench_config& config, size_t size) {
+    std::mt19937_64 rng(config.seed_);
+    ptr<buffer> ret = buffer::alloc(size);
+    byte* data = ret->data_begin();
+    for (size_t ii = 0; ii < size; ++ii) {
+        data[ii] = (byte)(rng() & 0xff);
+    }
+    return ret;
+}
+
+// Run `func` `num_ops_` times in each round, and report the median
+// latency of the rounds, along with their spread.
+// If `bytes_per_op` is given, also report the throughput in bytes.
+int run_bench(const bench_config& config,
+              const std::string& name,
+              size_t bytes_per_op,
+              const std::function<void()>& func)
+{
+    std::vector<double> ns_per_op;
+    for (size_t rr = 0; rr <= config.num_repeats_; ++rr) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t ii = 0; ii < config.num_ops_; ++ii) {
+            func();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if (rr == 0) {
+            // Warm-up.
+            continue;
+        }
+        uint64_t elapsed_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        ns_per_op.push_back( (double)elapsed_ns / config.num_ops_ );
+    }
+
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    double median = ns_per_op[ns_per_op.size() / 2];
+    double spread = (ns_per_op.back() - ns_per_op.front()) * 100.0 / median;
+
+    std::string bw_str;
+    if (bytes_per_op) {
+        bw_str = ", " +
+                 TestSuite::sizeToString( (uint64_t)( bytes_per_op * 1e9 / median ) ) +
+                 "/s";
+    }
+    TestSuite::_msg("%-40s %10.1f ns/op, %s ops/s%s (spread %.1f%%)\n",
+                    name.c_str(),
+                    median,
+                    TestSuite::countToString( (uint64_t)(1e9 / median) ).c_str(),
+                    bw_str.c_str(),
+                    spread);
+
+    if (!config.csv_path_.empty()) {
+        std::ofstream fs(config.csv_path_, std::ios::app);
+        fs << name << "," << median << ","
+           << ns_per_op.front() << "," << ns_per_op.back() << "\n";
+    }
+    return 0;
+}
+
+int bench_buffer_alloc(const bench_config& config) {
+    // Below and above 32KB, where the size of buffer header changes.
+    for (size_t size: {(size_t)64, config.payload_size_, (size_t)64 * 1024}) {
+        CHK_Z( run_bench( config, "buffer::alloc " + std::to_string(size), 0,
+                          [&]() {
+                              ptr<buffer> buf = buffer::alloc(size);
+                              sink += (uint64_t)buf->size();
+                          } ) );
+    }
+    return 0;
+}
+
+// Fields of a typical message header, plus the payload.
+void put_fields(buffer_serializer& bs, buffer& payload) {
+    bs.pos(0);
+    bs.put_u8(0x0);
+    bs.put_u8(0x1);
+    bs.put_i32(1);
+    bs.put_i32(2);
+    bs.put_u64(10);
+    bs.put_u64(20);
+    bs.put_u64(30);
+    bs.put_u64(40);
+    bs.put_bytes(payload.data_begin(), payload.size());
+}
+
+int bench_buffer_serializer(const bench_config& config) {
+    ptr<buffer> payload = make_payload(config, config.payload_size_);
+    size_t msg_size = 1 * 2 + 4 * 2 + 8 * 4 + 4 + payload->size();
+    ptr<buffer> buf = buffer::alloc(msg_size);
+    buffer_serializer bs(buf);
+
+    CHK_Z( run_bench( config, "buffer_serializer put", msg_size,
+                      [&]() {
+                          put_fields(bs, *payload);
+                          sink += bs.pos();
+                      } ) );
+
+    put_fields(bs, *payload);
+    CHK_Z( run_bench( config, "buffer_serializer get", msg_size,
+                      [&]() {
+                          bs.pos(0);
+                          sink += bs.get_u8();
+                          sink += bs.get_u8();
+                          sink += bs.get_i32();
+                          sink += bs.get_i32();
+                          sink += bs.get_u64();
+                          sink += bs.get_u64();
+                          sink += bs.get_u64();
+                          sink += bs.get_u64();
+                          size_t len = 0;
+                          const byte* data = (const byte*)bs.get_bytes(len);
+                          sink += data[len - 1];
+                      } ) );
+    return 0;
+}
+
+int bench_log_entry(const bench_config& config) {
+    ptr<buffer> payload = make_payload(config, config.payload_size_);
+    ptr<log_entry> le = cs_new<log_entry>(10, payload, log_val_type::app_log, 1234);
+
+    ptr<buffer> serialized = le->serialize();
+    CHK_Z( run_bench( config, "log_entry::serialize", serialized->size(),
+                      [&]() {
+                          ptr<buffer> buf = le->serialize();
+                          sink += buf->size();
+                      } ) );
+
+    CHK_Z( run_bench( config, "log_entry::deserialize", serialized->size(),
+                      [&]() {
+                          serialized->pos(0);
+                          ptr<log_entry> entry = log_entry::deserialize(*serialized);
+                          sink += entry->get_term();
+                      } ) );
+    return 0;
+}
+
+int bench_cluster_config(const bench_config& config) {
+    ptr<cluster_config> c_conf = cs_new<cluster_config>(100, 99);
+    for (size_t ii = 1; ii <= config.num_servers_; ++ii) {
+        c_conf->get_servers().push_back
+            ( cs_new<srv_config>( ii, 0,
+                                  "tcp://10.10.10." + std::to_string(ii) + ":20000",
+                                  "server " + std::to_string(ii),
+                                  false,
+                                  ii == 1 ? 100 : 1 ) );
+    }
+    c_conf->set_user_ctx("user ctx");
+
+    // The same number of servers as the other cases.
+    bench_config local_config = config;
+    local_config.num_ops_ =
+        std::max( (size_t)1, config.num_ops_ / config.num_servers_ );
+
+    ptr<buffer> serialized = c_conf->serialize();
+    CHK_Z( run_bench( local_config,
+                      "cluster_config::serialize " +
+                          std::to_string(config.num_servers_),
+                      serialized->size(),
+                      [&]() {
+                          ptr<buffer> buf = c_conf->serialize();
+                          sink += buf->size();
+                      } ) );
+
+    CHK_Z( run_bench( local_config,
+                      "cluster_config::deserialize " +
+                          std::to_string(config.num_servers_),
+                      serialized->size(),
+                      [&]() {
+                          serialized->pos(0);
+                          ptr<cluster_config> conf =
+                              cluster_config::deserialize(*serialized);
+                          sink += conf->get_log_idx();
+                      } ) );
+    return 0;
+}
+
+int bench_crc32(const bench_config& config) {
+    for (size_t size: {(size_t)64, config.payload_size_, (size_t)64 * 1024}) {
+        ptr<buffer> payload = make_payload(config, size);
+        // The same number of bytes regardless of size.
+        bench_config local_config = config;
+        local_config.num_ops_ =
+            std::max( (size_t)1, config.num_ops_ * 64 / size );
+        CHK_Z( run_bench( local_config, "crc32_8 " + std::to_string(size), size,
+                          [&]() {
+                              sink += crc32_8(payload->data_begin(), size, 0);
+                          } ) );
+    }
+    return 0;
+}
+
+int bench_resp_appendix(const bench_config& config) {
+    resp_appendix appendix;
+    appendix.extra_order_ = resp_appendix::CONFLICT_TERM_HINT;
+    appendix.conflict_term_ = 10;
+    appendix.conflict_term_first_idx_ = 1000;
+    appendix.append_latency_us_ = 123;
+    appendix.append_bytes_ = 4096;
+
+    ptr<buffer> serialized = appendix.serialize();
+    CHK_Z( run_bench( config, "resp_appendix::serialize", serialized->size(),
+                      [&]() {
+                          ptr<buffer> buf = appendix.serialize();
+                          sink += buf->size();
+                      } ) );
+
+    CHK_Z( run_bench( config, "resp_appendix::deserialize", serialized->size(),
+                      [&]() {
+                          ptr<resp_appendix> res =
+                              resp_appendix::deserialize(*serialized);
+                          sink += res->conflict_term_;
+                      } ) );
+    return 0;
+}
+
+int bench_asio_req(const bench_config& config, uint32_t flags, const char* name) {
+    // `num_entries_` log entries of `payload_size_` each.
+    ptr<buffer> payload = make_payload(config, config.payload_size_);
+    uint32_t crc_payload = crc32_8(payload->data_begin(), payload->size(), 0);
+    ptr<req_msg> req = cs_new<req_msg>
+                       ( 10, msg_type::append_entries_request, 1, 2,
+                         10, 1000, 999 );
+    for (size_t ii = 0; ii < config.num_entries_; ++ii) {
+        ptr<buffer> buf = buffer::clone(*payload);
+        req->log_entries().push_back
+            ( cs_new<log_entry>( 10, buf, log_val_type::app_log,
+                                 1234, true, crc_payload, false ) );
+    }
+
+    // The same number of log entries as `bench_log_entry`.
+    bench_config local_config = config;
+    local_config.num_ops_ =
+        std::max( (size_t)1, config.num_ops_ / config.num_entries_ );
+
+    ptr<buffer> encoded = asio_rpc_codec::encode_req(*req, flags, 0, "");
+    size_t data_size = encoded->size() - RPC_REQ_HEADER_SIZE;
+    CHK_Z( run_bench( local_config, std::string("asio encode ") + name, encoded->size(),
+                      [&]() {
+                          ptr<buffer> buf =
+                              asio_rpc_codec::encode_req(*req, flags, 0, "");
+                          sink += buf->size();
+                      } ) );
+
+    // The same as `rpc_session`, which reads the header and the payload
+    // into separate buffers.
+    ptr<buffer> header = buffer::alloc(RPC_REQ_HEADER_SIZE);
+    memcpy(header->data_begin(), encoded->data_begin(), RPC_REQ_HEADER_SIZE);
+    ptr<buffer> log_ctx = buffer::alloc(data_size);
+    memcpy( log_ctx->data_begin(),
+            encoded->data_begin() + RPC_REQ_HEADER_SIZE,
+            data_size );
+
+    std::string meta, err_msg;
+    std::vector<ptr<log_entry>> entries;
+    asio_rpc_codec::req_header hdr;
+    asio_rpc_codec::decode_req_header(*header, hdr);
+    CHK_EQ( (int32)data_size, hdr.data_size_ );
+    CHK_EQ( asio_rpc_codec::OK,
+            asio_rpc_codec::decode_log_entries( *log_ctx, 0, hdr.flags_,
+                                                meta, entries, err_msg ) );
+    CHK_EQ( config.num_entries_, entries.size() );
+
+    CHK_Z( run_bench( local_config, std::string("asio decode ") + name, encoded->size(),
+                      [&]() {
+                          asio_rpc_codec::decode_req_header(*header, hdr);
+                          if (hdr.flags_ & CRC_ON_ENTIRE_MESSAGE) {
+                              sink += crc32_8( log_ctx->data_begin(),
+                                               log_ctx->size(),
+                                               hdr.crc_header_ );
+                          }
+                          entries.clear();
+                          asio_rpc_codec::decode_log_entries
+                              ( *log_ctx, 0, hdr.flags_, meta, entries, err_msg );
+                          sink += entries.size();
+                      } ) );
+    return 0;
+}
+
+int bench_asio_req_default(const bench_config& config) {
+    return bench_asio_req(config, 0x0, "default");
+}
+
+int bench_asio_req_crc(const bench_config& config) {
+    // Timestamp and CRC on both each log entry and the entire message.
+    return bench_asio_req( config,
+                           INCLUDE_LOG_TIMESTAMP |
+                               CRC_ON_PAYLOAD |
+                               CRC_ON_ENTIRE_MESSAGE,
+                           "ts+crc" );
+}
+
+void usage(int argc, char** argv) {
+    std::stringstream ss;
+    ss <<
+    "Usage: \n" <<
+    "    serialization_bench [options] [-f <case name>]\n" <<
+    std::endl <<
+    "    - Options:\n" <<
+    "    --ops=<N>: number of operations in each round (default: 1000000).\n" <<
+    "    --repeat=<N>: number of rounds after warm-up, the median is\n"
+    "                  reported (default: 5).\n" <<
+    "    --payload=<bytes>: payload size (default: 256).\n" <<
+    "    --entries=<N>: number of log entries in each request (default: 16).\n" <<
+    "    --servers=<N>: number of servers in cluster config (default: 5).\n" <<
+    "    --seed=<seed>: random seed of the payload (default: 0).\n" <<
+    "    --cpu=<ID>: pin the benchmark thread to the given CPU.\n" <<
+    "    --csv=<path>: write the result of each case to the file.\n" <<
+    std::endl;
+
+    std::cout << ss.str();
+    exit(0);
+}
+
+bench_config parse_config(int argc, char** argv) {
+    bench_config ret;
+    for (int ii=1; ii<argc; ++ii) {
+        std::string arg = argv[ii];
+        if (arg == "-f" || arg == "--filter") {
+            // Handled by `TestSuite`.
+            ++ii;
+            continue;
+        }
+
+        size_t eq_pos = arg.find('=');
+        std::string key = arg.substr(0, eq_pos);
+        std::string value = (eq_pos == std::string::npos)
+                            ? std::string()
+                            : arg.substr(eq_pos + 1);
+        size_t num = atoi( value.c_str() );
+
+        if (key == "--ops") {
+            ret.num_ops_ = num;
+        } else if (key == "--repeat") {
+            ret.num_repeats_ = num;
+        } else if (key == "--payload") {
+            ret.payload_size_ = num;
+        } else if (key == "--entries") {
+            ret.num_entries_ = num;
+        } else if (key == "--servers") {
+            ret.num_servers_ = num;
+        } else if (key == "--seed") {
+            ret.seed_ = strtoull( value.c_str(), nullptr, 10 );
+        } else if (key == "--cpu") {
+            ret.cpu_ = atoi( value.c_str() );
+        } else if (key == "--csv") {
+            ret.csv_path_ = value;
+        } else {
+            // Including `--usage`.
+            usage(argc, argv);
+        }
+    }
+
+    if ( !ret.num_ops_ || !ret.num_repeats_ ||
+         !ret.payload_size_ || !ret.num_entries_ || !ret.num_servers_ ) {
+        usage(argc, argv);
+    }
+    return ret;
+}
+
+void pin_thread(const bench_config& config) {
+    if (config.cpu_ < 0) return;
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(config.cpu_, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset)) {
+        TestSuite::_msg("failed to pin the thread to CPU %d\n", config.cpu_);
+    }
+#else
+    TestSuite::_msg("pinning the thread is not supported on this platform\n");
+#endif
+}
+
+}; // namespace serialization_bench;
+using namespace serialization_bench;
+
+int main(int argc, char** argv) {
+    TestSuite ts(argc, argv);
+
+    bench_config config = parse_config(argc, argv);
+    pin_thread(config);
+    if (!config.csv_path_.empty()) {
+        std::ofstream fs(config.csv_path_);
+        fs << "case,median_ns,min_ns,max_ns\n";
+    }
+
+    ts.options.printTestMessage = true;
+
+    ts.doTest("buffer alloc", bench_buffer_alloc, config);
+    ts.doTest("buffer serializer", bench_buffer_serializer, config);
+    ts.doTest("log entry", bench_log_entry, config);
+    ts.doTest("cluster config", bench_cluster_config, config);
+    ts.doTest("crc32", bench_crc32, config);
+    ts.doTest("resp appendix", bench_resp_appendix, config);
+    ts.doTest("asio request default", bench_asio_req_default, config);
+    ts.doTest("asio request crc", bench_asio_req_crc, config);
+
+    // Not to be optimized out.
+    TestSuite::_msg("checksum: %" PRIu64 "\n", sink);
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "stat_mgr.hxx"
+
+#include "test_common.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace nuraft;
+
+namespace stat_bench {
+
+struct bench_config {
+    bench_config(size_t _num_threads = 8,
+                 size_t _num_ops = 10 * 1000 * 1000)
+        : num_threads_(_num_threads)
+        , num_ops_(_num_ops)
+        {}
+
+    size_t num_threads_;
+    size_t num_ops_;
+};
+
+// Run `func` `num_ops_` times on each thread, and report the throughput.
+int run_bench(const bench_config& config,
+              const char* name,
+              const std::function<void(uint64_t)>& func)
+{
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < config.num_threads_; ++ii) {
+        threads.push_back( std::thread([&]() {
+            while (!start) std::this_thread::yield();
+            for (size_t jj = 0; jj < config.num_ops_; ++jj) {
+                func(jj);
+            }
+        }) );
+    }
+
+    TestSuite::Timer timer;
+    start = true;
+    for (std::thread& tt: threads) tt.join();
+    uint64_t elapsed_us = timer.getTimeUs();
+
+    TestSuite::_msg("%s, %zu threads: %s ops/s\n",
+                    name,
+                    config.num_threads_,
+                    TestSuite::throughputStr( config.num_ops_ * config.num_threads_,
+                                              elapsed_us ).c_str());
+    return 0;
+}
+
+// The previous implementation of `stat_elem`: a single atomic variable.
+int bench_atomic_counter(const bench_config& config) {
+    std::atomic<int64_t> counter(0);
+    CHK_Z( run_bench( config, "atomic counter",
+                      [&](uint64_t) {
+                          counter.fetch_add(1, std::memory_order_relaxed);
+                      } ) );
+    CHK_EQ( (int64_t)(config.num_ops_ * config.num_threads_), counter.load() );
+    return 0;
+}
+
+int bench_sharded_counter(const bench_config& config) {
+    sharded_counter counter;
+    CHK_Z( run_bench( config, "sharded counter",
+                      [&](uint64_t) {
+                          counter.add(1);
+                      } ) );
+    CHK_EQ( (int64_t)(config.num_ops_ * config.num_threads_), counter.get() );
+    return 0;
+}
+
+// The previous implementation of `stat_elem`: a single histogram,
+// whose count, sum, and max are updated by every `add`.
+int bench_atomic_histogram(const bench_config& config) {
+    HdrHistogram hist;
+    CHK_Z( run_bench( config, "atomic histogram",
+                      [&](uint64_t val) {
+                          hist.add(val);
+                      } ) );
+    CHK_EQ( config.num_ops_ * config.num_threads_, hist.getTotal() );
+    return 0;
+}
+
+int bench_sharded_histogram(const bench_config& config) {
+    sharded_histogram hist;
+    CHK_Z( run_bench( config, "sharded histogram",
+                      [&](uint64_t val) {
+                          hist.add(val);
+                      } ) );
+    CHK_EQ( config.num_ops_ * config.num_threads_, hist.get().getTotal() );
+    return 0;
+}
+
+void usage(int argc, char** argv) {
+    std::stringstream ss;
+    ss <<
+    "Usage: \n" <<
+    "    stat_bench [<# threads> [<# operations per thread>]]\n" <<
+    std::endl;
+
+    std::cout << ss.str();
+    exit(0);
+}
+
+bench_config parse_config(int argc, char** argv) {
+    bench_config ret;
+    if (argc > 1) {
+        if (std::string(argv[1]) == "-h") usage(argc, argv);
+        ret.num_threads_ = atoi(argv[1]);
+    }
+    if (argc > 2) ret.num_ops_ = atoi(argv[2]);
+
+    if (!ret.num_threads_ || !ret.num_ops_) {
+        usage(argc, argv);
+    }
+    return ret;
+}
+
+}; // namespace stat_bench;
+using namespace stat_bench;
+
+int main(int argc, char** argv) {
+    TestSuite ts(argc, argv);
+
+    bench_config config = parse_config(argc, argv);
+
+    ts.options.printTestMessage = true;
+
+    ts.doTest("atomic counter", bench_atomic_counter, config);
+    ts.doTest("sharded counter", bench_sharded_counter, config);
+    ts.doTest("atomic histogram", bench_atomic_histogram, config);
+    ts.doTest("sharded histogram", bench_sharded_histogram, config);
+
+    return 0;
+}
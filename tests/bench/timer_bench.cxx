@@ -0,0 +1,198 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "nuraft.hxx"
+
+#include "test_common.h"
+
+#include <atomic>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace nuraft;
+
+namespace timer_bench {
+
+struct bench_config {
+    bench_config(size_t _num_timers = 10000,
+                 size_t _duration = 10,
+                 size_t _tick_ms = 10,
+                 size_t _num_threads = 4)
+        : num_timers_(_num_timers)
+        , duration_(_duration)
+        , tick_ms_(_tick_ms)
+        , num_threads_(_num_threads)
+        {}
+
+    size_t num_timers_;
+    size_t duration_;
+    size_t tick_ms_;
+    size_t num_threads_;
+};
+
+// Timer re-scheduling itself on every expiry, like heartbeat.
+struct bench_timer {
+    bench_timer(delayed_task_scheduler* sched,
+                int32 interval_ms,
+                std::atomic<uint64_t>* num_fired)
+        : sched_(sched)
+        , interval_ms_(interval_ms)
+        , num_fired_(num_fired)
+    {
+        timer_task<void>::executor exec = std::bind(&bench_timer::on_fire, this);
+        task_ = cs_new< timer_task<void> >(exec);
+    }
+
+    void on_fire() {
+        num_fired_->fetch_add(1);
+        sched_->schedule(task_, interval_ms_);
+    }
+
+    delayed_task_scheduler* sched_;
+    int32 interval_ms_;
+    std::atomic<uint64_t>* num_fired_;
+    ptr<delayed_task> task_;
+};
+
+uint64_t get_cpu_time_us() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t)ru.ru_utime.tv_sec * 1000000 + ru.ru_utime.tv_usec +
+           (uint64_t)ru.ru_stime.tv_sec * 1000000 + ru.ru_stime.tv_usec;
+}
+
+int bench_scheduler(const bench_config& config, bool use_timer_wheel) {
+    asio_service::options asio_opt;
+    asio_opt.thread_pool_size_ = config.num_threads_;
+    if (use_timer_wheel) {
+        asio_opt.timer_wheel_tick_ms_ = config.tick_ms_;
+    }
+    ptr<asio_service> svc = cs_new<asio_service>(asio_opt);
+
+    std::atomic<uint64_t> num_fired(0);
+    std::vector< ptr<bench_timer> > timers(config.num_timers_);
+    for (size_t ii = 0; ii < config.num_timers_; ++ii) {
+        // 50 ~ 149 ms, a typical range of heartbeat interval.
+        int32 interval_ms = 50 + (ii % 100);
+        timers[ii] = cs_new<bench_timer>(svc.get(), interval_ms, &num_fired);
+    }
+
+    // === Phase 1: re-arming pending timers, like election timer reset.
+    const size_t NUM_ROUNDS = 20;
+    TestSuite::Timer timer;
+    for (size_t rr = 0; rr < NUM_ROUNDS; ++rr) {
+        for (size_t ii = 0; ii < config.num_timers_; ++ii) {
+            // Long enough not to fire.
+            svc->schedule(timers[ii]->task_, 60 * 1000);
+        }
+    }
+    uint64_t schedule_us = timer.getTimeUs();
+    uint64_t num_schedules = NUM_ROUNDS * config.num_timers_;
+
+    timer.reset();
+    for (size_t ii = 0; ii < config.num_timers_; ++ii) {
+        svc->cancel(timers[ii]->task_);
+    }
+    uint64_t cancel_us = timer.getTimeUs();
+
+    // === Phase 2: all timers active, each re-schedules itself.
+    for (size_t ii = 0; ii < config.num_timers_; ++ii) {
+        svc->schedule(timers[ii]->task_, timers[ii]->interval_ms_);
+    }
+    uint64_t cpu_begin_us = get_cpu_time_us();
+    timer.reset();
+    TestSuite::sleep_sec(config.duration_, "running");
+    uint64_t elapsed_us = timer.getTimeUs();
+    uint64_t cpu_us = get_cpu_time_us() - cpu_begin_us;
+    uint64_t fired = num_fired.load();
+
+    for (size_t ii = 0; ii < config.num_timers_; ++ii) {
+        svc->cancel(timers[ii]->task_);
+    }
+    svc->stop();
+    size_t count = 0;
+    while (svc->get_active_workers() && count < 100) {
+        TestSuite::sleep_ms(10);
+        count++;
+    }
+    timers.clear();
+
+    TestSuite::_msg("%s, %zu active timers\n",
+                    use_timer_wheel ? "timer wheel" : "asio timer",
+                    config.num_timers_);
+    TestSuite::_msg("  schedule: %s ops/s\n",
+                    TestSuite::throughputStr(num_schedules, schedule_us).c_str());
+    TestSuite::_msg("  cancel: %s ops/s\n",
+                    TestSuite::throughputStr(config.num_timers_, cancel_us).c_str());
+    TestSuite::_msg("  fired: %s ops/s\n",
+                    TestSuite::throughputStr(fired, elapsed_us).c_str());
+    TestSuite::_msg("  CPU usage: %.1f%%\n",
+                    (double)cpu_us * 100 / elapsed_us);
+
+    return 0;
+}
+
+int bench_asio_timer(const bench_config& config) {
+    return bench_scheduler(config, false);
+}
+
+int bench_timer_wheel(const bench_config& config) {
+    return bench_scheduler(config, true);
+}
+
+void usage(int argc, char** argv) {
+    std::stringstream ss;
+    ss <<
+    "Usage: \n" <<
+    "    timer_bench [<# timers> [<duration> [<tick ms> [<# threads>]]]]\n" <<
+    std::endl;
+
+    std::cout << ss.str();
+    exit(0);
+}
+
+bench_config parse_config(int argc, char** argv) {
+    bench_config ret;
+    if (argc > 1) {
+        if (std::string(argv[1]) == "-h") usage(argc, argv);
+        ret.num_timers_ = atoi(argv[1]);
+    }
+    if (argc > 2) ret.duration_ = atoi(argv[2]);
+    if (argc > 3) ret.tick_ms_ = atoi(argv[3]);
+    if (argc > 4) ret.num_threads_ = atoi(argv[4]);
+
+    if (!ret.num_timers_ || !ret.duration_ || !ret.tick_ms_ || !ret.num_threads_) {
+        usage(argc, argv);
+    }
+    return ret;
+}
+
+}; // namespace timer_bench;
+using namespace timer_bench;
+
+int main(int argc, char** argv) {
+    TestSuite ts(argc, argv);
+
+    bench_config config = parse_config(argc, argv);
+
+    ts.options.printTestMessage = true;
+
+    ts.doTest("asio timer", bench_asio_timer, config);
+    ts.doTest("timer wheel", bench_timer_wheel, config);
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "batch_size_controller.hxx"
+
+#include "test_common.h"
+
+using namespace nuraft;
+
+namespace batch_size_controller_test {
+
+// Latency = `fixed_us` + 1 us per 100 bytes.
+void add_samples(batch_size_controller& bsc, uint64_t fixed_us) {
+    const uint64_t SIZES[] = {10000, 20000, 40000};
+    for (size_t ii = 0; ii < 30; ++ii) {
+        uint64_t bytes = SIZES[ii % 3];
+        bsc.on_append_latency(bytes, fixed_us + bytes / 100);
+    }
+}
+
+int fast_follower_test() {
+    batch_size_controller bsc;
+    CHK_Z( bsc.get_batch_size(500) );
+    CHK_Z( bsc.get_avg_latency_us() );
+
+    add_samples(bsc, 50);
+    // (500 - 50) * 100 bytes.
+    int64_t size = bsc.get_batch_size(500);
+    TestSuite::_msg("batch size %ld\n", (long)size);
+    CHK_GTEQ(size, 44000);
+    CHK_SMEQ(size, 46000);
+    CHK_GT(bsc.get_avg_latency_us(), 50);
+
+    // Smaller target, smaller batch.
+    CHK_SM( bsc.get_batch_size(200), size );
+    return 0;
+}
+
+int slow_follower_test() {
+    batch_size_controller bsc;
+    // Fixed cost exceeds the target, not limited.
+    add_samples(bsc, 5000);
+    CHK_Z( bsc.get_batch_size(500) );
+    // Reachable target.
+    CHK_GT( bsc.get_batch_size(6000), 0 );
+    return 0;
+}
+
+int uniform_size_test() {
+    batch_size_controller bsc;
+    // All the same size: fixed cost is unknown, assumed 0.
+    for (size_t ii = 0; ii < 10; ++ii) {
+        bsc.on_append_latency(10000, 200);
+    }
+    int64_t size = bsc.get_batch_size(500);
+    CHK_GTEQ(size, 24000);
+    CHK_SMEQ(size, 26000);
+
+    // Too slow per byte, minimum size.
+    batch_size_controller bsc2;
+    for (size_t ii = 0; ii < 10; ++ii) {
+        bsc2.on_append_latency(1000, 490);
+    }
+    CHK_EQ( batch_size_controller::MIN_BATCH_SIZE, bsc2.get_batch_size(500) );
+    return 0;
+}
+
+}  // namespace batch_size_controller_test;
+using namespace batch_size_controller_test;
+
+int main(int argc, char** argv) {
+    TestSuite ts(argc, argv);
+
+    ts.options.printTestMessage = false;
+
+    ts.doTest( "fast follower test",
+               fast_follower_test );
+
+    ts.doTest( "slow follower test",
+               slow_follower_test );
+
+    ts.doTest( "uniform size test",
+               uniform_size_test );
+
+    return 0;
+}
@@ -186,6 +186,107 @@ int simple_conflict_test() {
     return 0;
 }
 
+int conflict_term_backtracking_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    raft_params custom_params;
+    custom_params.election_timeout_lower_bound_ = 0;
+    custom_params.election_timeout_upper_bound_ = 1000;
+    custom_params.heart_beat_interval_ = 500;
+    custom_params.snapshot_distance_ = 1000;
+    custom_params.return_method_ = raft_params::async_handler;
+    CHK_Z( launch_servers( pkgs, &custom_params ) );
+    CHK_Z( make_group( pkgs ) );
+
+    const size_t NUM = 10;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s1.raftServer->append_entries( {msg} );
+    }
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        s1.fNet->execReqResp();
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // Append many messages to S1, which will not be replicated.
+    const size_t MORE1 = 100;
+    for (size_t ii=NUM; ii<NUM+MORE1; ++ii) {
+        std::string test_msg = "more" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s1.raftServer->append_entries( {msg} );
+    }
+
+    // S2 becomes the new leader with the help of S3.
+    s2.dbgLog(" --- S2 will start leader election ---");
+    s2.fTimer->invoke( timer_task_type::election_timer );
+    s3.fTimer->invoke( timer_task_type::election_timer );
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_TRUE( s2.raftServer->is_leader() );
+
+    // Let S2 append diverged messages, whose indexes
+    // overlap with the uncommitted logs of S1.
+    s2.fNet->makeReqFailAll( s1_addr );
+    s2.fNet->makeReqFailAll( s3_addr );
+    const size_t MORE2 = 50;
+    for (size_t ii=NUM; ii<NUM+MORE2; ++ii) {
+        std::string test_msg = "diverged" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s2.raftServer->append_entries( {msg} );
+    }
+    s2.fNet->makeReqFailAll( s1_addr );
+    s2.fNet->makeReqFailAll( s3_addr );
+    CHK_GT( s1.getTestMgr()->load_log_store()->next_slot(),
+            s2.getTestMgr()->load_log_store()->next_slot() );
+
+    // S1 is rejected due to its stale term.
+    s1.fNet->execReqResp();
+
+    // Without the conflicting term hint, S2 rewinds the next index of S1
+    // one by one, which requires about `MORE2` rounds. With the hint,
+    // the entire divergent term is skipped at once.
+    s2.dbgLog(" --- S2 starts to replicate ---");
+    s2.fTimer->invoke( timer_task_type::heartbeat_timer );
+    for (size_t ii = 0; ii < 5; ++ii) {
+        s2.fNet->execReqResp();
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    CHK_EQ( s2.getTestMgr()->load_log_store()->next_slot(),
+            s1.getTestMgr()->load_log_store()->next_slot() );
+    CHK_EQ( s2.getTestMgr()->load_log_store()->next_slot(),
+            s3.getTestMgr()->load_log_store()->next_slot() );
+    CHK_OK( s1.getTestSm()->isSame( *s2.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s2.getTestSm() ) );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
 int rmv_not_resp_srv_wq_test(bool explicit_failure) {
     // * Remove server that is not responding.
     // * Can reach quorum.
@@ -610,6 +711,9 @@ int main(int argc, char** argv) {
     ts.doTest( "simple conflict test",
                simple_conflict_test );
 
+    ts.doTest( "conflict term backtracking test",
+               conflict_term_backtracking_test );
+
     ts.doTest( "remove not responding server with quorum test",
                rmv_not_resp_srv_wq_test,
                TestRange<bool>({false, true}) );
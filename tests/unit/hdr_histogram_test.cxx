@@ -0,0 +1,181 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "hdr_histogram.h"
+
+#include "test_common.h"
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace hdr_histogram_test {
+
+int bucket_bounds_test() {
+    for (int precision: {1, 3, 5, 8}) {
+        HdrHistogram hist(precision);
+        double max_error = 1.0 / (1 << precision);
+
+        std::vector<uint64_t> values = {0, 1, 2, 63, 64, 65, 1000, 123456789,
+                                        std::numeric_limits<uint64_t>::max()};
+        for (size_t ii = 0; ii < 64; ++ii) {
+            values.push_back( (uint64_t)1 << ii );
+            values.push_back( ((uint64_t)1 << ii) + 1 );
+        }
+
+        for (uint64_t val: values) {
+            HdrHistItr itr(hist.getIdx(val), &hist);
+            uint64_t lower = itr.getLowerBound();
+            uint64_t upper = itr.getUpperBound();
+            CHK_GTEQ(val, lower);
+            CHK_SMEQ(val, upper);
+            CHK_SMEQ( (double)(upper - lower), (double)lower * max_error );
+
+            // Exact below `2^(precision + 1)`.
+            if (val < ((uint64_t)2 << precision)) {
+                CHK_EQ(val, lower);
+                CHK_EQ(val, upper);
+            }
+        }
+    }
+    return 0;
+}
+
+int percentile_accuracy_test() {
+    // Uniform 1..100000: percentile `p` is `p * 1000`.
+    HdrHistogram hist;
+    const uint64_t NUM = 100000;
+    for (uint64_t ii = 1; ii <= NUM; ++ii) hist.add(ii);
+
+    CHK_EQ(NUM, hist.getTotal());
+    CHK_EQ(NUM * (NUM + 1) / 2, hist.getSum());
+    CHK_EQ(NUM, hist.getMax());
+    CHK_EQ(NUM, hist.estimate(100));
+    CHK_EQ(1, hist.estimate(0));
+
+    for (double pct: {1.0, 10.0, 50.0, 90.0, 99.0, 99.9, 99.99}) {
+        double exp = pct * NUM / 100;
+        double est = hist.estimate(pct);
+        TestSuite::_msg("p%.2f: %.0f, expected %.0f\n", pct, est, exp);
+        CHK_SMEQ( std::abs(est - exp), exp / 32 + 1 );
+    }
+
+    size_t num_buckets = 0;
+    uint64_t count_sum = 0;
+    for (HdrHistItr& entry: hist) {
+        CHK_GT(entry.getCount(), 0);
+        num_buckets++;
+        count_sum += entry.getCount();
+    }
+    CHK_EQ(NUM, count_sum);
+    TestSuite::_msg("%zu non-empty buckets\n", num_buckets);
+
+    return 0;
+}
+
+int merge_subtract_test() {
+    std::mt19937_64 rng(0);
+    std::lognormal_distribution<double> dist(8, 2);
+
+    HdrHistogram hist1, hist2, all;
+    const size_t NUM = 10000;
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        uint64_t val = (uint64_t)dist(rng);
+        ( (ii % 2) ? hist1 : hist2 ).add(val);
+        all.add(val);
+    }
+
+    HdrHistogram merged = hist1 + hist2;
+    CHK_EQ(all.getTotal(), merged.getTotal());
+    CHK_EQ(all.getSum(), merged.getSum());
+    CHK_EQ(all.getMax(), merged.getMax());
+    for (double pct: {50.0, 99.0, 99.9}) {
+        CHK_EQ(all.estimate(pct), merged.estimate(pct));
+    }
+
+    // Window: `all` minus its earlier part is the later part.
+    HdrHistogram window = all - hist1;
+    CHK_EQ(hist2.getTotal(), window.getTotal());
+    CHK_EQ(hist2.getSum(), window.getSum());
+    CHK_SMEQ(hist2.getMax(), window.getMax());
+    for (double pct: {50.0, 99.0}) {
+        CHK_EQ(hist2.estimate(pct), window.estimate(pct));
+    }
+
+    // Nothing left.
+    window -= hist2;
+    CHK_EQ(0, window.getTotal());
+    CHK_EQ(0, window.getMax());
+    CHK_TRUE( window.begin() == window.end() );
+
+    // Different precision: merged at the lower bounds of buckets.
+    HdrHistogram coarse(2);
+    coarse += all;
+    CHK_EQ(all.getTotal(), coarse.getTotal());
+    uint64_t exp = all.estimate(99);
+    CHK_SMEQ( std::abs((double)coarse.estimate(99) - exp), exp / 4.0 + 1 );
+
+    return 0;
+}
+
+int concurrent_add_test() {
+    HdrHistogram hist;
+    const size_t NUM_THREADS = 4;
+    const size_t NUM = 100000;
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < NUM_THREADS; ++ii) {
+        threads.push_back( std::thread([&hist, ii]() {
+            for (size_t jj = 1; jj <= NUM; ++jj) hist.add(jj * (ii + 1));
+        }) );
+    }
+    for (std::thread& tt: threads) tt.join();
+
+    CHK_EQ(NUM * NUM_THREADS, hist.getTotal());
+    CHK_EQ(NUM * NUM_THREADS, hist.getMax());
+
+    uint64_t count_sum = 0;
+    for (HdrHistItr& entry: hist) count_sum += entry.getCount();
+    CHK_EQ(NUM * NUM_THREADS, count_sum);
+
+    hist.clear();
+    CHK_EQ(0, hist.getTotal());
+    CHK_TRUE( hist.begin() == hist.end() );
+    return 0;
+}
+
+}  // namespace hdr_histogram_test;
+using namespace hdr_histogram_test;
+
+int main(int argc, char** argv) {
+    TestSuite ts(argc, argv);
+
+    ts.options.printTestMessage = true;
+
+    ts.doTest( "bucket bounds test",
+               bucket_bounds_test );
+
+    ts.doTest( "percentile accuracy test",
+               percentile_accuracy_test );
+
+    ts.doTest( "merge subtract test",
+               merge_subtract_test );
+
+    ts.doTest( "concurrent add test",
+               concurrent_add_test );
+
+    return 0;
+}
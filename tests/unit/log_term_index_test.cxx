@@ -0,0 +1,119 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "log_term_index.hxx"
+
+#include "test_common.h"
+
+using namespace nuraft;
+
+namespace log_term_index_test {
+
+int append_lookup_test() {
+    log_term_index idx;
+    ulong term = 0;
+    CHK_FALSE( idx.get_term(1, term) );
+
+    // Log 1-10: term 1, 11-20: term 3, 21-25: term 4.
+    for (ulong ii = 1; ii <= 10; ++ii) idx.append(ii, 1);
+    idx.append(11, 3, 10);
+    idx.append(21, 4, 5);
+    CHK_EQ(3, idx.num_runs());
+
+    CHK_TRUE( idx.get_term(1, term) );
+    CHK_EQ(1, term);
+    CHK_TRUE( idx.get_term(10, term) );
+    CHK_EQ(1, term);
+    CHK_TRUE( idx.get_term(11, term) );
+    CHK_EQ(3, term);
+    CHK_TRUE( idx.get_term(25, term) );
+    CHK_EQ(4, term);
+    CHK_FALSE( idx.get_term(0, term) );
+    CHK_FALSE( idx.get_term(26, term) );
+
+    ulong found = 0;
+    CHK_TRUE( idx.lower_bound(2, 1, 25, found) );
+    CHK_EQ(11, found);
+    CHK_TRUE( idx.lower_bound(3, 15, 25, found) );
+    CHK_EQ(15, found);
+    CHK_TRUE( idx.lower_bound(5, 1, 25, found) );
+    CHK_EQ(26, found);
+    CHK_TRUE( idx.lower_bound(4, 1, 18, found) );
+    CHK_EQ(19, found);
+    // Not covered.
+    CHK_FALSE( idx.lower_bound(4, 1, 26, found) );
+
+    return 0;
+}
+
+int truncate_compact_test() {
+    log_term_index idx;
+    idx.append(1, 1, 10);
+    idx.append(11, 2, 10);
+    idx.append(21, 3, 10);
+
+    // Overwrite from 15, as `write_at` does.
+    idx.append(15, 4);
+    CHK_EQ(3, idx.num_runs());
+    ulong term = 0;
+    CHK_TRUE( idx.get_term(14, term) );
+    CHK_EQ(2, term);
+    CHK_TRUE( idx.get_term(15, term) );
+    CHK_EQ(4, term);
+    CHK_FALSE( idx.get_term(16, term) );
+
+    idx.truncate(11);
+    CHK_EQ(1, idx.num_runs());
+    CHK_FALSE( idx.get_term(11, term) );
+
+    idx.append(11, 5, 10);
+    idx.compact(12);
+    CHK_EQ(1, idx.num_runs());
+    CHK_FALSE( idx.get_term(12, term) );
+    CHK_TRUE( idx.get_term(13, term) );
+    CHK_EQ(5, term);
+
+    // Compact beyond the end (e.g., snapshot installation),
+    // then append after the gap.
+    idx.compact(100);
+    CHK_EQ(0, idx.num_runs());
+    idx.append(101, 6);
+    CHK_TRUE( idx.get_term(101, term) );
+    CHK_EQ(6, term);
+
+    idx.append(200, 7);
+    CHK_EQ(1, idx.num_runs());
+    CHK_FALSE( idx.get_term(101, term) );
+
+    return 0;
+}
+
+}  // namespace log_term_index_test;
+using namespace log_term_index_test;
+
+int main(int argc, char** argv) {
+    TestSuite ts(argc, argv);
+
+    ts.options.printTestMessage = false;
+
+    ts.doTest( "append and lookup test",
+               append_lookup_test );
+
+    ts.doTest( "truncate and compact test",
+               truncate_compact_test );
+
+    return 0;
+}
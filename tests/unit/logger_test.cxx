@@ -22,10 +22,14 @@ limitations under the License.
 #include "tracer.hxx"
 
 #include "test_common.h"
+#include <condition_variable>
 #include <cstddef>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace nuraft;
 
@@ -94,6 +98,283 @@ int logger_long_line_test() {
     return 0;
 }
 
+class RecordingLogger : public nuraft::logger {
+public:
+    struct entry {
+        int level_;
+        std::string msg_;
+        bool deferred_;
+        uint64_t timestamp_us_;
+        uint64_t thread_id_;
+    };
+
+    RecordingLogger() : level_(6) {}
+
+    void put_details(int level,
+                     const char* source_file,
+                     const char* func_name,
+                     size_t line_number,
+                     const std::string& msg) override {
+        std::lock_guard<std::mutex> l(lock_);
+        entries_.push_back( entry{level, msg, false, 0, 0} );
+    }
+
+    void put_deferred_details(int level,
+                              const char* source_file,
+                              const char* func_name,
+                              size_t line_number,
+                              uint64_t timestamp_us,
+                              uint64_t thread_id,
+                              const std::string& msg) override {
+        std::lock_guard<std::mutex> l(lock_);
+        entries_.push_back( entry{level, msg, true, timestamp_us, thread_id} );
+    }
+
+    void set_level(int l) override { level_ = l; }
+
+    int get_level() override { return level_; }
+
+    std::vector<entry> get_entries() {
+        std::lock_guard<std::mutex> l(lock_);
+        return entries_;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> l(lock_);
+        entries_.clear();
+    }
+
+private:
+    int level_;
+    std::mutex lock_;
+    std::vector<entry> entries_;
+};
+
+// Put the same log to a normal logger and a binary logger,
+// and compare the results.
+#define CHK_SAME_LOG(...) \
+    { \
+        direct->clear(); \
+        sink->clear(); \
+        { nuraft::logger* l_ = direct.get(); p_db(__VA_ARGS__); } \
+        { nuraft::logger* l_ = binary.get(); p_db(__VA_ARGS__); } \
+        binary->flush(); \
+        CHK_EQ(1, direct->get_entries().size()); \
+        CHK_EQ(1, sink->get_entries().size()); \
+        CHK_TRUE(sink->get_entries()[0].deferred_); \
+        CHK_EQ(direct->get_entries()[0].msg_, sink->get_entries()[0].msg_); \
+    }
+
+int binary_logger_format_test() {
+    ptr<RecordingLogger> direct = cs_new<RecordingLogger>();
+    ptr<RecordingLogger> sink = cs_new<RecordingLogger>();
+    ptr<binary_logger> binary = cs_new<binary_logger>(sink);
+
+    int32_t i32 = -12345;
+    uint32_t u32 = 4000000000U;
+    uint64_t u64 = 18446744073709551615ULL;
+    int64_t i64 = -9223372036854775807LL;
+    size_t sz = 1234567;
+    double dd = 3.14159265;
+    const char* str = "hello";
+    std::string long_str(1000, 'x');
+    char buf[16] = "array";
+    void* ptr = &i32;
+
+    CHK_SAME_LOG("no argument");
+    CHK_SAME_LOG("with newline\n");
+    CHK_SAME_LOG("%d %u %" PRIu64 " %" PRId64, i32, u32, u64, i64);
+    CHK_SAME_LOG("%zu %5d|%-5d|%05d %x %X %o", sz, 42, 42, 42, 255, 255, 8);
+    // Negative integers in their original sizes.
+    CHK_SAME_LOG("%x %u %o %hx", i32, i32, i32, (short)-2);
+    CHK_SAME_LOG("%f %.2f %10.3e %g", dd, dd, dd, dd);
+    CHK_SAME_LOG("%s %10s|%-10s|%.3s %s", str, str, str, str, buf);
+    CHK_SAME_LOG("%c%c 100%% %p", 'o', 'k', ptr);
+    CHK_SAME_LOG("%*d %.*f", 8, 7, 2, dd);
+    CHK_SAME_LOG("%s %d", long_str.c_str(), 1);
+    CHK_SAME_LOG("%s", (int)sizeof(buf) > 0 ? "yes" : "no");
+
+    binary->shutdown();
+    return 0;
+}
+
+int binary_logger_level_test() {
+    ptr<RecordingLogger> sink = cs_new<RecordingLogger>();
+    sink->set_level(4);
+
+    // Background thread will not flush within the test.
+    binary_logger::options opt;
+    opt.flush_interval_ms_ = 60 * 1000;
+    ptr<binary_logger> binary = cs_new<binary_logger>(sink, opt);
+    CHK_EQ(4, binary->get_level());
+
+    ptr<logger> l_ = binary;
+    p_db("filtered %d", 1);
+    p_in("deferred %d", 2);
+    CHK_Z( sink->get_entries().size() );
+
+    // Warning wakes up the background thread,
+    // and is put after the deferred ones.
+    p_wn("immediate %d", 3);
+    std::vector<RecordingLogger::entry> entries;
+    for (size_t ii = 0; ii < 100; ++ii) {
+        entries = sink->get_entries();
+        if (entries.size() >= 2) break;
+        TestSuite::sleep_ms(10);
+    }
+    CHK_EQ(2, entries.size());
+    CHK_EQ(std::string("deferred 2"), entries[0].msg_);
+    CHK_EQ(4, entries[0].level_);
+    CHK_TRUE(entries[0].deferred_);
+    CHK_TRUE(entries[0].timestamp_us_ > 0);
+    CHK_EQ( std::hash<std::thread::id>()(std::this_thread::get_id()),
+            entries[0].thread_id_ );
+    CHK_EQ(std::string("immediate 3"), entries[1].msg_);
+    CHK_EQ(3, entries[1].level_);
+    CHK_GTEQ(entries[1].timestamp_us_, entries[0].timestamp_us_);
+
+    // Level change is applied to both.
+    binary->set_level(6);
+    CHK_EQ(6, sink->get_level());
+    p_db("not filtered %d", 4);
+    binary->flush();
+    entries = sink->get_entries();
+    CHK_EQ(3, entries.size());
+    CHK_EQ(std::string("not filtered 4"), entries[2].msg_);
+
+    // After shutdown, logs are passed to the sink directly.
+    CHK_EQ(binary.get(), l_->get_binary_logger());
+    binary->shutdown();
+    CHK_NULL(l_->get_binary_logger());
+    p_in("direct %d", 5);
+    entries = sink->get_entries();
+    CHK_EQ(4, entries.size());
+    CHK_EQ(std::string("direct 5"), entries[3].msg_);
+    CHK_FALSE(entries[3].deferred_);
+    return 0;
+}
+
+int binary_logger_multi_thread_test() {
+    ptr<RecordingLogger> sink = cs_new<RecordingLogger>();
+    binary_logger::options opt;
+    opt.flush_interval_ms_ = 10;
+    ptr<binary_logger> binary = cs_new<binary_logger>(sink, opt);
+
+    const size_t NUM_THREADS = 4;
+    const size_t NUM_LOGS = 10000;
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < NUM_THREADS; ++ii) {
+        threads.push_back( std::thread([&binary, ii, NUM_LOGS]() {
+            ptr<logger> l_ = binary;
+            for (size_t jj = 0; jj < NUM_LOGS; ++jj) {
+                p_tr("thread %zu log %zu", ii, jj);
+            }
+        }) );
+    }
+    for (std::thread& tt: threads) tt.join();
+    binary->shutdown();
+
+    // Each log is either delivered or dropped,
+    // and logs of each thread are in order.
+    std::vector<RecordingLogger::entry> entries = sink->get_entries();
+    size_t num_dropped = binary->get_num_dropped();
+    size_t num_reports = 0;
+    std::vector<int64_t> last_idx(NUM_THREADS, -1);
+    for (auto& entry: entries) {
+        if (!entry.deferred_) {
+            // Number of dropped logs.
+            num_reports++;
+            continue;
+        }
+        size_t thread_idx = 0, log_idx = 0;
+        CHK_EQ( 2, sscanf( entry.msg_.c_str(), "thread %zu log %zu",
+                           &thread_idx, &log_idx ) );
+        CHK_GT( (int64_t)log_idx, last_idx[thread_idx] );
+        last_idx[thread_idx] = log_idx;
+    }
+    CHK_EQ(NUM_THREADS * NUM_LOGS, entries.size() - num_reports + num_dropped);
+    CHK_EQ(num_dropped > 0, num_reports > 0);
+
+    return 0;
+}
+
+// Sink blocking the background thread on the first log.
+class BlockingLogger : public RecordingLogger {
+public:
+    BlockingLogger() : entered_(false), blocked_(true) {}
+
+    void put_deferred_details(int level,
+                              const char* source_file,
+                              const char* func_name,
+                              size_t line_number,
+                              uint64_t timestamp_us,
+                              uint64_t thread_id,
+                              const std::string& log_line)
+    {
+        {   std::unique_lock<std::mutex> l(lock_);
+            entered_ = true;
+            cv_.wait(l, [this]() { return !blocked_; });
+        }
+        RecordingLogger::put_deferred_details( level, source_file, func_name,
+                                               line_number, timestamp_us,
+                                               thread_id, log_line );
+    }
+
+    bool is_entered() {
+        std::lock_guard<std::mutex> l(lock_);
+        return entered_;
+    }
+
+    void unblock() {
+        {   std::lock_guard<std::mutex> l(lock_);
+            blocked_ = false;
+        }
+        cv_.notify_all();
+    }
+
+private:
+    std::mutex lock_;
+    std::condition_variable cv_;
+    bool entered_;
+    bool blocked_;
+};
+
+int binary_logger_drop_test() {
+    ptr<BlockingLogger> sink = cs_new<BlockingLogger>();
+    binary_logger::options opt;
+    opt.flush_interval_ms_ = 10;
+    ptr<binary_logger> binary = cs_new<binary_logger>(sink, opt);
+
+    // While the background thread is blocked on the first log,
+    // the ring will be full, and the rest will be dropped.
+    const size_t NUM_LOGS = binary_log_ring::NUM_RECORDS + 100;
+    std::thread tt([&]() {
+        ptr<logger> l_ = binary;
+        p_tr("log %d", 0);
+        while (!sink->is_entered()) std::this_thread::yield();
+        for (size_t ii = 1; ii < NUM_LOGS; ++ii) {
+            p_tr("log %zu", ii);
+        }
+    });
+    tt.join();
+    CHK_EQ(100, binary->get_num_dropped());
+    sink->unblock();
+
+    // Ring of the exited thread is still flushed.
+    binary->flush();
+    std::vector<RecordingLogger::entry> entries = sink->get_entries();
+    CHK_EQ(binary_log_ring::NUM_RECORDS + 1, entries.size());
+    CHK_EQ(std::string("log 0"), entries[0].msg_);
+    // Reported at the end of the round that was blocked.
+    CHK_EQ( std::string("100 logs were dropped as the buffer was full"),
+            entries[1].msg_ );
+    CHK_EQ(3, entries[1].level_);
+    CHK_EQ(std::string("log 1"), entries[2].msg_);
+
+    binary->shutdown();
+    return 0;
+}
+
 } // namespace logger_test
 using namespace logger_test;
 
@@ -106,6 +387,14 @@ int main(int argc, char** argv) {
 
     ts.doTest("logger long line test", logger_long_line_test);
 
+    ts.doTest("binary logger format test", binary_logger_format_test);
+
+    ts.doTest("binary logger level test", binary_logger_level_test);
+
+    ts.doTest("binary logger multi thread test", binary_logger_multi_thread_test);
+
+    ts.doTest("binary logger drop test", binary_logger_drop_test);
+
     return 0;
 }
 
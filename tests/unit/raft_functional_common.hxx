@@ -56,6 +56,7 @@ public:
         , lastCommittedConfigIdx(0)
         , targetSnpReadFailures(0)
         , snpDelayMs(0)
+        , preCommitDelayMs(0)
         , numSnapshotCreations(0)
         , myLog(logger)
     {
@@ -79,6 +80,10 @@ public:
     }
 
     ptr<buffer> pre_commit(const ulong log_idx, buffer& data) {
+        if (preCommitDelayMs) {
+            TestSuite::sleep_ms(preCommitDelayMs);
+        }
+
         std::lock_guard<std::mutex> ll(dataLock);
         preCommits[log_idx] = buffer::copy(data);
 
@@ -379,6 +384,10 @@ public:
         snpDelayMs = delay_ms;
     }
 
+    void setPreCommitDelay(size_t delay_ms) {
+        preCommitDelayMs = delay_ms;
+    }
+
     void setServersForCommit(const std::list<int>& src) {
         std::lock_guard<std::mutex> l(serversForCommitLock);
         serversForCommit = src;
@@ -405,6 +414,8 @@ private:
 
     std::atomic<size_t> snpDelayMs;
 
+    std::atomic<size_t> preCommitDelayMs;
+
     std::set<void*> openedUserCtxs;
     mutable std::mutex openedUserCtxsLock;
 
@@ -57,6 +57,7 @@ public:
         , useCustomResolver(false)
         , useLogTimestamp(false)
         , useCrcOnEntireMessage(false)
+        , useCumulativeAck(false)
         , customIoContext(nullptr)
         , myLogWrapper(nullptr)
         , myLog(nullptr)
@@ -106,6 +107,7 @@ public:
         asio_opt.thread_pool_size_  = 4;
         if (use_stream_asio) {
             asio_opt.streaming_mode_ = true;
+            asio_opt.streaming_cumulative_ack_ = useCumulativeAck;
         }
 
         if (enable_ssl) {
@@ -230,6 +232,38 @@ public:
         asioListener->listen(raftServer);
     }
 
+    /**
+     * Init Raft server as a member of the given group, sharing
+     * asio service, listener, and connections with other groups.
+     */
+    void initMuxServer(ptr<asio_service>& shared_svc,
+                       ptr<rpc_listener>& shared_listener,
+                       uint64_t group_id) {
+        std::string log_file_name = "./srv" + std::to_string(myId) +
+                                    "_g" + std::to_string(group_id) + ".log";
+        myLogWrapper = cs_new<logger_wrapper>(log_file_name);
+        myLog = myLogWrapper;
+
+        sMgr = cs_new<TestMgr>(myId, myEndpoint);
+        sm = cs_new<TestSm>( myLogWrapper->getLogger() );
+
+        ptr<delayed_task_scheduler> scheduler = shared_svc;
+        ptr<rpc_client_factory> rpc_cli_factory =
+            shared_svc->create_mux_client_factory(group_id);
+
+        raft_params params;
+        params.with_hb_interval(HEARTBEAT_MS);
+        params.with_election_timeout_lower(HEARTBEAT_MS * 2);
+        params.with_election_timeout_upper(HEARTBEAT_MS * 4);
+        params.with_reserved_log_items(10);
+        params.with_snapshot_enabled(5);
+        params.with_client_req_timeout(10000);
+        context* ctx( new context( sMgr, sm, shared_listener, myLog,
+                                   rpc_cli_factory, scheduler, params ) );
+        raftServer = cs_new<raft_server>(ctx);
+        shared_svc->register_mux_group(group_id, raftServer);
+    }
+
     void stopAsio() {
         if (asioListener) {
             asioListener->stop();
@@ -289,6 +323,8 @@ public:
 
     bool useCrcOnEntireMessage;
 
+    bool useCumulativeAck;
+
 #ifdef USE_BOOST_ASIO
     boost::asio::io_context* customIoContext;
 #else
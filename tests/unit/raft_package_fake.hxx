@@ -265,7 +265,9 @@ static INT_UNUSED launch_servers(const std::vector<RaftPkg*>& pkgs,
 }
 
 /// pkgs[0] becomes leader
-static INT_UNUSED make_group(const std::vector<RaftPkg*>& pkgs) {
+/// `after_hb` is invoked right after each heartbeat timer of leader.
+static INT_UNUSED make_group(const std::vector<RaftPkg*>& pkgs,
+                             std::function<void()> after_hb = nullptr) {
     size_t num_srvs = pkgs.size();
     CHK_GT(num_srvs, 0);
 
@@ -291,6 +293,7 @@ static INT_UNUSED make_group(const std::vector<RaftPkg*>& pkgs) {
 
         // Heartbeat.
         leader->fTimer->invoke( timer_task_type::heartbeat_timer );
+        if (after_hb) after_hb();
         // The new node receives the commit of
         // the new config (membership change), and now be the part of cluster.
         leader->fNet->execReqResp();
@@ -299,6 +302,7 @@ static INT_UNUSED make_group(const std::vector<RaftPkg*>& pkgs) {
 
         // One more heartbeat.
         leader->fTimer->invoke( timer_task_type::heartbeat_timer );
+        if (after_hb) after_hb();
         // New node will clear the catch-up flag.
         leader->fNet->execReqResp();
         // Need one-more req/resp.
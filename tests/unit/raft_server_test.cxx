@@ -24,6 +24,7 @@ limitations under the License.
 #include "raft_params.hxx"
 #include "test_common.h"
 
+#include <set>
 #include <stdio.h>
 
 using namespace nuraft;
@@ -1968,6 +1969,1383 @@ int extended_append_entries_api_test() {
     return 0;
 }
 
+// Delivers requests as the Asio session does in stream mode.
+class stream_req_handler : public raft_server_handler {
+public:
+    static ptr<resp_msg> send(raft_server* srv, req_msg& req) {
+        return process_req(srv, req);
+    }
+    static void flush(raft_server* srv) {
+        flush_deferred_appends(srv);
+    }
+};
+
+int deferred_append_commit_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    // S2's log writes are slow, and its durability waits are deferred.
+    {
+        raft_params param = s2.raftServer->get_current_params();
+        param.parallel_log_appending_ = true;
+        param.target_append_latency_us_ = 1000;
+        s2.raftServer->update_params(param);
+    }
+    s2.getTestMgr()->set_disk_delay(s2.raftServer.get(), 200);
+
+    // Make sure S2 is up-to-date.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    const size_t NUM = 5;
+    ulong last_idx = s1.raftServer->get_last_log_idx();
+    CHK_EQ( last_idx, s2.raftServer->get_last_log_idx() );
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        CHK_TRUE( s1.raftServer->append_entries( {msg} )->get_accepted() );
+    }
+
+    // Take the logs before they are compacted.
+    ptr<log_store> s1_log = s1.getTestMgr()->load_log_store();
+    ulong last_term = s1_log->term_at(last_idx);
+    ptr< std::vector< ptr<log_entry> > > entries =
+        s1_log->log_entries(last_idx + 1, last_idx + NUM + 1);
+
+    // Commit them with S3 only.
+    s1.fNet->execReqResp(s3_addr);
+    s1.fNet->execReqResp(s3_addr);
+    CHK_Z( wait_for_sm_exec({&s1}, COMMIT_TIMEOUT_SEC) );
+    CHK_EQ( last_idx + NUM, s1.raftServer->get_committed_log_idx() );
+
+    // All logs but the last one arrive at S2 with the commit index,
+    // and more requests follow in the stream.
+    req_msg req( s1.raftServer->get_term(),
+                 msg_type::append_entries_request,
+                 1, 2,
+                 last_term,
+                 last_idx,
+                 last_idx + NUM );
+    for (size_t ii=0; ii<NUM-1; ++ii) {
+        req.log_entries().push_back( (*entries)[ii] );
+    }
+    req.set_extra_flags(req_msg::MORE_IN_STREAM);
+
+    raft_server* s2_raft = s2.raftServer.get();
+    ptr<resp_msg> resp = stream_req_handler::send(s2_raft, req);
+    CHK_TRUE( resp->get_accepted() );
+    CHK_EQ( last_idx + NUM - 1, s2_raft->get_last_log_idx() );
+    // The write is not done yet, its latency should not be reported.
+    CHK_NULL( resp->get_ctx().get() );
+
+    // Logs not durable yet should not be committed.
+    ptr<log_store> s2_log = s2.getTestMgr()->load_log_store();
+    CHK_GTEQ( s2_log->last_durable_index(),
+              s2_raft->get_target_committed_log_idx() );
+    CHK_GT( last_idx + NUM - 1, s2_raft->get_target_committed_log_idx() );
+
+    // Once flushed, they should be committed.
+    stream_req_handler::flush(s2_raft);
+    CHK_EQ( last_idx + NUM - 1, s2_log->last_durable_index() );
+    CHK_EQ( last_idx + NUM - 1, s2_raft->get_target_committed_log_idx() );
+
+    // The last one is not followed by others.
+    req_msg last_req( s1.raftServer->get_term(),
+                      msg_type::append_entries_request,
+                      1, 2,
+                      (*entries)[NUM-2]->get_term(),
+                      last_idx + NUM - 1,
+                      last_idx + NUM );
+    last_req.log_entries().push_back( (*entries)[NUM-1] );
+    resp = stream_req_handler::send(s2_raft, last_req);
+    CHK_TRUE( resp->get_accepted() );
+    CHK_EQ( last_idx + NUM, s2_log->last_durable_index() );
+    CHK_EQ( last_idx + NUM, s2_raft->get_target_committed_log_idx() );
+    // Now the latency should be reported.
+    CHK_NONNULL( resp->get_ctx().get() );
+
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int deferred_append_truncate_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    // S2's log writes are slow, and its durability waits are deferred.
+    {
+        raft_params param = s2.raftServer->get_current_params();
+        param.parallel_log_appending_ = true;
+        s2.raftServer->update_params(param);
+    }
+    s2.getTestMgr()->set_disk_delay(s2.raftServer.get(), 500);
+
+    const size_t NUM = 5;
+    ulong last_idx = s1.raftServer->get_last_log_idx();
+    CHK_EQ( last_idx, s2.raftServer->get_last_log_idx() );
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        CHK_TRUE( s1.raftServer->append_entries( {msg} )->get_accepted() );
+    }
+
+    ptr<log_store> s1_log = s1.getTestMgr()->load_log_store();
+    ulong term = s1.raftServer->get_term();
+    ulong last_term = s1_log->term_at(last_idx);
+    ptr< std::vector< ptr<log_entry> > > entries =
+        s1_log->log_entries(last_idx + 1, last_idx + NUM + 1);
+
+    // Uncommitted logs arrive at S2, and more requests follow.
+    req_msg req( term,
+                 msg_type::append_entries_request,
+                 1, 2,
+                 last_term,
+                 last_idx,
+                 last_idx );
+    for (ptr<log_entry>& le: *entries) {
+        req.log_entries().push_back(le);
+    }
+    req.set_extra_flags(req_msg::MORE_IN_STREAM);
+
+    raft_server* s2_raft = s2.raftServer.get();
+    ptr<resp_msg> resp = stream_req_handler::send(s2_raft, req);
+    CHK_TRUE( resp->get_accepted() );
+    CHK_EQ( last_idx + NUM, s2_raft->get_last_log_idx() );
+
+    // A new leader of the next term overwrites them with a shorter log,
+    // while the durability wait of the previous batch is deferred.
+    std::string new_msg = "new leader";
+    ptr<buffer> new_buf = buffer::alloc(new_msg.size() + 1);
+    new_buf->put(new_msg);
+    new_buf->pos(0);
+    req_msg trunc_req( term + 1,
+                       msg_type::append_entries_request,
+                       3, 2,
+                       last_term,
+                       last_idx,
+                       last_idx );
+    trunc_req.log_entries().push_back( cs_new<log_entry>(term + 1, new_buf) );
+    trunc_req.set_extra_flags(req_msg::MORE_IN_STREAM);
+
+    resp = stream_req_handler::send(s2_raft, trunc_req);
+    CHK_TRUE( resp->get_accepted() );
+    CHK_EQ( last_idx + 1, s2_raft->get_last_log_idx() );
+
+    // Flush should wait for the overwritten log only, not for the logs
+    // of the previous batch that no longer exist.
+    stream_req_handler::flush(s2_raft);
+    ptr<log_store> s2_log = s2.getTestMgr()->load_log_store();
+    CHK_EQ( last_idx + 1, s2_log->last_durable_index() );
+    CHK_EQ( term + 1, s2_log->term_at(last_idx + 1) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+ptr<log_entry> make_test_log(ulong term, const std::string& str) {
+    ptr<buffer> buf = buffer::alloc(str.size() + 1);
+    buf->put(str);
+    buf->pos(0);
+    return cs_new<log_entry>(term, buf);
+}
+
+int check_test_log(log_store& store, ulong idx,
+                   ulong term, const std::string& str)
+{
+    ptr<log_entry> le = store.entry_at(idx);
+    CHK_NONNULL(le);
+    CHK_EQ( term, le->get_term() );
+    CHK_EQ( term, store.term_at(idx) );
+    le->get_buf().pos(0);
+    CHK_EQ( str, std::string( le->get_buf().get_str() ) );
+    return 0;
+}
+
+int log_store_append_batch_test() {
+    // `false`: the default implementation of `log_store`,
+    // appending logs one by one.
+    for (bool batch_enabled: {true, false}) {
+        inmem_log_store store;
+        store.set_append_batch_enabled(batch_enabled);
+
+        // Empty batch.
+        std::vector< ptr<log_entry> > empty;
+        CHK_EQ( 1, store.append_batch(empty) );
+        CHK_EQ( 1, store.next_slot() );
+
+        // Log 1-5: term 1.
+        std::vector< ptr<log_entry> > batch;
+        for (size_t ii = 1; ii <= 5; ++ii) {
+            batch.push_back( make_test_log(1, "t1_" + std::to_string(ii)) );
+        }
+        CHK_EQ( 1, store.append_batch(batch) );
+        CHK_EQ( 6, store.next_slot() );
+
+        // Overwrite log 4-5, and then append a batch after it,
+        // as a follower does after a conflict.
+        ptr<log_entry> le = make_test_log(2, "t2_4");
+        store.write_at(4, le);
+        CHK_EQ( 5, store.next_slot() );
+        batch.clear();
+        for (size_t ii = 5; ii <= 7; ++ii) {
+            batch.push_back( make_test_log(2, "t2_" + std::to_string(ii)) );
+        }
+        CHK_EQ( 5, store.append_batch(batch) );
+        CHK_EQ( 8, store.next_slot() );
+        CHK_EQ( 2, store.last_entry()->get_term() );
+
+        for (size_t ii = 1; ii <= 3; ++ii) {
+            CHK_Z( check_test_log(store, ii, 1, "t1_" + std::to_string(ii)) );
+        }
+        for (size_t ii = 4; ii <= 7; ++ii) {
+            CHK_Z( check_test_log(store, ii, 2, "t2_" + std::to_string(ii)) );
+        }
+
+        // Entries are cloned, the caller's ones are not referenced.
+        batch[0]->get_buf().pos(0);
+        batch[0]->get_buf().put( std::string("xx_5") );
+        CHK_Z( check_test_log(store, 5, 2, "t2_5") );
+    }
+    return 0;
+}
+
+int append_batch_overwrite_test(bool batch_enabled) {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+    s2.getTestMgr()->get_inmem_log_store()->set_append_batch_enabled(batch_enabled);
+
+    raft_server* s2_raft = s2.raftServer.get();
+    ptr<log_store> s2_log = s2.getTestMgr()->load_log_store();
+    ulong term = s1.raftServer->get_term();
+    ulong last_idx = s2_raft->get_last_log_idx();
+    ulong last_term = s2_log->term_at(last_idx);
+
+    // Log `last_idx` + 1 ~ 5: current term, from S1.
+    req_msg req( term,
+                 msg_type::append_entries_request,
+                 1, 2,
+                 last_term,
+                 last_idx,
+                 last_idx );
+    for (size_t ii = 1; ii <= 5; ++ii) {
+        req.log_entries().push_back
+            ( make_test_log(term, "old" + std::to_string(ii)) );
+    }
+    ptr<resp_msg> resp = stream_req_handler::send(s2_raft, req);
+    CHK_TRUE( resp->get_accepted() );
+    CHK_EQ( last_idx + 5, s2_raft->get_last_log_idx() );
+
+    // A new leader S3 of the next term sends logs starting from
+    // `last_idx` + 3. The first one is the same, the next two overwrite
+    // the existing ones, and the remaining three are appended at once.
+    req_msg ovwr_req( term + 1,
+                      msg_type::append_entries_request,
+                      3, 2,
+                      term,
+                      last_idx + 2,
+                      last_idx );
+    ovwr_req.log_entries().push_back( make_test_log(term, "old3") );
+    for (size_t ii = 4; ii <= 8; ++ii) {
+        ovwr_req.log_entries().push_back
+            ( make_test_log(term + 1, "new" + std::to_string(ii)) );
+    }
+    resp = stream_req_handler::send(s2_raft, ovwr_req);
+    CHK_TRUE( resp->get_accepted() );
+    CHK_EQ( last_idx + 8, s2_raft->get_last_log_idx() );
+
+    for (size_t ii = 1; ii <= 3; ++ii) {
+        CHK_Z( check_test_log( *s2_log, last_idx + ii,
+                               term, "old" + std::to_string(ii) ) );
+    }
+    for (size_t ii = 4; ii <= 8; ++ii) {
+        CHK_Z( check_test_log( *s2_log, last_idx + ii,
+                               term + 1, "new" + std::to_string(ii) ) );
+    }
+
+    // Term lookups of S2 (through its log term index) should see
+    // the overwritten logs: previous logs of the new terms are accepted,
+    // and the ones of the old term are not.
+    struct prev_log { ulong idx; ulong term; bool ok; };
+    std::vector<prev_log> prev_logs = {
+        {last_idx + 3, term, true},
+        {last_idx + 4, term + 1, true},
+        {last_idx + 8, term + 1, true},
+        {last_idx + 4, term, false},
+        {last_idx + 5, term, false},
+        {last_idx + 3, term + 1, false},
+    };
+    for (prev_log& pl: prev_logs) {
+        req_msg probe( term + 1,
+                       msg_type::append_entries_request,
+                       3, 2,
+                       pl.term,
+                       pl.idx,
+                       last_idx );
+        resp = stream_req_handler::send(s2_raft, probe);
+        CHK_EQ( pl.ok, resp->get_accepted() );
+        // Nothing should be truncated by empty requests.
+        CHK_EQ( last_idx + 8, s2_raft->get_last_log_idx() );
+    }
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int log_term_index_update_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    raft_server* s2_raft = s2.raftServer.get();
+    ptr<log_store> s2_log = s2.getTestMgr()->load_log_store();
+    const ulong tt = s1.raftServer->get_term();
+    const ulong ll = s2_raft->get_last_log_idx();
+
+    // Send logs of the given terms from `first_idx` to S2, as if the
+    // sender is the leader of the term of the last one (or S2's term).
+    auto append = [&](ulong first_idx,
+                      ulong prev_term,
+                      const std::vector<ulong>& terms,
+                      ulong commit_idx) -> bool {
+        ulong term = terms.empty() ? s2_raft->get_term() : terms.back();
+        req_msg req( term,
+                     msg_type::append_entries_request,
+                     (term == tt) ? 1 : 3, 2,
+                     prev_term,
+                     first_idx - 1,
+                     commit_idx );
+        for (ulong log_term: terms) {
+            req.log_entries().push_back( make_test_log(log_term, "log") );
+        }
+        return stream_req_handler::send(s2_raft, req)->get_accepted();
+    };
+
+    // Term lookups of S2 for the previous log of a request.
+    auto prev_log_matches = [&](ulong idx, ulong term) -> bool {
+        req_msg probe( s2_raft->get_term(),
+                       msg_type::append_entries_request,
+                       3, 2,
+                       term,
+                       idx,
+                       0 );
+        ulong last_idx = s2_raft->get_last_log_idx();
+        bool ok = stream_req_handler::send(s2_raft, probe)->get_accepted();
+        // Empty requests should not truncate anything.
+        if (last_idx != s2_raft->get_last_log_idx()) return false;
+        return ok;
+    };
+
+    // Runs of S2: [tt: ll+1 ~ ll+2], [tt+1: ll+3 ~ ll+4], [tt+2: ll+5 ~ ll+7].
+    CHK_TRUE( append(ll + 1, tt, {tt, tt, tt, tt, tt, tt}, ll) );
+    CHK_TRUE( append(ll + 3, tt, {tt + 1, tt + 1, tt + 1, tt + 1}, ll) );
+    CHK_TRUE( append(ll + 5, tt + 1, {tt + 2, tt + 2, tt + 2}, ll) );
+    CHK_EQ( ll + 7, s2_raft->get_last_log_idx() );
+    CHK_TRUE( prev_log_matches(ll + 2, tt) );
+    CHK_TRUE( prev_log_matches(ll + 4, tt + 1) );
+    CHK_TRUE( prev_log_matches(ll + 7, tt + 2) );
+    CHK_FALSE( prev_log_matches(ll + 6, tt + 1) );
+
+    // Overwrite from the first run, removing the other runs (`write_at`).
+    CHK_TRUE( append(ll + 2, tt, {tt + 3, tt + 3, tt + 3}, ll) );
+    CHK_EQ( ll + 4, s2_raft->get_last_log_idx() );
+    CHK_TRUE( prev_log_matches(ll + 1, tt) );
+    CHK_FALSE( prev_log_matches(ll + 2, tt) );
+    CHK_TRUE( prev_log_matches(ll + 2, tt + 3) );
+    CHK_FALSE( prev_log_matches(ll + 3, tt + 1) );
+    CHK_TRUE( prev_log_matches(ll + 4, tt + 3) );
+    for (ulong ii = ll + 2; ii <= ll + 4; ++ii) {
+        CHK_EQ( tt + 3, s2_log->term_at(ii) );
+    }
+
+    // Install a snapshot in the middle of the log.
+    auto install_snapshot = [&](ulong idx, ulong term) -> bool {
+        ptr<snapshot> snp = cs_new<snapshot>(idx, term, s2_raft->get_config());
+        // Object ID 1 with config only, no data for the state machine.
+        ptr<buffer> data = buffer::alloc(sizeof(ulong));
+        data->put( (ulong)0 );
+        data->pos(0);
+        snapshot_sync_req sync_req(snp, 1, data, true);
+        req_msg req( term,
+                     msg_type::install_snapshot_request,
+                     3, 2,
+                     0, 0, 0 );
+        req.log_entries().push_back
+            ( cs_new<log_entry>( term, sync_req.serialize(),
+                                 log_val_type::snp_sync_req ) );
+        return stream_req_handler::send(s2_raft, req)->get_accepted();
+    };
+    CHK_TRUE( install_snapshot(ll + 3, tt + 3) );
+    CHK_EQ( ll + 4, s2_log->start_index() );
+    CHK_TRUE( prev_log_matches(ll + 3, tt + 3) );
+    CHK_TRUE( prev_log_matches(ll + 4, tt + 3) );
+    CHK_FALSE( prev_log_matches(ll + 4, tt) );
+
+    // Install a snapshot beyond the end of the log, with a new term.
+    CHK_TRUE( install_snapshot(ll + 10, tt + 4) );
+    CHK_EQ( ll + 11, s2_log->start_index() );
+    CHK_TRUE( prev_log_matches(ll + 10, tt + 4) );
+    CHK_TRUE( append(ll + 11, tt + 4, {tt + 4, tt + 4, tt + 5, tt + 5}, ll + 10) );
+    CHK_TRUE( prev_log_matches(ll + 11, tt + 4) );
+    CHK_TRUE( prev_log_matches(ll + 14, tt + 5) );
+    CHK_FALSE( prev_log_matches(ll + 12, tt + 5) );
+
+    // Compact the log by a snapshot of S2 itself, up to `ll` + 12.
+    CHK_TRUE( append(ll + 15, tt + 5, {}, ll + 12) );
+    CHK_Z( wait_for_sm_exec({&s2}, COMMIT_TIMEOUT_SEC) );
+    CHK_EQ( ll + 12, s2_raft->create_snapshot() );
+    CHK_EQ( ll + 13, s2_log->start_index() );
+    CHK_TRUE( prev_log_matches(ll + 12, tt + 4) );
+    CHK_TRUE( prev_log_matches(ll + 13, tt + 5) );
+
+    // Overwrite right after the compaction.
+    CHK_TRUE( append(ll + 14, tt + 5, {tt + 6}, ll + 12) );
+    CHK_TRUE( prev_log_matches(ll + 13, tt + 5) );
+    CHK_FALSE( prev_log_matches(ll + 14, tt + 5) );
+    CHK_TRUE( prev_log_matches(ll + 14, tt + 6) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int heartbeat_batch_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    // 2 groups on 3 nodes, node N runs server N of each group.
+    const size_t NUM_NODES = 3;
+    const size_t NUM_GROUPS = 2;
+
+    // Batchers send heartbeats through their own network.
+    std::vector< ptr<FakeNetwork> > hb_nets;
+    std::vector< ptr<heartbeat_batcher> > batchers;
+    for (size_t nn = 0; nn < NUM_NODES; ++nn) {
+        std::string hb_addr = "node" + std::to_string(nn + 1) + ":hb";
+        ptr<FakeNetwork> hb_net = cs_new<FakeNetwork>(hb_addr, f_base);
+        f_base->addNetwork(hb_net);
+        hb_nets.push_back(hb_net);
+
+        // Flush manually. Each group listens on its own endpoint,
+        // coalesce heartbeats to the same node (i.e., server ID).
+        heartbeat_batcher::options opt;
+        opt.flush_interval_ms_ = 0;
+        opt.dest_key_func_ = [](int32 srv_id, const std::string&) {
+            return std::to_string(srv_id);
+        };
+        batchers.push_back( cs_new<heartbeat_batcher>(hb_net, nullptr, opt) );
+    }
+
+    std::vector< std::vector< ptr<RaftPkg> > > groups(NUM_GROUPS);
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        std::vector<RaftPkg*> pkgs;
+        for (size_t nn = 0; nn < NUM_NODES; ++nn) {
+            std::string addr = "node" + std::to_string(nn + 1) +
+                               ":g" + std::to_string(gg + 1);
+            groups[gg].push_back( cs_new<RaftPkg>(f_base, nn + 1, addr) );
+            pkgs.push_back( groups[gg][nn].get() );
+        }
+
+        uint64_t group_id = gg + 1;
+        CHK_Z( launch_servers( pkgs, nullptr, false, cb_default,
+                               [&](RaftPkg* pp) {
+                                   pp->ctx->set_hb_batcher
+                                            ( batchers[pp->myId - 1], group_id );
+                               } ) );
+        CHK_Z( make_group( pkgs,
+                           [&]() {
+                               batchers[0]->flush();
+                               hb_nets[0]->execReqResp();
+                           } ) );
+    }
+
+    // Heartbeats should have been processed by followers.
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        raft_server* leader = groups[gg][0]->raftServer.get();
+        CHK_TRUE( leader->is_leader() );
+        for (size_t nn = 1; nn < NUM_NODES; ++nn) {
+            raft_server* ff = groups[gg][nn]->raftServer.get();
+            CHK_EQ( 1, ff->get_leader() );
+            CHK_EQ( leader->get_committed_log_idx(),
+                    ff->get_committed_log_idx() );
+        }
+    }
+
+    // Heartbeat of all groups.
+    uint64_t num_batches = batchers[0]->get_num_batches_sent();
+    uint64_t num_hbs = batchers[0]->get_num_hbs_sent();
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        groups[gg][0]->fTimer->invoke( timer_task_type::heartbeat_timer );
+    }
+    // Nothing is sent before flush.
+    CHK_EQ( num_batches, batchers[0]->get_num_batches_sent() );
+
+    // One batch per destination node, containing heartbeats of all groups.
+    batchers[0]->flush();
+    CHK_EQ( num_batches + NUM_NODES - 1, batchers[0]->get_num_batches_sent() );
+    CHK_EQ( num_hbs + (NUM_NODES - 1) * NUM_GROUPS,
+            batchers[0]->get_num_hbs_sent() );
+
+    TestSuite::sleep_ms(100, "wait before next heartbeat");
+    hb_nets[0]->execReqResp();
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        raft_server* leader = groups[gg][0]->raftServer.get();
+        for (size_t nn = 1; nn < NUM_NODES; ++nn) {
+            raft_server::peer_info pi = leader->get_peer_info(nn + 1);
+            CHK_SM( pi.last_succ_resp_us_, 100 * 1000 );
+        }
+    }
+
+    // Failure of a batch should not reset the main connections
+    // of the groups in it.
+    std::vector< ptr<FakeClient> > main_clients;
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        for (size_t nn = 1; nn < NUM_NODES; ++nn) {
+            main_clients.push_back( groups[gg][0]->fNet->findClient
+                                    ( groups[gg][nn]->myEndpoint ) );
+            CHK_NONNULL( main_clients.back().get() );
+        }
+    }
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        groups[gg][0]->fTimer->invoke( timer_task_type::heartbeat_timer );
+    }
+    batchers[0]->flush();
+    size_t num_failed = 0;
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        for (size_t nn = 1; nn < NUM_NODES; ++nn) {
+            const std::string& ep = groups[gg][nn]->myEndpoint;
+            if (!hb_nets[0]->findClient(ep)) continue;
+            num_failed += hb_nets[0]->getNumPendingReqs(ep);
+            hb_nets[0]->makeReqFailAll(ep);
+        }
+    }
+    CHK_EQ( NUM_NODES - 1, num_failed );
+
+    // The next heartbeats should go through the same connections.
+    TestSuite::sleep_ms(100, "wait before next heartbeat");
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        groups[gg][0]->fTimer->invoke( timer_task_type::heartbeat_timer );
+    }
+    batchers[0]->flush();
+    hb_nets[0]->execReqResp();
+    size_t idx = 0;
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        raft_server* leader = groups[gg][0]->raftServer.get();
+        for (size_t nn = 1; nn < NUM_NODES; ++nn) {
+            CHK_EQ( main_clients[idx++],
+                    groups[gg][0]->fNet->findClient
+                        ( groups[gg][nn]->myEndpoint ) );
+            raft_server::peer_info pi = leader->get_peer_info(nn + 1);
+            CHK_SM( pi.last_succ_resp_us_, 100 * 1000 );
+        }
+    }
+
+    // Shutdown group 2 of node 2, its heartbeat should fail while
+    // that of group 1 still succeeds.
+    groups[1][1]->raftServer->shutdown();
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        groups[gg][0]->fTimer->invoke( timer_task_type::heartbeat_timer );
+    }
+    batchers[0]->flush();
+    TestSuite::sleep_ms(100, "wait before next heartbeat");
+    hb_nets[0]->execReqResp();
+    CHK_SM( groups[0][0]->raftServer->get_peer_info(2).last_succ_resp_us_,
+            100 * 1000 );
+    CHK_GTEQ( groups[1][0]->raftServer->get_peer_info(2).last_succ_resp_us_,
+              100 * 1000 );
+
+    // Batch of unknown version, or with more heartbeats than its size,
+    // should get an empty response so that the sender fails all of them.
+    auto send_raw_batch = [&](uint8_t version, uint32_t num_elems) {
+        ptr<buffer> buf = buffer::alloc( sizeof(uint8_t) + sizeof(uint32_t) +
+                                         sizeof(uint64_t) * 6 +
+                                         sizeof(int32) * 2 );
+        buffer_serializer bs(buf);
+        bs.put_u8(version);
+        bs.put_u32(num_elems);
+        // A valid heartbeat of group 1, from S1 to S3.
+        raft_server* leader = groups[0][0]->raftServer.get();
+        bs.put_u64(1);
+        bs.put_i32(1);
+        bs.put_i32(3);
+        bs.put_u64(leader->get_term());
+        bs.put_u64(leader->get_last_log_term());
+        bs.put_u64(leader->get_last_log_idx());
+        bs.put_u64(leader->get_committed_log_idx());
+        bs.put_u64(0);
+        req_msg req(0, msg_type::heartbeat_batch_request, 1, 3, 0, 0, 0);
+        req.log_entries().push_back
+            ( cs_new<log_entry>(0, buf, log_val_type::custom) );
+        return batchers[2]->handle_batch(req);
+    };
+    ptr<resp_msg> raw_resp = send_raw_batch(0x0, 1);
+    CHK_TRUE( raw_resp->get_accepted() );
+    CHK_NONNULL( raw_resp->get_ctx().get() );
+
+    raw_resp = send_raw_batch(0xff, 1);
+    CHK_FALSE( raw_resp->get_accepted() );
+    CHK_NULL( raw_resp->get_ctx().get() );
+
+    raw_resp = send_raw_batch(0x0, 2);
+    CHK_FALSE( raw_resp->get_accepted() );
+    CHK_NULL( raw_resp->get_ctx().get() );
+
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        for (size_t nn = 0; nn < NUM_NODES; ++nn) {
+            if (gg == 1 && nn == 1) continue;
+            groups[gg][nn]->raftServer->shutdown();
+        }
+    }
+    for (size_t nn = 0; nn < NUM_NODES; ++nn) {
+        batchers[nn]->shutdown();
+        hb_nets[nn]->shutdown();
+    }
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int heartbeat_batch_same_host_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    // S2 and S3 are different processes on the same host.
+    std::string s1_addr = "host1:10001";
+    std::string s2_addr = "host2:10001";
+    std::string s3_addr = "host2:10002";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    std::vector< ptr<FakeNetwork> > hb_nets;
+    std::vector< ptr<heartbeat_batcher> > batchers;
+    for (size_t nn = 0; nn < pkgs.size(); ++nn) {
+        std::string hb_addr = pkgs[nn]->myEndpoint + ":hb";
+        ptr<FakeNetwork> hb_net = cs_new<FakeNetwork>(hb_addr, f_base);
+        f_base->addNetwork(hb_net);
+        hb_nets.push_back(hb_net);
+
+        // Flush manually, with the default destination key.
+        heartbeat_batcher::options opt;
+        opt.flush_interval_ms_ = 0;
+        batchers.push_back( cs_new<heartbeat_batcher>(hb_net, nullptr, opt) );
+    }
+
+    CHK_Z( launch_servers( pkgs, nullptr, false, cb_default,
+                           [&](RaftPkg* pp) {
+                               pp->ctx->set_hb_batcher
+                                        ( batchers[pp->myId - 1], 1 );
+                           } ) );
+    CHK_Z( make_group( pkgs,
+                       [&]() {
+                           batchers[0]->flush();
+                           hb_nets[0]->execReqResp();
+                       } ) );
+
+    // Heartbeats to different ports should not be merged.
+    uint64_t num_batches = batchers[0]->get_num_batches_sent();
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    batchers[0]->flush();
+    CHK_EQ( num_batches + 2, batchers[0]->get_num_batches_sent() );
+    CHK_EQ( 1, hb_nets[0]->getNumPendingReqs(s2_addr) );
+    CHK_EQ( 1, hb_nets[0]->getNumPendingReqs(s3_addr) );
+
+    // Both followers respond.
+    TestSuite::sleep_ms(100, "wait before next heartbeat");
+    hb_nets[0]->execReqResp();
+    for (int32 peer_id: {2, 3}) {
+        raft_server::peer_info pi = s1.raftServer->get_peer_info(peer_id);
+        CHK_SM( pi.last_succ_resp_us_, 100 * 1000 );
+    }
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    for (size_t nn = 0; nn < pkgs.size(); ++nn) {
+        batchers[nn]->shutdown();
+        hb_nets[nn]->shutdown();
+    }
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int heartbeat_batch_busy_group_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    // 2 groups on 3 nodes, node N runs server N of each group.
+    const size_t NUM_NODES = 3;
+    const size_t NUM_GROUPS = 2;
+    const size_t BLOCK_MS = 1000;
+
+    std::vector< ptr<FakeNetwork> > hb_nets;
+    std::vector< ptr<heartbeat_batcher> > batchers;
+    for (size_t nn = 0; nn < NUM_NODES; ++nn) {
+        std::string hb_addr = "node" + std::to_string(nn + 1) + ":hb";
+        ptr<FakeNetwork> hb_net = cs_new<FakeNetwork>(hb_addr, f_base);
+        f_base->addNetwork(hb_net);
+        hb_nets.push_back(hb_net);
+
+        heartbeat_batcher::options opt;
+        opt.flush_interval_ms_ = 0;
+        opt.dest_key_func_ = [](int32 srv_id, const std::string&) {
+            return std::to_string(srv_id);
+        };
+        batchers.push_back( cs_new<heartbeat_batcher>(hb_net, nullptr, opt) );
+    }
+
+    // Once armed, S2 of group 2 gets stuck in the next append request,
+    // while holding its lock.
+    std::atomic<bool> block_s2(false);
+    EventAwaiter s2_blocked;
+    EventAwaiter s2_release;
+    cb_func::func_type cb_block_s2 =
+        [&](cb_func::Type type, cb_func::Param* param) {
+            bool exp = true;
+            if ( type == cb_func::Type::ReceivedAppendEntriesReq &&
+                 param->myId == 2 &&
+                 block_s2.compare_exchange_strong(exp, false) ) {
+                s2_blocked.invoke();
+                s2_release.wait_ms(BLOCK_MS);
+            }
+            return cb_default(type, param);
+        };
+
+    std::vector< std::vector< ptr<RaftPkg> > > groups(NUM_GROUPS);
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        std::vector<RaftPkg*> pkgs;
+        for (size_t nn = 0; nn < NUM_NODES; ++nn) {
+            std::string addr = "node" + std::to_string(nn + 1) +
+                               ":g" + std::to_string(gg + 1);
+            groups[gg].push_back( cs_new<RaftPkg>(f_base, nn + 1, addr) );
+            pkgs.push_back( groups[gg][nn].get() );
+        }
+
+        uint64_t group_id = gg + 1;
+        CHK_Z( launch_servers( pkgs, nullptr, false,
+                               gg ? cb_block_s2 : cb_default,
+                               [&](RaftPkg* pp) {
+                                   pp->ctx->set_hb_batcher
+                                            ( batchers[pp->myId - 1], group_id );
+                               } ) );
+        CHK_Z( make_group( pkgs,
+                           [&]() {
+                               batchers[0]->flush();
+                               hb_nets[0]->execReqResp();
+                           } ) );
+    }
+
+    // Block S2 of group 2 with a heartbeat sent by someone else.
+    raft_server* g2_leader = groups[1][0]->raftServer.get();
+    raft_server* g2_s2 = groups[1][1]->raftServer.get();
+    block_s2 = true;
+    std::thread blocker([&]() {
+        req_msg req( g2_leader->get_term(),
+                     msg_type::append_entries_request,
+                     1, 2,
+                     g2_leader->get_last_log_term(),
+                     g2_leader->get_last_log_idx(),
+                     g2_leader->get_committed_log_idx() );
+        stream_req_handler::send(g2_s2, req);
+    });
+    s2_blocked.wait_ms(BLOCK_MS);
+    CHK_FALSE( block_s2 );
+
+    // Heartbeats of both groups in the same batch. That of group 1
+    // should not wait for group 2.
+    TestSuite::sleep_ms(100, "wait before next heartbeat");
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        groups[gg][0]->fTimer->invoke( timer_task_type::heartbeat_timer );
+    }
+    batchers[0]->flush();
+    TestSuite::Timer timer;
+    hb_nets[0]->execReqResp();
+    uint64_t elapsed_ms = timer.getTimeMs();
+
+    s2_release.invoke();
+    blocker.join();
+
+    CHK_GT( BLOCK_MS / 2, elapsed_ms );
+    for (size_t nn = 1; nn < NUM_NODES; ++nn) {
+        raft_server::peer_info pi = groups[0][0]->raftServer->get_peer_info(nn + 1);
+        CHK_SM( pi.last_succ_resp_us_, 100 * 1000 );
+    }
+    // Busy one should have been skipped, but not the other member.
+    CHK_GTEQ( g2_leader->get_peer_info(2).last_succ_resp_us_, 100 * 1000 );
+    CHK_SM( g2_leader->get_peer_info(3).last_succ_resp_us_, 100 * 1000 );
+
+    // It gets the next heartbeat once it is free.
+    TestSuite::sleep_ms(100, "wait before next heartbeat");
+    groups[1][0]->fTimer->invoke( timer_task_type::heartbeat_timer );
+    batchers[0]->flush();
+    hb_nets[0]->execReqResp();
+    CHK_SM( g2_leader->get_peer_info(2).last_succ_resp_us_, 100 * 1000 );
+
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        for (size_t nn = 0; nn < NUM_NODES; ++nn) {
+            groups[gg][nn]->raftServer->shutdown();
+        }
+    }
+    for (size_t nn = 0; nn < NUM_NODES; ++nn) {
+        batchers[nn]->shutdown();
+        hb_nets[nn]->shutdown();
+    }
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int quiescence_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    // Failure detectors send liveness checks through their own network.
+    std::vector< ptr<FakeNetwork> > fd_nets;
+    std::vector< ptr<failure_detector> > detectors;
+    for (size_t nn = 0; nn < pkgs.size(); ++nn) {
+        std::string fd_addr = "S" + std::to_string(nn + 1) + ":fd";
+        ptr<FakeNetwork> fd_net = cs_new<FakeNetwork>(fd_addr, f_base);
+        f_base->addNetwork(fd_net);
+        fd_nets.push_back(fd_net);
+
+        // Check manually, and declare failure at the first error.
+        failure_detector::options opt;
+        opt.check_interval_ms_ = 0;
+        opt.max_failures_ = 1;
+        detectors.push_back( cs_new<failure_detector>(fd_net, nullptr, opt) );
+    }
+
+    const int QUIESCE_AFTER_MS = 100;
+    raft_params params;
+    params.with_election_timeout_lower(0);
+    params.with_election_timeout_upper(10000);
+    params.with_hb_interval(5000);
+    params.with_client_req_timeout(1000000);
+    params.with_reserved_log_items(0);
+    params.with_snapshot_enabled(5);
+    params.with_log_sync_stopping_gap(1);
+    params.return_method_ = raft_params::async_handler;
+    params.quiesce_after_ms_ = QUIESCE_AFTER_MS;
+
+    CHK_Z( launch_servers( pkgs, &params, false, cb_default,
+                           [&](RaftPkg* pp) {
+                               pp->ctx->set_failure_detector
+                                        ( detectors[pp->myId - 1], 0 );
+                           } ) );
+    CHK_Z( make_group( pkgs ) );
+
+    auto idle_heartbeats = [&]() {
+        // The first round starts the idle timer,
+        // the next round asks followers to quiesce.
+        for (size_t ii = 0; ii < 2; ++ii) {
+            TestSuite::sleep_ms(QUIESCE_AFTER_MS + 50, "idle");
+            s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+            s1.fNet->execReqResp();
+        }
+    };
+
+    // Group becomes quiescent.
+    idle_heartbeats();
+    CHK_TRUE( s1.raftServer->is_quiescent() );
+    CHK_Z( s1.fTimer->getNumPendingTasks(timer_task_type::heartbeat_timer) );
+    // Leader watches followers' nodes.
+    CHK_EQ( 2, detectors[0]->get_num_watched_nodes() );
+    for (RaftPkg* ff: {&s2, &s3}) {
+        CHK_TRUE( ff->raftServer->is_quiescent() );
+        CHK_TRUE( ff->raftServer->is_leader_alive() );
+        // Backstop timer only.
+        CHK_EQ( 1, ff->fTimer->getNumPendingTasks(timer_task_type::election_timer) );
+        CHK_EQ( 1, detectors[ff->myId - 1]->get_num_watched_nodes() );
+    }
+
+    // Leader is alive, nothing happens.
+    detectors[1]->check_now();
+    fd_nets[1]->execReqResp();
+    CHK_TRUE( s2.raftServer->is_quiescent() );
+    CHK_EQ( 1, detectors[1]->get_num_checks_sent() );
+
+    // New append wakes up the group.
+    std::string test_msg = "test";
+    ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+    msg->put(test_msg);
+    ptr< cmd_result< ptr<buffer> > > ret =
+        s1.raftServer->append_entries( {msg} );
+    CHK_TRUE( ret->get_accepted() );
+    CHK_FALSE( s1.raftServer->is_quiescent() );
+    CHK_GT( s1.fTimer->getNumPendingTasks(timer_task_type::heartbeat_timer), 0 );
+
+    // Pre-commit and commit.
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_TRUE( ret->has_result() );
+    for (RaftPkg* ff: {&s2, &s3}) {
+        CHK_FALSE( ff->raftServer->is_quiescent() );
+        CHK_GT( ff->fTimer->getNumPendingTasks(timer_task_type::election_timer), 0 );
+        CHK_Z( detectors[ff->myId - 1]->get_num_watched_nodes() );
+    }
+    CHK_Z( detectors[0]->get_num_watched_nodes() );
+
+    // Quiescent again.
+    idle_heartbeats();
+    CHK_TRUE( s1.raftServer->is_quiescent() );
+    CHK_TRUE( s2.raftServer->is_quiescent() );
+
+    // Liveness check to the leader's node fails,
+    // the follower should resume its election timer.
+    detectors[1]->check_now();
+    fd_nets[1]->makeReqFailAll(s1_addr);
+    CHK_FALSE( s2.raftServer->is_quiescent() );
+    CHK_FALSE( s2.raftServer->is_leader_alive() );
+    CHK_GT( s2.fTimer->getNumPendingTasks(timer_task_type::election_timer), 0 );
+    CHK_Z( detectors[1]->get_num_watched_nodes() );
+
+    // Other follower is not affected.
+    CHK_TRUE( s3.raftServer->is_quiescent() );
+
+    // The leader is partitioned from the followers while it is quiescent,
+    // its leadership should expire.
+    const int LEADERSHIP_EXPIRY_MS = QUIESCE_AFTER_MS * 5;
+    {
+        raft_params cur_params = s1.raftServer->get_current_params();
+        cur_params.leadership_expiry_ = LEADERSHIP_EXPIRY_MS;
+        s1.raftServer->update_params(cur_params);
+    }
+    TestSuite::sleep_ms(LEADERSHIP_EXPIRY_MS + 100, "partitioned");
+    // Not responding quiesced followers are not failures by themselves.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    CHK_TRUE( s1.raftServer->is_leader() );
+    CHK_TRUE( s1.raftServer->is_quiescent() );
+
+    detectors[0]->check_now();
+    fd_nets[0]->makeReqFailAll(s2_addr);
+    fd_nets[0]->makeReqFailAll(s3_addr);
+    CHK_FALSE( s1.raftServer->is_quiescent() );
+    CHK_Z( detectors[0]->get_num_watched_nodes() );
+    CHK_GT( s1.fTimer->getNumPendingTasks(timer_task_type::heartbeat_timer), 0 );
+
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    CHK_FALSE( s1.raftServer->is_leader() );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    for (size_t nn = 0; nn < pkgs.size(); ++nn) {
+        detectors[nn]->shutdown();
+        fd_nets[nn]->shutdown();
+    }
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int quiescence_leader_shutdown_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    std::vector< ptr<FakeNetwork> > fd_nets;
+    std::vector< ptr<failure_detector> > detectors;
+    for (size_t nn = 0; nn < pkgs.size(); ++nn) {
+        std::string fd_addr = "S" + std::to_string(nn + 1) + ":fd";
+        ptr<FakeNetwork> fd_net = cs_new<FakeNetwork>(fd_addr, f_base);
+        f_base->addNetwork(fd_net);
+        fd_nets.push_back(fd_net);
+
+        // Check manually, tolerating a few failed checks.
+        failure_detector::options opt;
+        opt.check_interval_ms_ = 0;
+        opt.max_failures_ = 3;
+        detectors.push_back( cs_new<failure_detector>(fd_net, nullptr, opt) );
+    }
+
+    const int QUIESCE_AFTER_MS = 100;
+    raft_params params;
+    params.with_election_timeout_lower(0);
+    params.with_election_timeout_upper(10000);
+    params.with_hb_interval(5000);
+    params.with_client_req_timeout(1000000);
+    params.with_reserved_log_items(0);
+    params.with_snapshot_enabled(5);
+    params.with_log_sync_stopping_gap(1);
+    params.return_method_ = raft_params::async_handler;
+    params.quiesce_after_ms_ = QUIESCE_AFTER_MS;
+
+    CHK_Z( launch_servers( pkgs, &params, false, cb_default,
+                           [&](RaftPkg* pp) {
+                               pp->ctx->set_failure_detector
+                                        ( detectors[pp->myId - 1], 0 );
+                           } ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (size_t ii = 0; ii < 2; ++ii) {
+        TestSuite::sleep_ms(QUIESCE_AFTER_MS + 50, "idle");
+        s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+        s1.fNet->execReqResp();
+    }
+    CHK_TRUE( s1.raftServer->is_quiescent() );
+    CHK_TRUE( s2.raftServer->is_quiescent() );
+    CHK_TRUE( s3.raftServer->is_quiescent() );
+
+    // Backstop election timer wakes up the follower,
+    // even though the detector does not notice anything.
+    s3.fTimer->invoke( timer_task_type::election_timer );
+    CHK_FALSE( s3.raftServer->is_quiescent() );
+    CHK_FALSE( s3.raftServer->is_leader_alive() );
+    CHK_EQ( 1, s3.fTimer->getNumPendingTasks(timer_task_type::election_timer) );
+    CHK_Z( detectors[2]->get_num_watched_nodes() );
+
+    // Shut down the leader's Raft server only. Its node is still alive,
+    // and still answers liveness checks.
+    s1.raftServer->shutdown();
+
+    // The follower wakes up by the first check,
+    // as the leader is gone from the node.
+    detectors[1]->check_now();
+    fd_nets[1]->execReqResp();
+    CHK_FALSE( s2.raftServer->is_quiescent() );
+    CHK_FALSE( s2.raftServer->is_leader_alive() );
+    CHK_EQ( 1, s2.fTimer->getNumPendingTasks(timer_task_type::election_timer) );
+    CHK_Z( detectors[1]->get_num_watched_nodes() );
+
+    // New election without the former leader.
+    s2.fTimer->invoke( timer_task_type::election_timer );
+    // Pre-vote, granted by S3.
+    s2.fNet->makeReqFailAll(s1_addr);
+    s2.fNet->execReqResp();
+    // Vote, granted by S3.
+    s2.fNet->makeReqFailAll(s1_addr);
+    s2.fNet->execReqResp();
+    CHK_TRUE( s2.raftServer->is_leader() );
+
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    for (size_t nn = 0; nn < pkgs.size(); ++nn) {
+        detectors[nn]->shutdown();
+        fd_nets[nn]->shutdown();
+    }
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int request_trace_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    // Traces reported by each server, <server ID, traces>.
+    std::mutex traces_lock;
+    std::map< int32, std::vector<request_trace> > traces;
+    auto trace_cb = [&](cb_func::Type type, cb_func::Param* param) {
+        if (type == cb_func::Type::RequestTraced) {
+            std::lock_guard<std::mutex> l(traces_lock);
+            traces[param->myId].push_back
+                ( *static_cast<request_trace*>(param->ctx) );
+            return cb_func::ReturnCode::Ok;
+        }
+        return cb_default(type, param);
+    };
+
+    CHK_Z( launch_servers( pkgs, nullptr, false, trace_cb ) );
+    CHK_Z( make_group( pkgs ) );
+
+    const int32 INTERVAL = 2;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.trace_sample_interval_ = INTERVAL;
+        pp->raftServer->update_params(param);
+    }
+
+    const size_t NUM = 10;
+    ulong start_idx = s1.raftServer->get_last_log_idx() + 1;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr<raft_result> ret = s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+    }
+
+    // Packet for pre-commit.
+    s1.fNet->execReqResp();
+    // Packet for commit.
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // One more time to make sure.
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // Logs whose index is a multiple of the interval are sampled.
+    std::set<ulong> sampled;
+    for (ulong idx = start_idx; idx < start_idx + NUM; ++idx) {
+        if (idx % INTERVAL == 0) sampled.insert(idx);
+    }
+
+    // Traces are reported after the state machine execution.
+    TestSuite::Timer timer(COMMIT_TIMEOUT_SEC * 1000);
+    while (!timer.timeout()) {
+        std::lock_guard<std::mutex> l(traces_lock);
+        bool done = true;
+        for (auto& entry: pkgs) {
+            if (traces[entry->myId].size() < sampled.size()) done = false;
+        }
+        if (done) break;
+        TestSuite::sleep_ms(10);
+    }
+
+    std::lock_guard<std::mutex> l(traces_lock);
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        std::vector<request_trace>& tt_list = traces[pp->myId];
+        CHK_EQ( sampled.size(), tt_list.size() );
+
+        for (request_trace& tt: tt_list) {
+            CHK_EQ( tt.first_log_idx_, tt.last_log_idx_ );
+            CHK_EQ( 1, sampled.count(tt.last_log_idx_) );
+            CHK_TRUE( tt.appended_us_ > 0 );
+            CHK_GTEQ( tt.committed_us_, tt.appended_us_ );
+            CHK_GTEQ( tt.applied_us_, tt.committed_us_ );
+
+            if (pp == &s1) {
+                // Leader: accepted -> appended -> sent -> acked -> committed
+                //         -> applied -> returned.
+                CHK_TRUE( tt.is_leader_ );
+                CHK_GTEQ( tt.appended_us_, tt.accepted_us_ );
+                CHK_EQ( 2, tt.sent_us_.size() );
+                CHK_GT( tt.acked_us_.size(), 0 );
+                for (auto& acked: tt.acked_us_) {
+                    CHK_GTEQ( acked.second, tt.sent_us_[acked.first] );
+                    CHK_GTEQ( acked.second, tt.appended_us_ );
+                }
+                CHK_GTEQ( tt.returned_us_, tt.applied_us_ );
+
+            } else {
+                // Follower: received -> appended -> committed -> applied.
+                CHK_FALSE( tt.is_leader_ );
+                CHK_TRUE( tt.received_us_ > 0 );
+                CHK_GTEQ( tt.appended_us_, tt.received_us_ );
+                CHK_Z( tt.sent_us_.size() );
+                CHK_Z( tt.returned_us_ );
+            }
+        }
+    }
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int lock_profiling_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    raft_params param = s1.raftServer->get_current_params();
+    param.return_method_ = raft_params::async_handler;
+    param.profile_locks_ = true;
+    s1.raftServer->update_params(param);
+
+    auto append_and_commit = [&]() -> int {
+        ptr<buffer> msg = buffer::alloc(16);
+        msg->put("test");
+        ptr<raft_result> ret = s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+        s1.fNet->execReqResp();
+        s1.fNet->execReqResp();
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+        return 0;
+    };
+    CHK_Z( append_and_commit() );
+
+    // Contention depends on the timing of the commit thread,
+    // but the result should be sorted by the total wait time.
+    std::vector<lock_contention> contentions;
+    s1.raftServer->get_lock_contentions(contentions, 0);
+    for (size_t ii = 1; ii < contentions.size(); ++ii) {
+        CHK_GTEQ( contentions[ii - 1].total_wait_us_,
+                  contentions[ii].total_wait_us_ );
+    }
+
+#ifdef ENABLE_RAFT_STATS
+    auto get_counter = [&](const std::string& name) -> uint64_t {
+        return s1.raftServer->get_server_stat_counter(name);
+    };
+    uint64_t raft_lock_count = get_counter("raft_lock_acquisitions");
+    CHK_TRUE( raft_lock_count > 0 );
+    CHK_TRUE( get_counter("peer_lock_acquisitions") > 0 );
+    CHK_TRUE( get_counter("commit_lock_acquisitions") > 0 );
+
+    std::map<double, uint64_t> hist;
+    CHK_TRUE( s1.raftServer->get_server_stat_histogram
+                  ("raft_lock_hold_us", hist) );
+
+    // Followers are not profiled.
+    CHK_FALSE( s2.raftServer->get_server_stat_histogram
+                   ("raft_lock_hold_us", hist) );
+
+    // Stop profiling.
+    param.profile_locks_ = false;
+    s1.raftServer->update_params(param);
+    raft_lock_count = get_counter("raft_lock_acquisitions");
+    CHK_Z( append_and_commit() );
+    CHK_EQ( raft_lock_count, get_counter("raft_lock_acquisitions") );
+#endif
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
 }  // namespace raft_server_test;
 using namespace raft_server_test;
 
@@ -2039,6 +3417,43 @@ int main(int argc, char** argv) {
     ts.doTest( "extended append_entries API test",
                extended_append_entries_api_test );
 
+    ts.doTest( "deferred append commit test",
+               deferred_append_commit_test );
+
+    ts.doTest( "deferred append truncate test",
+               deferred_append_truncate_test );
+
+    ts.doTest( "log store append batch test",
+               log_store_append_batch_test );
+
+    ts.doTest( "append batch overwrite test",
+               append_batch_overwrite_test,
+               TestRange<bool>( {true, false} ) );
+
+    ts.doTest( "log term index update test",
+               log_term_index_update_test );
+
+    ts.doTest( "heartbeat batch test",
+               heartbeat_batch_test );
+
+    ts.doTest( "heartbeat batch same host test",
+               heartbeat_batch_same_host_test );
+
+    ts.doTest( "heartbeat batch busy group test",
+               heartbeat_batch_busy_group_test );
+
+    ts.doTest( "quiescence test",
+               quiescence_test );
+
+    ts.doTest( "quiescence leader shutdown test",
+               quiescence_leader_shutdown_test );
+
+    ts.doTest( "request trace test",
+               request_trace_test );
+
+    ts.doTest( "lock profiling test",
+               lock_profiling_test );
+
 #ifdef ENABLE_RAFT_STATS
     _msg("raft stats: ENABLED\n");
 #else
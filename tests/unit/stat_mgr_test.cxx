@@ -16,13 +16,16 @@ limitations under the License.
 
 #include "nuraft.hxx"
 
+#include "stat_exporter.hxx"
 #include "stat_mgr.hxx"
 
 #include "test_common.h"
 
+#include <atomic>
 #include <cstring>
 #include <random>
 #include <string>
+#include <thread>
 
 using namespace nuraft;
 
@@ -80,6 +83,230 @@ int stat_mgr_basic_test() {
     return 0;
 }
 
+int stat_scope_test() {
+    raft_server::reset_all_stats();
+
+    ptr<stat_mgr> scope1 = stat_mgr::create_scope( {{"server_id", "1"}} );
+    ptr<stat_mgr> scope2 = stat_mgr::create_scope( {{"server_id", "2"}} );
+
+    stat_elem& counter1 = *scope1->create_stat(stat_elem::COUNTER, "counter");
+    stat_elem& counter2 = *scope2->create_stat(stat_elem::COUNTER, "counter");
+    stat_elem& hist1 = *scope1->create_stat(stat_elem::HISTOGRAM, "histogram");
+    stat_elem& hist2 = *scope2->create_stat(stat_elem::HISTOGRAM, "histogram");
+
+    const size_t NUM = 100;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        counter1++;
+        counter2 += 2;
+        hist1 += ii;
+        hist2 += ii;
+    }
+    CHK_EQ(NUM, scope1->get_stat("counter")->get_counter());
+    CHK_EQ(NUM * 2, scope2->get_stat("counter")->get_counter());
+
+    // Aggregate view over all scopes.
+    CHK_EQ(NUM * 3, raft_server::get_stat_counter("counter"));
+
+    std::map<double, uint64_t> hist_dump;
+    CHK_TRUE( raft_server::get_stat_histogram("histogram", hist_dump) );
+    size_t hist_sum = 0;
+    for (auto& entry: hist_dump) hist_sum += entry.second;
+    CHK_EQ(NUM * 2, hist_sum);
+
+    // Enumerate scopes: the global one, and then the above two.
+    std::vector<raft_server::stat_scope> scopes;
+    raft_server::get_all_stat_scopes(scopes);
+    CHK_GTEQ(scopes.size(), 3);
+    CHK_TRUE( scopes[0].labels_.empty() );
+    size_t num_found = 0;
+    for (raft_server::stat_scope& scope: scopes) {
+        auto entry = scope.labels_.find("server_id");
+        if (entry == scope.labels_.end()) continue;
+        num_found++;
+        size_t exp = (entry->second == "1") ? NUM : NUM * 2;
+        CHK_EQ(exp, scope.values_["counter"]);
+        CHK_EQ(1, scope.histograms_.count("histogram"));
+    }
+    CHK_EQ(2, num_found);
+
+    // Destroyed scope should not be visible.
+    scope2.reset();
+    CHK_EQ(NUM, raft_server::get_stat_counter("counter"));
+
+    raft_server::reset_all_stats();
+    CHK_EQ(0, scope1->get_stat("counter")->get_counter());
+
+    return 0;
+}
+
+int stat_exporter_test() {
+    raft_server::reset_all_stats();
+
+    ptr<stat_mgr> scope = stat_mgr::create_scope( {{"server_id", "1"}} );
+    stat_elem& counter = *scope->create_stat(stat_elem::COUNTER, "export.counter");
+    stat_elem& gauge = *scope->create_stat(stat_elem::GAUGE, "export_gauge");
+    stat_elem& hist = *scope->create_stat(stat_elem::HISTOGRAM, "export_hist");
+    counter += 3;
+    gauge = 7;
+    for (size_t ii = 1; ii <= 100; ++ii) hist += ii;
+
+    stat_exporter exporter;
+    std::string text = exporter.render();
+    TestSuite::_msg("%s", text.c_str());
+
+    auto contains = [&](const std::string& str) {
+        return text.find(str) != std::string::npos;
+    };
+    // Invalid characters are replaced, and counters get `_total`.
+    CHK_TRUE( contains("# TYPE nuraft_export_counter counter\n") );
+    CHK_TRUE( contains("nuraft_export_counter_total{server_id=\"1\"} 3\n") );
+    CHK_TRUE( contains("# TYPE nuraft_export_gauge gauge\n") );
+    CHK_TRUE( contains("nuraft_export_gauge{server_id=\"1\"} 7\n") );
+
+    // Cumulative buckets.
+    CHK_TRUE( contains("# TYPE nuraft_export_hist histogram\n") );
+    CHK_TRUE( contains("nuraft_export_hist_bucket{le=\"1\",server_id=\"1\"} 1\n") );
+    CHK_TRUE( contains("nuraft_export_hist_bucket{le=\"50\",server_id=\"1\"} 50\n") );
+    CHK_TRUE( contains("nuraft_export_hist_bucket{le=\"+Inf\",server_id=\"1\"} 100\n") );
+    CHK_TRUE( contains("nuraft_export_hist_count{server_id=\"1\"} 100\n") );
+    CHK_TRUE( contains("nuraft_export_hist_sum{server_id=\"1\"} 5050\n") );
+
+    // Ends with EOF.
+    const std::string eof = "# EOF\n";
+    CHK_GTEQ(text.size(), eof.size());
+    CHK_EQ(eof, text.substr(text.size() - eof.size()));
+
+    return 0;
+}
+
+int lock_profiler_test() {
+    raft_server::reset_all_stats();
+
+    ptr<stat_mgr> scope = stat_mgr::create_scope( {{"server_id", "1"}} );
+    ptr<lock_profile> profile = cs_new<lock_profile>("test_lock", scope);
+
+    auto get_counter = [&](const std::string& name) -> uint64_t {
+        return scope->get_stat(name)->get_counter();
+    };
+    auto get_hist_count = [&](const std::string& name) -> uint64_t {
+        return scope->get_stat(name)->get_histogram().getTotal();
+    };
+    const uint64_t INTERVAL = profiled_mutex::HOLD_SAMPLE_INTERVAL;
+
+    // Not profiled yet.
+    profiled_mutex mm;
+    {   profiled_lock(mm);
+    }
+    CHK_Z( get_counter("test_lock_acquisitions") );
+
+    // Uncontended: hold time is sampled.
+    mm.set_profile(profile);
+    const uint64_t NUM = INTERVAL * 2;
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        profiled_lock(mm);
+    }
+    CHK_EQ( NUM, get_counter("test_lock_acquisitions") );
+    CHK_EQ( NUM / INTERVAL, get_hist_count("test_lock_hold_us") );
+    CHK_Z( get_counter("test_lock_contentions") );
+    CHK_Z( get_hist_count("test_lock_wait_us") );
+
+    // Contended: another thread holds the lock for a while.
+    std::atomic<bool> locked(false);
+    std::thread holder([&]() {
+        profiled_lock(mm);
+        locked = true;
+        TestSuite::sleep_ms(50);
+    });
+    while (!locked) std::this_thread::yield();
+    size_t contended_line = 0;
+    {   contended_line = __LINE__; profiled_guard(ll, mm);
+    }
+    holder.join();
+
+    CHK_EQ( NUM + 2, get_counter("test_lock_acquisitions") );
+    CHK_EQ( 1, get_counter("test_lock_contentions") );
+    CHK_EQ( 1, get_hist_count("test_lock_wait_us") );
+
+    std::vector<lock_contention> contentions;
+    profile->get_contentions(contentions);
+    CHK_EQ( 1, contentions.size() );
+    CHK_EQ( std::string("test_lock"), contentions[0].lock_name_ );
+    CHK_EQ( std::string("stat_mgr_test.cxx"), contentions[0].file_ );
+    CHK_EQ( std::string("lock_profiler_test"), contentions[0].func_ );
+    CHK_EQ( contended_line, contentions[0].line_ );
+    CHK_EQ( 1, contentions[0].num_contentions_ );
+    CHK_TRUE( contentions[0].total_wait_us_ > 0 );
+    CHK_EQ( contentions[0].total_wait_us_, contentions[0].max_wait_us_ );
+
+    // Each contended site has its own scope.
+    CHK_EQ( 1, raft_server::get_stat_counter("lock_site_contentions") );
+    CHK_EQ( contentions[0].total_wait_us_,
+            raft_server::get_stat_counter("lock_site_wait_us") );
+
+    // Recursive mutex: only the outermost lock is recorded.
+    profiled_recursive_mutex rm;
+    rm.set_profile(profile);
+    uint64_t num_acquisitions = get_counter("test_lock_acquisitions");
+    uint64_t num_holds = get_hist_count("test_lock_hold_us");
+    for (size_t ii = 0; ii < INTERVAL; ++ii) {
+        profiled_lock(rm);
+        {   profiled_lock(rm);
+            std::lock_guard<profiled_recursive_mutex> ll(rm);
+        }
+    }
+    CHK_EQ( num_acquisitions + INTERVAL, get_counter("test_lock_acquisitions") );
+    CHK_EQ( num_holds + 1, get_hist_count("test_lock_hold_us") );
+
+    // Stopped while held: the hold time is still recorded.
+    for (size_t ii = 0; ii < INTERVAL - 1; ++ii) {
+        profiled_lock(rm);
+    }
+    {   profiled_lock(rm);
+        rm.set_profile(nullptr);
+        {   profiled_lock(rm);
+        }
+    }
+    CHK_EQ( num_holds + 2, get_hist_count("test_lock_hold_us") );
+
+    num_acquisitions = get_counter("test_lock_acquisitions");
+    {   profiled_lock(rm);
+    }
+    CHK_EQ( num_acquisitions, get_counter("test_lock_acquisitions") );
+
+    return 0;
+}
+
+int sharded_histogram_test() {
+    sharded_histogram hist;
+    const size_t NUM_THREADS = 4;
+    const size_t NUM = 100000;
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < NUM_THREADS; ++ii) {
+        threads.push_back( std::thread([&hist, ii]() {
+            for (size_t jj = 1; jj <= NUM; ++jj) hist.add(jj * (ii + 1));
+        }) );
+    }
+    for (std::thread& tt: threads) tt.join();
+
+    // Sum and max of all shards, and the count from the buckets.
+    HdrHistogram merged = hist.get();
+    uint64_t exp_sum = 0;
+    for (size_t ii = 0; ii < NUM_THREADS; ++ii) {
+        exp_sum += (ii + 1) * NUM * (NUM + 1) / 2;
+    }
+    CHK_EQ( NUM * NUM_THREADS, merged.getTotal() );
+    CHK_EQ( exp_sum, merged.getSum() );
+    CHK_EQ( NUM * NUM_THREADS, merged.getMax() );
+    CHK_EQ( NUM * NUM_THREADS, merged.estimate(100) );
+
+    hist.reset();
+    merged = hist.get();
+    CHK_Z( merged.getTotal() );
+    CHK_Z( merged.getSum() );
+    CHK_Z( merged.getMax() );
+    return 0;
+}
+
 }  // namespace stat_mgr_test;
 using namespace stat_mgr_test;
 
@@ -88,9 +315,21 @@ int main(int argc, char** argv) {
 
     ts.options.printTestMessage = false;
 
+    ts.doTest( "sharded histogram test",
+               sharded_histogram_test );
+
 #ifdef ENABLE_RAFT_STATS
     ts.doTest( "stat mgr basic test",
                stat_mgr_basic_test );
+
+    ts.doTest( "stat scope test",
+               stat_scope_test );
+
+    ts.doTest( "stat exporter test",
+               stat_exporter_test );
+
+    ts.doTest( "lock profiler test",
+               lock_profiler_test );
 #endif
 
     return 0;
@@ -0,0 +1,141 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "stream_window.hxx"
+
+#include "test_common.h"
+
+using namespace nuraft;
+
+namespace stream_window_test {
+
+// Acknowledge `num_logs` logs (100 bytes each) evenly during 1 ms,
+// while the window is full.
+void ack_round(stream_window& sw,
+               uint64_t& now_us,
+               int64_t num_logs,
+               uint64_t rtt_us)
+{
+    sw.on_window_full();
+    for (int64_t ii = 0; ii < num_logs; ++ii) {
+        sw.on_ack(1, 100, rtt_us, now_us + ii * 1000 / num_logs);
+    }
+    now_us += 1000;
+}
+
+int initial_window_test() {
+    stream_window sw;
+    CHK_EQ(stream_window::INIT_LOG_WINDOW, sw.get_log_window(0));
+    CHK_EQ(stream_window::INIT_BYTE_WINDOW, sw.get_byte_window(0));
+    CHK_EQ(10, sw.get_log_window(10));
+    CHK_EQ(1000, sw.get_byte_window(1000));
+    CHK_Z(sw.get_min_rtt_us());
+    return 0;
+}
+
+int grow_and_shrink_test() {
+    stream_window sw;
+    uint64_t now_us = 1000000;
+
+    // The peer keeps up with the window, RTT is 1 ms.
+    for (size_t ii = 0; ii < 10; ++ii) {
+        ack_round(sw, now_us, sw.get_log_window(0), 1000);
+    }
+    int64_t grown_window = sw.get_log_window(0);
+    TestSuite::_msg("grown window %ld\n", (long)grown_window);
+    CHK_GT(grown_window, 100);
+    CHK_EQ(1000, sw.get_min_rtt_us());
+    CHK_GT(sw.get_byte_rate(), 0);
+    CHK_EQ(100, sw.get_log_window(100));
+
+    // Now the peer handles only 50 logs per ms, and RTT goes up.
+    for (size_t ii = 0; ii < 30; ++ii) {
+        ack_round(sw, now_us, 50, 5000);
+    }
+    int64_t shrunk_window = sw.get_log_window(0);
+    TestSuite::_msg("shrunk window %ld\n", (long)shrunk_window);
+    CHK_SM(shrunk_window, grown_window / 2);
+    CHK_GTEQ(shrunk_window, stream_window::MIN_LOG_WINDOW);
+    CHK_GT(sw.get_smoothed_rtt_us(), 2000);
+
+    return 0;
+}
+
+int failure_test() {
+    stream_window sw;
+    uint64_t now_us = 1000000;
+    for (size_t ii = 0; ii < 10; ++ii) {
+        ack_round(sw, now_us, sw.get_log_window(0), 1000);
+    }
+    CHK_GT(sw.get_log_window(0), stream_window::INIT_LOG_WINDOW);
+
+    sw.on_failure();
+    CHK_EQ(stream_window::INIT_LOG_WINDOW, sw.get_log_window(0));
+    CHK_GTEQ(stream_window::INIT_BYTE_WINDOW, sw.get_byte_window(0));
+    return 0;
+}
+
+int app_limited_test() {
+    stream_window sw;
+    uint64_t now_us = 1000000;
+    for (size_t ii = 0; ii < 10; ++ii) {
+        ack_round(sw, now_us, sw.get_log_window(0), 1000);
+    }
+    int64_t grown_window = sw.get_log_window(0);
+    int64_t grown_byte_window = sw.get_byte_window(0);
+    uint64_t byte_rate = sw.get_byte_rate();
+    CHK_GT(grown_window, stream_window::INIT_LOG_WINDOW);
+
+    // The application sends only one log per ms for a while,
+    // the window is never full.
+    for (size_t ii = 0; ii < 100; ++ii) {
+        sw.on_ack(1, 100, 1000, now_us);
+        now_us += 1000;
+    }
+    CHK_EQ(grown_window, sw.get_log_window(0));
+    CHK_EQ(grown_byte_window, sw.get_byte_window(0));
+    CHK_EQ(byte_rate, sw.get_byte_rate());
+
+    // Once the window is full again, it works as usual.
+    for (size_t ii = 0; ii < 30; ++ii) {
+        ack_round(sw, now_us, 50, 5000);
+    }
+    CHK_SM(sw.get_log_window(0), grown_window / 2);
+    return 0;
+}
+
+}  // namespace stream_window_test;
+using namespace stream_window_test;
+
+int main(int argc, char** argv) {
+    TestSuite ts(argc, argv);
+
+    ts.options.printTestMessage = false;
+
+    ts.doTest( "initial window test",
+               initial_window_test );
+
+    ts.doTest( "grow and shrink test",
+               grow_and_shrink_test );
+
+    ts.doTest( "failure test",
+               failure_test );
+
+    ts.doTest( "app limited test",
+               app_limited_test );
+
+    return 0;
+}
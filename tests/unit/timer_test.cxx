@@ -23,6 +23,8 @@ limitations under the License.
 #include "test_common.h"
 
 #include <atomic>
+#include <limits>
+#include <vector>
 
 using namespace nuraft;
 
@@ -91,6 +93,188 @@ int timer_cancel_test() {
     return 0;
 }
 
+int timer_wheel_basic_test() {
+    timer_wheel_scheduler::options opt;
+    opt.tick_ms_ = 10;
+    timer_wheel_scheduler tw(opt);
+    std::atomic<size_t> counter(0);
+    timer_task<void>::executor handler = std::bind( timer_invoke_handler,
+                                                    &counter );
+    ptr<delayed_task> task = cs_new< timer_task<void> >( handler );
+
+    // Set 200 ms timer and check it is not fired too early.
+    TestSuite::Timer timer;
+    tw.schedule(task, 200);
+    CHK_EQ(1, tw.get_num_active_timers());
+    while (!counter && timer.getTimeMs() < 1000) {
+        TestSuite::sleep_ms(1);
+    }
+    CHK_GTEQ(timer.getTimeMs(), 200);
+    TestSuite::sleep_ms(100);
+
+    // It should be invoked only once.
+    CHK_EQ(1, counter);
+    CHK_EQ(0, tw.get_num_active_timers());
+
+    return 0;
+}
+
+int timer_wheel_cancel_test() {
+    timer_wheel_scheduler::options opt;
+    opt.tick_ms_ = 10;
+    timer_wheel_scheduler tw(opt);
+    std::atomic<size_t> counter(0);
+    timer_task<void>::executor handler = std::bind( timer_invoke_handler,
+                                                    &counter );
+    ptr<delayed_task> task = cs_new< timer_task<void> >( handler );
+
+    // Set 300 ms timer, wait 100 ms, and then cancel it.
+    tw.schedule(task, 300);
+    TestSuite::sleep_ms(100);
+    tw.cancel(task);
+    CHK_EQ(0, tw.get_num_active_timers());
+    TestSuite::sleep_ms(300);
+
+    // It should never be invoked.
+    CHK_EQ(0, counter);
+
+    // Re-schedule it, and then re-schedule again before it fires.
+    tw.schedule(task, 100);
+    tw.schedule(task, 300);
+    CHK_EQ(1, tw.get_num_active_timers());
+    TestSuite::sleep_ms(200);
+    CHK_EQ(0, counter);
+    TestSuite::sleep_ms(300);
+
+    // It should be invoked only once.
+    CHK_EQ(1, counter);
+
+    return 0;
+}
+
+int timer_wheel_cascade_test() {
+    // Drive the wheel manually with 1 ms tick, so that the timers
+    // below span multiple levels of the wheel.
+    timer_wheel_scheduler::options opt;
+    opt.tick_ms_ = 1;
+    opt.use_internal_thread_ = false;
+    timer_wheel_scheduler tw(opt);
+
+    const size_t NUM = 50;
+    std::vector< std::atomic<size_t> > counters(NUM);
+    std::vector< ptr<delayed_task> > tasks(NUM);
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        counters[ii] = 0;
+        timer_task<void>::executor handler = std::bind( timer_invoke_handler,
+                                                        &counters[ii] );
+        tasks[ii] = cs_new< timer_task<void> >( handler );
+        // 0 ms ~ 4900 ms.
+        tw.schedule(tasks[ii], ii * 100);
+    }
+    CHK_EQ(NUM, tw.get_num_active_timers());
+
+    TestSuite::Timer timer;
+    size_t num_fired = 0;
+    while (num_fired < NUM && timer.getTimeMs() < 10000) {
+        TestSuite::sleep_ms(5);
+        tw.advance();
+        uint64_t elapsed_ms = timer.getTimeMs();
+        for (size_t ii = num_fired; ii < NUM; ++ii) {
+            if (!counters[ii]) break;
+            // Should not be fired earlier than scheduled.
+            CHK_GTEQ(elapsed_ms, ii * 100);
+            num_fired++;
+        }
+    }
+    CHK_EQ(NUM, num_fired);
+    CHK_EQ(0, tw.get_num_active_timers());
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        CHK_EQ(1, counters[ii]);
+    }
+
+    return 0;
+}
+
+int timer_wheel_overflow_test() {
+    // With 1 ms tick, the wheel covers about 4.6 hours.
+    timer_wheel_scheduler::options opt;
+    opt.tick_ms_ = 1;
+    opt.use_internal_thread_ = false;
+    timer_wheel_scheduler tw(opt);
+
+    std::atomic<size_t> far_counter(0);
+    std::atomic<size_t> near_counter(0);
+    timer_task<void>::executor far_handler = std::bind( timer_invoke_handler,
+                                                        &far_counter );
+    timer_task<void>::executor near_handler = std::bind( timer_invoke_handler,
+                                                         &near_counter );
+    ptr<delayed_task> far_task = cs_new< timer_task<void> >( far_handler );
+    ptr<delayed_task> near_task = cs_new< timer_task<void> >( near_handler );
+
+    // Beyond the range of the wheel, it should not be clamped
+    // and fired earlier.
+    tw.schedule(far_task, std::numeric_limits<int32>::max());
+    tw.schedule(near_task, 10);
+    CHK_EQ(2, tw.get_num_active_timers());
+
+    TestSuite::sleep_ms(50);
+    tw.advance();
+    CHK_EQ(1, near_counter);
+    CHK_EQ(0, far_counter);
+    CHK_EQ(1, tw.get_num_active_timers());
+
+    // Can be cancelled and re-scheduled within the range.
+    tw.cancel(far_task);
+    CHK_EQ(0, tw.get_num_active_timers());
+    tw.schedule(far_task, std::numeric_limits<int32>::max());
+    tw.schedule(far_task, 10);
+    CHK_EQ(1, tw.get_num_active_timers());
+    TestSuite::sleep_ms(50);
+    tw.advance();
+    CHK_EQ(1, far_counter);
+
+    // Pending one should be released along with the wheel.
+    {   timer_wheel_scheduler tw2(opt);
+        tw2.schedule(far_task, std::numeric_limits<int32>::max());
+        CHK_EQ(2, far_task.use_count());
+    }
+    CHK_EQ(1, far_task.use_count());
+
+    return 0;
+}
+
+int asio_timer_wheel_test() {
+    asio_service::options asio_opt;
+    asio_opt.timer_wheel_tick_ms_ = 10;
+    asio_service svc(asio_opt);
+    std::atomic<size_t> counter(0);
+    timer_task<void>::executor handler = std::bind( timer_invoke_handler,
+                                                    &counter );
+    ptr<delayed_task> task = cs_new< timer_task<void> >( handler );
+
+    // Set 200 ms timer and wait 300 ms.
+    svc.schedule(task, 200);
+    TestSuite::sleep_ms(300);
+    CHK_EQ(1, counter);
+
+    // Cancel.
+    svc.schedule(task, 300);
+    TestSuite::sleep_ms(100);
+    svc.cancel(task);
+    TestSuite::sleep_ms(300);
+    CHK_EQ(1, counter);
+
+    svc.stop();
+    size_t count = 0;
+    while (svc.get_active_workers() && count < 100) {
+        // 10ms per tick.
+        TestSuite::sleep_ms(10);
+        count++;
+    }
+
+    return 0;
+}
+
 }  // namespace timer_test;
 using namespace timer_test;
 
@@ -105,6 +289,21 @@ int main(int argc, char** argv) {
     ts.doTest( "timer cancel test",
                timer_cancel_test );
 
+    ts.doTest( "timer wheel basic test",
+               timer_wheel_basic_test );
+
+    ts.doTest( "timer wheel cancel test",
+               timer_wheel_cancel_test );
+
+    ts.doTest( "timer wheel cascade test",
+               timer_wheel_cascade_test );
+
+    ts.doTest( "timer wheel overflow test",
+               timer_wheel_overflow_test );
+
+    ts.doTest( "asio timer wheel test",
+               asio_timer_wheel_test );
+
     return 0;
 }
 